@@ -25,18 +25,44 @@
 extern "C" {
 #endif
 
+/**
+ * Pixel formats the core can draw the frames in
+ */
+typedef enum
+{
+	DISPLAY_FORMAT_BGR555, /**< 16 bits, red in the low bits as on the GBA */
+	DISPLAY_FORMAT_RGB565, /**< 16 bits, blue in the low bits */
+	DISPLAY_FORMAT_XRGB8888 /**< 32 bits, blue in the low byte */
+} DisplayFormat;
+
 /**
  * Sound driver abstract interface for the core to use to output sound.
  */
 typedef struct DisplayDriver DisplayDriver;
 struct DisplayDriver {
 
+	/**
+	 * Format of the pixels of the frames
+	 */
+	DisplayFormat format;
+
+	/**
+	 * Get the buffer the core draws the next frame to, so that the pixels
+	 * are only written once. The core reads it back when saving a state.
+	 * May be NULL for the core to draw to a buffer of its own.
+	 * @param driver display driver
+	 * @param pitch set to the number of bytes from a line to the next
+	 * @return a frame of 240*160 pixels in the format of the driver
+	 */
+	gpointer (*getFrame)(const DisplayDriver *driver, int *pitch);
+
 	/**
 	 * Tell the driver the screen needs to be updated with new data
 	 * @param driver display driver
-	 * @param pix an array of 240*160 16bits BGR555 pixels
+	 * @param pix the frame drawn, the last one returned by getFrame if set
+	 * @param pitch number of bytes from a line to the next
 	 */
-	void (*drawScreen)(const DisplayDriver *driver, guint16 *pix);
+	void (*drawScreen)(const DisplayDriver *driver, gpointer pix, int pitch);
 
 	/**
 	 * Opaque driver specific data
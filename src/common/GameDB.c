@@ -138,6 +138,29 @@ static void on_start_element(GMarkupParseContext *context,
 			db->game->flashSize = atoi(attribute_values[sizeIndex]);
 		}
 	}
+	else if (g_markup_is_in_element(context, "idleLoop", "game", "games", NULL))
+	{
+		int detectIndex = findv(attribute_names, "detect");
+		if (detectIndex >= 0)
+		{
+			const gchar *detect = attribute_values[detectIndex];
+			db->game->idleLoopDetection = g_strcmp0(detect, "false") && g_strcmp0(detect, "0");
+		}
+		int addressIndex = findv(attribute_names, "address");
+		if (addressIndex >= 0)
+		{
+			db->game->idleLoop = g_ascii_strtoull(attribute_values[addressIndex], NULL, 16);
+		}
+	}
+	else if (g_markup_is_in_element(context, "bios", "game", "games", NULL))
+	{
+		int hleIndex = findv(attribute_names, "hle");
+		if (hleIndex >= 0)
+		{
+			const gchar *hle = attribute_values[hleIndex];
+			db->game->biosHle = g_strcmp0(hle, "false") && g_strcmp0(hle, "0");
+		}
+	}
 }
 
 static void on_end_element(GMarkupParseContext *context,
@@ -28,6 +28,9 @@ GameInfos *game_infos_new() {
 	game->hasRTC = FALSE;
 	game->EEPROMSize = 0x2000;
 	game->flashSize = 0x10000;
+	game->idleLoopDetection = TRUE;
+	game->idleLoop = 0;
+	game->biosHle = TRUE;
 	game->title = NULL;
 	game->code = NULL;
 	game->region = NULL;
@@ -33,6 +33,9 @@ typedef struct
 	gboolean hasRTC;
 	int EEPROMSize;
 	int flashSize;
+	gboolean idleLoopDetection;
+	guint32 idleLoop;
+	gboolean biosHle;
 
 	gchar *title;
 	gchar *region;
@@ -26,13 +26,23 @@
 #include "RingBuffer.h"
 
 #define MAX_SIZE 262144
+#define CACHE_LINE_SIZE 64
 
+/*
+ * in is only written by the producer and out by the consumer. Each of them
+ * sits alone on its cache line, so that updating one does not evict the
+ * other, or the read-only fields, from the cache of the other thread. Both
+ * are free-running counters, their difference is the number of bytes used.
+ */
 struct ring_buffer {
 	unsigned char *buffer;
 	unsigned int size;
 	unsigned int mask;
-	unsigned int in;
-	unsigned int out;
+	char pad0[CACHE_LINE_SIZE - sizeof(unsigned char *) - 2 * sizeof(unsigned int)];
+	gint in;
+	char pad1[CACHE_LINE_SIZE - sizeof(gint)];
+	gint out;
+	char pad2[CACHE_LINE_SIZE - sizeof(gint)];
 };
 
 struct ring_buffer *ring_buffer_new(unsigned int size)
@@ -71,19 +81,22 @@ int ring_buffer_write(struct ring_buffer *buf, const void *data,
 	unsigned int end;
 	unsigned int offset;
 	const unsigned char *d = data; /* Needed to satisfy non-gcc compilers */
+	unsigned int in = buf->in;
+	unsigned int out = g_atomic_int_get(&buf->out);
 
 	/* Determine how much we can actually write */
-	len = MIN(len, buf->size - buf->in + buf->out);
+	len = MIN(len, buf->size - in + out);
 
 	/* Determine how much to write before wrapping */
-	offset = buf->in & buf->mask;
+	offset = in & buf->mask;
 	end = MIN(len, buf->size - offset);
 	memcpy(buf->buffer+offset, d, end);
 
 	/* Now put the remainder on the beginning of the buffer */
 	memcpy(buf->buffer, d + end, len - end);
 
-	buf->in += len;
+	/* Publish the data once it has been copied */
+	g_atomic_int_set(&buf->in, in + len);
 
 	return len;
 }
@@ -93,21 +106,21 @@ int ring_buffer_read(struct ring_buffer *buf, void *data, unsigned int len)
 	unsigned int end;
 	unsigned int offset;
 	unsigned char *d = data;
+	unsigned int in = g_atomic_int_get(&buf->in);
+	unsigned int out = buf->out;
 
-	len = MIN(len, buf->in - buf->out);
+	len = MIN(len, in - out);
 
 	/* Grab data from buffer starting at offset until the end */
-	offset = buf->out & buf->mask;
+	offset = out & buf->mask;
 	end = MIN(len, buf->size - offset);
 	memcpy(d, buf->buffer + offset, end);
 
 	/* Now grab remainder from the beginning */
 	memcpy(d + end, buf->buffer, len - end);
 
-	buf->out += len;
-
-	if (buf->out == buf->in)
-		buf->out = buf->in = 0;
+	/* Hand the space back once the data has been copied */
+	g_atomic_int_set(&buf->out, out + len);
 
 	return len;
 }
@@ -117,8 +130,8 @@ void ring_buffer_reset(struct ring_buffer *buf)
 	if (buf == NULL)
 		return;
 
-	buf->in = 0;
-	buf->out = 0;
+	g_atomic_int_set(&buf->in, 0);
+	g_atomic_int_set(&buf->out, 0);
 }
 
 int ring_buffer_avail(struct ring_buffer *buf)
@@ -126,7 +139,17 @@ int ring_buffer_avail(struct ring_buffer *buf)
 	if (buf == NULL)
 		return -1;
 
-	return buf->size - buf->in + buf->out;
+	return buf->size - ((unsigned int)g_atomic_int_get(&buf->in)
+			- (unsigned int)g_atomic_int_get(&buf->out));
+}
+
+int ring_buffer_used(struct ring_buffer *buf)
+{
+	if (buf == NULL)
+		return -1;
+
+	return (unsigned int)g_atomic_int_get(&buf->in)
+			- (unsigned int)g_atomic_int_get(&buf->out);
 }
 
 void ring_buffer_free(struct ring_buffer *buf)
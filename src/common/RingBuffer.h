@@ -27,6 +27,11 @@
 extern "C" {
 #endif
 
+/*
+ * The ring buffer is safe to use from two threads without locking, as long
+ * as a single thread writes and a single thread reads. ring_buffer_reset
+ * must not run concurrently with either.
+ */
 struct ring_buffer;
 
 /*!
@@ -56,6 +61,11 @@ int ring_buffer_write(struct ring_buffer *buf, const void *data,
  */
 int ring_buffer_avail(struct ring_buffer *buf);
 
+/*!
+ * Returns the number of bytes waiting to be read from the buffer
+ */
+int ring_buffer_used(struct ring_buffer *buf);
+
 /*!
  * Reads data from the ring buffer buf into memory region pointed to by data.
  * A maximum of len bytes will be read.  Returns -1 if the read failed or
@@ -51,11 +51,23 @@ typedef struct {
 	gboolean pauseWhenInactive;
 	gboolean showSpeed;
 	gboolean disableStatus;
+	gboolean vsync;
 
 	guint soundSampleRate;
 	gdouble soundVolume;
+	guint soundLatency;
+	gboolean soundRateControl;
+	gboolean lowLatency;
+	guint soundFlushFrames;
 
 	guint logChannels;
+	gboolean threadedThumb;
+	gboolean cpuSelfCheck;
+	gboolean thumbRecompiler;
+	gboolean idleLoops;
+	gboolean biosHle;
+	gboolean renderThread;
+	guint renderThreads;
 
 	guint32 joypad[G_N_ELEMENTS(buttons)];
 } Settings;
@@ -68,6 +80,15 @@ static GOptionEntry commandLineOptions[] = {
   { "fullscreen", 0, 0, G_OPTION_ARG_NONE, &settings.fullscreen, "Full screen", NULL },
   { "pause-when-inactive", 0, 0, G_OPTION_ARG_NONE, &settings.pauseWhenInactive, "Pause when inactive", NULL },
   { "show-speed", 0, 0, G_OPTION_ARG_NONE, &settings.showSpeed, "Show emulation speed", NULL },
+  { "low-latency", 0, 0, G_OPTION_ARG_NONE, &settings.lowLatency, "Keep the sound latency low, following the display refresh", NULL },
+  { "cpu-self-check", 0, 0, G_OPTION_ARG_NONE, &settings.cpuSelfCheck, "Check the cached, threaded and recompiled CPU code against the interpreter", NULL },
+  { "thumb-recompiler", 0, 0, G_OPTION_ARG_NONE, &settings.thumbRecompiler, "Recompile hot Thumb code from ROM and IWRAM to x86-64 code", NULL },
+  { "no-threaded-thumb", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &settings.threadedThumb, "Run Thumb code from ROM with the plain interpreter", NULL },
+  { "no-idle-loops", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &settings.idleLoops, "Do not skip ahead when the game waits in an idle loop", NULL },
+  { "no-bios-hle", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &settings.biosHle, "Run the BIOS functions with the BIOS code instead of natively", NULL },
+  { "render-thread", 0, 0, G_OPTION_ARG_NONE, &settings.renderThread, "Draw the screen on a separate thread, with the same output as inline", NULL },
+  { "render-threads", 0, 0, G_OPTION_ARG_INT, &settings.renderThreads, "Number of threads drawing the frames with the render thread", "N" },
+  { "sound-flush-frames", 0, 0, G_OPTION_ARG_INT, &settings.soundFlushFrames, "Output the sound every N video frames, 0 for every 1/100 second", "N" },
   { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &filenames, NULL, "[GBA ROM file]" },
   { NULL }
 };
@@ -92,12 +113,24 @@ static SettingDescription settingsList[] = {
 	&settings.showSpeed, "display", "showSpeed", BOOLEAN,
 	&settings.pauseWhenInactive, "display", "pauseWhenInactive", BOOLEAN,
 	&settings.disableStatus, "display", "disableStatus", BOOLEAN,
+	&settings.vsync, "display", "vsync", BOOLEAN,
+	&settings.renderThread, "display", "renderThread", BOOLEAN,
+	&settings.renderThreads, "display", "renderThreads", INTEGER,
 	&settings.biosFileName, "paths", "biosFileName", STRING,
 	&settings.batteryDir, "paths", "batteryDir", STRING,
 	&settings.saveDir, "paths", "saveDir", STRING,
 	&settings.soundVolume, "sound", "volume", DOUBLE,
 	&settings.soundSampleRate, "sound", "sampleRate", INTEGER,
-	&settings.logChannels, "system", "logChannels", INTEGER
+	&settings.soundLatency, "sound", "latency", INTEGER,
+	&settings.soundRateControl, "sound", "rateControl", BOOLEAN,
+	&settings.lowLatency, "sound", "lowLatency", BOOLEAN,
+	&settings.soundFlushFrames, "sound", "flushFrames", INTEGER,
+	&settings.logChannels, "system", "logChannels", INTEGER,
+	&settings.threadedThumb, "system", "threadedThumb", BOOLEAN,
+	&settings.cpuSelfCheck, "system", "cpuSelfCheck", BOOLEAN,
+	&settings.thumbRecompiler, "system", "thumbRecompiler", BOOLEAN,
+	&settings.idleLoops, "system", "idleLoops", BOOLEAN,
+	&settings.biosHle, "system", "biosHle", BOOLEAN
 };
 
 void settings_init() {
@@ -116,11 +149,23 @@ void settings_init() {
 	settings.pauseWhenInactive = FALSE;
 	settings.showSpeed = FALSE;
 	settings.disableStatus = FALSE;
+	settings.vsync = FALSE;
+	settings.renderThread = FALSE;
+	settings.renderThreads = 1;
 
 	settings.soundSampleRate = 44100;
 	settings.soundVolume = 1.0f;
+	settings.soundLatency = 100;
+	settings.soundRateControl = FALSE;
+	settings.lowLatency = FALSE;
+	settings.soundFlushFrames = 0;
 
 	settings.logChannels = 0;
+	settings.threadedThumb = TRUE;
+	settings.cpuSelfCheck = FALSE;
+	settings.thumbRecompiler = FALSE;
+	settings.idleLoops = TRUE;
+	settings.biosHle = TRUE;
 
 	for (guint i = 0; i < G_N_ELEMENTS(buttons); i++) {
 		settings.joypad[buttons[i].button] = 0;
@@ -376,13 +421,34 @@ gboolean settings_check(GError **err) {
 		return FALSE;
 	}
 
-	if (settings.soundSampleRate < 11000 || settings.soundVolume > 48000) {
+	if (settings.soundSampleRate < 11000 || settings.soundSampleRate > 48000) {
 		g_set_error(err,
 			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
 			"The sound sample rate must be between 11000 KHz and 48000 KHz.");
 		return FALSE;
 	}
 
+	if (settings.soundLatency < SETTINGS_SOUND_MIN_LATENCY || settings.soundLatency > SETTINGS_SOUND_MAX_LATENCY) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The sound latency must be between %d ms and %d ms.", SETTINGS_SOUND_MIN_LATENCY, SETTINGS_SOUND_MAX_LATENCY);
+		return FALSE;
+	}
+
+	if (settings.soundFlushFrames > SETTINGS_SOUND_MAX_FLUSH_FRAMES) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The sound must be output at least every %d frames.", SETTINGS_SOUND_MAX_FLUSH_FRAMES);
+		return FALSE;
+	}
+
+	if (settings.renderThreads < 1 || settings.renderThreads > SETTINGS_RENDER_MAX_THREADS) {
+		g_set_error(err,
+			G_OPTION_ERROR, G_OPTION_ERROR_FAILED,
+			"The number of render threads must be between 1 and %d.", SETTINGS_RENDER_MAX_THREADS);
+		return FALSE;
+	}
+
 	return TRUE;
 }
 
@@ -426,6 +492,52 @@ guint settings_sound_sample_rate() {
 	return settings.soundSampleRate;
 }
 
+// The low latency profile overrides the settings it is made of
+
+gboolean settings_vsync() {
+	return settings.vsync || settings.lowLatency;
+}
+
+guint settings_sound_latency() {
+	return settings.lowLatency ? SETTINGS_SOUND_LOW_LATENCY : settings.soundLatency;
+}
+
+gboolean settings_sound_rate_control() {
+	return settings.soundRateControl || settings.lowLatency;
+}
+
+guint settings_sound_flush_frames() {
+	return settings.soundFlushFrames;
+}
+
+gboolean settings_threaded_thumb() {
+	return settings.threadedThumb;
+}
+
+gboolean settings_cpu_self_check() {
+	return settings.cpuSelfCheck;
+}
+
+gboolean settings_thumb_recompiler() {
+	return settings.thumbRecompiler;
+}
+
+gboolean settings_idle_loops() {
+	return settings.idleLoops;
+}
+
+gboolean settings_bios_hle() {
+	return settings.biosHle;
+}
+
+gboolean settings_render_thread() {
+	return settings.renderThread;
+}
+
+guint settings_render_threads() {
+	return settings.renderThreads;
+}
+
 gboolean settings_log_channel_enabled(LogChannel channel) {
 	return settings.logChannels & (1 << channel);
 }
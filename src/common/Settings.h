@@ -28,6 +28,11 @@ extern "C" {
 #endif
 
 #define SETTINGS_SOUND_MAX_VOLUME 2.0
+#define SETTINGS_SOUND_MIN_LATENCY 20
+#define SETTINGS_SOUND_MAX_LATENCY 500
+#define SETTINGS_SOUND_LOW_LATENCY 30
+#define SETTINGS_SOUND_MAX_FLUSH_FRAMES 8
+#define SETTINGS_RENDER_MAX_THREADS 8
 
 /**
  * Initialize the settings module and set default setting values
@@ -109,6 +114,67 @@ gdouble settings_sound_volume();
 /** @return sound sample rate value */
 guint settings_sound_sample_rate();
 
+/**
+ * @return whether to wait for the display refresh to present frames, and to
+ * pace the emulation after it
+ */
+gboolean settings_vsync();
+
+/** @return sound latency to aim for, in milliseconds */
+guint settings_sound_latency();
+
+/**
+ * @return whether to adjust the sound sample rate slightly to keep the sound
+ * buffer filled at the latency aimed for
+ */
+gboolean settings_sound_rate_control();
+
+/**
+ * @return number of video frames of sound to hand to the sound output at once,
+ * at V-Blank, or 0 to hand it every 1/100 second
+ */
+guint settings_sound_flush_frames();
+
+/** @return whether to run Thumb code from ROM with the threaded code engine */
+gboolean settings_threaded_thumb();
+
+/**
+ * @return whether to run every instruction of the ARM block cache, the
+ * Thumb threaded code and the Thumb recompiled code a second time with the
+ * interpreter, and compare them
+ */
+gboolean settings_cpu_self_check();
+
+/**
+ * @return whether to recompile the hot Thumb code from ROM and IWRAM to
+ * native code, on x86-64 hosts
+ */
+gboolean settings_thumb_recompiler();
+
+/** @return whether to fast forward to the next event when the game waits in an idle loop */
+gboolean settings_idle_loops();
+
+/** @return whether to run the BIOS functions natively instead of with the BIOS code */
+gboolean settings_bios_hle();
+
+/**
+ * @return whether to draw the screen on a separate thread, from the state
+ * captured at the end of each line, rather than inline with the emulation
+ *
+ * Both renderers draw a line from the registers and the video memory as they
+ * are when the line enters HBlank, so the frames are the same, raster effects
+ * changing them between the lines included. Changes made within a line are
+ * not shown by either. The render thread only sees the video memory written
+ * through the memory map or marked with gfx_dirty_mark().
+ */
+gboolean settings_render_thread();
+
+/**
+ * @return number of threads drawing strips of the lines of a frame with the
+ * render thread, 1 to draw them one after the other
+ */
+guint settings_render_threads();
+
 /**
  * Available log channels
  */
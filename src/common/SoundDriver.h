@@ -43,9 +43,17 @@ struct SoundDriver {
 
 	/**
 	 * Write length bytes of data from the finalWave buffer to the driver output buffer.
+	 * The core writes the sound of 1/100 second at once, or when set to, the
+	 * sound of one or more whole video frames, at V-Blank.
 	 */
 	void (*write)(SoundDriver *driver, guint16 *finalWave, int length);
 
+	/**
+	 * Optional, get the factor to apply to the output sample rate so that the
+	 * driver buffer stays at the level it aims for. Called after each write.
+	 */
+	gdouble (*getRateRatio)(SoundDriver *driver);
+
 	/**
 	 * Opaque driver specific data
 	 */
@@ -0,0 +1,587 @@
+#include "BIOS.h"
+#include "Cartridge.h"
+#include "CPU.h"
+#include "GBA.h"
+#include "MMU.h"
+#include "../common/Port.h"
+#include "../common/Settings.h"
+
+#include <string.h>
+
+namespace BIOS
+{
+
+using namespace CPU;
+
+// Approximate time taken by the BIOS code, in cycles. SWI_TICKS covers
+// entering the BIOS, dispatching the call and returning to the game.
+#define SWI_TICKS 40
+#define DIV_TICKS 100
+#define SQRT_TICKS 150
+#define ARCTAN_TICKS 50
+#define ARCTAN2_TICKS 120
+#define CPUSET_COPY_TICKS 9 // Per unit
+#define CPUSET_FILL_TICKS 6
+#define CPUFASTSET_COPY_TICKS 3 // Per word
+#define CPUFASTSET_FILL_TICKS 2
+#define BGAFFINESET_TICKS 90 // Per entry
+#define OBJAFFINESET_TICKS 50
+#define LZ77_TICKS 20 // Per decompressed byte
+#define HUFF_TICKS 20
+#define RL_TICKS 10
+
+static bool enabled = false;
+
+// Sine table of the BIOS, 256 steps per turn, 1.14 fixed point
+static s16 sineTable[256];
+
+void reset()
+{
+	enabled = settings_bios_hle() && cartridge_get_bios_hle();
+
+	// The first quarter is floor(sin(i * 2 * PI / 256) * 0x4000)
+	static const s16 quarter[65] = {
+		0x0000, 0x0192, 0x0323, 0x04B5, 0x0645, 0x07D5, 0x0964, 0x0AF1,
+		0x0C7C, 0x0E05, 0x0F8C, 0x1111, 0x1294, 0x1413, 0x158F, 0x1708,
+		0x187D, 0x19EF, 0x1B5D, 0x1CC6, 0x1E2B, 0x1F8B, 0x20E7, 0x223D,
+		0x238E, 0x24DA, 0x261F, 0x275F, 0x2899, 0x29CD, 0x2AFA, 0x2C21,
+		0x2D41, 0x2E5A, 0x2F6B, 0x3076, 0x3179, 0x3274, 0x3367, 0x3453,
+		0x3536, 0x3612, 0x36E5, 0x37AF, 0x3871, 0x392A, 0x39DA, 0x3A82,
+		0x3B20, 0x3BB6, 0x3C42, 0x3CC5, 0x3D3E, 0x3DAE, 0x3E14, 0x3E71,
+		0x3EC5, 0x3F0E, 0x3F4E, 0x3F84, 0x3FB1, 0x3FD3, 0x3FEC, 0x3FFB,
+		0x4000
+	};
+
+	for (int i = 0; i <= 64; i++)
+	{
+		sineTable[i] = quarter[i];
+		sineTable[128 - i] = quarter[i];
+		sineTable[(128 + i) & 255] = -quarter[i];
+		sineTable[(256 - i) & 255] = -quarter[i];
+	}
+}
+
+// Memory access helpers ////////////////////////////////////////////////////
+
+// Host memory for the destination of a bulk write, or NULL when the range
+// is not plain RAM. Byte writes are only plain for the work RAMs.
+static u8 *destination(u32 address, u32 length, u32 unit)
+{
+	if ((address >> 24) >= 8 || (address & (unit - 1)))
+		return NULL;
+	if (unit == 1 && (address >> 24) != 2 && (address >> 24) != 3)
+		return NULL;
+
+	u32 available;
+	u8 *mem = MMU::pointer(address, available);
+	if (mem == NULL || length > available)
+		return NULL;
+
+	return mem;
+}
+
+// Compressed data is read from host memory while it stays in the region it
+// starts in. Corrupted data running past the end goes through the MMU.
+struct Source
+{
+	u32 address;
+	const u8 *mem;
+	u32 available;
+
+	bool init(u32 source)
+	{
+		address = source;
+		mem = MMU::pointer(source, available);
+		return mem != NULL && (source & 3) == 0;
+	}
+
+	u8 read8(u32 offset) const
+	{
+		if (offset < available)
+			return mem[offset];
+		return MMU::read8(address + offset);
+	}
+
+	u32 read32(u32 offset) const
+	{
+		return read8(offset) | (read8(offset + 1) << 8) | (read8(offset + 2) << 16) | (read8(offset + 3) << 24);
+	}
+};
+
+// The Vram variants of the decompression functions write halfwords. The
+// first byte of a pair is held back, so reading it from the destination
+// before the pair is complete gives the former contents, like on hardware.
+struct Destination
+{
+	u8 *mem;
+	bool halfwords;
+	u8 pending;
+
+	void put(u32 offset, u8 value)
+	{
+		if (!halfwords)
+			mem[offset] = value;
+		else if (offset & 1)
+			WRITE16LE(&mem[offset - 1], pending | (value << 8));
+		else
+			pending = value;
+	}
+};
+
+// Arithmetic ///////////////////////////////////////////////////////////////
+
+static bool divide(s32 number, s32 denom)
+{
+	// The BIOS does not return in a sensible time
+	if (denom == 0)
+		return false;
+
+	s64 quotient = (s64)number / denom;
+	s64 remainder = (s64)number % denom;
+
+	reg[0].I = (u32)quotient;
+	reg[1].I = (u32)remainder;
+	reg[3].I = (u32)(quotient < 0 ? -quotient : quotient);
+
+	cpuTotalTicks += SWI_TICKS + DIV_TICKS;
+	return true;
+}
+
+static bool squareRoot()
+{
+	u32 value = reg[0].I;
+	u32 root = 0;
+
+	for (u32 bit = 1 << 30; bit != 0; bit >>= 2)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+	}
+
+	reg[0].I = root;
+
+	cpuTotalTicks += SWI_TICKS + SQRT_TICKS;
+	return true;
+}
+
+// Polynomial approximation of the BIOS, tan is 1.14 fixed point and the
+// result is in 0x10000 steps per turn. a and b are the values the BIOS
+// leaves in r1 and r3.
+static s32 arcTan(s32 tan, s32 &a, s32 &b)
+{
+	a = -((tan * tan) >> 14);
+	b = ((0xA9 * a) >> 14) + 0x390;
+	b = ((b * a) >> 14) + 0x91C;
+	b = ((b * a) >> 14) + 0xFB6;
+	b = ((b * a) >> 14) + 0x16AA;
+	b = ((b * a) >> 14) + 0x2081;
+	b = ((b * a) >> 14) + 0x3651;
+	b = ((b * a) >> 14) + 0xA2F9;
+
+	return (tan * b) >> 16;
+}
+
+static bool arcTan()
+{
+	s32 a, b;
+	reg[0].I = arcTan((s32)reg[0].I, a, b);
+	reg[1].I = a;
+	reg[3].I = b;
+
+	cpuTotalTicks += SWI_TICKS + ARCTAN_TICKS;
+	return true;
+}
+
+static bool arcTan2()
+{
+	s32 x = (s32)reg[0].I;
+	s32 y = (s32)reg[1].I;
+	s32 a = (s32)reg[1].I;
+	s32 b;
+	s32 angle;
+
+	if (y == 0)
+		angle = x >= 0 ? 0 : 0x8000;
+	else if (x == 0)
+		angle = y >= 0 ? 0x4000 : 0xC000;
+	else if (y >= 0 && x >= 0 && x >= y)
+		angle = arcTan((s32)((u32)y << 14) / x, a, b);
+	else if (y >= 0 && x < 0 && -x >= y)
+		angle = arcTan((s32)((u32)y << 14) / x, a, b) + 0x8000;
+	else if (y >= 0)
+		angle = 0x4000 - arcTan((s32)((u32)x << 14) / y, a, b);
+	else if (x <= 0 && -x > -y)
+		angle = arcTan((s32)((u32)y << 14) / x, a, b) + 0x8000;
+	else if (x > 0 && x >= -y)
+		angle = arcTan((s32)((u32)y << 14) / x, a, b) + 0x10000;
+	else
+		angle = 0xC000 - arcTan((s32)((u32)x << 14) / y, a, b);
+
+	reg[0].I = angle & 0xFFFF;
+	reg[1].I = a;
+	reg[3].I = 0x170;
+
+	cpuTotalTicks += SWI_TICKS + ARCTAN2_TICKS;
+	return true;
+}
+
+// Memory copy //////////////////////////////////////////////////////////////
+
+// Copy or fill length bytes from source to dest, with unit sized accesses
+static bool copy(u32 source, u32 dest, u32 length, u32 unit, bool fill)
+{
+	u32 available;
+	const u8 *src = MMU::pointer(source, available);
+	if (src == NULL || (source & (unit - 1)) || (fill ? unit : length) > available)
+		return false;
+
+	u8 *dst = destination(dest, length, unit);
+	if (dst == NULL)
+		return false;
+
+	if (fill)
+	{
+		if (unit == 4)
+		{
+			u32 value = READ32LE(src);
+			for (u32 i = 0; i < length; i += 4)
+				WRITE32LE(&dst[i], value);
+		}
+		else
+		{
+			u16 value = READ16LE(src);
+			for (u32 i = 0; i < length; i += 2)
+				WRITE16LE(&dst[i], value);
+		}
+	}
+	else
+	{
+		// The BIOS copies forwards, which memmove does not do for overlapping
+		// ranges where the destination comes after the source
+		if (dst > src && dst < src + length)
+			return false;
+		memmove(dst, src, length);
+	}
+
+	MMU::invalidate(dest, length);
+	return true;
+}
+
+static bool cpuSet()
+{
+	u32 control = reg[2].I;
+	u32 unit = (control & 0x04000000) ? 4 : 2;
+	u32 count = control & 0x001FFFFF;
+	bool fill = (control & 0x01000000) != 0;
+
+	if (!copy(reg[0].I, reg[1].I, count * unit, unit, fill))
+		return false;
+
+	cpuTotalTicks += SWI_TICKS + count * (fill ? CPUSET_FILL_TICKS : CPUSET_COPY_TICKS);
+	return true;
+}
+
+static bool cpuFastSet()
+{
+	u32 control = reg[2].I;
+	u32 count = ((control & 0x001FFFFF) + 7) & ~7; // Blocks of eight words
+	bool fill = (control & 0x01000000) != 0;
+
+	if (!copy(reg[0].I, reg[1].I, count * 4, 4, fill))
+		return false;
+
+	cpuTotalTicks += SWI_TICKS + count * (fill ? CPUFASTSET_FILL_TICKS : CPUFASTSET_COPY_TICKS);
+	return true;
+}
+
+// Affine transformations ///////////////////////////////////////////////////
+
+static bool bgAffineSet()
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+	u32 count = reg[2].I;
+
+	if ((source >> 24) == 0)
+		return false;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		s32 cx = MMU::read32(source);
+		s32 cy = MMU::read32(source + 4);
+		s16 dispx = MMU::read16(source + 8);
+		s16 dispy = MMU::read16(source + 10);
+		s16 rx = MMU::read16(source + 12);
+		s16 ry = MMU::read16(source + 14);
+		u32 theta = MMU::read16(source + 16) >> 8;
+		source += 20;
+
+		s32 a = sineTable[(theta + 0x40) & 255];
+		s32 b = sineTable[theta];
+
+		s16 dx = (rx * a) >> 14;
+		s16 dmx = (rx * b) >> 14;
+		s16 dy = (ry * b) >> 14;
+		s16 dmy = (ry * a) >> 14;
+
+		MMU::write16(dest, dx);
+		MMU::write16(dest + 2, -dmx);
+		MMU::write16(dest + 4, dy);
+		MMU::write16(dest + 6, dmy);
+		MMU::write32(dest + 8, cx - dx * dispx + dmx * dispy);
+		MMU::write32(dest + 12, cy - dy * dispx - dmy * dispy);
+		dest += 16;
+	}
+
+	cpuTotalTicks += SWI_TICKS + count * BGAFFINESET_TICKS;
+	return true;
+}
+
+static bool objAffineSet()
+{
+	u32 source = reg[0].I;
+	u32 dest = reg[1].I;
+	u32 count = reg[2].I;
+	u32 offset = reg[3].I;
+
+	if ((source >> 24) == 0)
+		return false;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		s16 rx = MMU::read16(source);
+		s16 ry = MMU::read16(source + 2);
+		u32 theta = MMU::read16(source + 4) >> 8;
+		source += 8;
+
+		s32 a = sineTable[(theta + 0x40) & 255];
+		s32 b = sineTable[theta];
+
+		s16 dx = (rx * a) >> 14;
+		s16 dmx = (rx * b) >> 14;
+		s16 dy = (ry * b) >> 14;
+		s16 dmy = (ry * a) >> 14;
+
+		MMU::write16(dest, dx);
+		MMU::write16(dest + offset, -dmx);
+		MMU::write16(dest + offset * 2, dy);
+		MMU::write16(dest + offset * 3, dmy);
+		dest += offset * 4;
+	}
+
+	cpuTotalTicks += SWI_TICKS + count * OBJAFFINESET_TICKS;
+	return true;
+}
+
+// Decompression ////////////////////////////////////////////////////////////
+
+static bool lz77UnComp(bool vram)
+{
+	Source src;
+	if (!src.init(reg[0].I))
+		return false;
+
+	u32 dest = reg[1].I;
+	u32 size = src.read32(0) >> 8;
+
+	Destination dst;
+	dst.halfwords = vram;
+	dst.mem = destination(dest, vram ? size & ~1 : size, vram ? 2 : 1);
+	if (dst.mem == NULL)
+		return false;
+
+	u32 in = 4;
+	u32 out = 0;
+	while (out < size)
+	{
+		u8 flags = src.read8(in++);
+		for (int i = 0; i < 8 && out < size; i++, flags <<= 1)
+		{
+			if (flags & 0x80)
+			{
+				u8 b0 = src.read8(in++);
+				u8 b1 = src.read8(in++);
+				u32 disp = (((b0 & 0x0F) << 8) | b1) + 1;
+				u32 length = (b0 >> 4) + 3;
+
+				for (; length > 0 && out < size; length--, out++)
+				{
+					u8 value = disp <= out ? dst.mem[out - disp] : MMU::read8(dest + out - disp);
+					dst.put(out, value);
+				}
+			}
+			else
+			{
+				dst.put(out++, src.read8(in++));
+			}
+		}
+	}
+
+	MMU::invalidate(dest, size);
+
+	cpuTotalTicks += SWI_TICKS + size * LZ77_TICKS;
+	return true;
+}
+
+static bool huffUnComp()
+{
+	Source src;
+	if (!src.init(reg[0].I))
+		return false;
+
+	u32 dest = reg[1].I;
+	u32 header = src.read32(0);
+	u32 bits = header & 0x0F;
+	u32 size = ((header >> 8) + 3) & ~3;
+
+	// Other data sizes do not divide words and are not used by games
+	if (bits != 4 && bits != 8)
+		return false;
+
+	u8 *dst = destination(dest, size, 4);
+	if (dst == NULL)
+		return false;
+
+	// Tree nodes hold the offset to their pair of children in bits 0-5, and
+	// whether the right and the left child are data in bits 6 and 7
+	const u32 root = 5;
+	u32 in = 4 + (src.read8(4) + 1) * 2;
+	u32 node = root;
+	u32 word = 0;
+	u32 wordBits = 0;
+	u32 out = 0;
+
+	while (out < size)
+	{
+		u32 stream = src.read32(in);
+		in += 4;
+
+		for (int i = 0; i < 32 && out < size; i++, stream <<= 1)
+		{
+			u8 value = src.read8(node);
+			u32 child = (node & ~1) + (value & 0x3F) * 2 + 2;
+			bool data;
+
+			if (stream & 0x80000000)
+			{
+				child++;
+				data = (value & 0x40) != 0;
+			}
+			else
+			{
+				data = (value & 0x80) != 0;
+			}
+
+			if (!data)
+			{
+				node = child;
+				continue;
+			}
+
+			word |= (src.read8(child) & ((1 << bits) - 1)) << wordBits;
+			wordBits += bits;
+			node = root;
+
+			if (wordBits == 32)
+			{
+				WRITE32LE(&dst[out], word);
+				out += 4;
+				word = 0;
+				wordBits = 0;
+			}
+		}
+	}
+
+	MMU::invalidate(dest, size);
+
+	cpuTotalTicks += SWI_TICKS + size * HUFF_TICKS;
+	return true;
+}
+
+static bool rlUnComp(bool vram)
+{
+	Source src;
+	if (!src.init(reg[0].I))
+		return false;
+
+	u32 dest = reg[1].I;
+	u32 size = src.read32(0) >> 8;
+
+	Destination dst;
+	dst.halfwords = vram;
+	dst.mem = destination(dest, vram ? size & ~1 : size, vram ? 2 : 1);
+	if (dst.mem == NULL)
+		return false;
+
+	u32 in = 4;
+	u32 out = 0;
+	while (out < size)
+	{
+		u8 flag = src.read8(in++);
+		if (flag & 0x80)
+		{
+			u8 value = src.read8(in++);
+			for (u32 length = (flag & 0x7F) + 3; length > 0 && out < size; length--)
+				dst.put(out++, value);
+		}
+		else
+		{
+			for (u32 length = (flag & 0x7F) + 1; length > 0 && out < size; length--)
+				dst.put(out++, src.read8(in++));
+		}
+	}
+
+	MMU::invalidate(dest, size);
+
+	cpuTotalTicks += SWI_TICKS + size * RL_TICKS;
+	return true;
+}
+
+bool softwareInterrupt(int comment)
+{
+	if (!enabled)
+		return false;
+
+	switch (comment)
+	{
+	case 0x06:
+		return divide(reg[0].I, reg[1].I);
+	case 0x07:
+		return divide(reg[1].I, reg[0].I);
+	case 0x08:
+		return squareRoot();
+	case 0x09:
+		return arcTan();
+	case 0x0A:
+		return arcTan2();
+	case 0x0B:
+		return cpuSet();
+	case 0x0C:
+		return cpuFastSet();
+	case 0x0E:
+		return bgAffineSet();
+	case 0x0F:
+		return objAffineSet();
+	case 0x11:
+		return lz77UnComp(false);
+	case 0x12:
+		return lz77UnComp(true);
+	case 0x13:
+		return huffUnComp();
+	case 0x14:
+		return rlUnComp(false);
+	case 0x15:
+		return rlUnComp(true);
+	default:
+		return false;
+	}
+}
+
+} // namespace BIOS
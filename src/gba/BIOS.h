@@ -0,0 +1,28 @@
+#ifndef BIOS_H
+#define BIOS_H
+
+#include "../common/Types.h"
+
+namespace BIOS
+{
+
+/**
+ * Enable the high level emulation of the BIOS functions according to the
+ * settings and the game database
+ */
+void reset();
+
+/**
+ * Run the BIOS function called by a SWI instruction natively, taking the
+ * arguments from and returning the results in the CPU registers. An
+ * approximation of the time the BIOS code would have taken is added to
+ * cpuTotalTicks.
+ *
+ * @param comment SWI number
+ * @return false when the call has to go through the BIOS code instead
+ */
+bool softwareInterrupt(int comment);
+
+} // namespace BIOS
+
+#endif // BIOS_H
@@ -1,22 +1,31 @@
 #include "CPU.h"
+#include "BIOS.h"
 #include "GBA.h"
 #include "Globals.h"
 #include "MMU.h"
+#include "Cartridge.h"
 #include "../common/Settings.h"
 
 #include <algorithm>
+#include <string.h>
 
 namespace CPU
 {
 
 u32 cpuPrefetch[2];
 u8 cpuBitsSet[256];
+u8 iwramCode[0x8000 >> IWRAM_CODE_SHIFT];
 
 reg_pair reg[45];
-bool N_FLAG = 0;
-bool C_FLAG = 0;
-bool Z_FLAG = 0;
-bool V_FLAG = 0;
+u32 flagsN = 0;
+u32 flagsZ = 1;
+u32 flagsLhs = 0;
+u32 flagsRhs = 0;
+u32 flagsRes = 0;
+bool flagsC = false;
+bool flagsV = false;
+bool flagsCLazy = false;
+bool flagsVLazy = false;
 
 bool armState = true;
 bool armIrqEnable = true;
@@ -27,6 +36,29 @@ bool busPrefetch = false; //TODO: never read ?
 bool busPrefetchEnable = false;
 u32 busPrefetchCount = 0;
 
+bool idleLoopEnabled = false;
+bool idleLoopVolatileRead = false;
+u64 idleLoopSkippedTicks = 0;
+
+// Longest loop considered for idle loop detection, in instructions
+#define IDLE_LOOP_MAX_INSNS 8
+
+static bool idleLoopDetection = false;
+static u32 idleLoopForced = 0;
+
+// Last short backward branch seen, and whether its loop may be skipped
+static u32 idleBranch = 0;
+static u32 idleTarget = 0;
+static bool idleArm = false;
+static bool idleCandidate = false;
+
+// CPU state when that branch was last taken
+static bool idleMeasured = false;
+static u32 idleRegs[16];
+static u32 idleFlags;
+static u32 idleBusPrefetchCount;
+static int idleTicks;
+
 void init()
 {
 	for (int i = 0; i < 256; i++)
@@ -64,10 +96,10 @@ void reset()
 		armIrqEnable = false;
 	}
 	armState = true;
-	C_FLAG = false;
-	V_FLAG = false;
-	N_FLAG = false;
-	Z_FLAG = false;
+	SET_C_FLAG(false);
+	SET_V_FLAG(false);
+	SET_N_FLAG(false);
+	SET_Z_FLAG(false);
 
 	// disable FIQ
 	reg[16].I |= 0x40;
@@ -77,6 +109,19 @@ void reset()
 	armNextPC = reg[15].I;
 	reg[15].I += 4;
 
+	armCacheFlush();
+	thumbCacheFlush();
+	jitFlush();
+	memset(iwramCode, 0, sizeof(iwramCode));
+
+	idleLoopDetection = settings_idle_loops() && cartridge_get_idle_loop_detection();
+	idleLoopForced = settings_idle_loops() ? cartridge_get_idle_loop() : 0;
+	idleLoopEnabled = idleLoopDetection || idleLoopForced != 0;
+	idleLoopSkippedTicks = 0;
+	idleBranch = 0;
+	idleCandidate = false;
+	idleMeasured = false;
+
 	ARM_PREFETCH();
 }
 
@@ -96,207 +141,57 @@ static void CPUSwap(u32 *a, u32 *b)
 }
 #endif
 
-// Waitstates when accessing data
-int dataTicksAccess16(u32 address) // DATA 8/16bits NON SEQ
-{
-	int addr = (address>>24)&15;
-	int value =  memoryWait[addr];
-
-	if ((addr>=0x08) || (addr < 0x02))
-	{
-		busPrefetchCount=0;
-		busPrefetch=false;
-	}
-	else if (busPrefetch)
-	{
-		int waitState = value;
-		if (!waitState)
-			waitState = 1;
-		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
-	}
-
-	return value;
-}
-
-int dataTicksAccess32(u32 address) // DATA 32bits NON SEQ
-{
-	int addr = (address>>24)&15;
-	int value = memoryWait32[addr];
-
-	if ((addr>=0x08) || (addr < 0x02))
-	{
-		busPrefetchCount=0;
-		busPrefetch=false;
-	}
-	else if (busPrefetch)
-	{
-		int waitState = value;
-		if (!waitState)
-			waitState = 1;
-		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
-	}
-
-	return value;
-}
+// Wait states ////////////////////////////////////////////////////////////
 
-int dataTicksAccessSeq16(u32 address)// DATA 8/16bits SEQ
+WaitStates waitStates[16] =
 {
-	int addr = (address>>24)&15;
-	int value = memoryWaitSeq[addr];
-
-	if ((addr>=0x08) || (addr < 0x02))
-	{
-		busPrefetchCount=0;
-		busPrefetch=false;
-	}
-	else if (busPrefetch)
-	{
-		int waitState = value;
-		if (!waitState)
-			waitState = 1;
-		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
-	}
-
-	return value;
-}
-
-int dataTicksAccessSeq32(u32 address)// DATA 32bits SEQ
+	// 16 bits, 16 bits seq, 32 bits, 32 bits seq, prefetched, stops prefetch
+	{ 0, 0,  0,  0, false, true  }, // 0 - bios
+	{ 0, 0,  0,  0, false, true  }, // 1
+	{ 2, 2,  5,  5, false, false }, // 2 - ewram
+	{ 0, 0,  0,  0, false, false }, // 3 - iwram
+	{ 0, 0,  0,  0, false, false }, // 4 - io
+	{ 0, 0,  1,  1, false, false }, // 5 - palette
+	{ 0, 0,  1,  1, false, false }, // 6 - vram
+	{ 0, 0,  0,  0, false, false }, // 7 - oam
+	{ 4, 2,  7,  5, true,  true  }, // 8 - rom wait state 0
+	{ 4, 2,  7,  5, true,  true  }, // 9
+	{ 4, 4,  9,  9, true,  true  }, // 10 - rom wait state 1
+	{ 4, 4,  9,  9, true,  true  }, // 11
+	{ 4, 8, 13, 17, true,  true  }, // 12 - rom wait state 2
+	{ 4, 8, 13, 17, true,  true  }, // 13
+	{ 4, 4,  4,  4, false, true  }, // 14 - sram
+	{ 0, 0,  0,  0, false, true  }, // 15
+};
+
+void updateWaitStates(u16 waitcnt)
 {
-	int addr = (address>>24)&15;
-	int value =  memoryWaitSeq32[addr];
-
-	if ((addr>=0x08) || (addr < 0x02))
-	{
-		busPrefetchCount=0;
-		busPrefetch=false;
-	}
-	else if (busPrefetch)
-	{
-		int waitState = value;
-		if (!waitState)
-			waitState = 1;
-		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
-	}
-
-	return value;
-}
-
-
-// Waitstates when executing opcode
-int codeTicksAccess16(u32 address) // THUMB NON SEQ
-{
-	int addr = (address>>24)&15;
-
-	if ((addr>=0x08) && (addr<=0x0D))
-	{
-		if (busPrefetchCount&0x1)
-		{
-			if (busPrefetchCount&0x2)
-			{
-				busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
-				return 0;
-			}
-			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
-			return memoryWaitSeq[addr]-1;
-		}
-		else
-		{
-			busPrefetchCount=0;
-			return memoryWait[addr];
-		}
-	}
-	else
-	{
-		busPrefetchCount = 0;
-		return memoryWait[addr];
-	}
-}
+	static const u8 gamepakRamWaitState[4] = { 4, 3, 2, 8 };
+	static const u8 gamepakWaitState[4] =  { 4, 3, 2, 8 };
+	static const u8 gamepakWaitState0[2] = { 2, 1 };
+	static const u8 gamepakWaitState1[2] = { 4, 1 };
+	static const u8 gamepakWaitState2[2] = { 8, 1 };
 
-int codeTicksAccess32(u32 address) // ARM NON SEQ
-{
-	int addr = (address>>24)&15;
+	waitStates[0x0e].access16 = waitStates[0x0e].accessSeq16 = gamepakRamWaitState[waitcnt & 3];
+	waitStates[0x08].access16 = waitStates[0x09].access16 = gamepakWaitState[(waitcnt >> 2) & 3];
+	waitStates[0x08].accessSeq16 = waitStates[0x09].accessSeq16 = gamepakWaitState0[(waitcnt >> 4) & 1];
 
-	if ((addr>=0x08) && (addr<=0x0D))
-	{
-		if (busPrefetchCount&0x1)
-		{
-			if (busPrefetchCount&0x2)
-			{
-				busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
-				return 0;
-			}
-			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
-			return memoryWaitSeq[addr] - 1;
-		}
-		else
-		{
-			busPrefetchCount = 0;
-			return memoryWait32[addr];
-		}
-	}
-	else
-	{
-		busPrefetchCount = 0;
-		return memoryWait32[addr];
-	}
-}
+	waitStates[0x0a].access16 = waitStates[0x0b].access16 = gamepakWaitState[(waitcnt >> 5) & 3];
+	waitStates[0x0a].accessSeq16 = waitStates[0x0b].accessSeq16 = gamepakWaitState1[(waitcnt >> 7) & 1];
 
-int codeTicksAccessSeq16(u32 address) // THUMB SEQ
-{
-	int addr = (address>>24)&15;
+	waitStates[0x0c].access16 = waitStates[0x0d].access16 = gamepakWaitState[(waitcnt >> 8) & 3];
+	waitStates[0x0c].accessSeq16 = waitStates[0x0d].accessSeq16 = gamepakWaitState2[(waitcnt >> 10) & 1];
 
-	if ((addr>=0x08) && (addr<=0x0D))
+	for (int i = 8; i < 15; i++)
 	{
-		if (busPrefetchCount&0x1)
-		{
-			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
-			return 0;
-		}
-		else
-			if (busPrefetchCount>0xFF)
-			{
-				busPrefetchCount=0;
-				return memoryWait[addr];
-			}
-			else
-				return memoryWaitSeq[addr];
-	}
-	else
-	{
-		busPrefetchCount = 0;
-		return memoryWaitSeq[addr];
+		waitStates[i].access32 = waitStates[i].access16 + waitStates[i].accessSeq16 + 1;
+		waitStates[i].accessSeq32 = waitStates[i].accessSeq16 * 2 + 1;
 	}
-}
 
-int codeTicksAccessSeq32(u32 address) // ARM SEQ
-{
-	int addr = (address>>24)&15;
+	enableBusPrefetch((waitcnt & 0x4000) == 0x4000);
 
-	if ((addr>=0x08) && (addr<=0x0D))
-	{
-		if (busPrefetchCount&0x1)
-		{
-			if (busPrefetchCount&0x2)
-			{
-				busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
-				return 0;
-			}
-			busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
-			return memoryWaitSeq[addr];
-		}
-		else
-			if (busPrefetchCount>0xFF)
-			{
-				busPrefetchCount=0;
-				return memoryWait32[addr];
-			}
-			else
-				return memoryWaitSeq32[addr];
-	}
-	else
-	{
-		return memoryWaitSeq32[addr];
-	}
+	// The recompiled code has the timings built in
+	jitFlush();
 }
 
 void CPUSwitchMode(int mode, bool saveState, bool breakLoop)
@@ -463,19 +358,22 @@ void CPUSoftwareInterrupt(int comment)
 		    VCOUNT);
 	}
 #endif
+	if (BIOS::softwareInterrupt(comment))
+		return;
+
 	CPUSoftwareInterrupt();
 }
 
 void CPUUpdateCPSR()
 {
 	u32 CPSR = reg[16].I & 0x40;
-	if (N_FLAG)
+	if (N_FLAG())
 		CPSR |= 0x80000000;
-	if (Z_FLAG)
+	if (Z_FLAG())
 		CPSR |= 0x40000000;
-	if (C_FLAG)
+	if (C_FLAG())
 		CPSR |= 0x20000000;
-	if (V_FLAG)
+	if (V_FLAG())
 		CPSR |= 0x10000000;
 	if (!armState)
 		CPSR |= 0x00000020;
@@ -489,10 +387,10 @@ void CPUUpdateFlags(bool breakLoop)
 {
 	u32 CPSR = reg[16].I;
 
-	N_FLAG = (CPSR & 0x80000000) ? true: false;
-	Z_FLAG = (CPSR & 0x40000000) ? true: false;
-	C_FLAG = (CPSR & 0x20000000) ? true: false;
-	V_FLAG = (CPSR & 0x10000000) ? true: false;
+	SET_N_FLAG((CPSR & 0x80000000) != 0);
+	SET_Z_FLAG((CPSR & 0x40000000) != 0);
+	SET_C_FLAG((CPSR & 0x20000000) != 0);
+	SET_V_FLAG((CPSR & 0x10000000) != 0);
 	armState = (CPSR & 0x20) ? false : true;
 	armIrqEnable = (CPSR & 0x80) ? false : true;
 	if (breakLoop)
@@ -546,5 +444,344 @@ void enableBusPrefetch(bool enable)
 	}
 }
 
-} // namespace CPU
+// Idle loops //////////////////////////////////////////////////////////////
+
+// Loads, ALU operations and branches are allowed in an idle loop.
+// Stores, writes to PC and anything changing the CPU mode are not.
+static bool idleLoopArmInsn(u32 opcode)
+{
+	int dest = (opcode >> 12) & 15;
 
+	switch ((opcode >> 25) & 7)
+	{
+	case 0:
+		if ((opcode & 0x90) == 0x90)
+		{
+			// Halfword and signed loads, but not multiplies, swaps or stores
+			return (opcode & 0x60) && (opcode & 0x00100000) && dest != 15;
+		}
+		// Fall through
+	case 1:
+		// MRS, MSR and BX
+		if ((opcode & 0x01900000) == 0x01000000)
+			return false;
+		// Compares do not write Rd
+		return dest != 15 || (opcode & 0x01800000) == 0x01000000;
+	case 3:
+		// Undefined instruction
+		if (opcode & 0x10)
+			return false;
+		// Fall through
+	case 2:
+		return (opcode & 0x00100000) && dest != 15;
+	case 5:
+		// B, but not BL
+		return !(opcode & 0x01000000);
+	default:
+		return false;
+	}
+}
+
+static bool idleLoopThumbInsn(u32 opcode)
+{
+	switch (opcode >> 12)
+	{
+	case 0x0:
+	case 0x1:
+	case 0x2:
+	case 0x3:
+	case 0xA:
+		return true;
+	case 0x4:
+		// ADD and MOV to PC, BX
+		if ((opcode & 0x0F00) == 0x0700)
+			return false;
+		if ((opcode & 0x0C00) == 0x0400 && (opcode & 0x0300) != 0x0100)
+			return (opcode & 0x87) != 0x87;
+		return true;
+	case 0x5:
+		return (opcode & 0x0E00) >= 0x0600;
+	case 0x6:
+	case 0x7:
+	case 0x8:
+	case 0x9:
+		return (opcode & 0x0800) != 0;
+	case 0xD:
+		return (opcode & 0x0F00) < 0x0E00;
+	case 0xE:
+		return (opcode & 0x0800) == 0;
+	default:
+		return false;
+	}
+}
+
+static bool idleLoopAnalyse(u32 branch, u32 target)
+{
+	if (armState)
+	{
+		if ((MMU::read32(branch) & 0x0F000000) != 0x0A000000)
+			return false;
+
+		for (u32 address = target; address != branch; address += 4)
+			if (!idleLoopArmInsn(MMU::read32(address)))
+				return false;
+	}
+	else
+	{
+		u32 opcode = MMU::read16(branch);
+		if ((opcode & 0xF000) != 0xD000 && (opcode & 0xF800) != 0xE000)
+			return false;
+		if (!idleLoopThumbInsn(opcode))
+			return false;
+
+		for (u32 address = target; address != branch; address += 2)
+			if (!idleLoopThumbInsn(MMU::read16(address)))
+				return false;
+	}
+
+	return true;
+}
+
+static u32 idleLoopFlags()
+{
+	return (N_FLAG() << 3) | (Z_FLAG() << 2) | (C_FLAG() << 1) | V_FLAG();
+}
+
+void idleLoopBranch(u32 branch, u32 target)
+{
+	u32 insnSize = armState ? 4 : 2;
+	if (branch - target >= IDLE_LOOP_MAX_INSNS * insnSize)
+		return;
+
+	if (branch != idleBranch || target != idleTarget || armState != idleArm)
+	{
+		idleBranch = branch;
+		idleTarget = target;
+		idleArm = armState;
+		idleCandidate = branch == idleLoopForced
+		                || (idleLoopDetection && idleLoopAnalyse(branch, target));
+		idleMeasured = false;
+	}
+
+	if (!idleCandidate)
+		return;
+
+	// The loop has no side effects, so when an iteration did not change
+	// anything the next ones will not either until an event occurs.
+	if (idleMeasured && !idleLoopVolatileRead
+	        && !memcmp(idleRegs, reg, sizeof(idleRegs))
+	        && idleFlags == idleLoopFlags()
+	        && idleBusPrefetchCount == busPrefetchCount)
+	{
+		int iterationTicks = cpuTotalTicks - idleTicks;
+		if (iterationTicks > 0)
+		{
+			int skipped = (cpuNextEvent - cpuTotalTicks) / iterationTicks * iterationTicks;
+			cpuTotalTicks += skipped;
+			idleLoopSkippedTicks += skipped;
+		}
+	}
+
+	memcpy(idleRegs, reg, sizeof(idleRegs));
+	idleFlags = idleLoopFlags();
+	idleBusPrefetchCount = busPrefetchCount;
+	idleTicks = cpuTotalTicks;
+	idleLoopVolatileRead = false;
+	idleMeasured = true;
+}
+
+void idleLoopRestart()
+{
+	idleMeasured = false;
+}
+
+// Self-check //////////////////////////////////////////////////////////////
+
+// Everything an instruction can change in the CPU. The condition flags are
+// compared once evaluated, the records they are evaluated from may differ.
+struct SelfCheckState
+{
+	reg_pair reg[45];
+	u32 flags; // N, Z, C and V as in the CPSR
+	u32 flagsN;
+	u32 flagsZ;
+	u32 flagsLhs;
+	u32 flagsRhs;
+	u32 flagsRes;
+	bool flagsC;
+	bool flagsV;
+	bool flagsCLazy;
+	bool flagsVLazy;
+	bool armState;
+	bool armIrqEnable;
+	u32 armNextPC;
+	int armMode;
+	bool busPrefetch;
+	u32 busPrefetchCount;
+	u32 cpuPrefetch[2];
+	int clockTicks;
+	MMU::Journal accesses;
+};
+
+static SelfCheckState checkBefore;
+static SelfCheckState checkCached;
+static SelfCheckState checkInterpreted;
+
+static void selfCheckSave(SelfCheckState &state, int clockTicks)
+{
+	memcpy(state.reg, reg, sizeof(reg));
+	state.flags = (N_FLAG() << 31) | (Z_FLAG() << 30) | (C_FLAG() << 29) | (V_FLAG() << 28);
+	state.flagsN = flagsN;
+	state.flagsZ = flagsZ;
+	state.flagsLhs = flagsLhs;
+	state.flagsRhs = flagsRhs;
+	state.flagsRes = flagsRes;
+	state.flagsC = flagsC;
+	state.flagsV = flagsV;
+	state.flagsCLazy = flagsCLazy;
+	state.flagsVLazy = flagsVLazy;
+	state.armState = armState;
+	state.armIrqEnable = armIrqEnable;
+	state.armNextPC = armNextPC;
+	state.armMode = armMode;
+	state.busPrefetch = busPrefetch;
+	state.busPrefetchCount = busPrefetchCount;
+	state.cpuPrefetch[0] = cpuPrefetch[0];
+	state.cpuPrefetch[1] = cpuPrefetch[1];
+	state.clockTicks = clockTicks;
+}
+
+static void selfCheckRestore(const SelfCheckState &state)
+{
+	memcpy(reg, state.reg, sizeof(reg));
+	flagsN = state.flagsN;
+	flagsZ = state.flagsZ;
+	flagsLhs = state.flagsLhs;
+	flagsRhs = state.flagsRhs;
+	flagsRes = state.flagsRes;
+	flagsC = state.flagsC;
+	flagsV = state.flagsV;
+	flagsCLazy = state.flagsCLazy;
+	flagsVLazy = state.flagsVLazy;
+	armState = state.armState;
+	armIrqEnable = state.armIrqEnable;
+	armNextPC = state.armNextPC;
+	armMode = state.armMode;
+	busPrefetch = state.busPrefetch;
+	busPrefetchCount = state.busPrefetchCount;
+	cpuPrefetch[0] = state.cpuPrefetch[0];
+	cpuPrefetch[1] = state.cpuPrefetch[1];
+}
+
+void selfCheckBegin()
+{
+	selfCheckSave(checkBefore, 0);
+	MMU::journalStart(MMU::JOURNAL_RECORD, &checkCached.accesses, NULL);
+}
+
+void selfCheckReplay(int clockTicks)
+{
+	MMU::journalStop();
+	selfCheckSave(checkCached, clockTicks);
+	selfCheckRestore(checkBefore);
+	MMU::journalStart(MMU::JOURNAL_REPLAY, &checkInterpreted.accesses, &checkCached.accesses);
+}
+
+// Log a value that differs between the runs
+static bool selfCheckDiffers(const char *engine, u32 address, u32 opcode, const char *name,
+                             u32 cached, u32 interpreted)
+{
+	if (cached == interpreted)
+		return false;
+
+	g_message("%s self-check mismatch at %08x (%08x): %s %08x, interpreter %08x\n",
+	    engine, address, opcode, name, cached, interpreted);
+	return true;
+}
+
+static bool selfCheckAccessDiffers(const char *engine, u32 address, u32 opcode, int index,
+                                   const MMU::JournalAccess &cached,
+                                   const MMU::JournalAccess &interpreted)
+{
+	if (cached.address == interpreted.address && cached.value == interpreted.value
+	    && cached.size == interpreted.size && cached.write == interpreted.write)
+		return false;
+
+	g_message("%s self-check mismatch at %08x (%08x): access %d %s%d %08x at %08x, "
+	    "interpreter %s%d %08x at %08x\n", engine, address, opcode, index,
+	    cached.write ? "write" : "read", cached.size * 8, cached.value, cached.address,
+	    interpreted.write ? "write" : "read", interpreted.size * 8, interpreted.value,
+	    interpreted.address);
+	return true;
+}
+
+// A write to WAITCNT resets the prefetch buffer in the cached run only, the
+// interpreter does not write again
+static bool selfCheckWritesWaitcnt(const MMU::Journal &accesses)
+{
+	for (int i = 0; i < accesses.count && i < JOURNAL_SIZE; i++)
+	{
+		const MMU::JournalAccess &access = accesses.accesses[i];
+		if (access.write && access.address <= 0x4000205 && access.address + access.size > 0x4000204)
+			return true;
+	}
+
+	return false;
+}
+
+static bool selfCheckCompare(const char *engine, u32 address, u32 opcode,
+                             const SelfCheckState &cached, const SelfCheckState &interpreted)
+{
+	for (int i = 0; i < 45; i++)
+	{
+		if (cached.reg[i].I != interpreted.reg[i].I)
+		{
+			gchar name[8];
+			g_snprintf(name, sizeof(name), "reg[%d]", i);
+			selfCheckDiffers(engine, address, opcode, name, cached.reg[i].I, interpreted.reg[i].I);
+			return false;
+		}
+	}
+
+	if (selfCheckDiffers(engine, address, opcode, "NZCV", cached.flags, interpreted.flags)
+	    || selfCheckDiffers(engine, address, opcode, "armState", cached.armState, interpreted.armState)
+	    || selfCheckDiffers(engine, address, opcode, "armIrqEnable", cached.armIrqEnable, interpreted.armIrqEnable)
+	    || selfCheckDiffers(engine, address, opcode, "armMode", cached.armMode, interpreted.armMode)
+	    || selfCheckDiffers(engine, address, opcode, "armNextPC", cached.armNextPC, interpreted.armNextPC))
+		return false;
+
+	if (!selfCheckWritesWaitcnt(cached.accesses))
+	{
+		if (selfCheckDiffers(engine, address, opcode, "busPrefetch", cached.busPrefetch, interpreted.busPrefetch)
+		    || selfCheckDiffers(engine, address, opcode, "busPrefetchCount", cached.busPrefetchCount, interpreted.busPrefetchCount)
+		    || selfCheckDiffers(engine, address, opcode, "clockTicks", cached.clockTicks, interpreted.clockTicks))
+			return false;
+	}
+
+	if (selfCheckDiffers(engine, address, opcode, "memory accesses", cached.accesses.count, interpreted.accesses.count))
+		return false;
+
+	for (int i = 0; i < cached.accesses.count && i < JOURNAL_SIZE; i++)
+	{
+		if (selfCheckAccessDiffers(engine, address, opcode, i, cached.accesses.accesses[i],
+		                           interpreted.accesses.accesses[i]))
+			return false;
+	}
+
+	return true;
+}
+
+bool selfCheckEnd(const char *engine, u32 address, u32 opcode, int &clockTicks)
+{
+	MMU::journalStop();
+	selfCheckSave(checkInterpreted, clockTicks);
+
+	bool match = selfCheckCompare(engine, address, opcode, checkCached, checkInterpreted);
+
+	selfCheckRestore(checkCached);
+	clockTicks = checkCached.clockTicks;
+
+	return match;
+}
+
+} // namespace CPU
@@ -43,10 +43,21 @@ union reg_pair
 
 extern reg_pair reg[45];
 
-extern bool N_FLAG;
-extern bool C_FLAG;
-extern bool Z_FLAG;
-extern bool V_FLAG;
+// The condition flags are evaluated lazily. Flag setting instructions only
+// record their result, and for additions and subtractions their operands.
+// N, Z, C and V are worked out from that record when they are read.
+extern u32 flagsN; // N is bit 31
+extern u32 flagsZ; // Z is set when zero
+// Operands and result of the last addition. Subtractions are recorded
+// as lhs + ~rhs + 1, so that C and V are computed the same way for both.
+extern u32 flagsLhs;
+extern u32 flagsRhs;
+extern u32 flagsRes;
+// C and V are either explicit or come from the last addition
+extern bool flagsC;
+extern bool flagsV;
+extern bool flagsCLazy;
+extern bool flagsVLazy;
 
 extern bool armState;
 extern bool armIrqEnable;
@@ -60,6 +71,10 @@ extern u32 busPrefetchCount;
 extern u32 cpuPrefetch[2];
 extern u8 cpuBitsSet[256];
 
+extern bool idleLoopEnabled;
+extern bool idleLoopVolatileRead; // Set when a timer counter is read
+extern u64 idleLoopSkippedTicks;
+
 void init();
 void reset();
 void interrupt();
@@ -68,14 +83,132 @@ void enableBusPrefetch(bool enable);
 int armExecute();
 int thumbExecute();
 
-int dataTicksAccess16(u32 address);
-int dataTicksAccess32(u32 address);
-int dataTicksAccessSeq16(u32 address);
-int dataTicksAccessSeq32(u32 address);
-int codeTicksAccess16(u32 address);
-int codeTicksAccess32(u32 address);
-int codeTicksAccessSeq16(u32 address);
-int codeTicksAccessSeq32(u32 address);
+/**
+ * Drop the decoded ARM instruction cached for the word at address.
+ * Must be called whenever IWRAM or EWRAM is written.
+ */
+void armCacheInvalidate(u32 address);
+
+/**
+ * Drop the decoded ARM instructions for a range of IWRAM or EWRAM that
+ * does not wrap around the end of its region.
+ */
+void armCacheInvalidateRange(u32 address, u32 length);
+
+/**
+ * Drop all the decoded ARM instructions, after RAM has been reloaded
+ */
+void armCacheFlush();
+
+/**
+ * Drop the threaded code translated from the cartridge ROM
+ */
+void thumbCacheFlush();
+
+/**
+ * Run an instruction of Thumb code through the interpreter, without the
+ * prefetch pipeline. armNextPC and reg[15] must point to it.
+ * @return the ticks it took
+ */
+int thumbInsnRun(u32 opcode);
+
+// IWRAM holding ARM code decoded to the block cache or Thumb code recompiled
+// to native code, one flag per 64 bytes. Writes to the other parts of IWRAM
+// do not need to look for code to drop.
+#define IWRAM_CODE_SHIFT 6
+extern u8 iwramCode[0x8000 >> IWRAM_CODE_SHIFT];
+
+/**
+ * Run the recompiled Thumb block starting at armNextPC, recompiling it once
+ * it has been reached often enough.
+ * @param selfCheck whether to check each instruction against the interpreter
+ * @param last receives the address of the last instruction run
+ * @return false when there is no block, for the interpreter to run the
+ * instruction instead
+ */
+bool jitRun(bool selfCheck, u32 &last);
+
+/**
+ * Drop all the recompiled code, before the next block is run
+ */
+void jitFlush();
+
+/**
+ * Drop the recompiled blocks covering a range of IWRAM that does not wrap
+ * around the end of the region
+ */
+void jitInvalidateRange(u32 address, u32 length);
+
+/**
+ * Drop the recompiled blocks covering the word at address.
+ * Must be called whenever IWRAM is written.
+ */
+inline void jitInvalidate(u32 address)
+{
+	if ((address >> 24) == 3 && iwramCode[(address & 0x7FFF) >> IWRAM_CODE_SHIFT])
+		jitInvalidateRange(address & ~3, 4);
+}
+
+/**
+ * Called by the interpreters when a backward branch from branch to target
+ * has been taken. When the loop is short, has no side effects and an
+ * iteration left the CPU in the same state as the previous one, the
+ * following iterations are skipped up to the next event.
+ */
+void idleLoopBranch(u32 branch, u32 target);
+
+/**
+ * Forget the loop iteration being measured, cpuTotalTicks restarts from zero
+ */
+void idleLoopRestart();
+
+/**
+ * Start the self-check of an instruction a cached engine is about to run.
+ * Saves the state of the CPU and journals the memory accesses.
+ */
+void selfCheckBegin();
+
+/**
+ * Go back to the state the instruction started from, for the interpreter to
+ * run it again. Its reads return what the cached run read from the region
+ * handlers and its writes are dropped, so that the devices see them once.
+ * @param clockTicks ticks the cached run took
+ */
+void selfCheckReplay(int clockTicks);
+
+/**
+ * Compare the state the interpreter left with the one the cached run left,
+ * logging the first difference, then carry on from the cached run.
+ * @param engine name of the cached engine, for the log
+ * @param address address of the instruction
+ * @param opcode opcode of the instruction
+ * @param clockTicks ticks the interpreter took, set to those of the cached run
+ * @return whether both runs left the same state
+ */
+bool selfCheckEnd(const char *engine, u32 address, u32 opcode, int &clockTicks);
+
+/**
+ * Access timings of a memory region, in wait states
+ */
+struct WaitStates
+{
+	u8 access16; // 8 and 16 bits accesses
+	u8 accessSeq16;
+	u8 access32;
+	u8 accessSeq32;
+	bool prefetched; // Code fetches are served by the prefetch buffer
+	bool stopsPrefetch; // Data accesses stop the prefetch buffer
+};
+
+/**
+ * Timings of the memory regions, indexed by the top byte of the address
+ */
+extern WaitStates waitStates[16];
+
+/**
+ * Compute the game pak timings again, after WAITCNT has been written
+ */
+void updateWaitStates(u16 waitcnt);
 
 void CPUSwitchMode(int mode, bool saveState);
 void CPUSwitchMode(int mode, bool saveState, bool breakLoop);
@@ -86,6 +219,208 @@ void CPUUndefinedException();
 void CPUSoftwareInterrupt();
 void CPUSoftwareInterrupt(int comment);
 
+inline bool N_FLAG()
+{
+	return (flagsN >> 31) != 0;
+}
+
+inline bool Z_FLAG()
+{
+	return flagsZ == 0;
+}
+
+inline bool C_FLAG()
+{
+	if (flagsCLazy)
+		return (((flagsLhs & flagsRhs) | ((flagsLhs | flagsRhs) & ~flagsRes)) >> 31) != 0;
+	return flagsC;
+}
+
+inline bool V_FLAG()
+{
+	if (flagsVLazy)
+		return (((flagsLhs & flagsRhs & ~flagsRes) | (~flagsLhs & ~flagsRhs & flagsRes)) >> 31) != 0;
+	return flagsV;
+}
+
+inline void SET_N_FLAG(bool n)
+{
+	flagsN = n ? 0x80000000 : 0;
+}
+
+inline void SET_Z_FLAG(bool z)
+{
+	flagsZ = z ? 0 : 1;
+}
+
+inline void SET_C_FLAG(bool c)
+{
+	flagsC = c;
+	flagsCLazy = false;
+}
+
+inline void SET_V_FLAG(bool v)
+{
+	flagsV = v;
+	flagsVLazy = false;
+}
+
+inline void SET_FLAGS_NZ(u32 res)
+{
+	flagsN = res;
+	flagsZ = res;
+}
+
+inline void SET_FLAGS_ADD(u32 lhs, u32 rhs, u32 res)
+{
+	flagsN = res;
+	flagsZ = res;
+	flagsLhs = lhs;
+	flagsRhs = rhs;
+	flagsRes = res;
+	flagsCLazy = true;
+	flagsVLazy = true;
+}
+
+inline void SET_FLAGS_SUB(u32 lhs, u32 rhs, u32 res)
+{
+	SET_FLAGS_ADD(lhs, ~rhs, res);
+}
+
+// Waitstates when accessing data
+inline void dataTicksPrefetch(const WaitStates &region, int value)
+{
+	if (region.stopsPrefetch)
+	{
+		busPrefetchCount=0;
+		busPrefetch=false;
+	}
+	else if (busPrefetch)
+	{
+		int waitState = value;
+		if (!waitState)
+			waitState = 1;
+		busPrefetchCount = ((busPrefetchCount+1)<<waitState) - 1;
+	}
+}
+
+inline int dataTicksAccess16(u32 address) // DATA 8/16bits NON SEQ
+{
+	const WaitStates &region = waitStates[(address>>24)&15];
+	dataTicksPrefetch(region, region.access16);
+	return region.access16;
+}
+
+inline int dataTicksAccess32(u32 address) // DATA 32bits NON SEQ
+{
+	const WaitStates &region = waitStates[(address>>24)&15];
+	dataTicksPrefetch(region, region.access32);
+	return region.access32;
+}
+
+inline int dataTicksAccessSeq16(u32 address) // DATA 8/16bits SEQ
+{
+	const WaitStates &region = waitStates[(address>>24)&15];
+	dataTicksPrefetch(region, region.accessSeq16);
+	return region.accessSeq16;
+}
+
+inline int dataTicksAccessSeq32(u32 address) // DATA 32bits SEQ
+{
+	const WaitStates &region = waitStates[(address>>24)&15];
+	dataTicksPrefetch(region, region.accessSeq32);
+	return region.accessSeq32;
+}
+
+// Waitstates when executing opcode
+inline int codeTicksAccess16(u32 address) // THUMB NON SEQ
+{
+	const WaitStates &region = waitStates[(address>>24)&15];
+
+	if (region.prefetched && (busPrefetchCount&0x1))
+	{
+		if (busPrefetchCount&0x2)
+		{
+			busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
+			return 0;
+		}
+		busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
+		return region.accessSeq16-1;
+	}
+
+	busPrefetchCount = 0;
+	return region.access16;
+}
+
+inline int codeTicksAccess32(u32 address) // ARM NON SEQ
+{
+	const WaitStates &region = waitStates[(address>>24)&15];
+
+	if (region.prefetched && (busPrefetchCount&0x1))
+	{
+		if (busPrefetchCount&0x2)
+		{
+			busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
+			return 0;
+		}
+		busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
+		return region.accessSeq16 - 1;
+	}
+
+	busPrefetchCount = 0;
+	return region.access32;
+}
+
+inline int codeTicksAccessSeq16(u32 address) // THUMB SEQ
+{
+	const WaitStates &region = waitStates[(address>>24)&15];
+
+	if (!region.prefetched)
+	{
+		busPrefetchCount = 0;
+		return region.accessSeq16;
+	}
+
+	if (busPrefetchCount&0x1)
+	{
+		busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
+		return 0;
+	}
+	else if (busPrefetchCount>0xFF)
+	{
+		busPrefetchCount=0;
+		return region.access16;
+	}
+
+	return region.accessSeq16;
+}
+
+inline int codeTicksAccessSeq32(u32 address) // ARM SEQ
+{
+	const WaitStates &region = waitStates[(address>>24)&15];
+
+	if (!region.prefetched)
+		return region.accessSeq32;
+
+	if (busPrefetchCount&0x1)
+	{
+		if (busPrefetchCount&0x2)
+		{
+			busPrefetchCount = ((busPrefetchCount&0xFF)>>2) | (busPrefetchCount&0xFFFFFF00);
+			return 0;
+		}
+		busPrefetchCount = ((busPrefetchCount&0xFF)>>1) | (busPrefetchCount&0xFFFFFF00);
+		return region.accessSeq16;
+	}
+	else if (busPrefetchCount>0xFF)
+	{
+		busPrefetchCount=0;
+		return region.access32;
+	}
+
+	return region.accessSeq32;
+}
+
 inline void ARM_PREFETCH()
 {
 	cpuPrefetch[0] = MMU::read32(armNextPC);
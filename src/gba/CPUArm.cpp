@@ -11,6 +11,74 @@ namespace CPU
 
 static int clockTicks;
 
+// Operands of the data processing and load/store instructions. The
+// interpreter handlers extract them from the opcode, the block cache extracts
+// them once when it decodes the instruction (see DEFINE_OPERANDS_INSN).
+struct ArmOperands
+{
+	u8 rd;
+	u8 rn;
+	u8 rm;
+	u8 rs;
+	u8 shift; // Rm shift amount, or rotation of the immediate
+	u32 imm;  // Rotated immediate, or immediate offset
+};
+
+enum ArmOperandsKind
+{
+	ARM_OPERANDS_REG,     // Rm, shifted by an immediate or by Rs
+	ARM_OPERANDS_IMM,     // 8 bits immediate rotated by 2 * the rotate field
+	ARM_OPERANDS_OFFSET,  // 12 bits offset of LDR, STR, LDRB and STRB
+	ARM_OPERANDS_OFFSET8  // 8 bits offset of LDRH, STRH, LDRSB and LDRSH
+};
+
+static inline ArmOperands armOperandsDecode(u32 opcode, ArmOperandsKind kind)
+{
+	ArmOperands op;
+	op.rd = (opcode >> 12) & 15;
+	op.rn = (opcode >> 16) & 15;
+	op.rm = opcode & 15;
+	op.rs = (opcode >> 8) & 15;
+
+	switch (kind)
+	{
+	case ARM_OPERANDS_IMM:
+		op.shift = (opcode & 0xF00) >> 7;
+		op.imm = opcode & 0xFF;
+		if (op.shift)
+			op.imm = (op.imm << (32 - op.shift)) | (op.imm >> op.shift);
+		break;
+	case ARM_OPERANDS_OFFSET:
+		op.shift = 0;
+		op.imm = opcode & 0xFFF;
+		break;
+	case ARM_OPERANDS_OFFSET8:
+		op.shift = 0;
+		op.imm = (opcode & 0x0F) | ((opcode >> 4) & 0xF0);
+		break;
+	default:
+		op.shift = (opcode >> 7) & 31;
+		op.imm = 0;
+		break;
+	}
+
+	return op;
+}
+
+struct ArmCachedInsn;
+typedef INSN_REGPARM void (*insnfunc_t)(u32 opcode);
+typedef INSN_REGPARM void (*cachedfunc_t)(const ArmCachedInsn *insn);
+
+// Instruction of the block cache, see below
+struct ArmCachedInsn
+{
+	insnfunc_t func;
+	cachedfunc_t cached;
+	u32 opcode;
+	u32 cond;
+	ArmOperands op;
+};
+
 static INSN_REGPARM void armUnknownInsn(u32 opcode)
 {
 #ifdef GBA_LOGGING
@@ -27,9 +95,6 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 
 #define CONSOLE_OUTPUT(a,b)  /* nothing */
 
-#define NEG(i) ((i) >> 31)
-#define POS(i) ((~(i)) >> 31)
-
 // The following macros are used for optimization; any not defined for a
 // particular compiler/CPU combination default to the C core versions.
 //
@@ -58,40 +123,27 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 // C core
 
 #define C_SETCOND_LOGICAL \
-    N_FLAG = ((s32)res < 0) ? true : false;             \
-    Z_FLAG = (res == 0) ? true : false;                 \
-    C_FLAG = C_OUT;
+    SET_FLAGS_NZ(res);                                  \
+    SET_C_FLAG(C_OUT);
 #define C_SETCOND_ADD \
-    N_FLAG = ((s32)res < 0) ? true : false;             \
-    Z_FLAG = (res == 0) ? true : false;                 \
-    V_FLAG = ((NEG(lhs) & NEG(rhs) & POS(res)) |        \
-              (POS(lhs) & POS(rhs) & NEG(res))) ? true : false;\
-    C_FLAG = ((NEG(lhs) & NEG(rhs)) |                   \
-              (NEG(lhs) & POS(res)) |                   \
-              (NEG(rhs) & POS(res))) ? true : false;
+    SET_FLAGS_ADD(lhs, rhs, res);
 #define C_SETCOND_SUB \
-    N_FLAG = ((s32)res < 0) ? true : false;             \
-    Z_FLAG = (res == 0) ? true : false;                 \
-    V_FLAG = ((NEG(lhs) & POS(rhs) & POS(res)) |        \
-              (POS(lhs) & NEG(rhs) & NEG(res))) ? true : false;\
-    C_FLAG = ((NEG(lhs) & POS(rhs)) |                   \
-              (NEG(lhs) & POS(res)) |                   \
-              (POS(rhs) & POS(res))) ? true : false;
+    SET_FLAGS_SUB(lhs, rhs, res);
 
 #ifndef ALU_INIT_C
 #define ALU_INIT_C \
-    int dest = (opcode>>12) & 15;                       \
-    bool C_OUT = C_FLAG;                                \
+    int dest = op.rd;                                   \
+    bool C_OUT = C_FLAG();                              \
     u32 value;
 #endif
 // OP Rd,Rb,Rm LSL #
 #ifndef VALUE_LSL_IMM_C
 #define VALUE_LSL_IMM_C \
-    unsigned int shift = (opcode >> 7) & 0x1F;          \
+    unsigned int shift = op.shift;                      \
     if (LIKELY(!shift)) {  /* LSL #0 most common? */    \
-        value = reg[opcode & 0x0F].I;                   \
+        value = reg[op.rm].I;                           \
     } else {                                            \
-        u32 v = reg[opcode & 0x0F].I;                   \
+        u32 v = reg[op.rm].I;                           \
         C_OUT = (v >> (32 - shift)) & 1 ? true : false; \
         value = v << shift;                             \
     }
@@ -99,9 +151,9 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 // OP Rd,Rb,Rm LSL Rs
 #ifndef VALUE_LSL_REG_C
 #define VALUE_LSL_REG_C \
-    u32 shift = reg[(opcode >> 8) & 15].B.B0;                \
-    u32 rm = reg[opcode & 0x0F].I;                           \
-    if ((opcode & 0x0F) == 15) {                             \
+    u32 shift = reg[op.rs].B.B0;                             \
+    u32 rm = reg[op.rm].I;                                   \
+    if (op.rm == 15) {                                       \
         rm += 4;                                             \
     }                                                        \
     if (LIKELY(shift)) {                                     \
@@ -123,22 +175,22 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 // OP Rd,Rb,Rm LSR #
 #ifndef VALUE_LSR_IMM_C
 #define VALUE_LSR_IMM_C \
-    u32 shift = (opcode >> 7) & 0x1F;                   \
+    u32 shift = op.shift;                               \
     if (LIKELY(shift)) {                                \
-        u32 v = reg[opcode & 0x0F].I;                   \
+        u32 v = reg[op.rm].I;                           \
         C_OUT = (v >> (shift - 1)) & 1 ? true : false;  \
         value = v >> shift;                             \
     } else {                                            \
         value = 0;                                      \
-        C_OUT = (reg[opcode & 0x0F].I & 0x80000000) ? true : false;\
+        C_OUT = (reg[op.rm].I & 0x80000000) ? true : false;        \
     }
 #endif
 // OP Rd,Rb,Rm LSR Rs
 #ifndef VALUE_LSR_REG_C
 #define VALUE_LSR_REG_C \
-    unsigned int shift = reg[(opcode >> 8) & 15].B.B0;  \
-    u32 rm = reg[opcode & 0x0F].I;                      \
-    if ((opcode & 0x0F) == 15) {                        \
+    unsigned int shift = reg[op.rs].B.B0;               \
+    u32 rm = reg[op.rm].I;                              \
+    if (op.rm == 15) {                                  \
         rm += 4;                                        \
     }                                                   \
     if (LIKELY(shift)) {                                \
@@ -160,14 +212,14 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 // OP Rd,Rb,Rm ASR #
 #ifndef VALUE_ASR_IMM_C
 #define VALUE_ASR_IMM_C \
-    unsigned int shift = (opcode >> 7) & 0x1F;          \
+    unsigned int shift = op.shift;                      \
     if (LIKELY(shift)) {                                \
         /* VC++ BUG: u32 v; (s32)v>>n is optimized to shr! */ \
-        s32 v = reg[opcode & 0x0F].I;                   \
+        s32 v = reg[op.rm].I;                           \
         C_OUT = (v >> (int)(shift - 1)) & 1 ? true : false;\
         value = v >> (int)shift;                        \
     } else {                                            \
-        if (reg[opcode & 0x0F].I & 0x80000000) {        \
+        if (reg[op.rm].I & 0x80000000) {                \
             value = 0xFFFFFFFF;                         \
             C_OUT = true;                               \
         } else {                                        \
@@ -179,9 +231,9 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 // OP Rd,Rb,Rm ASR Rs
 #ifndef VALUE_ASR_REG_C
 #define VALUE_ASR_REG_C \
-    unsigned int shift = reg[(opcode >> 8)&15].B.B0;    \
-    u32 rm = reg[opcode & 0x0F].I;                      \
-    if ((opcode & 0x0F) == 15) {                        \
+    unsigned int shift = reg[op.rs].B.B0;               \
+    u32 rm = reg[op.rm].I;                              \
+    if (op.rm == 15) {                                  \
         rm += 4;                                        \
     }                                                   \
     if (LIKELY(shift < 32)) {                           \
@@ -193,7 +245,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
             value = rm;                                 \
         }                                               \
     } else {                                            \
-        if (reg[opcode & 0x0F].I & 0x80000000) {        \
+        if (reg[op.rm].I & 0x80000000) {                \
             value = 0xFFFFFFFF;                         \
             C_OUT = true;                               \
         } else {                                        \
@@ -205,25 +257,25 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 // OP Rd,Rb,Rm ROR #
 #ifndef VALUE_ROR_IMM_C
 #define VALUE_ROR_IMM_C \
-    unsigned int shift = (opcode >> 7) & 0x1F;          \
+    unsigned int shift = op.shift;                      \
     if (LIKELY(shift)) {                                \
-        u32 v = reg[opcode & 0x0F].I;                   \
+        u32 v = reg[op.rm].I;                           \
         C_OUT = (v >> (shift - 1)) & 1 ? true : false;  \
         value = ((v << (32 - shift)) |                  \
                  (v >> shift));                         \
     } else {                                            \
-        u32 v = reg[opcode & 0x0F].I;                   \
+        u32 v = reg[op.rm].I;                           \
         C_OUT = (v & 1) ? true : false;                 \
         value = ((v >> 1) |                             \
-                 (C_FLAG << 31));                       \
+                 (C_FLAG() << 31));                     \
     }
 #endif
 // OP Rd,Rb,Rm ROR Rs
 #ifndef VALUE_ROR_REG_C
 #define VALUE_ROR_REG_C \
-    unsigned int shift = reg[(opcode >> 8)&15].B.B0;    \
-    u32 rm = reg[opcode & 0x0F].I;                      \
-    if ((opcode & 0x0F) == 15) {                        \
+    unsigned int shift = reg[op.rs].B.B0;               \
+    u32 rm = reg[op.rm].I;                              \
+    if (op.rm == 15) {                                  \
         rm += 4;                                        \
     }                                                   \
     if (LIKELY(shift & 0x1F)) {                         \
@@ -240,14 +292,9 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 // OP Rd,Rb,# ROR #
 #ifndef VALUE_IMM_C
 #define VALUE_IMM_C \
-    int shift = (opcode & 0xF00) >> 7;                  \
-    if (UNLIKELY(shift)) {                              \
-        u32 v = opcode & 0xFF;                          \
-        C_OUT = (v >> (shift - 1)) & 1 ? true : false;  \
-        value = ((v << (32 - shift)) |                  \
-                 (v >> shift));                         \
-    } else {                                            \
-        value = opcode & 0xFF;                          \
+    value = op.imm;                                     \
+    if (UNLIKELY(op.shift)) {                           \
+        C_OUT = (value >> 31) ? true : false;           \
     }
 #endif
 
@@ -287,7 +334,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #define C_CHECK_PC(SETCOND) if (LIKELY(dest != 15)) { SETCOND }
 #ifndef OP_AND
 #define OP_AND \
-    u32 res = reg[(opcode>>16)&15].I & value;           \
+    u32 res = reg[op.rn].I & value;                     \
     reg[dest].I = res;
 #endif
 #ifndef OP_ANDS
@@ -295,7 +342,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef OP_EOR
 #define OP_EOR \
-    u32 res = reg[(opcode>>16)&15].I ^ value;           \
+    u32 res = reg[op.rn].I ^ value;                     \
     reg[dest].I = res;
 #endif
 #ifndef OP_EORS
@@ -303,7 +350,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef OP_SUB
 #define OP_SUB \
-    u32 lhs = reg[(opcode>>16)&15].I;                   \
+    u32 lhs = reg[op.rn].I;                             \
     u32 rhs = value;                                    \
     u32 res = lhs - rhs;                                \
     reg[dest].I = res;
@@ -314,7 +361,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #ifndef OP_RSB
 #define OP_RSB \
     u32 lhs = value;                                    \
-    u32 rhs = reg[(opcode>>16)&15].I;                   \
+    u32 rhs = reg[op.rn].I;                             \
     u32 res = lhs - rhs;                                \
     reg[dest].I = res;
 #endif
@@ -323,7 +370,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef OP_ADD
 #define OP_ADD \
-    u32 lhs = reg[(opcode>>16)&15].I;                   \
+    u32 lhs = reg[op.rn].I;                             \
     u32 rhs = value;                                    \
     u32 res = lhs + rhs;                                \
     reg[dest].I = res;
@@ -333,9 +380,9 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef OP_ADC
 #define OP_ADC \
-    u32 lhs = reg[(opcode>>16)&15].I;                   \
+    u32 lhs = reg[op.rn].I;                             \
     u32 rhs = value;                                    \
-    u32 res = lhs + rhs + (u32)C_FLAG;                  \
+    u32 res = lhs + rhs + (u32)C_FLAG();                \
     reg[dest].I = res;
 #endif
 #ifndef OP_ADCS
@@ -343,9 +390,9 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef OP_SBC
 #define OP_SBC \
-    u32 lhs = reg[(opcode>>16)&15].I;                   \
+    u32 lhs = reg[op.rn].I;                             \
     u32 rhs = value;                                    \
-    u32 res = lhs - rhs - !((u32)C_FLAG);               \
+    u32 res = lhs - rhs - !((u32)C_FLAG());             \
     reg[dest].I = res;
 #endif
 #ifndef OP_SBCS
@@ -354,8 +401,8 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #ifndef OP_RSC
 #define OP_RSC \
     u32 lhs = value;                                    \
-    u32 rhs = reg[(opcode>>16)&15].I;                   \
-    u32 res = lhs - rhs - !((u32)C_FLAG);               \
+    u32 rhs = reg[op.rn].I;                             \
+    u32 res = lhs - rhs - !((u32)C_FLAG());             \
     reg[dest].I = res;
 #endif
 #ifndef OP_RSCS
@@ -363,31 +410,31 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef OP_TST
 #define OP_TST \
-    u32 res = reg[(opcode >> 16) & 0x0F].I & value;     \
+    u32 res = reg[op.rn].I & value;                     \
     C_SETCOND_LOGICAL;
 #endif
 #ifndef OP_TEQ
 #define OP_TEQ \
-    u32 res = reg[(opcode >> 16) & 0x0F].I ^ value;     \
+    u32 res = reg[op.rn].I ^ value;                     \
     C_SETCOND_LOGICAL;
 #endif
 #ifndef OP_CMP
 #define OP_CMP \
-    u32 lhs = reg[(opcode>>16)&15].I;                   \
+    u32 lhs = reg[op.rn].I;                             \
     u32 rhs = value;                                    \
     u32 res = lhs - rhs;                                \
     C_SETCOND_SUB;
 #endif
 #ifndef OP_CMN
 #define OP_CMN \
-    u32 lhs = reg[(opcode>>16)&15].I;                   \
+    u32 lhs = reg[op.rn].I;                             \
     u32 rhs = value;                                    \
     u32 res = lhs + rhs;                                \
     C_SETCOND_ADD;
 #endif
 #ifndef OP_ORR
 #define OP_ORR \
-    u32 res = reg[(opcode >> 16) & 0x0F].I | value;     \
+    u32 res = reg[op.rn].I | value;                     \
     reg[dest].I = res;
 #endif
 #ifndef OP_ORRS
@@ -403,7 +450,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef OP_BIC
 #define OP_BIC \
-    u32 res = reg[(opcode >> 16) & 0x0F].I & (~value);  \
+    u32 res = reg[op.rn].I & (~value);                  \
     reg[dest].I = res;
 #endif
 #ifndef OP_BICS
@@ -423,13 +470,12 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef SETCOND_MUL
 #define SETCOND_MUL \
-     N_FLAG = ((s32)reg[dest].I < 0) ? true : false;    \
-     Z_FLAG = reg[dest].I ? false : true;
+     SET_FLAGS_NZ(reg[dest].I);
 #endif
 #ifndef SETCOND_MULL
 #define SETCOND_MULL \
-     N_FLAG = (reg[dest].I & 0x80000000) ? true : false;\
-     Z_FLAG = reg[dest].I || reg[acc].I ? false : true;
+     flagsN = reg[dest].I;                              \
+     flagsZ = reg[dest].I | reg[acc].I;
 #endif
 
 #ifndef ALU_FINISH
@@ -447,7 +493,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #endif
 #ifndef RRX_OFFSET
 #define RRX_OFFSET \
-    offset = ((offset >> 1) | ((int)C_FLAG << 31));
+    offset = ((offset >> 1) | ((int)C_FLAG() << 31));
 #endif
 
 // ALU ops (except multiply) //////////////////////////////////////////////
@@ -460,7 +506,7 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 // ALU_INIT, GETVALUE, OP, and ALU_FINISH are concatenated in order.
 #define ALU_INSN(ALU_INIT, GETVALUE, OP, MODECHANGE, ISREGSHIFT) \
     ALU_INIT GETVALUE OP ALU_FINISH;                            \
-    if (LIKELY((opcode & 0x0000F000) != 0x0000F000)) {          \
+    if (LIKELY(dest != 15)) {                                   \
         clockTicks = 1 + ISREGSHIFT                             \
                        + codeTicksAccessSeq32(armNextPC);       \
     } else {                                                    \
@@ -485,26 +531,33 @@ static INSN_REGPARM void armUnknownInsn(u32 opcode)
 #define MODECHANGE_NO  /*nothing*/
 #define MODECHANGE_YES CPUSwitchMode(reg[17].I & 0x1f, false);
 
+// Define the interpreter handler arm<CODE>, which extracts the operands from
+// the opcode, and arm<CODE>Cached, which the block cache runs with the
+// operands it extracted when it decoded the instruction.
+#define DEFINE_OPERANDS_INSN(CODE, OPERANDS, BODY) \
+  static INSN_REGPARM void arm##CODE(u32 opcode) { const ArmOperands op = armOperandsDecode(opcode, ARM_OPERANDS_##OPERANDS); BODY; }\
+  static INSN_REGPARM void arm##CODE##Cached(const ArmCachedInsn *insn) { const ArmOperands &op = insn->op; BODY; }
+
 #define DEFINE_ALU_INSN_C(CODE1, CODE2, OP, MODECHANGE) \
-  static INSN_REGPARM void arm##CODE1##0(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_LSL_IMM_C, OP_##OP, MODECHANGE_##MODECHANGE, 0); }\
-  static INSN_REGPARM void arm##CODE1##1(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_LSL_REG_C, OP_##OP, MODECHANGE_##MODECHANGE, 1); }\
-  static INSN_REGPARM void arm##CODE1##2(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_LSR_IMM_C, OP_##OP, MODECHANGE_##MODECHANGE, 0); }\
-  static INSN_REGPARM void arm##CODE1##3(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_LSR_REG_C, OP_##OP, MODECHANGE_##MODECHANGE, 1); }\
-  static INSN_REGPARM void arm##CODE1##4(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_ASR_IMM_C, OP_##OP, MODECHANGE_##MODECHANGE, 0); }\
-  static INSN_REGPARM void arm##CODE1##5(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_ASR_REG_C, OP_##OP, MODECHANGE_##MODECHANGE, 1); }\
-  static INSN_REGPARM void arm##CODE1##6(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_ROR_IMM_C, OP_##OP, MODECHANGE_##MODECHANGE, 0); }\
-  static INSN_REGPARM void arm##CODE1##7(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_ROR_REG_C, OP_##OP, MODECHANGE_##MODECHANGE, 1); }\
-  static INSN_REGPARM void arm##CODE2##0(u32 opcode) { ALU_INSN(ALU_INIT_C, VALUE_IMM_C,     OP_##OP, MODECHANGE_##MODECHANGE, 0); }
+  DEFINE_OPERANDS_INSN(CODE1##0, REG, ALU_INSN(ALU_INIT_C, VALUE_LSL_IMM_C, OP_##OP, MODECHANGE_##MODECHANGE, 0))\
+  DEFINE_OPERANDS_INSN(CODE1##1, REG, ALU_INSN(ALU_INIT_C, VALUE_LSL_REG_C, OP_##OP, MODECHANGE_##MODECHANGE, 1))\
+  DEFINE_OPERANDS_INSN(CODE1##2, REG, ALU_INSN(ALU_INIT_C, VALUE_LSR_IMM_C, OP_##OP, MODECHANGE_##MODECHANGE, 0))\
+  DEFINE_OPERANDS_INSN(CODE1##3, REG, ALU_INSN(ALU_INIT_C, VALUE_LSR_REG_C, OP_##OP, MODECHANGE_##MODECHANGE, 1))\
+  DEFINE_OPERANDS_INSN(CODE1##4, REG, ALU_INSN(ALU_INIT_C, VALUE_ASR_IMM_C, OP_##OP, MODECHANGE_##MODECHANGE, 0))\
+  DEFINE_OPERANDS_INSN(CODE1##5, REG, ALU_INSN(ALU_INIT_C, VALUE_ASR_REG_C, OP_##OP, MODECHANGE_##MODECHANGE, 1))\
+  DEFINE_OPERANDS_INSN(CODE1##6, REG, ALU_INSN(ALU_INIT_C, VALUE_ROR_IMM_C, OP_##OP, MODECHANGE_##MODECHANGE, 0))\
+  DEFINE_OPERANDS_INSN(CODE1##7, REG, ALU_INSN(ALU_INIT_C, VALUE_ROR_REG_C, OP_##OP, MODECHANGE_##MODECHANGE, 1))\
+  DEFINE_OPERANDS_INSN(CODE2##0, IMM, ALU_INSN(ALU_INIT_C, VALUE_IMM_C,     OP_##OP, MODECHANGE_##MODECHANGE, 0))
 #define DEFINE_ALU_INSN_NC(CODE1, CODE2, OP, MODECHANGE) \
-  static INSN_REGPARM void arm##CODE1##0(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_LSL_IMM_NC, OP_##OP, MODECHANGE_##MODECHANGE, 0); }\
-  static INSN_REGPARM void arm##CODE1##1(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_LSL_REG_NC, OP_##OP, MODECHANGE_##MODECHANGE, 1); }\
-  static INSN_REGPARM void arm##CODE1##2(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_LSR_IMM_NC, OP_##OP, MODECHANGE_##MODECHANGE, 0); }\
-  static INSN_REGPARM void arm##CODE1##3(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_LSR_REG_NC, OP_##OP, MODECHANGE_##MODECHANGE, 1); }\
-  static INSN_REGPARM void arm##CODE1##4(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_ASR_IMM_NC, OP_##OP, MODECHANGE_##MODECHANGE, 0); }\
-  static INSN_REGPARM void arm##CODE1##5(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_ASR_REG_NC, OP_##OP, MODECHANGE_##MODECHANGE, 1); }\
-  static INSN_REGPARM void arm##CODE1##6(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_ROR_IMM_NC, OP_##OP, MODECHANGE_##MODECHANGE, 0); }\
-  static INSN_REGPARM void arm##CODE1##7(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_ROR_REG_NC, OP_##OP, MODECHANGE_##MODECHANGE, 1); }\
-  static INSN_REGPARM void arm##CODE2##0(u32 opcode) { ALU_INSN(ALU_INIT_NC, VALUE_IMM_NC,     OP_##OP, MODECHANGE_##MODECHANGE, 0); }
+  DEFINE_OPERANDS_INSN(CODE1##0, REG, ALU_INSN(ALU_INIT_NC, VALUE_LSL_IMM_NC, OP_##OP, MODECHANGE_##MODECHANGE, 0))\
+  DEFINE_OPERANDS_INSN(CODE1##1, REG, ALU_INSN(ALU_INIT_NC, VALUE_LSL_REG_NC, OP_##OP, MODECHANGE_##MODECHANGE, 1))\
+  DEFINE_OPERANDS_INSN(CODE1##2, REG, ALU_INSN(ALU_INIT_NC, VALUE_LSR_IMM_NC, OP_##OP, MODECHANGE_##MODECHANGE, 0))\
+  DEFINE_OPERANDS_INSN(CODE1##3, REG, ALU_INSN(ALU_INIT_NC, VALUE_LSR_REG_NC, OP_##OP, MODECHANGE_##MODECHANGE, 1))\
+  DEFINE_OPERANDS_INSN(CODE1##4, REG, ALU_INSN(ALU_INIT_NC, VALUE_ASR_IMM_NC, OP_##OP, MODECHANGE_##MODECHANGE, 0))\
+  DEFINE_OPERANDS_INSN(CODE1##5, REG, ALU_INSN(ALU_INIT_NC, VALUE_ASR_REG_NC, OP_##OP, MODECHANGE_##MODECHANGE, 1))\
+  DEFINE_OPERANDS_INSN(CODE1##6, REG, ALU_INSN(ALU_INIT_NC, VALUE_ROR_IMM_NC, OP_##OP, MODECHANGE_##MODECHANGE, 0))\
+  DEFINE_OPERANDS_INSN(CODE1##7, REG, ALU_INSN(ALU_INIT_NC, VALUE_ROR_REG_NC, OP_##OP, MODECHANGE_##MODECHANGE, 1))\
+  DEFINE_OPERANDS_INSN(CODE2##0, IMM, ALU_INSN(ALU_INIT_NC, VALUE_IMM_NC,     OP_##OP, MODECHANGE_##MODECHANGE, 0))
 
 // AND
 DEFINE_ALU_INSN_NC(00, 20, AND,  NO)
@@ -909,28 +962,28 @@ static INSN_REGPARM void arm121(u32 opcode)
 // Load/store /////////////////////////////////////////////////////////////
 
 #define OFFSET_IMM \
-    int offset = opcode & 0xFFF;
+    int offset = op.imm;
 #define OFFSET_IMM8 \
-    int offset = ((opcode & 0x0F) | ((opcode>>4) & 0xF0));
+    int offset = op.imm;
 #define OFFSET_REG \
-    int offset = reg[opcode & 15].I;
+    int offset = reg[op.rm].I;
 #define OFFSET_LSL \
-    int offset = reg[opcode & 15].I << ((opcode>>7) & 31);
+    int offset = reg[op.rm].I << op.shift;
 #define OFFSET_LSR \
-    int shift = (opcode >> 7) & 31;                     \
-    int offset = shift ? reg[opcode & 15].I >> shift : 0;
+    int shift = op.shift;                               \
+    int offset = shift ? reg[op.rm].I >> shift : 0;
 #define OFFSET_ASR \
-    int shift = (opcode >> 7) & 31;                     \
+    int shift = op.shift;                               \
     int offset;                                         \
     if (shift)                                          \
-        offset = (int)((s32)reg[opcode & 15].I >> shift);\
-    else if (reg[opcode & 15].I & 0x80000000)           \
+        offset = (int)((s32)reg[op.rm].I >> shift);      \
+    else if (reg[op.rm].I & 0x80000000)                 \
         offset = 0xFFFFFFFF;                            \
     else                                                \
         offset = 0;
 #define OFFSET_ROR \
-    int shift = (opcode >> 7) & 31;                     \
-    u32 offset = reg[opcode & 15].I;                    \
+    int shift = op.shift;                               \
+    u32 offset = reg[op.rm].I;                          \
     if (shift) {                                        \
         ROR_OFFSET;                                     \
     } else {                                            \
@@ -958,8 +1011,8 @@ static INSN_REGPARM void arm121(u32 opcode)
 #define LDRSTR_INIT(CALC_OFFSET, CALC_ADDRESS) \
     if (busPrefetchCount == 0)                          \
         busPrefetch = busPrefetchEnable;                \
-    int dest = (opcode >> 12) & 15;                     \
-    int base = (opcode >> 16) & 15;                     \
+    int dest = op.rd;                                   \
+    int base = op.rn;                                   \
     CALC_OFFSET;                                        \
     u32 address = CALC_ADDRESS;
 
@@ -1014,851 +1067,347 @@ static INSN_REGPARM void arm121(u32 opcode)
   LDR(CALC_OFFSET, ADDRESS_PREINC, LOAD_DATA, WRITEBACK_PRE, SIZE)
 
 // STRH Rd, [Rn], -Rm
-static INSN_REGPARM void arm00B(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_REG, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(00B, REG, STR_POSTDEC(OFFSET_REG, OP_STRH, 16))
 // STRH Rd, [Rn], #-offset
-static INSN_REGPARM void arm04B(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_IMM8, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(04B, OFFSET8, STR_POSTDEC(OFFSET_IMM8, OP_STRH, 16))
 // STRH Rd, [Rn], Rm
-static INSN_REGPARM void arm08B(u32 opcode)
-{
-	STR_POSTINC(OFFSET_REG, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(08B, REG, STR_POSTINC(OFFSET_REG, OP_STRH, 16))
 // STRH Rd, [Rn], #offset
-static INSN_REGPARM void arm0CB(u32 opcode)
-{
-	STR_POSTINC(OFFSET_IMM8, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(0CB, OFFSET8, STR_POSTINC(OFFSET_IMM8, OP_STRH, 16))
 // STRH Rd, [Rn, -Rm]
-static INSN_REGPARM void arm10B(u32 opcode)
-{
-	STR_PREDEC(OFFSET_REG, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(10B, REG, STR_PREDEC(OFFSET_REG, OP_STRH, 16))
 // STRH Rd, [Rn, -Rm]!
-static INSN_REGPARM void arm12B(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_REG, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(12B, REG, STR_PREDEC_WB(OFFSET_REG, OP_STRH, 16))
 // STRH Rd, [Rn, -#offset]
-static INSN_REGPARM void arm14B(u32 opcode)
-{
-	STR_PREDEC(OFFSET_IMM8, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(14B, OFFSET8, STR_PREDEC(OFFSET_IMM8, OP_STRH, 16))
 // STRH Rd, [Rn, -#offset]!
-static INSN_REGPARM void arm16B(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_IMM8, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(16B, OFFSET8, STR_PREDEC_WB(OFFSET_IMM8, OP_STRH, 16))
 // STRH Rd, [Rn, Rm]
-static INSN_REGPARM void arm18B(u32 opcode)
-{
-	STR_PREINC(OFFSET_REG, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(18B, REG, STR_PREINC(OFFSET_REG, OP_STRH, 16))
 // STRH Rd, [Rn, Rm]!
-static INSN_REGPARM void arm1AB(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_REG, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(1AB, REG, STR_PREINC_WB(OFFSET_REG, OP_STRH, 16))
 // STRH Rd, [Rn, #offset]
-static INSN_REGPARM void arm1CB(u32 opcode)
-{
-	STR_PREINC(OFFSET_IMM8, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(1CB, OFFSET8, STR_PREINC(OFFSET_IMM8, OP_STRH, 16))
 // STRH Rd, [Rn, #offset]!
-static INSN_REGPARM void arm1EB(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_IMM8, OP_STRH, 16);
-}
+DEFINE_OPERANDS_INSN(1EB, OFFSET8, STR_PREINC_WB(OFFSET_IMM8, OP_STRH, 16))
 
 // LDRH Rd, [Rn], -Rm
-static INSN_REGPARM void arm01B(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_REG, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(01B, REG, LDR_POSTDEC(OFFSET_REG, OP_LDRH, 16))
 // LDRH Rd, [Rn], #-offset
-static INSN_REGPARM void arm05B(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_IMM8, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(05B, OFFSET8, LDR_POSTDEC(OFFSET_IMM8, OP_LDRH, 16))
 // LDRH Rd, [Rn], Rm
-static INSN_REGPARM void arm09B(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_REG, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(09B, REG, LDR_POSTINC(OFFSET_REG, OP_LDRH, 16))
 // LDRH Rd, [Rn], #offset
-static INSN_REGPARM void arm0DB(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_IMM8, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(0DB, OFFSET8, LDR_POSTINC(OFFSET_IMM8, OP_LDRH, 16))
 // LDRH Rd, [Rn, -Rm]
-static INSN_REGPARM void arm11B(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_REG, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(11B, REG, LDR_PREDEC(OFFSET_REG, OP_LDRH, 16))
 // LDRH Rd, [Rn, -Rm]!
-static INSN_REGPARM void arm13B(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_REG, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(13B, REG, LDR_PREDEC_WB(OFFSET_REG, OP_LDRH, 16))
 // LDRH Rd, [Rn, -#offset]
-static INSN_REGPARM void arm15B(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_IMM8, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(15B, OFFSET8, LDR_PREDEC(OFFSET_IMM8, OP_LDRH, 16))
 // LDRH Rd, [Rn, -#offset]!
-static INSN_REGPARM void arm17B(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_IMM8, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(17B, OFFSET8, LDR_PREDEC_WB(OFFSET_IMM8, OP_LDRH, 16))
 // LDRH Rd, [Rn, Rm]
-static INSN_REGPARM void arm19B(u32 opcode)
-{
-	LDR_PREINC(OFFSET_REG, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(19B, REG, LDR_PREINC(OFFSET_REG, OP_LDRH, 16))
 // LDRH Rd, [Rn, Rm]!
-static INSN_REGPARM void arm1BB(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_REG, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(1BB, REG, LDR_PREINC_WB(OFFSET_REG, OP_LDRH, 16))
 // LDRH Rd, [Rn, #offset]
-static INSN_REGPARM void arm1DB(u32 opcode)
-{
-	LDR_PREINC(OFFSET_IMM8, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(1DB, OFFSET8, LDR_PREINC(OFFSET_IMM8, OP_LDRH, 16))
 // LDRH Rd, [Rn, #offset]!
-static INSN_REGPARM void arm1FB(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_IMM8, OP_LDRH, 16);
-}
+DEFINE_OPERANDS_INSN(1FB, OFFSET8, LDR_PREINC_WB(OFFSET_IMM8, OP_LDRH, 16))
 
 // LDRSB Rd, [Rn], -Rm
-static INSN_REGPARM void arm01D(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_REG, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(01D, REG, LDR_POSTDEC(OFFSET_REG, OP_LDRSB, 16))
 // LDRSB Rd, [Rn], #-offset
-static INSN_REGPARM void arm05D(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_IMM8, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(05D, OFFSET8, LDR_POSTDEC(OFFSET_IMM8, OP_LDRSB, 16))
 // LDRSB Rd, [Rn], Rm
-static INSN_REGPARM void arm09D(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_REG, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(09D, REG, LDR_POSTINC(OFFSET_REG, OP_LDRSB, 16))
 // LDRSB Rd, [Rn], #offset
-static INSN_REGPARM void arm0DD(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_IMM8, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(0DD, OFFSET8, LDR_POSTINC(OFFSET_IMM8, OP_LDRSB, 16))
 // LDRSB Rd, [Rn, -Rm]
-static INSN_REGPARM void arm11D(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_REG, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(11D, REG, LDR_PREDEC(OFFSET_REG, OP_LDRSB, 16))
 // LDRSB Rd, [Rn, -Rm]!
-static INSN_REGPARM void arm13D(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_REG, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(13D, REG, LDR_PREDEC_WB(OFFSET_REG, OP_LDRSB, 16))
 // LDRSB Rd, [Rn, -#offset]
-static INSN_REGPARM void arm15D(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_IMM8, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(15D, OFFSET8, LDR_PREDEC(OFFSET_IMM8, OP_LDRSB, 16))
 // LDRSB Rd, [Rn, -#offset]!
-static INSN_REGPARM void arm17D(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_IMM8, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(17D, OFFSET8, LDR_PREDEC_WB(OFFSET_IMM8, OP_LDRSB, 16))
 // LDRSB Rd, [Rn, Rm]
-static INSN_REGPARM void arm19D(u32 opcode)
-{
-	LDR_PREINC(OFFSET_REG, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(19D, REG, LDR_PREINC(OFFSET_REG, OP_LDRSB, 16))
 // LDRSB Rd, [Rn, Rm]!
-static INSN_REGPARM void arm1BD(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_REG, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(1BD, REG, LDR_PREINC_WB(OFFSET_REG, OP_LDRSB, 16))
 // LDRSB Rd, [Rn, #offset]
-static INSN_REGPARM void arm1DD(u32 opcode)
-{
-	LDR_PREINC(OFFSET_IMM8, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(1DD, OFFSET8, LDR_PREINC(OFFSET_IMM8, OP_LDRSB, 16))
 // LDRSB Rd, [Rn, #offset]!
-static INSN_REGPARM void arm1FD(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_IMM8, OP_LDRSB, 16);
-}
+DEFINE_OPERANDS_INSN(1FD, OFFSET8, LDR_PREINC_WB(OFFSET_IMM8, OP_LDRSB, 16))
 
 // LDRSH Rd, [Rn], -Rm
-static INSN_REGPARM void arm01F(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_REG, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(01F, REG, LDR_POSTDEC(OFFSET_REG, OP_LDRSH, 16))
 // LDRSH Rd, [Rn], #-offset
-static INSN_REGPARM void arm05F(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_IMM8, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(05F, OFFSET8, LDR_POSTDEC(OFFSET_IMM8, OP_LDRSH, 16))
 // LDRSH Rd, [Rn], Rm
-static INSN_REGPARM void arm09F(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_REG, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(09F, REG, LDR_POSTINC(OFFSET_REG, OP_LDRSH, 16))
 // LDRSH Rd, [Rn], #offset
-static INSN_REGPARM void arm0DF(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_IMM8, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(0DF, OFFSET8, LDR_POSTINC(OFFSET_IMM8, OP_LDRSH, 16))
 // LDRSH Rd, [Rn, -Rm]
-static INSN_REGPARM void arm11F(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_REG, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(11F, REG, LDR_PREDEC(OFFSET_REG, OP_LDRSH, 16))
 // LDRSH Rd, [Rn, -Rm]!
-static INSN_REGPARM void arm13F(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_REG, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(13F, REG, LDR_PREDEC_WB(OFFSET_REG, OP_LDRSH, 16))
 // LDRSH Rd, [Rn, -#offset]
-static INSN_REGPARM void arm15F(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_IMM8, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(15F, OFFSET8, LDR_PREDEC(OFFSET_IMM8, OP_LDRSH, 16))
 // LDRSH Rd, [Rn, -#offset]!
-static INSN_REGPARM void arm17F(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_IMM8, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(17F, OFFSET8, LDR_PREDEC_WB(OFFSET_IMM8, OP_LDRSH, 16))
 // LDRSH Rd, [Rn, Rm]
-static INSN_REGPARM void arm19F(u32 opcode)
-{
-	LDR_PREINC(OFFSET_REG, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(19F, REG, LDR_PREINC(OFFSET_REG, OP_LDRSH, 16))
 // LDRSH Rd, [Rn, Rm]!
-static INSN_REGPARM void arm1BF(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_REG, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(1BF, REG, LDR_PREINC_WB(OFFSET_REG, OP_LDRSH, 16))
 // LDRSH Rd, [Rn, #offset]
-static INSN_REGPARM void arm1DF(u32 opcode)
-{
-	LDR_PREINC(OFFSET_IMM8, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(1DF, OFFSET8, LDR_PREINC(OFFSET_IMM8, OP_LDRSH, 16))
 // LDRSH Rd, [Rn, #offset]!
-static INSN_REGPARM void arm1FF(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_IMM8, OP_LDRSH, 16);
-}
+DEFINE_OPERANDS_INSN(1FF, OFFSET8, LDR_PREINC_WB(OFFSET_IMM8, OP_LDRSH, 16))
 
 // STR[T] Rd, [Rn], -#
 // Note: STR and STRT do the same thing on the GBA (likewise for LDR/LDRT etc)
-static INSN_REGPARM void arm400(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_IMM, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(400, OFFSET, STR_POSTDEC(OFFSET_IMM, OP_STR, 32))
 // LDR[T] Rd, [Rn], -#
-static INSN_REGPARM void arm410(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_IMM, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(410, OFFSET, LDR_POSTDEC(OFFSET_IMM, OP_LDR, 32))
 // STRB[T] Rd, [Rn], -#
-static INSN_REGPARM void arm440(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_IMM, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(440, OFFSET, STR_POSTDEC(OFFSET_IMM, OP_STRB, 16))
 // LDRB[T] Rd, [Rn], -#
-static INSN_REGPARM void arm450(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_IMM, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(450, OFFSET, LDR_POSTDEC(OFFSET_IMM, OP_LDRB, 16))
 // STR[T] Rd, [Rn], #
-static INSN_REGPARM void arm480(u32 opcode)
-{
-	STR_POSTINC(OFFSET_IMM, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(480, OFFSET, STR_POSTINC(OFFSET_IMM, OP_STR, 32))
 // LDR Rd, [Rn], #
-static INSN_REGPARM void arm490(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_IMM, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(490, OFFSET, LDR_POSTINC(OFFSET_IMM, OP_LDR, 32))
 // STRB[T] Rd, [Rn], #
-static INSN_REGPARM void arm4C0(u32 opcode)
-{
-	STR_POSTINC(OFFSET_IMM, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(4C0, OFFSET, STR_POSTINC(OFFSET_IMM, OP_STRB, 16))
 // LDRB[T] Rd, [Rn], #
-static INSN_REGPARM void arm4D0(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_IMM, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(4D0, OFFSET, LDR_POSTINC(OFFSET_IMM, OP_LDRB, 16))
 // STR Rd, [Rn, -#]
-static INSN_REGPARM void arm500(u32 opcode)
-{
-	STR_PREDEC(OFFSET_IMM, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(500, OFFSET, STR_PREDEC(OFFSET_IMM, OP_STR, 32))
 // LDR Rd, [Rn, -#]
-static INSN_REGPARM void arm510(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_IMM, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(510, OFFSET, LDR_PREDEC(OFFSET_IMM, OP_LDR, 32))
 // STR Rd, [Rn, -#]!
-static INSN_REGPARM void arm520(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_IMM, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(520, OFFSET, STR_PREDEC_WB(OFFSET_IMM, OP_STR, 32))
 // LDR Rd, [Rn, -#]!
-static INSN_REGPARM void arm530(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_IMM, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(530, OFFSET, LDR_PREDEC_WB(OFFSET_IMM, OP_LDR, 32))
 // STRB Rd, [Rn, -#]
-static INSN_REGPARM void arm540(u32 opcode)
-{
-	STR_PREDEC(OFFSET_IMM, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(540, OFFSET, STR_PREDEC(OFFSET_IMM, OP_STRB, 16))
 // LDRB Rd, [Rn, -#]
-static INSN_REGPARM void arm550(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_IMM, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(550, OFFSET, LDR_PREDEC(OFFSET_IMM, OP_LDRB, 16))
 // STRB Rd, [Rn, -#]!
-static INSN_REGPARM void arm560(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_IMM, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(560, OFFSET, STR_PREDEC_WB(OFFSET_IMM, OP_STRB, 16))
 // LDRB Rd, [Rn, -#]!
-static INSN_REGPARM void arm570(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_IMM, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(570, OFFSET, LDR_PREDEC_WB(OFFSET_IMM, OP_LDRB, 16))
 // STR Rd, [Rn, #]
-static INSN_REGPARM void arm580(u32 opcode)
-{
-	STR_PREINC(OFFSET_IMM, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(580, OFFSET, STR_PREINC(OFFSET_IMM, OP_STR, 32))
 // LDR Rd, [Rn, #]
-static INSN_REGPARM void arm590(u32 opcode)
-{
-	LDR_PREINC(OFFSET_IMM, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(590, OFFSET, LDR_PREINC(OFFSET_IMM, OP_LDR, 32))
 // STR Rd, [Rn, #]!
-static INSN_REGPARM void arm5A0(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_IMM, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(5A0, OFFSET, STR_PREINC_WB(OFFSET_IMM, OP_STR, 32))
 // LDR Rd, [Rn, #]!
-static INSN_REGPARM void arm5B0(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_IMM, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(5B0, OFFSET, LDR_PREINC_WB(OFFSET_IMM, OP_LDR, 32))
 // STRB Rd, [Rn, #]
-static INSN_REGPARM void arm5C0(u32 opcode)
-{
-	STR_PREINC(OFFSET_IMM, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(5C0, OFFSET, STR_PREINC(OFFSET_IMM, OP_STRB, 16))
 // LDRB Rd, [Rn, #]
-static INSN_REGPARM void arm5D0(u32 opcode)
-{
-	LDR_PREINC(OFFSET_IMM, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(5D0, OFFSET, LDR_PREINC(OFFSET_IMM, OP_LDRB, 16))
 // STRB Rd, [Rn, #]!
-static INSN_REGPARM void arm5E0(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_IMM, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(5E0, OFFSET, STR_PREINC_WB(OFFSET_IMM, OP_STRB, 16))
 // LDRB Rd, [Rn, #]!
-static INSN_REGPARM void arm5F0(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_IMM, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(5F0, OFFSET, LDR_PREINC_WB(OFFSET_IMM, OP_LDRB, 16))
 
 // STR[T] Rd, [Rn], -Rm, LSL #
-static INSN_REGPARM void arm600(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_LSL, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(600, REG, STR_POSTDEC(OFFSET_LSL, OP_STR, 32))
 // STR[T] Rd, [Rn], -Rm, LSR #
-static INSN_REGPARM void arm602(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_LSR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(602, REG, STR_POSTDEC(OFFSET_LSR, OP_STR, 32))
 // STR[T] Rd, [Rn], -Rm, ASR #
-static INSN_REGPARM void arm604(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_ASR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(604, REG, STR_POSTDEC(OFFSET_ASR, OP_STR, 32))
 // STR[T] Rd, [Rn], -Rm, ROR #
-static INSN_REGPARM void arm606(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_ROR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(606, REG, STR_POSTDEC(OFFSET_ROR, OP_STR, 32))
 // LDR[T] Rd, [Rn], -Rm, LSL #
-static INSN_REGPARM void arm610(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_LSL, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(610, REG, LDR_POSTDEC(OFFSET_LSL, OP_LDR, 32))
 // LDR[T] Rd, [Rn], -Rm, LSR #
-static INSN_REGPARM void arm612(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_LSR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(612, REG, LDR_POSTDEC(OFFSET_LSR, OP_LDR, 32))
 // LDR[T] Rd, [Rn], -Rm, ASR #
-static INSN_REGPARM void arm614(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_ASR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(614, REG, LDR_POSTDEC(OFFSET_ASR, OP_LDR, 32))
 // LDR[T] Rd, [Rn], -Rm, ROR #
-static INSN_REGPARM void arm616(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_ROR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(616, REG, LDR_POSTDEC(OFFSET_ROR, OP_LDR, 32))
 // STRB[T] Rd, [Rn], -Rm, LSL #
-static INSN_REGPARM void arm640(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_LSL, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(640, REG, STR_POSTDEC(OFFSET_LSL, OP_STRB, 16))
 // STRB[T] Rd, [Rn], -Rm, LSR #
-static INSN_REGPARM void arm642(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_LSR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(642, REG, STR_POSTDEC(OFFSET_LSR, OP_STRB, 16))
 // STRB[T] Rd, [Rn], -Rm, ASR #
-static INSN_REGPARM void arm644(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_ASR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(644, REG, STR_POSTDEC(OFFSET_ASR, OP_STRB, 16))
 // STRB[T] Rd, [Rn], -Rm, ROR #
-static INSN_REGPARM void arm646(u32 opcode)
-{
-	STR_POSTDEC(OFFSET_ROR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(646, REG, STR_POSTDEC(OFFSET_ROR, OP_STRB, 16))
 // LDRB[T] Rd, [Rn], -Rm, LSL #
-static INSN_REGPARM void arm650(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_LSL, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(650, REG, LDR_POSTDEC(OFFSET_LSL, OP_LDRB, 16))
 // LDRB[T] Rd, [Rn], -Rm, LSR #
-static INSN_REGPARM void arm652(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_LSR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(652, REG, LDR_POSTDEC(OFFSET_LSR, OP_LDRB, 16))
 // LDRB[T] Rd, [Rn], -Rm, ASR #
-static INSN_REGPARM void arm654(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_ASR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(654, REG, LDR_POSTDEC(OFFSET_ASR, OP_LDRB, 16))
 // LDRB Rd, [Rn], -Rm, ROR #
-static INSN_REGPARM void arm656(u32 opcode)
-{
-	LDR_POSTDEC(OFFSET_ROR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(656, REG, LDR_POSTDEC(OFFSET_ROR, OP_LDRB, 16))
 // STR[T] Rd, [Rn], Rm, LSL #
-static INSN_REGPARM void arm680(u32 opcode)
-{
-	STR_POSTINC(OFFSET_LSL, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(680, REG, STR_POSTINC(OFFSET_LSL, OP_STR, 32))
 // STR[T] Rd, [Rn], Rm, LSR #
-static INSN_REGPARM void arm682(u32 opcode)
-{
-	STR_POSTINC(OFFSET_LSR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(682, REG, STR_POSTINC(OFFSET_LSR, OP_STR, 32))
 // STR[T] Rd, [Rn], Rm, ASR #
-static INSN_REGPARM void arm684(u32 opcode)
-{
-	STR_POSTINC(OFFSET_ASR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(684, REG, STR_POSTINC(OFFSET_ASR, OP_STR, 32))
 // STR[T] Rd, [Rn], Rm, ROR #
-static INSN_REGPARM void arm686(u32 opcode)
-{
-	STR_POSTINC(OFFSET_ROR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(686, REG, STR_POSTINC(OFFSET_ROR, OP_STR, 32))
 // LDR[T] Rd, [Rn], Rm, LSL #
-static INSN_REGPARM void arm690(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_LSL, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(690, REG, LDR_POSTINC(OFFSET_LSL, OP_LDR, 32))
 // LDR[T] Rd, [Rn], Rm, LSR #
-static INSN_REGPARM void arm692(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_LSR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(692, REG, LDR_POSTINC(OFFSET_LSR, OP_LDR, 32))
 // LDR[T] Rd, [Rn], Rm, ASR #
-static INSN_REGPARM void arm694(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_ASR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(694, REG, LDR_POSTINC(OFFSET_ASR, OP_LDR, 32))
 // LDR[T] Rd, [Rn], Rm, ROR #
-static INSN_REGPARM void arm696(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_ROR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(696, REG, LDR_POSTINC(OFFSET_ROR, OP_LDR, 32))
 // STRB[T] Rd, [Rn], Rm, LSL #
-static INSN_REGPARM void arm6C0(u32 opcode)
-{
-	STR_POSTINC(OFFSET_LSL, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(6C0, REG, STR_POSTINC(OFFSET_LSL, OP_STRB, 16))
 // STRB[T] Rd, [Rn], Rm, LSR #
-static INSN_REGPARM void arm6C2(u32 opcode)
-{
-	STR_POSTINC(OFFSET_LSR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(6C2, REG, STR_POSTINC(OFFSET_LSR, OP_STRB, 16))
 // STRB[T] Rd, [Rn], Rm, ASR #
-static INSN_REGPARM void arm6C4(u32 opcode)
-{
-	STR_POSTINC(OFFSET_ASR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(6C4, REG, STR_POSTINC(OFFSET_ASR, OP_STRB, 16))
 // STRB[T] Rd, [Rn], Rm, ROR #
-static INSN_REGPARM void arm6C6(u32 opcode)
-{
-	STR_POSTINC(OFFSET_ROR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(6C6, REG, STR_POSTINC(OFFSET_ROR, OP_STRB, 16))
 // LDRB[T] Rd, [Rn], Rm, LSL #
-static INSN_REGPARM void arm6D0(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_LSL, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(6D0, REG, LDR_POSTINC(OFFSET_LSL, OP_LDRB, 16))
 // LDRB[T] Rd, [Rn], Rm, LSR #
-static INSN_REGPARM void arm6D2(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_LSR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(6D2, REG, LDR_POSTINC(OFFSET_LSR, OP_LDRB, 16))
 // LDRB[T] Rd, [Rn], Rm, ASR #
-static INSN_REGPARM void arm6D4(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_ASR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(6D4, REG, LDR_POSTINC(OFFSET_ASR, OP_LDRB, 16))
 // LDRB[T] Rd, [Rn], Rm, ROR #
-static INSN_REGPARM void arm6D6(u32 opcode)
-{
-	LDR_POSTINC(OFFSET_ROR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(6D6, REG, LDR_POSTINC(OFFSET_ROR, OP_LDRB, 16))
 // STR Rd, [Rn, -Rm, LSL #]
-static INSN_REGPARM void arm700(u32 opcode)
-{
-	STR_PREDEC(OFFSET_LSL, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(700, REG, STR_PREDEC(OFFSET_LSL, OP_STR, 32))
 // STR Rd, [Rn, -Rm, LSR #]
-static INSN_REGPARM void arm702(u32 opcode)
-{
-	STR_PREDEC(OFFSET_LSR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(702, REG, STR_PREDEC(OFFSET_LSR, OP_STR, 32))
 // STR Rd, [Rn, -Rm, ASR #]
-static INSN_REGPARM void arm704(u32 opcode)
-{
-	STR_PREDEC(OFFSET_ASR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(704, REG, STR_PREDEC(OFFSET_ASR, OP_STR, 32))
 // STR Rd, [Rn, -Rm, ROR #]
-static INSN_REGPARM void arm706(u32 opcode)
-{
-	STR_PREDEC(OFFSET_ROR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(706, REG, STR_PREDEC(OFFSET_ROR, OP_STR, 32))
 // LDR Rd, [Rn, -Rm, LSL #]
-static INSN_REGPARM void arm710(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_LSL, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(710, REG, LDR_PREDEC(OFFSET_LSL, OP_LDR, 32))
 // LDR Rd, [Rn, -Rm, LSR #]
-static INSN_REGPARM void arm712(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_LSR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(712, REG, LDR_PREDEC(OFFSET_LSR, OP_LDR, 32))
 // LDR Rd, [Rn, -Rm, ASR #]
-static INSN_REGPARM void arm714(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_ASR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(714, REG, LDR_PREDEC(OFFSET_ASR, OP_LDR, 32))
 // LDR Rd, [Rn, -Rm, ROR #]
-static INSN_REGPARM void arm716(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_ROR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(716, REG, LDR_PREDEC(OFFSET_ROR, OP_LDR, 32))
 // STR Rd, [Rn, -Rm, LSL #]!
-static INSN_REGPARM void arm720(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_LSL, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(720, REG, STR_PREDEC_WB(OFFSET_LSL, OP_STR, 32))
 // STR Rd, [Rn, -Rm, LSR #]!
-static INSN_REGPARM void arm722(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_LSR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(722, REG, STR_PREDEC_WB(OFFSET_LSR, OP_STR, 32))
 // STR Rd, [Rn, -Rm, ASR #]!
-static INSN_REGPARM void arm724(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_ASR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(724, REG, STR_PREDEC_WB(OFFSET_ASR, OP_STR, 32))
 // STR Rd, [Rn, -Rm, ROR #]!
-static INSN_REGPARM void arm726(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_ROR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(726, REG, STR_PREDEC_WB(OFFSET_ROR, OP_STR, 32))
 // LDR Rd, [Rn, -Rm, LSL #]!
-static INSN_REGPARM void arm730(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_LSL, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(730, REG, LDR_PREDEC_WB(OFFSET_LSL, OP_LDR, 32))
 // LDR Rd, [Rn, -Rm, LSR #]!
-static INSN_REGPARM void arm732(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_LSR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(732, REG, LDR_PREDEC_WB(OFFSET_LSR, OP_LDR, 32))
 // LDR Rd, [Rn, -Rm, ASR #]!
-static INSN_REGPARM void arm734(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_ASR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(734, REG, LDR_PREDEC_WB(OFFSET_ASR, OP_LDR, 32))
 // LDR Rd, [Rn, -Rm, ROR #]!
-static INSN_REGPARM void arm736(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_ROR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(736, REG, LDR_PREDEC_WB(OFFSET_ROR, OP_LDR, 32))
 // STRB Rd, [Rn, -Rm, LSL #]
-static INSN_REGPARM void arm740(u32 opcode)
-{
-	STR_PREDEC(OFFSET_LSL, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(740, REG, STR_PREDEC(OFFSET_LSL, OP_STRB, 16))
 // STRB Rd, [Rn, -Rm, LSR #]
-static INSN_REGPARM void arm742(u32 opcode)
-{
-	STR_PREDEC(OFFSET_LSR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(742, REG, STR_PREDEC(OFFSET_LSR, OP_STRB, 16))
 // STRB Rd, [Rn, -Rm, ASR #]
-static INSN_REGPARM void arm744(u32 opcode)
-{
-	STR_PREDEC(OFFSET_ASR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(744, REG, STR_PREDEC(OFFSET_ASR, OP_STRB, 16))
 // STRB Rd, [Rn, -Rm, ROR #]
-static INSN_REGPARM void arm746(u32 opcode)
-{
-	STR_PREDEC(OFFSET_ROR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(746, REG, STR_PREDEC(OFFSET_ROR, OP_STRB, 16))
 // LDRB Rd, [Rn, -Rm, LSL #]
-static INSN_REGPARM void arm750(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_LSL, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(750, REG, LDR_PREDEC(OFFSET_LSL, OP_LDRB, 16))
 // LDRB Rd, [Rn, -Rm, LSR #]
-static INSN_REGPARM void arm752(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_LSR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(752, REG, LDR_PREDEC(OFFSET_LSR, OP_LDRB, 16))
 // LDRB Rd, [Rn, -Rm, ASR #]
-static INSN_REGPARM void arm754(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_ASR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(754, REG, LDR_PREDEC(OFFSET_ASR, OP_LDRB, 16))
 // LDRB Rd, [Rn, -Rm, ROR #]
-static INSN_REGPARM void arm756(u32 opcode)
-{
-	LDR_PREDEC(OFFSET_ROR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(756, REG, LDR_PREDEC(OFFSET_ROR, OP_LDRB, 16))
 // STRB Rd, [Rn, -Rm, LSL #]!
-static INSN_REGPARM void arm760(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_LSL, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(760, REG, STR_PREDEC_WB(OFFSET_LSL, OP_STRB, 16))
 // STRB Rd, [Rn, -Rm, LSR #]!
-static INSN_REGPARM void arm762(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_LSR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(762, REG, STR_PREDEC_WB(OFFSET_LSR, OP_STRB, 16))
 // STRB Rd, [Rn, -Rm, ASR #]!
-static INSN_REGPARM void arm764(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_ASR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(764, REG, STR_PREDEC_WB(OFFSET_ASR, OP_STRB, 16))
 // STRB Rd, [Rn, -Rm, ROR #]!
-static INSN_REGPARM void arm766(u32 opcode)
-{
-	STR_PREDEC_WB(OFFSET_ROR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(766, REG, STR_PREDEC_WB(OFFSET_ROR, OP_STRB, 16))
 // LDRB Rd, [Rn, -Rm, LSL #]!
-static INSN_REGPARM void arm770(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_LSL, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(770, REG, LDR_PREDEC_WB(OFFSET_LSL, OP_LDRB, 16))
 // LDRB Rd, [Rn, -Rm, LSR #]!
-static INSN_REGPARM void arm772(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_LSR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(772, REG, LDR_PREDEC_WB(OFFSET_LSR, OP_LDRB, 16))
 // LDRB Rd, [Rn, -Rm, ASR #]!
-static INSN_REGPARM void arm774(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_ASR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(774, REG, LDR_PREDEC_WB(OFFSET_ASR, OP_LDRB, 16))
 // LDRB Rd, [Rn, -Rm, ROR #]!
-static INSN_REGPARM void arm776(u32 opcode)
-{
-	LDR_PREDEC_WB(OFFSET_ROR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(776, REG, LDR_PREDEC_WB(OFFSET_ROR, OP_LDRB, 16))
 // STR Rd, [Rn, Rm, LSL #]
-static INSN_REGPARM void arm780(u32 opcode)
-{
-	STR_PREINC(OFFSET_LSL, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(780, REG, STR_PREINC(OFFSET_LSL, OP_STR, 32))
 // STR Rd, [Rn, Rm, LSR #]
-static INSN_REGPARM void arm782(u32 opcode)
-{
-	STR_PREINC(OFFSET_LSR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(782, REG, STR_PREINC(OFFSET_LSR, OP_STR, 32))
 // STR Rd, [Rn, Rm, ASR #]
-static INSN_REGPARM void arm784(u32 opcode)
-{
-	STR_PREINC(OFFSET_ASR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(784, REG, STR_PREINC(OFFSET_ASR, OP_STR, 32))
 // STR Rd, [Rn, Rm, ROR #]
-static INSN_REGPARM void arm786(u32 opcode)
-{
-	STR_PREINC(OFFSET_ROR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(786, REG, STR_PREINC(OFFSET_ROR, OP_STR, 32))
 // LDR Rd, [Rn, Rm, LSL #]
-static INSN_REGPARM void arm790(u32 opcode)
-{
-	LDR_PREINC(OFFSET_LSL, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(790, REG, LDR_PREINC(OFFSET_LSL, OP_LDR, 32))
 // LDR Rd, [Rn, Rm, LSR #]
-static INSN_REGPARM void arm792(u32 opcode)
-{
-	LDR_PREINC(OFFSET_LSR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(792, REG, LDR_PREINC(OFFSET_LSR, OP_LDR, 32))
 // LDR Rd, [Rn, Rm, ASR #]
-static INSN_REGPARM void arm794(u32 opcode)
-{
-	LDR_PREINC(OFFSET_ASR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(794, REG, LDR_PREINC(OFFSET_ASR, OP_LDR, 32))
 // LDR Rd, [Rn, Rm, ROR #]
-static INSN_REGPARM void arm796(u32 opcode)
-{
-	LDR_PREINC(OFFSET_ROR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(796, REG, LDR_PREINC(OFFSET_ROR, OP_LDR, 32))
 // STR Rd, [Rn, Rm, LSL #]!
-static INSN_REGPARM void arm7A0(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_LSL, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(7A0, REG, STR_PREINC_WB(OFFSET_LSL, OP_STR, 32))
 // STR Rd, [Rn, Rm, LSR #]!
-static INSN_REGPARM void arm7A2(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_LSR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(7A2, REG, STR_PREINC_WB(OFFSET_LSR, OP_STR, 32))
 // STR Rd, [Rn, Rm, ASR #]!
-static INSN_REGPARM void arm7A4(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_ASR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(7A4, REG, STR_PREINC_WB(OFFSET_ASR, OP_STR, 32))
 // STR Rd, [Rn, Rm, ROR #]!
-static INSN_REGPARM void arm7A6(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_ROR, OP_STR, 32);
-}
+DEFINE_OPERANDS_INSN(7A6, REG, STR_PREINC_WB(OFFSET_ROR, OP_STR, 32))
 // LDR Rd, [Rn, Rm, LSL #]!
-static INSN_REGPARM void arm7B0(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_LSL, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(7B0, REG, LDR_PREINC_WB(OFFSET_LSL, OP_LDR, 32))
 // LDR Rd, [Rn, Rm, LSR #]!
-static INSN_REGPARM void arm7B2(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_LSR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(7B2, REG, LDR_PREINC_WB(OFFSET_LSR, OP_LDR, 32))
 // LDR Rd, [Rn, Rm, ASR #]!
-static INSN_REGPARM void arm7B4(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_ASR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(7B4, REG, LDR_PREINC_WB(OFFSET_ASR, OP_LDR, 32))
 // LDR Rd, [Rn, Rm, ROR #]!
-static INSN_REGPARM void arm7B6(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_ROR, OP_LDR, 32);
-}
+DEFINE_OPERANDS_INSN(7B6, REG, LDR_PREINC_WB(OFFSET_ROR, OP_LDR, 32))
 // STRB Rd, [Rn, Rm, LSL #]
-static INSN_REGPARM void arm7C0(u32 opcode)
-{
-	STR_PREINC(OFFSET_LSL, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(7C0, REG, STR_PREINC(OFFSET_LSL, OP_STRB, 16))
 // STRB Rd, [Rn, Rm, LSR #]
-static INSN_REGPARM void arm7C2(u32 opcode)
-{
-	STR_PREINC(OFFSET_LSR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(7C2, REG, STR_PREINC(OFFSET_LSR, OP_STRB, 16))
 // STRB Rd, [Rn, Rm, ASR #]
-static INSN_REGPARM void arm7C4(u32 opcode)
-{
-	STR_PREINC(OFFSET_ASR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(7C4, REG, STR_PREINC(OFFSET_ASR, OP_STRB, 16))
 // STRB Rd, [Rn, Rm, ROR #]
-static INSN_REGPARM void arm7C6(u32 opcode)
-{
-	STR_PREINC(OFFSET_ROR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(7C6, REG, STR_PREINC(OFFSET_ROR, OP_STRB, 16))
 // LDRB Rd, [Rn, Rm, LSL #]
-static INSN_REGPARM void arm7D0(u32 opcode)
-{
-	LDR_PREINC(OFFSET_LSL, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(7D0, REG, LDR_PREINC(OFFSET_LSL, OP_LDRB, 16))
 // LDRB Rd, [Rn, Rm, LSR #]
-static INSN_REGPARM void arm7D2(u32 opcode)
-{
-	LDR_PREINC(OFFSET_LSR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(7D2, REG, LDR_PREINC(OFFSET_LSR, OP_LDRB, 16))
 // LDRB Rd, [Rn, Rm, ASR #]
-static INSN_REGPARM void arm7D4(u32 opcode)
-{
-	LDR_PREINC(OFFSET_ASR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(7D4, REG, LDR_PREINC(OFFSET_ASR, OP_LDRB, 16))
 // LDRB Rd, [Rn, Rm, ROR #]
-static INSN_REGPARM void arm7D6(u32 opcode)
-{
-	LDR_PREINC(OFFSET_ROR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(7D6, REG, LDR_PREINC(OFFSET_ROR, OP_LDRB, 16))
 // STRB Rd, [Rn, Rm, LSL #]!
-static INSN_REGPARM void arm7E0(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_LSL, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(7E0, REG, STR_PREINC_WB(OFFSET_LSL, OP_STRB, 16))
 // STRB Rd, [Rn, Rm, LSR #]!
-static INSN_REGPARM void arm7E2(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_LSR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(7E2, REG, STR_PREINC_WB(OFFSET_LSR, OP_STRB, 16))
 // STRB Rd, [Rn, Rm, ASR #]!
-static INSN_REGPARM void arm7E4(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_ASR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(7E4, REG, STR_PREINC_WB(OFFSET_ASR, OP_STRB, 16))
 // STRB Rd, [Rn, Rm, ROR #]!
-static INSN_REGPARM void arm7E6(u32 opcode)
-{
-	STR_PREINC_WB(OFFSET_ROR, OP_STRB, 16);
-}
+DEFINE_OPERANDS_INSN(7E6, REG, STR_PREINC_WB(OFFSET_ROR, OP_STRB, 16))
 // LDRB Rd, [Rn, Rm, LSL #]!
-static INSN_REGPARM void arm7F0(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_LSL, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(7F0, REG, LDR_PREINC_WB(OFFSET_LSL, OP_LDRB, 16))
 // LDRB Rd, [Rn, Rm, LSR #]!
-static INSN_REGPARM void arm7F2(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_LSR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(7F2, REG, LDR_PREINC_WB(OFFSET_LSR, OP_LDRB, 16))
 // LDRB Rd, [Rn, Rm, ASR #]!
-static INSN_REGPARM void arm7F4(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_ASR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(7F4, REG, LDR_PREINC_WB(OFFSET_ASR, OP_LDRB, 16))
 // LDRB Rd, [Rn, Rm, ROR #]!
-static INSN_REGPARM void arm7F6(u32 opcode)
-{
-	LDR_PREINC_WB(OFFSET_ROR, OP_LDRB, 16);
-}
+DEFINE_OPERANDS_INSN(7F6, REG, LDR_PREINC_WB(OFFSET_ROR, OP_LDRB, 16))
 
 // STM/LDM ////////////////////////////////////////////////////////////////
 
@@ -2568,7 +2117,6 @@ static INSN_REGPARM void armF00(u32 opcode)
 
 // Instruction table //////////////////////////////////////////////////////
 
-typedef INSN_REGPARM void (*insnfunc_t)(u32 opcode);
 #define REP16(insn) \
     insn,insn,insn,insn,insn,insn,insn,insn,\
     insn,insn,insn,insn,insn,insn,insn,insn
@@ -2758,102 +2306,423 @@ static insnfunc_t armInsnTable[4096] =
 	REP256(armF00),                                           // F00
 };
 
+// Handlers of the block cache taking the operands it extracted, the other
+// instructions run through armCachedOpcode
+struct ArmCachedHandler
+{
+	insnfunc_t func;
+	cachedfunc_t cached;
+};
+
+#define CACHED(CODE) { arm##CODE, arm##CODE##Cached }
+#define CACHED_ALU(CODE1, CODE2) \
+    CACHED(CODE1##0), CACHED(CODE1##1), CACHED(CODE1##2), CACHED(CODE1##3), \
+    CACHED(CODE1##4), CACHED(CODE1##5), CACHED(CODE1##6), CACHED(CODE1##7), \
+    CACHED(CODE2##0)
+static const ArmCachedHandler armCachedHandlers[] =
+{
+	CACHED_ALU(00, 20), CACHED_ALU(01, 21), CACHED_ALU(02, 22), CACHED_ALU(03, 23),
+	CACHED_ALU(04, 24), CACHED_ALU(05, 25), CACHED_ALU(06, 26), CACHED_ALU(07, 27),
+	CACHED_ALU(08, 28), CACHED_ALU(09, 29), CACHED_ALU(0A, 2A), CACHED_ALU(0B, 2B),
+	CACHED_ALU(0C, 2C), CACHED_ALU(0D, 2D), CACHED_ALU(0E, 2E), CACHED_ALU(0F, 2F),
+	CACHED_ALU(11, 31), CACHED_ALU(13, 33), CACHED_ALU(15, 35), CACHED_ALU(17, 37),
+	CACHED_ALU(18, 38), CACHED_ALU(19, 39), CACHED_ALU(1A, 3A), CACHED_ALU(1B, 3B),
+	CACHED_ALU(1C, 3C), CACHED_ALU(1D, 3D), CACHED_ALU(1E, 3E), CACHED_ALU(1F, 3F),
+	CACHED(00B), CACHED(04B), CACHED(08B), CACHED(0CB),
+	CACHED(10B), CACHED(12B), CACHED(14B), CACHED(16B),
+	CACHED(18B), CACHED(1AB), CACHED(1CB), CACHED(1EB),
+	CACHED(01B), CACHED(05B), CACHED(09B), CACHED(0DB),
+	CACHED(11B), CACHED(13B), CACHED(15B), CACHED(17B),
+	CACHED(19B), CACHED(1BB), CACHED(1DB), CACHED(1FB),
+	CACHED(01D), CACHED(05D), CACHED(09D), CACHED(0DD),
+	CACHED(11D), CACHED(13D), CACHED(15D), CACHED(17D),
+	CACHED(19D), CACHED(1BD), CACHED(1DD), CACHED(1FD),
+	CACHED(01F), CACHED(05F), CACHED(09F), CACHED(0DF),
+	CACHED(11F), CACHED(13F), CACHED(15F), CACHED(17F),
+	CACHED(19F), CACHED(1BF), CACHED(1DF), CACHED(1FF),
+	CACHED(400), CACHED(410), CACHED(440), CACHED(450),
+	CACHED(480), CACHED(490), CACHED(4C0), CACHED(4D0),
+	CACHED(500), CACHED(510), CACHED(520), CACHED(530),
+	CACHED(540), CACHED(550), CACHED(560), CACHED(570),
+	CACHED(580), CACHED(590), CACHED(5A0), CACHED(5B0),
+	CACHED(5C0), CACHED(5D0), CACHED(5E0), CACHED(5F0),
+	CACHED(600), CACHED(602), CACHED(604), CACHED(606),
+	CACHED(610), CACHED(612), CACHED(614), CACHED(616),
+	CACHED(640), CACHED(642), CACHED(644), CACHED(646),
+	CACHED(650), CACHED(652), CACHED(654), CACHED(656),
+	CACHED(680), CACHED(682), CACHED(684), CACHED(686),
+	CACHED(690), CACHED(692), CACHED(694), CACHED(696),
+	CACHED(6C0), CACHED(6C2), CACHED(6C4), CACHED(6C6),
+	CACHED(6D0), CACHED(6D2), CACHED(6D4), CACHED(6D6),
+	CACHED(700), CACHED(702), CACHED(704), CACHED(706),
+	CACHED(710), CACHED(712), CACHED(714), CACHED(716),
+	CACHED(720), CACHED(722), CACHED(724), CACHED(726),
+	CACHED(730), CACHED(732), CACHED(734), CACHED(736),
+	CACHED(740), CACHED(742), CACHED(744), CACHED(746),
+	CACHED(750), CACHED(752), CACHED(754), CACHED(756),
+	CACHED(760), CACHED(762), CACHED(764), CACHED(766),
+	CACHED(770), CACHED(772), CACHED(774), CACHED(776),
+	CACHED(780), CACHED(782), CACHED(784), CACHED(786),
+	CACHED(790), CACHED(792), CACHED(794), CACHED(796),
+	CACHED(7A0), CACHED(7A2), CACHED(7A4), CACHED(7A6),
+	CACHED(7B0), CACHED(7B2), CACHED(7B4), CACHED(7B6),
+	CACHED(7C0), CACHED(7C2), CACHED(7C4), CACHED(7C6),
+	CACHED(7D0), CACHED(7D2), CACHED(7D4), CACHED(7D6),
+	CACHED(7E0), CACHED(7E2), CACHED(7E4), CACHED(7E6),
+	CACHED(7F0), CACHED(7F2), CACHED(7F4), CACHED(7F6),
+};
+
+static INSN_REGPARM void armCachedOpcode(const ArmCachedInsn *insn)
+{
+	(*insn->func)(insn->opcode);
+}
+
+static cachedfunc_t armCachedTable[4096];
+
+static void armCachedTableInit()
+{
+	for (int i = 0; i < 4096; i++)
+	{
+		armCachedTable[i] = armCachedOpcode;
+		for (size_t j = 0; j < G_N_ELEMENTS(armCachedHandlers); j++)
+		{
+			if (armCachedHandlers[j].func == armInsnTable[i])
+			{
+				armCachedTable[i] = armCachedHandlers[j].cached;
+				break;
+			}
+		}
+	}
+}
+
+static void armCacheFill(ArmCachedInsn *insn, u32 opcode)
+{
+	int index = ((opcode>>16)&0xFF0) | ((opcode>>4)&0x0F);
+	ArmOperandsKind kind;
+
+	switch ((opcode >> 25) & 7)
+	{
+	case 1:
+		kind = ARM_OPERANDS_IMM;
+		break;
+	case 2:
+		kind = ARM_OPERANDS_OFFSET;
+		break;
+	case 0:
+		// LDRH, STRH, LDRSB and LDRSH with an immediate offset
+		if ((opcode & 0x00400090) == 0x00400090)
+		{
+			kind = ARM_OPERANDS_OFFSET8;
+			break;
+		}
+		// Fall through
+	default:
+		kind = ARM_OPERANDS_REG;
+		break;
+	}
+
+	insn->func = armInsnTable[index];
+	insn->cached = armCachedTable[index];
+	insn->opcode = opcode;
+	insn->cond = opcode >> 28;
+	insn->op = armOperandsDecode(opcode, kind);
+}
+
+// Block cache ////////////////////////////////////////////////////////////
+
+// ARM code running from IWRAM and EWRAM is decoded once into the cache below
+// and then executed without going through the prefetch, the condition
+// decoding and the instruction table again. The data processing and
+// load/store instructions also keep their operands extracted, and run through
+// their arm<CODE>Cached handlers. Each slot maps to one word of RAM, so a
+// write to RAM only has to drop the slot of the word it touches.
+//
+// Note that the cache bypasses the prefetch pipeline: code overwriting the
+// instruction right after the one being executed sees the new opcode, where
+// the hardware would still execute the prefetched one.
+
+// Maximum number of instructions decoded in one go on a cache miss
+#define ARM_CACHE_RUN_MAX 32
+
+static ArmCachedInsn armCacheWorkRAM[0x40000 >> 2];
+static ArmCachedInsn armCacheInternalRAM[0x8000 >> 2];
+
+static inline ArmCachedInsn *armCacheEntry(u32 address)
+{
+	switch (address >> 24)
+	{
+	case 0x02:
+		return &armCacheWorkRAM[(address & 0x3FFFF) >> 2];
+	case 0x03:
+		return &armCacheInternalRAM[(address & 0x7FFF) >> 2];
+	default:
+		return NULL;
+	}
+}
+
+static inline bool armInsnEndsRun(u32 opcode)
+{
+	// B, BL, SWI and BX
+	if (((opcode >> 25) & 7) == 5 || ((opcode >> 24) & 0x0F) == 0x0F)
+		return true;
+	if ((opcode & 0x0FFFFFF0) == 0x012FFF10)
+		return true;
+	// LDM with PC in the register list
+	if (((opcode >> 25) & 7) == 4 && (opcode & 0x00108000) == 0x00108000)
+		return true;
+	// Data processing or LDR with PC as the destination
+	if (((opcode >> 26) & 3) != 2 && ((opcode >> 12) & 0x0F) == 15)
+		return true;
+	return false;
+}
+
+static void armCacheDecode(u32 address)
+{
+	for (int i = 0; i < ARM_CACHE_RUN_MAX; i++, address += 4)
+	{
+		ArmCachedInsn *insn = armCacheEntry(address);
+		if (insn == NULL || insn->func != NULL)
+			break;
+
+		u32 opcode = MMU::read32(address);
+		armCacheFill(insn, opcode);
+		if ((address >> 24) == 3)
+			iwramCode[(address & 0x7FFF) >> IWRAM_CODE_SHIFT] = 1;
+
+		if (armInsnEndsRun(opcode))
+			break;
+	}
+}
+
+// SWI runs the BIOS and SWP reads the word it writes, running them twice
+// would not give the same result
+static inline bool armInsnRunsOnce(u32 opcode)
+{
+	return ((opcode >> 24) & 0x0F) == 0x0F || (opcode & 0x0FB00FF0) == 0x01000090;
+}
+
+// Compare a cached instruction with the one the interpreter would have
+// fetched, and decode it again if they differ. This is all the self-check
+// does for the instructions that can only run once.
+static void armCacheCheck(ArmCachedInsn *insn, u32 address)
+{
+	u32 opcode = MMU::read32(address);
+	insnfunc_t func = armInsnTable[((opcode>>16)&0xFF0) | ((opcode>>4)&0x0F)];
+
+	if (insn->opcode != opcode || insn->func != func || insn->cond != opcode >> 28)
+	{
+		g_message("ARM block cache mismatch at %08x: cached %08x, memory %08x\n",
+		    address, insn->opcode, opcode);
+
+		armCacheFill(insn, opcode);
+	}
+}
+
+void armCacheInvalidate(u32 address)
+{
+	ArmCachedInsn *insn = armCacheEntry(address);
+	if (insn != NULL)
+		insn->func = NULL;
+}
+
+void armCacheInvalidateRange(u32 address, u32 length)
+{
+	ArmCachedInsn *insn = armCacheEntry(address);
+	if (insn == NULL)
+		return;
+
+	for (u32 words = ((address & 3) + length + 3) >> 2; words > 0; words--)
+		(insn++)->func = NULL;
+}
+
+void armCacheFlush()
+{
+	if (armCachedTable[0] == NULL)
+		armCachedTableInit();
+
+	memset(armCacheWorkRAM, 0, sizeof(armCacheWorkRAM));
+	memset(armCacheInternalRAM, 0, sizeof(armCacheInternalRAM));
+}
+
 // Wrapper routine (execution loop) ///////////////////////////////////////
 
+static inline bool armConditionPassed(u32 cond)
+{
+	switch (cond)
+	{
+	case 0x00: // EQ
+		return Z_FLAG();
+	case 0x01: // NE
+		return !Z_FLAG();
+	case 0x02: // CS
+		return C_FLAG();
+	case 0x03: // CC
+		return !C_FLAG();
+	case 0x04: // MI
+		return N_FLAG();
+	case 0x05: // PL
+		return !N_FLAG();
+	case 0x06: // VS
+		return V_FLAG();
+	case 0x07: // VC
+		return !V_FLAG();
+	case 0x08: // HI
+		return C_FLAG() && !Z_FLAG();
+	case 0x09: // LS
+		return !C_FLAG() || Z_FLAG();
+	case 0x0A: // GE
+		return N_FLAG() == V_FLAG();
+	case 0x0B: // LT
+		return N_FLAG() != V_FLAG();
+	case 0x0C: // GT
+		return !Z_FLAG() &&(N_FLAG() == V_FLAG());
+	case 0x0D: // LE
+		return Z_FLAG() || (N_FLAG() != V_FLAG());
+	case 0x0E: // AL
+		return true;
+	case 0x0F:
+	default:
+		// ???
+		return false;
+	}
+}
+
+// Run the instruction the cache has just run at address again through the
+// interpreter and compare both runs. The cached run is the one kept, the
+// entry is dropped to be decoded again if they differ.
+static void armSelfCheck(ArmCachedInsn *insn, u32 address)
+{
+	selfCheckReplay(clockTicks);
+
+	u32 opcode = MMU::read32(address);
+	if (insn->opcode != opcode)
+	{
+		g_message("ARM block cache mismatch at %08x: cached %08x, memory %08x\n",
+		    address, insn->opcode, opcode);
+	}
+
+	busPrefetch = false;
+	if (busPrefetchCount & 0xFFFFFE00)
+		busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+
+	armNextPC = reg[15].I;
+	reg[15].I += 4;
+	ARM_PREFETCH_NEXT();
+
+	clockTicks = 0;
+
+	u32 cond = opcode >> 28;
+	if (cond == 0x0E || armConditionPassed(cond))
+		(*armInsnTable[((opcode>>16)&0xFF0) | ((opcode>>4)&0x0F)])(opcode);
+
+	if (!selfCheckEnd("ARM block cache", address, opcode, clockTicks) || insn->opcode != opcode)
+		insn->func = NULL;
+}
+
 int armExecute()
 {
+	bool selfCheck = settings_cpu_self_check();
+	// Set when cpuPrefetch has not been kept up to date by cached execution
+	bool prefetchStale = false;
+
+	idleLoopRestart();
+
 	do
 	{
-		if ((armNextPC & 0x0803FFFF) == 0x08020000)
-			busPrefetchCount = 0x100;
+		insnfunc_t func;
+		u32 opcode;
+		u32 cond;
+		int oldArmNextPC = armNextPC;
+		bool checking = false;
 
-		u32 opcode = cpuPrefetch[0];
-		cpuPrefetch[0] = cpuPrefetch[1];
+		ArmCachedInsn *insn = armCacheEntry(armNextPC);
+		if (insn != NULL)
+		{
+			if (UNLIKELY(insn->func == NULL))
+				armCacheDecode(armNextPC);
 
-		busPrefetch = false;
-		if (busPrefetchCount & 0xFFFFFE00)
-			busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+			if (UNLIKELY(selfCheck))
+			{
+				if (armInsnRunsOnce(insn->opcode))
+					armCacheCheck(insn, armNextPC);
+				else
+				{
+					selfCheckBegin();
+					checking = true;
+				}
+			}
 
-		clockTicks = 0;
-		int oldArmNextPC = armNextPC;
+			cond = insn->cond;
+			prefetchStale = true;
 
-		armNextPC = reg[15].I;
-		reg[15].I += 4;
-		ARM_PREFETCH_NEXT();
+			busPrefetch = false;
+			if (busPrefetchCount & 0xFFFFFE00)
+				busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
 
-		int cond = opcode >> 28;
-		bool cond_res = true;
-		if (UNLIKELY(cond != 0x0E))    // most opcodes are AL (always)
+			armNextPC = reg[15].I;
+			reg[15].I += 4;
+		}
+		else
 		{
-			switch (cond)
+			if (prefetchStale)
 			{
-			case 0x00: // EQ
-				cond_res = Z_FLAG;
-				break;
-			case 0x01: // NE
-				cond_res = !Z_FLAG;
-				break;
-			case 0x02: // CS
-				cond_res = C_FLAG;
-				break;
-			case 0x03: // CC
-				cond_res = !C_FLAG;
-				break;
-			case 0x04: // MI
-				cond_res = N_FLAG;
-				break;
-			case 0x05: // PL
-				cond_res = !N_FLAG;
-				break;
-			case 0x06: // VS
-				cond_res = V_FLAG;
-				break;
-			case 0x07: // VC
-				cond_res = !V_FLAG;
-				break;
-			case 0x08: // HI
-				cond_res = C_FLAG && !Z_FLAG;
-				break;
-			case 0x09: // LS
-				cond_res = !C_FLAG || Z_FLAG;
-				break;
-			case 0x0A: // GE
-				cond_res = N_FLAG == V_FLAG;
-				break;
-			case 0x0B: // LT
-				cond_res = N_FLAG != V_FLAG;
-				break;
-			case 0x0C: // GT
-				cond_res = !Z_FLAG &&(N_FLAG == V_FLAG);
-				break;
-			case 0x0D: // LE
-				cond_res = Z_FLAG || (N_FLAG != V_FLAG);
-				break;
-			case 0x0E: // AL (impossible, checked above)
-				cond_res = true;
-				break;
-			case 0x0F:
-			default:
-				// ???
-				cond_res = false;
-				break;
+				ARM_PREFETCH();
+				prefetchStale = false;
 			}
+
+			if ((armNextPC & 0x0803FFFF) == 0x08020000)
+				busPrefetchCount = 0x100;
+
+			opcode = cpuPrefetch[0];
+			cpuPrefetch[0] = cpuPrefetch[1];
+
+			busPrefetch = false;
+			if (busPrefetchCount & 0xFFFFFE00)
+				busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+
+			armNextPC = reg[15].I;
+			reg[15].I += 4;
+			ARM_PREFETCH_NEXT();
+
+			func = armInsnTable[((opcode>>16)&0xFF0) | ((opcode>>4)&0x0F)];
+			cond = opcode >> 28;
 		}
 
-		if (cond_res)
-			(*armInsnTable[((opcode>>16)&0xFF0) | ((opcode>>4)&0x0F)])(opcode);
+		clockTicks = 0;
+
+		// most opcodes are AL (always)
+		if (LIKELY(cond == 0x0E) || armConditionPassed(cond))
+		{
+			if (insn != NULL)
+				(*insn->cached)(insn);
+			else
+				(*func)(opcode);
+		}
+
+		if (UNLIKELY(checking))
+			armSelfCheck(insn, oldArmNextPC);
 
 		if (clockTicks < 0)
+		{
+			if (prefetchStale && armState)
+				ARM_PREFETCH();
 			return 0;
+		}
 		if (clockTicks == 0)
 			clockTicks = 1 + codeTicksAccessSeq32(oldArmNextPC);
 		cpuTotalTicks += clockTicks;
 
+		if (UNLIKELY(armNextPC < (u32)oldArmNextPC) && idleLoopEnabled)
+			idleLoopBranch(oldArmNextPC, armNextPC);
+
 	}
 	while (cpuTotalTicks<cpuNextEvent && armState && !holdState);
 
+	// Leave the pipeline as the interpreter expects to find it
+	if (prefetchStale && armState)
+		ARM_PREFETCH();
+
 	return 1;
 }
 
 } // namespace CPU
-
@@ -0,0 +1,2051 @@
+#include "GBA.h"
+#include "CPU.h"
+#include "Globals.h"
+#include "MMU.h"
+#include "../common/Settings.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+namespace CPU
+{
+
+#ifdef JIT_X86_64
+
+// Thumb recompiler ///////////////////////////////////////////////////////
+
+// Thumb code from ROM and IWRAM reached often enough is recompiled to x86-64
+// code, one block of straight-line code at a time. A block ends at the first
+// branch, or at the first instruction that can leave Thumb state, and runs
+// until then without going back to thumbExecute, unless an event is due.
+//
+// Within a block, rbx points to reg[] and every other global is addressed
+// from it. ebp holds cpuTotalTicks, r12d and r13d the values N and Z are
+// worked out from, as flagsN and flagsZ do, and r14d and r15d the C and V
+// flags. A few guest registers are kept in host registers, and written back
+// as soon as they change, so that reg[] is always up to date.
+//
+// The timings are those of the interpreter: the code fetch ticks are
+// computed at compile time when the state of the prefetch buffer is known,
+// the data ticks at run time from the region accessed. Loads and stores go
+// through the page tables like the interpreter does, and through the MMU
+// for the regions with handlers. The instructions the recompiler does not
+// handle, like the multiple loads and stores, the SWI or BX, run through the
+// interpreter handlers from within the block.
+//
+// Writes to IWRAM drop the blocks compiled from the words written, see
+// iwramCode. Writing WAITCNT or reloading the memory drops all the blocks.
+
+// Size of the code buffer, all the blocks are dropped once it is full
+#define JIT_CODE_SIZE (8 << 20)
+// Maximum number of instructions in a block
+#define JIT_BLOCK_INSNS 64
+// Room to leave in the code buffer for compiling a block
+#define JIT_BLOCK_CODE_MAX ((JIT_BLOCK_INSNS + 2) * 768)
+// Number of times an address is run by the interpreter before it is compiled
+#define JIT_HOT_RUNS 8
+// Size of the lazily allocated ROM pages of the block table
+#define JIT_PAGE_SHIFT 12
+#define JIT_PAGE_ENTRIES (1 << (JIT_PAGE_SHIFT - 1))
+
+// Block starting at a halfword of code
+struct JitEntry
+{
+	const u8 *code; // NULL when not compiled
+	u16 length; // in bytes
+	u8 runs; // times the interpreter ran the address
+	bool rejected; // the first instruction cannot be compiled
+};
+
+static JitEntry jitIwram[0x8000 >> 1];
+// Halfwords of IWRAM that have been compiled in a block
+static u8 jitIwramCovered[0x8000 >> 1];
+static JitEntry *jitRomPages[0x6000000 >> JIT_PAGE_SHIFT];
+
+static u8 *jitCode = NULL;
+static u8 *jitCodePtr;
+static u8 *jitCodeBlocks; // first byte after the thunks
+static bool jitAvailable = true;
+static bool jitFlushPending = true;
+static bool jitCompiledSelfCheck;
+
+// Set by the C code called from a block for it to stop after the
+// instruction, when the block itself has been dropped
+static bool jitStop;
+static JitEntry *jitCurrent;
+
+// Emitter ////////////////////////////////////////////////////////////////
+
+enum JitReg
+{
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15,
+	JIT_NO_REG = -1
+};
+
+enum JitAlu
+{
+	ALU_ADD, ALU_OR, ALU_ADC, ALU_SBB, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP
+};
+
+enum JitShift
+{
+	SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7
+};
+
+enum JitCondition
+{
+	CC_O, CC_NO, CC_B, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+	CC_S, CC_NS, CC_P, CC_NP, CC_L, CC_GE, CC_LE, CC_G
+};
+
+// Memory operand, [base + index * (1 << scale) + disp]
+struct JitMem
+{
+	int base;
+	int index;
+	int scale;
+	s32 disp;
+};
+
+static inline JitMem jitMem(int base, s32 disp = 0)
+{
+	JitMem m = { base, JIT_NO_REG, 0, disp };
+	return m;
+}
+
+static inline JitMem jitMemIndex(int base, int index, int scale, s32 disp = 0)
+{
+	JitMem m = { base, index, scale, disp };
+	return m;
+}
+
+// Global variable, addressed from rbx
+static inline JitMem jitVar(const void *variable)
+{
+	return jitMem(RBX, (s32)((const u8 *)variable - (const u8 *)reg));
+}
+
+static inline JitMem jitGuest(int r)
+{
+	return jitMem(RBX, r * 4);
+}
+
+static inline void jitEmit8(u8 value)
+{
+	*jitCodePtr++ = value;
+}
+
+static inline void jitEmit32(u32 value)
+{
+	memcpy(jitCodePtr, &value, 4);
+	jitCodePtr += 4;
+}
+
+static inline void jitEmit64(u64 value)
+{
+	memcpy(jitCodePtr, &value, 8);
+	jitCodePtr += 8;
+}
+
+static void jitEmitOpcode(u32 opcode, int length)
+{
+	for (int i = length - 1; i >= 0; i--)
+		jitEmit8(opcode >> (i * 8));
+}
+
+static void jitEmitRex(bool wide, int r, int x, int b, bool byteReg)
+{
+	u8 rex = 0x40 | (wide ? 8 : 0) | ((r & 8) ? 4 : 0) | ((x & 8) ? 2 : 0) | ((b & 8) ? 1 : 0);
+	if (rex != 0x40 || byteReg)
+		jitEmit8(rex);
+}
+
+// Instruction with a register and a memory operand. The displacement is
+// always 32 bits.
+static void jitEmitM(bool wide, u32 opcode, int length, int r, const JitMem &m, bool byteReg = false)
+{
+	int index = m.index == JIT_NO_REG ? 0 : m.index;
+	jitEmitRex(wide, r, index, m.base, byteReg && r >= RSP && r <= RDI);
+	jitEmitOpcode(opcode, length);
+
+	bool sib = m.index != JIT_NO_REG || (m.base & 7) == RSP;
+	jitEmit8(0x80 | ((r & 7) << 3) | (sib ? 4 : (m.base & 7)));
+	if (sib)
+		jitEmit8((m.scale << 6) | ((m.index == JIT_NO_REG ? 4 : (m.index & 7)) << 3) | (m.base & 7));
+	jitEmit32(m.disp);
+}
+
+// Instruction with two register operands
+static void jitEmitR(bool wide, u32 opcode, int length, int r, int rm, bool byteReg = false)
+{
+	jitEmitRex(wide, r, 0, rm, byteReg && ((r >= RSP && r <= RDI) || (rm >= RSP && rm <= RDI)));
+	jitEmitOpcode(opcode, length);
+	jitEmit8(0xC0 | ((r & 7) << 3) | (rm & 7));
+}
+
+static void jitMov(int dst, int src)
+{
+	if (dst != src)
+		jitEmitR(false, 0x8B, 1, dst, src);
+}
+
+static void jitMovImm(int dst, u32 value)
+{
+	jitEmitRex(false, 0, 0, dst, false);
+	jitEmit8(0xB8 + (dst & 7));
+	jitEmit32(value);
+}
+
+static void jitMovImm64(int dst, const void *value)
+{
+	jitEmitRex(true, 0, 0, dst, false);
+	jitEmit8(0xB8 + (dst & 7));
+	jitEmit64((u64)(uintptr_t)value);
+}
+
+static void jitLoad(int dst, const JitMem &m)
+{
+	jitEmitM(false, 0x8B, 1, dst, m);
+}
+
+static void jitLoad64(int dst, const JitMem &m)
+{
+	jitEmitM(true, 0x8B, 1, dst, m);
+}
+
+static void jitLoadU8(int dst, const JitMem &m)
+{
+	jitEmitM(false, 0x0FB6, 2, dst, m);
+}
+
+static void jitLoadS8(int dst, const JitMem &m)
+{
+	jitEmitM(false, 0x0FBE, 2, dst, m);
+}
+
+static void jitLoadU16(int dst, const JitMem &m)
+{
+	jitEmitM(false, 0x0FB7, 2, dst, m);
+}
+
+static void jitLoadS16(int dst, const JitMem &m)
+{
+	jitEmitM(false, 0x0FBF, 2, dst, m);
+}
+
+static void jitStore(const JitMem &m, int src)
+{
+	jitEmitM(false, 0x89, 1, src, m);
+}
+
+static void jitStore16(const JitMem &m, int src)
+{
+	jitEmit8(0x66);
+	jitEmitM(false, 0x89, 1, src, m);
+}
+
+static void jitStore8(const JitMem &m, int src)
+{
+	jitEmitM(false, 0x88, 1, src, m, true);
+}
+
+static void jitStoreImm(const JitMem &m, u32 value)
+{
+	jitEmitM(false, 0xC7, 1, 0, m);
+	jitEmit32(value);
+}
+
+static void jitStore8Imm(const JitMem &m, u8 value)
+{
+	jitEmitM(false, 0xC6, 1, 0, m);
+	jitEmit8(value);
+}
+
+static void jitLea(int dst, const JitMem &m)
+{
+	jitEmitM(false, 0x8D, 1, dst, m);
+}
+
+static void jitLea64(int dst, const JitMem &m)
+{
+	jitEmitM(true, 0x8D, 1, dst, m);
+}
+
+static void jitAlu(JitAlu op, int dst, int src)
+{
+	jitEmitR(false, (op << 3) | 1, 1, src, dst);
+}
+
+static void jitAlu64(JitAlu op, int dst, int src)
+{
+	jitEmitR(true, (op << 3) | 1, 1, src, dst);
+}
+
+static void jitAluImm(JitAlu op, int dst, u32 value)
+{
+	if ((s32)value >= -128 && (s32)value <= 127)
+	{
+		jitEmitR(false, 0x83, 1, op, dst);
+		jitEmit8(value);
+	}
+	else
+	{
+		jitEmitR(false, 0x81, 1, op, dst);
+		jitEmit32(value);
+	}
+}
+
+static void jitAlu64Imm(JitAlu op, int dst, s8 value)
+{
+	jitEmitR(true, 0x83, 1, op, dst);
+	jitEmit8(value);
+}
+
+// dst op= [m]
+static void jitAluMem(JitAlu op, int dst, const JitMem &m)
+{
+	jitEmitM(false, (op << 3) | 3, 1, dst, m);
+}
+
+static void jitAlu64Mem(JitAlu op, int dst, const JitMem &m)
+{
+	jitEmitM(true, (op << 3) | 3, 1, dst, m);
+}
+
+static void jitCmpMemZero(const JitMem &m)
+{
+	jitEmitM(false, 0x83, 1, ALU_CMP, m);
+	jitEmit8(0);
+}
+
+static void jitCmp8MemImm(const JitMem &m, u8 value)
+{
+	jitEmitM(false, 0x80, 1, ALU_CMP, m);
+	jitEmit8(value);
+}
+
+static void jitTest(int a, int b)
+{
+	jitEmitR(false, 0x85, 1, b, a);
+}
+
+static void jitTest64(int a, int b)
+{
+	jitEmitR(true, 0x85, 1, b, a);
+}
+
+static void jitTestImm(int r, u32 value)
+{
+	jitEmitR(false, 0xF7, 1, 0, r);
+	jitEmit32(value);
+}
+
+static void jitShiftImm(JitShift op, int r, int count)
+{
+	jitEmitR(false, 0xC1, 1, op, r);
+	jitEmit8(count);
+}
+
+static void jitShiftCl(JitShift op, int r)
+{
+	jitEmitR(false, 0xD3, 1, op, r);
+}
+
+static void jitNot(int r)
+{
+	jitEmitR(false, 0xF7, 1, 2, r);
+}
+
+static void jitSetcc(JitCondition cc, int r)
+{
+	jitEmitR(false, 0x0F90 | cc, 2, 0, r, true);
+}
+
+static void jitBt(int r, int bit)
+{
+	jitEmitR(false, 0x0FBA, 2, 4, r);
+	jitEmit8(bit);
+}
+
+// Jumps with a 32 bits displacement, returning where to patch it
+static u8 *jitJcc(JitCondition cc)
+{
+	jitEmit8(0x0F);
+	jitEmit8(0x80 | cc);
+	jitEmit32(0);
+	return jitCodePtr - 4;
+}
+
+static u8 *jitJmp()
+{
+	jitEmit8(0xE9);
+	jitEmit32(0);
+	return jitCodePtr - 4;
+}
+
+static void jitPatch(u8 *jump, const u8 *target)
+{
+	s32 offset = (s32)(target - (jump + 4));
+	memcpy(jump, &offset, 4);
+}
+
+// Point a jump at the code emitted next
+static void jitPatchHere(u8 *jump)
+{
+	jitPatch(jump, jitCodePtr);
+}
+
+static void jitJmpTo(const u8 *target)
+{
+	jitPatch(jitJmp(), target);
+}
+
+static void jitCallTo(const u8 *target)
+{
+	jitEmit8(0xE8);
+	jitEmit32(0);
+	jitPatch(jitCodePtr - 4, target);
+}
+
+// Call a C function, which may be too far for a 32 bits displacement
+static void jitCallC(const void *function)
+{
+	jitMovImm64(RAX, function);
+	jitEmitR(false, 0xFF, 1, 2, RAX);
+}
+
+static void jitPush(int r)
+{
+	jitEmitRex(false, 0, 0, r, false);
+	jitEmit8(0x50 + (r & 7));
+}
+
+static void jitPop(int r)
+{
+	jitEmitRex(false, 0, 0, r, false);
+	jitEmit8(0x58 + (r & 7));
+}
+
+static void jitRet()
+{
+	jitEmit8(0xC3);
+}
+
+// Thunks //////////////////////////////////////////////////////////////////
+
+typedef u32 (*JitEnterFunc)(const u8 *code);
+
+// Size of the data loads, as the load thunks are indexed
+enum JitLoadKind
+{
+	JIT_LOAD_32, JIT_LOAD_U16, JIT_LOAD_S16, JIT_LOAD_U8, JIT_LOAD_S8, JIT_LOAD_KINDS
+};
+
+static JitEnterFunc jitEnter;
+static const u8 *jitExitThunk; // eax: next address, edx: last address
+static const u8 *jitExitKeepThunk; // edx: last address, armNextPC already set
+// eax: address, edx: next address, returns the value in ecx. Indexed by the
+// kind of load, then by whether the data ticks are those of a word access.
+static const u8 *jitLoadThunks[JIT_LOAD_KINDS][2];
+// eax: address, ecx: value, edx: next address. Indexed by the log2 of the
+// size, then by whether the writes may bypass the MMU.
+static const u8 *jitStoreThunks[3][2];
+static const u8 *jitCheckBeginThunk; // edx: address
+static const u8 *jitCheckEndThunk; // edx: address, ecx: next address
+static const u8 *jitCheckEndKeepThunk; // edx: address, armNextPC already set
+
+// Host registers the guest registers are cached in. They are saved around
+// the calls to C code.
+static const int jitCacheRegs[] = { RSI, RDI, R8, R9, R10 };
+#define JIT_CACHE_SLOTS 5
+
+static u32 jitRead32(u32 address)
+{
+	return MMU::read32(address);
+}
+
+static u32 jitRead16(u32 address)
+{
+	return MMU::read16(address);
+}
+
+static u32 jitRead16s(u32 address)
+{
+	return (s16)MMU::read16s(address);
+}
+
+static u32 jitRead8(u32 address)
+{
+	return MMU::read8(address);
+}
+
+static u32 jitRead8s(u32 address)
+{
+	return (s8)MMU::read8(address);
+}
+
+static void jitWrite32(u32 address, u32 value)
+{
+	MMU::write32(address, value);
+}
+
+static void jitWrite16(u32 address, u32 value)
+{
+	MMU::write16(address, value);
+}
+
+static void jitWrite8(u32 address, u32 value)
+{
+	MMU::write8(address, value);
+}
+
+static void jitEmitFlagsStore()
+{
+	jitStore(jitVar(&flagsN), R12);
+	jitStore(jitVar(&flagsZ), R13);
+	jitStore8(jitVar(&flagsC), R14);
+	jitStore8(jitVar(&flagsV), R15);
+	jitStore8Imm(jitVar(&flagsCLazy), 0);
+	jitStore8Imm(jitVar(&flagsVLazy), 0);
+}
+
+// The flags must not be lazy
+static void jitEmitFlagsLoad()
+{
+	jitLoad(R12, jitVar(&flagsN));
+	jitLoad(R13, jitVar(&flagsZ));
+	jitLoadU8(R14, jitVar(&flagsC));
+	jitLoadU8(R15, jitVar(&flagsV));
+}
+
+static void jitEmitCacheSave()
+{
+	for (int i = 0; i < JIT_CACHE_SLOTS; i++)
+		jitPush(jitCacheRegs[i]);
+}
+
+static void jitEmitCacheRestore()
+{
+	for (int i = JIT_CACHE_SLOTS - 1; i >= 0; i--)
+		jitPop(jitCacheRegs[i]);
+}
+
+// Set armNextPC and reg[15] for the instruction at the address in edx + 2
+// to be seen running by C code
+static void jitEmitNextPCStore()
+{
+	jitStore(jitVar(&armNextPC), RDX);
+	jitLea(R11, jitMem(RDX, 2));
+	jitStore(jitGuest(15), R11);
+}
+
+// if (busPrefetchCount == 0) busPrefetch = busPrefetchEnable;
+static void jitEmitAccessStart()
+{
+	jitCmpMemZero(jitVar(&busPrefetchCount));
+	u8 *skip = jitJcc(CC_NE);
+	jitLoadU8(R11, jitVar(&busPrefetchEnable));
+	jitStore8(jitVar(&busPrefetch), R11);
+	jitPatchHere(skip);
+}
+
+// Data ticks of the access to the address in eax, as dataTicksAccess16 and
+// dataTicksAccess32 do, then return. Keeps ecx.
+static void jitEmitDataTicksRet(bool access32)
+{
+	jitMov(R11, RAX);
+	jitShiftImm(SHIFT_SHR, R11, 24);
+	jitAluImm(ALU_AND, R11, 15);
+	jitLea64(R11, jitMemIndex(R11, R11, 1));
+	jitLea64(R11, jitMemIndex(RBX, R11, 1, jitVar(waitStates).disp));
+
+	jitLoadU8(RAX, jitMem(R11, access32 ? offsetof(WaitStates, access32) : offsetof(WaitStates, access16)));
+	jitAlu(ALU_ADD, RBP, RAX);
+
+	jitCmp8MemImm(jitMem(R11, offsetof(WaitStates, stopsPrefetch)), 0);
+	u8 *keeps = jitJcc(CC_E);
+	jitStoreImm(jitVar(&busPrefetchCount), 0);
+	jitStore8Imm(jitVar(&busPrefetch), 0);
+	jitRet();
+
+	// busPrefetchCount = ((busPrefetchCount + 1) << max(ticks, 1)) - 1
+	jitPatchHere(keeps);
+	jitCmp8MemImm(jitVar(&busPrefetch), 0);
+	u8 *off = jitJcc(CC_E);
+	jitMov(RDX, RCX);
+	jitMov(RCX, RAX);
+	jitAluImm(ALU_CMP, RCX, 1);
+	jitAluImm(ALU_ADC, RCX, 0);
+	jitLoad(RAX, jitVar(&busPrefetchCount));
+	jitAluImm(ALU_ADD, RAX, 1);
+	jitShiftCl(SHIFT_SHL, RAX);
+	jitAluImm(ALU_SUB, RAX, 1);
+	jitStore(jitVar(&busPrefetchCount), RAX);
+	jitMov(RCX, RDX);
+	jitPatchHere(off);
+	jitRet();
+}
+
+// Call a C function taking the address in eax and the value in ecx, from a
+// thunk. The registers the thunk works with are saved, but eax and ecx.
+static void jitEmitThunkCall(const void *function)
+{
+	jitEmitNextPCStore();
+	jitStore(jitVar(&cpuTotalTicks), RBP);
+	jitPush(RAX);
+	jitEmitCacheSave();
+	jitAlu64Imm(ALU_SUB, RSP, 8);
+	jitMov(RDI, RAX);
+	jitMov(RSI, RCX);
+	jitCallC(function);
+	jitMov(RCX, RAX);
+	jitAlu64Imm(ALU_ADD, RSP, 8);
+	jitEmitCacheRestore();
+	jitPop(RAX);
+	jitLoad(RBP, jitVar(&cpuTotalTicks));
+}
+
+static const u8 *jitEmitLoadThunk(JitLoadKind kind, bool access32)
+{
+	static const void *const functions[JIT_LOAD_KINDS] =
+	{
+		(const void *)jitRead32, (const void *)jitRead16, (const void *)jitRead16s,
+		(const void *)jitRead8, (const void *)jitRead8s
+	};
+	static const int sizes[JIT_LOAD_KINDS] = { 4, 2, 2, 1, 1 };
+
+	const u8 *thunk = jitCodePtr;
+	jitEmitAccessStart();
+
+	// Plain memory, as MMU::read32 and others do
+	jitMov(RCX, RAX);
+	jitShiftImm(SHIFT_SHR, RCX, PAGE_SHIFT);
+	jitAluImm(ALU_CMP, RCX, PAGE_COUNT);
+	u8 *outside = jitJcc(CC_AE);
+	jitShiftImm(SHIFT_SHL, RCX, 4);
+	jitLea64(R11, jitVar(MMU::readPages));
+	jitAlu64(ALU_ADD, R11, RCX);
+	jitLoad64(RCX, jitMem(R11, offsetof(MMU::Page, mem)));
+	jitTest64(RCX, RCX);
+	u8 *handled = jitJcc(CC_E);
+	u8 *unaligned = NULL;
+	if (sizes[kind] > 1)
+	{
+		jitTestImm(RAX, sizes[kind] - 1);
+		unaligned = jitJcc(CC_NE);
+	}
+	jitLoad(R11, jitMem(R11, offsetof(MMU::Page, mask)));
+	jitAlu(ALU_AND, R11, RAX);
+
+	JitMem data = jitMemIndex(RCX, R11, 0);
+	switch (kind)
+	{
+	case JIT_LOAD_32:
+		jitLoad(RCX, data);
+		break;
+	case JIT_LOAD_U16:
+		jitLoadU16(RCX, data);
+		break;
+	case JIT_LOAD_S16:
+		jitLoadS16(RCX, data);
+		break;
+	case JIT_LOAD_U8:
+		jitLoadU8(RCX, data);
+		break;
+	default:
+		jitLoadS8(RCX, data);
+		break;
+	}
+	u8 *done = jitJmp();
+
+	jitPatchHere(outside);
+	jitPatchHere(handled);
+	if (unaligned)
+		jitPatchHere(unaligned);
+	jitEmitThunkCall(functions[kind]);
+
+	jitPatchHere(done);
+	jitEmitDataTicksRet(access32);
+	return thunk;
+}
+
+static const u8 *jitEmitStoreThunk(int sizeShift, bool fast)
+{
+	static const void *const functions[3] =
+	{
+		(const void *)jitWrite8, (const void *)jitWrite16, (const void *)jitWrite32
+	};
+
+	const u8 *thunk = jitCodePtr;
+	jitEmitAccessStart();
+
+	u8 *done = NULL;
+	u8 *slow[3] = { NULL, NULL, NULL };
+	if (fast)
+	{
+		// IWRAM holding no code is written directly
+		jitMov(R11, RAX);
+		jitShiftImm(SHIFT_SHR, R11, 24);
+		jitAluImm(ALU_CMP, R11, 3);
+		slow[0] = jitJcc(CC_NE);
+		if (sizeShift)
+		{
+			jitTestImm(RAX, (1 << sizeShift) - 1);
+			slow[1] = jitJcc(CC_NE);
+		}
+		jitMov(R11, RAX);
+		jitAluImm(ALU_AND, R11, 0x7FFF);
+		jitShiftImm(SHIFT_SHR, R11, IWRAM_CODE_SHIFT);
+		jitCmp8MemImm(jitMemIndex(RBX, R11, 0, jitVar(iwramCode).disp), 0);
+		slow[2] = jitJcc(CC_NE);
+		jitMov(R11, RAX);
+		jitAluImm(ALU_AND, R11, 0x7FFF);
+		jitAlu64Mem(ALU_ADD, R11, jitVar(&internalRAM));
+		if (sizeShift == 2)
+			jitStore(jitMem(R11), RCX);
+		else if (sizeShift == 1)
+			jitStore16(jitMem(R11), RCX);
+		else
+			jitStore8(jitMem(R11), RCX);
+		done = jitJmp();
+	}
+
+	for (int i = 0; i < 3; i++)
+		if (slow[i])
+			jitPatchHere(slow[i]);
+	jitEmitThunkCall(functions[sizeShift]);
+
+	if (done)
+		jitPatchHere(done);
+	jitEmitDataTicksRet(sizeShift == 2);
+	return thunk;
+}
+
+static int jitCheckTicks;
+
+static void jitCheckBegin()
+{
+	jitCheckTicks = cpuTotalTicks;
+	selfCheckBegin();
+}
+
+// Run the instruction again with the interpreter and compare
+static void jitCheckEnd(u32 address)
+{
+	int ticks = cpuTotalTicks - jitCheckTicks;
+	selfCheckReplay(ticks);
+	cpuTotalTicks = jitCheckTicks;
+
+	u32 opcode = MMU::read16(address);
+	int interpreted = thumbInsnRun(opcode);
+	if (!selfCheckEnd("Thumb recompiled code", address, opcode, interpreted))
+	{
+		jitCurrent->code = NULL;
+		jitCurrent->rejected = true;
+		jitStop = true;
+	}
+
+	cpuTotalTicks = jitCheckTicks + ticks;
+}
+
+// Run the instruction with the interpreter handler, from a block
+static int jitInsnRun(u32 opcode)
+{
+	int ticks = thumbInsnRun(opcode);
+
+	flagsC = C_FLAG();
+	flagsV = V_FLAG();
+	flagsCLazy = false;
+	flagsVLazy = false;
+
+	return ticks;
+}
+
+// Call a self-check function with the state of the block stored, the
+// address of the instruction in edx
+static void jitEmitCheckCall(const void *function)
+{
+	jitEmitFlagsStore();
+	jitStore(jitVar(&cpuTotalTicks), RBP);
+	jitEmitCacheSave();
+	jitMov(RDI, RDX);
+	jitCallC(function);
+	jitEmitCacheRestore();
+	jitLoad(RBP, jitVar(&cpuTotalTicks));
+	jitEmitFlagsLoad();
+	jitRet();
+}
+
+static void jitEmitThunks()
+{
+	jitEnter = (JitEnterFunc)(void *)jitCodePtr;
+	jitPush(RBX);
+	jitPush(RBP);
+	jitPush(R12);
+	jitPush(R13);
+	jitPush(R14);
+	jitPush(R15);
+	jitAlu64Imm(ALU_SUB, RSP, 8);
+	jitMovImm64(RBX, reg);
+	jitLoad(RBP, jitVar(&cpuTotalTicks));
+	jitEmitFlagsLoad();
+	jitEmitR(false, 0xFF, 1, 4, RDI);
+
+	jitExitThunk = jitCodePtr;
+	jitStore(jitVar(&armNextPC), RAX);
+	jitAluImm(ALU_ADD, RAX, 2);
+	jitStore(jitGuest(15), RAX);
+	jitExitKeepThunk = jitCodePtr;
+	jitEmitFlagsStore();
+	jitStore(jitVar(&cpuTotalTicks), RBP);
+	jitMov(RAX, RDX);
+	jitAlu64Imm(ALU_ADD, RSP, 8);
+	jitPop(R15);
+	jitPop(R14);
+	jitPop(R13);
+	jitPop(R12);
+	jitPop(RBP);
+	jitPop(RBX);
+	jitRet();
+
+	for (int kind = 0; kind < JIT_LOAD_KINDS; kind++)
+		for (int access32 = 0; access32 < 2; access32++)
+			jitLoadThunks[kind][access32] = jitEmitLoadThunk((JitLoadKind)kind, access32);
+
+	for (int sizeShift = 0; sizeShift < 3; sizeShift++)
+		for (int fast = 0; fast < 2; fast++)
+			jitStoreThunks[sizeShift][fast] = jitEmitStoreThunk(sizeShift, fast);
+
+	jitCheckBeginThunk = jitCodePtr;
+	jitStore(jitVar(&armNextPC), RDX);
+	jitLea(R11, jitMem(RDX, 2));
+	jitStore(jitGuest(15), R11);
+	jitEmitCheckCall((const void *)jitCheckBegin);
+
+	jitCheckEndThunk = jitCodePtr;
+	jitStore(jitVar(&armNextPC), RCX);
+	jitAluImm(ALU_ADD, RCX, 2);
+	jitStore(jitGuest(15), RCX);
+	jitCheckEndKeepThunk = jitCodePtr;
+	jitEmitCheckCall((const void *)jitCheckEnd);
+}
+
+// Whether the globals the blocks use can be addressed from reg[]
+static bool jitReachable()
+{
+	const void *const variables[] =
+	{
+		&flagsN, &flagsZ, &flagsC, &flagsV, &flagsCLazy, &flagsVLazy, &armNextPC,
+		&busPrefetch, &busPrefetchEnable, &busPrefetchCount, waitStates,
+		MMU::readPages, MMU::readPages + PAGE_COUNT, iwramCode, &internalRAM,
+		&cpuTotalTicks, &cpuNextEvent, &holdState, &jitStop
+	};
+
+	for (size_t i = 0; i < G_N_ELEMENTS(variables); i++)
+	{
+		s64 offset = (const u8 *)variables[i] - (const u8 *)reg;
+		if (offset != (s32)offset)
+			return false;
+	}
+
+	return true;
+}
+
+static bool jitInit()
+{
+	if (jitCode != NULL)
+		return true;
+
+	if (!jitReachable())
+	{
+		g_message("Thumb recompiler disabled: the globals are too far apart\n");
+		return false;
+	}
+
+	void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+	                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+	{
+		g_message("Thumb recompiler disabled: cannot map executable memory\n");
+		return false;
+	}
+
+	jitCode = (u8 *)code;
+	jitCodePtr = jitCode;
+	jitEmitThunks();
+	jitCodeBlocks = jitCodePtr;
+	return true;
+}
+
+static void jitReset(bool selfCheck)
+{
+	for (size_t page = 0; page < G_N_ELEMENTS(jitRomPages); page++)
+	{
+		g_free(jitRomPages[page]);
+		jitRomPages[page] = NULL;
+	}
+	memset(jitIwram, 0, sizeof(jitIwram));
+	memset(jitIwramCovered, 0, sizeof(jitIwramCovered));
+
+	jitCodePtr = jitCodeBlocks;
+	jitCompiledSelfCheck = selfCheck;
+	jitFlushPending = false;
+}
+
+// Compiler ///////////////////////////////////////////////////////////////
+
+// Host memory holding the aligned data at address, or NULL when reading it
+// goes through the region handlers
+static const u8 *jitPlain(u32 address, u32 size)
+{
+	u32 page = address >> PAGE_SHIFT;
+	if (page >= PAGE_COUNT || MMU::readPages[page].mem == NULL || (address & (size - 1)))
+		return NULL;
+	return &MMU::readPages[page].mem[address & MMU::readPages[page].mask];
+}
+
+// Whether code at address may be part of a block. IWRAM mirrors are not, so
+// that a write only has to look for the blocks at one address.
+static bool jitCompilable(u32 address)
+{
+	u32 region = address >> 24;
+	if (region == 3)
+		return address < 0x03008000;
+	return region >= 0x08 && region <= 0x0D && jitPlain(address, 2) != NULL;
+}
+
+// A branch target the interpreter prefetches from plain memory
+static bool jitBranchable(u32 target)
+{
+	return jitPlain(target, 2) != NULL && jitPlain(target + 2, 2) != NULL;
+}
+
+// Exit of the block taken by a conditional jump, emitted after the block
+struct JitExit
+{
+	u8 *jump;
+	u32 next;
+	u32 last;
+};
+
+static JitExit jitExits[JIT_BLOCK_INSNS * 4];
+static int jitExitCount;
+
+static u32 jitPC; // address of the instruction being compiled
+// What is known of the state of the prefetch buffer at this point
+static bool jitBpcZero; // busPrefetchCount is zero
+static bool jitBusPrefetchOff; // busPrefetch is false
+static bool jitChecking; // the instruction is checked against the interpreter
+static bool jitLRKnown; // the previous instruction was the first half of a BL
+static u32 jitLR;
+
+static int jitCacheGuest[JIT_CACHE_SLOTS]; // -1 when free
+static int jitCacheAge[JIT_CACHE_SLOTS];
+static int jitCacheClock;
+static u32 jitCacheUsed; // slots used by the current instruction
+
+static void jitCacheForget()
+{
+	for (int i = 0; i < JIT_CACHE_SLOTS; i++)
+		jitCacheGuest[i] = -1;
+}
+
+static int jitCacheFind(int r)
+{
+	for (int i = 0; i < JIT_CACHE_SLOTS; i++)
+		if (jitCacheGuest[i] == r)
+			return i;
+	return -1;
+}
+
+// Slot to cache a guest register in, never one used by the instruction
+static int jitCacheAllocate(int r)
+{
+	int slot = -1;
+	for (int i = 0; i < JIT_CACHE_SLOTS; i++)
+	{
+		if (jitCacheUsed & (1 << i))
+			continue;
+		if (jitCacheGuest[i] == -1)
+		{
+			slot = i;
+			break;
+		}
+		if (slot == -1 || jitCacheAge[i] < jitCacheAge[slot])
+			slot = i;
+	}
+
+	jitCacheGuest[slot] = r;
+	return slot;
+}
+
+static int jitCacheTouch(int slot)
+{
+	jitCacheUsed |= 1 << slot;
+	jitCacheAge[slot] = jitCacheClock++;
+	return jitCacheRegs[slot];
+}
+
+// Host register holding guest register r, which cannot be the PC
+static int jitGuestGet(int r)
+{
+	int slot = jitCacheFind(r);
+	if (slot == -1)
+	{
+		slot = jitCacheAllocate(r);
+		jitLoad(jitCacheRegs[slot], jitGuest(r));
+	}
+	return jitCacheTouch(slot);
+}
+
+// Copy guest register r to a host register
+static void jitGuestRead(int host, int r)
+{
+	if (r == 15)
+		jitMovImm(host, jitPC + 4);
+	else
+		jitMov(host, jitGuestGet(r));
+}
+
+static void jitGuestWrite(int r, int host)
+{
+	jitStore(jitGuest(r), host);
+
+	int slot = jitCacheFind(r);
+	if (slot == -1)
+		slot = jitCacheAllocate(r);
+	jitMov(jitCacheRegs[slot], host);
+	jitCacheTouch(slot);
+}
+
+// dst op= guest register r
+static void jitAluGuest(JitAlu op, int dst, int r)
+{
+	if (r == 15)
+		jitAluImm(op, dst, jitPC + 4);
+	else
+		jitAlu(op, dst, jitGuestGet(r));
+}
+
+static void jitEmitFlagsNZ(int r)
+{
+	jitMov(R12, r);
+	jitMov(R13, r);
+}
+
+static void jitEmitFlagsAdd()
+{
+	jitSetcc(CC_B, R14);
+	jitSetcc(CC_O, R15);
+}
+
+static void jitEmitFlagsSub()
+{
+	jitSetcc(CC_AE, R14);
+	jitSetcc(CC_O, R15);
+}
+
+static void jitEmitExitTo(u32 next, u32 last)
+{
+	jitMovImm(RAX, next);
+	jitMovImm(RDX, last);
+	jitJmpTo(jitExitThunk);
+}
+
+static void jitEmitExitIf(JitCondition cc, u32 next, u32 last)
+{
+	JitExit &exit = jitExits[jitExitCount++];
+	exit.jump = jitJcc(cc);
+	exit.next = next;
+	exit.last = last;
+}
+
+static void jitEmitExitKeep(u32 last)
+{
+	jitMovImm(RDX, last);
+	jitJmpTo(jitExitKeepThunk);
+}
+
+// Add the ticks returned by a jitEmitCodeTicks function, and extra ones
+static void jitEmitTicksAdd(int ticks, int extra)
+{
+	if (ticks >= 0)
+	{
+		if (ticks + extra)
+			jitAluImm(ALU_ADD, RBP, ticks + extra);
+	}
+	else
+		jitLea(RBP, jitMemIndex(RBP, RAX, 0, extra));
+}
+
+static void jitEmitBpcZero()
+{
+	if (!jitBpcZero)
+		jitStoreImm(jitVar(&busPrefetchCount), 0);
+	jitBpcZero = true;
+}
+
+// busPrefetchCount = ((busPrefetchCount & 0xFF) >> shift) | (busPrefetchCount & 0xFFFFFF00)
+// from eax
+static void jitEmitBpcShift(int shift)
+{
+	jitMov(RCX, RAX);
+	jitAluImm(ALU_AND, RCX, 0xFF);
+	jitShiftImm(SHIFT_SHR, RCX, shift);
+	jitAluImm(ALU_AND, RAX, 0xFFFFFF00);
+	jitAlu(ALU_OR, RAX, RCX);
+	jitStore(jitVar(&busPrefetchCount), RAX);
+}
+
+// codeTicksAccessSeq16(address): returns the ticks when they are known at
+// compile time, or -1 with the ticks in eax
+static int jitEmitCodeTicksSeq16(u32 address)
+{
+	const WaitStates &region = waitStates[(address >> 24) & 15];
+
+	if (!region.prefetched)
+	{
+		jitEmitBpcZero();
+		return region.accessSeq16;
+	}
+
+	if (jitBpcZero)
+		return region.accessSeq16;
+
+	jitLoad(RAX, jitVar(&busPrefetchCount));
+	jitTestImm(RAX, 1);
+	u8 *even = jitJcc(CC_E);
+	jitEmitBpcShift(1);
+	jitMovImm(RAX, 0);
+	u8 *done = jitJmp();
+
+	jitPatchHere(even);
+	jitAluImm(ALU_CMP, RAX, 0xFF);
+	u8 *small = jitJcc(CC_BE);
+	jitStoreImm(jitVar(&busPrefetchCount), 0);
+	jitMovImm(RAX, region.access16);
+	u8 *done2 = jitJmp();
+
+	jitPatchHere(small);
+	jitMovImm(RAX, region.accessSeq16);
+	jitPatchHere(done);
+	jitPatchHere(done2);
+	return -1;
+}
+
+// codeTicksAccess16(address), as above. With late, the timings of the
+// region are read at run time, for a write to WAITCNT to be seen at once.
+static int jitEmitCodeTicks16(u32 address, bool late)
+{
+	const WaitStates &region = waitStates[(address >> 24) & 15];
+
+	if (!late && (!region.prefetched || jitBpcZero))
+	{
+		jitEmitBpcZero();
+		return region.access16;
+	}
+
+	JitMem timings = jitVar(&region);
+	u8 *notPrefetched = NULL;
+	if (late)
+	{
+		jitCmp8MemImm(jitMem(RBX, timings.disp + offsetof(WaitStates, prefetched)), 0);
+		notPrefetched = jitJcc(CC_E);
+	}
+
+	jitLoad(RAX, jitVar(&busPrefetchCount));
+	jitTestImm(RAX, 1);
+	u8 *even = jitJcc(CC_E);
+	jitTestImm(RAX, 2);
+	u8 *one = jitJcc(CC_E);
+	jitEmitBpcShift(2);
+	jitMovImm(RAX, 0);
+	u8 *done = jitJmp();
+
+	jitPatchHere(one);
+	jitEmitBpcShift(1);
+	jitLoadU8(RAX, jitMem(RBX, timings.disp + offsetof(WaitStates, accessSeq16)));
+	jitAluImm(ALU_SUB, RAX, 1);
+	u8 *done2 = jitJmp();
+
+	jitPatchHere(even);
+	if (notPrefetched)
+		jitPatchHere(notPrefetched);
+	jitStoreImm(jitVar(&busPrefetchCount), 0);
+	jitLoadU8(RAX, jitMem(RBX, timings.disp + offsetof(WaitStates, access16)));
+	jitPatchHere(done);
+	jitPatchHere(done2);
+
+	jitBpcZero = false;
+	return -1;
+}
+
+// Ticks of an instruction that did not set clockTicks
+static void jitEmitDefaultTicks()
+{
+	jitEmitTicksAdd(jitEmitCodeTicksSeq16(jitPC), 1);
+}
+
+// What the interpreter does before each instruction
+static void jitEmitInsnStart()
+{
+	jitCacheUsed = 0;
+
+	if (!jitBusPrefetchOff)
+		jitStore8Imm(jitVar(&busPrefetch), 0);
+	jitBusPrefetchOff = true;
+
+	// if (busPrefetchCount & 0xFFFFFF00) busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF)
+	if (!jitBpcZero)
+	{
+		jitLoad(RAX, jitVar(&busPrefetchCount));
+		jitTestImm(RAX, 0xFFFFFF00);
+		u8 *skip = jitJcc(CC_E);
+		jitAluImm(ALU_AND, RAX, 0xFF);
+		jitAluImm(ALU_OR, RAX, 0x100);
+		jitStore(jitVar(&busPrefetchCount), RAX);
+		jitPatchHere(skip);
+	}
+}
+
+// Check the instruction that ended with the next one at next
+static void jitEmitCheckEnd(u32 next)
+{
+	if (!jitChecking)
+		return;
+
+	jitMovImm(RDX, jitPC);
+	jitMovImm(RCX, next);
+	jitCallTo(jitCheckEndThunk);
+}
+
+// Leave the block after the instruction when an event is due, or when C
+// code may have halted the CPU or dropped the block
+static void jitEmitInsnEnd(bool checkState)
+{
+	jitEmitCheckEnd(jitPC + 2);
+
+	jitAluMem(ALU_CMP, RBP, jitVar(&cpuNextEvent));
+	jitEmitExitIf(CC_GE, jitPC + 2, jitPC);
+
+	if (checkState || jitChecking)
+	{
+		jitCmpMemZero(jitVar(&holdState));
+		jitEmitExitIf(CC_NE, jitPC + 2, jitPC);
+		jitCmp8MemImm(jitVar(&jitStop), 0);
+		jitEmitExitIf(CC_NE, jitPC + 2, jitPC);
+	}
+}
+
+// Run the instruction with the interpreter handler
+static void jitEmitInterpreted(u16 opcode)
+{
+	jitStoreImm(jitVar(&armNextPC), jitPC);
+	jitStoreImm(jitGuest(15), jitPC + 2);
+	jitEmitFlagsStore();
+	jitStore(jitVar(&cpuTotalTicks), RBP);
+	jitMovImm(RDI, opcode);
+	jitCallC((const void *)jitInsnRun);
+	jitLoad(RBP, jitVar(&cpuTotalTicks));
+	jitAlu(ALU_ADD, RBP, RAX);
+	jitEmitFlagsLoad();
+
+	jitCacheForget();
+	jitBpcZero = false;
+	jitBusPrefetchOff = false;
+}
+
+// Instruction run by the interpreter handler, the block goes on after it
+static bool jitCompileInterpreted(u16 opcode, bool checkState)
+{
+	jitCacheUsed = 0;
+	jitEmitInterpreted(opcode);
+	jitEmitInsnEnd(checkState);
+	return true;
+}
+
+// Instruction run by the interpreter handler, the block ends with it
+static bool jitCompileInterpretedLast(u16 opcode)
+{
+	jitCacheUsed = 0;
+	jitEmitInterpreted(opcode);
+
+	if (jitChecking)
+	{
+		jitMovImm(RDX, jitPC);
+		jitCallTo(jitCheckEndKeepThunk);
+	}
+	jitEmitExitKeep(jitPC);
+	return false;
+}
+
+// Load to rd from the address in eax, then the ticks of a load
+static void jitEmitLoad(JitLoadKind kind, bool access32, int rd)
+{
+	jitMovImm(RDX, jitPC + 2);
+	jitCallTo(jitLoadThunks[kind][access32]);
+	jitGuestWrite(rd, RCX);
+	jitBpcZero = false;
+	jitBusPrefetchOff = false;
+	jitEmitTicksAdd(jitEmitCodeTicks16(jitPC + 2, false), 3);
+	jitEmitInsnEnd(false);
+}
+
+// Store rd to the address in eax, then the ticks of a store
+static void jitEmitStore(int sizeShift, int rd)
+{
+	jitGuestRead(RCX, rd);
+	jitMovImm(RDX, jitPC + 2);
+	jitCallTo(jitStoreThunks[sizeShift][!jitCompiledSelfCheck]);
+	jitBpcZero = false;
+	jitBusPrefetchOff = false;
+	jitEmitTicksAdd(jitEmitCodeTicks16(jitPC + 2, true), 2);
+	jitEmitInsnEnd(true);
+}
+
+// Taken branch to target, ticks and all, leaving the block
+static void jitEmitBranch(u32 target, int seq16Count, int extra)
+{
+	int seq16 = jitEmitCodeTicksSeq16(target);
+	if (seq16 < 0)
+	{
+		if (seq16Count == 2)
+			jitAlu(ALU_ADD, RAX, RAX);
+		jitAlu(ALU_ADD, RBP, RAX);
+		seq16 = 0;
+	}
+	jitEmitTicksAdd(jitEmitCodeTicks16(target, false), seq16 * seq16Count + extra);
+	jitEmitBpcZero();
+
+	jitEmitCheckEnd(target);
+	jitEmitExitTo(target, jitPC);
+}
+
+// Jump to taken when the condition of a Bcc passes. Returns the jump to
+// patch when it does not, if any.
+static u8 *jitEmitCondition(int cond, u8 **taken)
+{
+	u8 *skip = NULL;
+
+	switch (cond)
+	{
+	case 0x0: // EQ
+		jitTest(R13, R13);
+		taken[0] = jitJcc(CC_E);
+		break;
+	case 0x1: // NE
+		jitTest(R13, R13);
+		taken[0] = jitJcc(CC_NE);
+		break;
+	case 0x2: // CS
+		jitTest(R14, R14);
+		taken[0] = jitJcc(CC_NE);
+		break;
+	case 0x3: // CC
+		jitTest(R14, R14);
+		taken[0] = jitJcc(CC_E);
+		break;
+	case 0x4: // MI
+		jitTest(R12, R12);
+		taken[0] = jitJcc(CC_S);
+		break;
+	case 0x5: // PL
+		jitTest(R12, R12);
+		taken[0] = jitJcc(CC_NS);
+		break;
+	case 0x6: // VS
+		jitTest(R15, R15);
+		taken[0] = jitJcc(CC_NE);
+		break;
+	case 0x7: // VC
+		jitTest(R15, R15);
+		taken[0] = jitJcc(CC_E);
+		break;
+	case 0x8: // HI
+		jitTest(R14, R14);
+		skip = jitJcc(CC_E);
+		jitTest(R13, R13);
+		taken[0] = jitJcc(CC_NE);
+		break;
+	case 0x9: // LS
+		jitTest(R14, R14);
+		taken[0] = jitJcc(CC_E);
+		jitTest(R13, R13);
+		taken[1] = jitJcc(CC_E);
+		break;
+	case 0xA: // GE
+	case 0xB: // LT
+		jitMov(RAX, R12);
+		jitShiftImm(SHIFT_SHR, RAX, 31);
+		jitAlu(ALU_CMP, RAX, R15);
+		taken[0] = jitJcc(cond == 0xA ? CC_E : CC_NE);
+		break;
+	case 0xC: // GT
+		jitTest(R13, R13);
+		skip = jitJcc(CC_E);
+		jitMov(RAX, R12);
+		jitShiftImm(SHIFT_SHR, RAX, 31);
+		jitAlu(ALU_CMP, RAX, R15);
+		taken[0] = jitJcc(CC_E);
+		break;
+	default: // LE
+		jitTest(R13, R13);
+		taken[0] = jitJcc(CC_E);
+		jitMov(RAX, R12);
+		jitShiftImm(SHIFT_SHR, RAX, 31);
+		jitAlu(ALU_CMP, RAX, R15);
+		taken[1] = jitJcc(CC_NE);
+		break;
+	}
+
+	return skip;
+}
+
+// Emit the code of the instruction at jitPC. Returns false when the block
+// ends with it.
+static bool jitCompileInsn(u16 opcode)
+{
+	u32 pc = jitPC;
+	bool lrKnown = jitLRKnown;
+	jitLRKnown = false;
+	jitChecking = jitCompiledSelfCheck && (opcode & 0xFF00) != 0xDF00;
+
+	if (jitChecking)
+	{
+		jitMovImm(RDX, pc);
+		jitCallTo(jitCheckBeginThunk);
+	}
+
+	int rd = opcode & 7;
+	int rs = (opcode >> 3) & 7;
+
+	switch (opcode >> 11)
+	{
+	case 0x00: // LSL Rd, Rs, #Imm
+	case 0x01: // LSR Rd, Rs, #Imm
+	case 0x02: // ASR Rd, Rs, #Imm
+	{
+		int shift = (opcode >> 6) & 31;
+		jitEmitInsnStart();
+		jitGuestRead(RAX, rs);
+		if (shift)
+		{
+			static const JitShift ops[3] = { SHIFT_SHL, SHIFT_SHR, SHIFT_SAR };
+			jitShiftImm(ops[opcode >> 11], RAX, shift);
+			jitSetcc(CC_B, R14);
+		}
+		else if ((opcode >> 11) == 0x01)
+		{
+			// LSR #32
+			jitBt(RAX, 31);
+			jitSetcc(CC_B, R14);
+			jitMovImm(RAX, 0);
+		}
+		else if ((opcode >> 11) == 0x02)
+		{
+			// ASR #32
+			jitShiftImm(SHIFT_SAR, RAX, 31);
+			jitBt(RAX, 0);
+			jitSetcc(CC_B, R14);
+		}
+		jitEmitFlagsNZ(RAX);
+		jitGuestWrite(rd, RAX);
+		jitEmitDefaultTicks();
+		jitEmitInsnEnd(false);
+		return true;
+	}
+
+	case 0x03: // ADD/SUB Rd, Rs, Rn or #Imm3
+	{
+		int rn = (opcode >> 6) & 7;
+		JitAlu op = (opcode & 0x0200) ? ALU_SUB : ALU_ADD;
+		jitEmitInsnStart();
+		int source = jitGuestGet(rs);
+		if (opcode & 0x0400)
+		{
+			jitMov(RAX, source);
+			jitAluImm(op, RAX, rn);
+		}
+		else
+		{
+			int operand = jitGuestGet(rn);
+			jitMov(RAX, source);
+			jitAlu(op, RAX, operand);
+		}
+		if (op == ALU_SUB)
+			jitEmitFlagsSub();
+		else
+			jitEmitFlagsAdd();
+		jitEmitFlagsNZ(RAX);
+		jitGuestWrite(rd, RAX);
+		jitEmitDefaultTicks();
+		jitEmitInsnEnd(false);
+		return true;
+	}
+
+	case 0x04: // MOV Rd, #Imm
+	case 0x05: // CMP Rd, #Imm
+	case 0x06: // ADD Rd, #Imm
+	case 0x07: // SUB Rd, #Imm
+	{
+		int dest = (opcode >> 8) & 7;
+		u32 imm = opcode & 0xFF;
+		jitEmitInsnStart();
+		if ((opcode >> 11) == 0x04)
+			jitMovImm(RAX, imm);
+		else
+		{
+			jitGuestRead(RAX, dest);
+			if ((opcode >> 11) == 0x06)
+			{
+				jitAluImm(ALU_ADD, RAX, imm);
+				jitEmitFlagsAdd();
+			}
+			else
+			{
+				jitAluImm(ALU_SUB, RAX, imm);
+				jitEmitFlagsSub();
+			}
+		}
+		jitEmitFlagsNZ(RAX);
+		if ((opcode >> 11) != 0x05)
+			jitGuestWrite(dest, RAX);
+		jitEmitDefaultTicks();
+		jitEmitInsnEnd(false);
+		return true;
+	}
+
+	case 0x08:
+		if (!(opcode & 0x0400))
+		{
+			// ALU operations
+			int op = (opcode >> 6) & 15;
+			switch (op)
+			{
+			case 0x2: // LSL Rd, Rs
+			case 0x3: // LSR Rd, Rs
+			case 0x4: // ASR Rd, Rs
+			case 0x7: // ROR Rd, Rs
+			case 0xD: // MUL Rd, Rs
+				return jitCompileInterpreted(opcode, false);
+			}
+
+			jitEmitInsnStart();
+			int source = jitGuestGet(rs);
+			switch (op)
+			{
+			case 0x5: // ADC
+				jitGuestRead(RAX, rd);
+				jitBt(R14, 0);
+				jitAlu(ALU_ADC, RAX, source);
+				jitEmitFlagsAdd();
+				break;
+			case 0x6: // SBC
+				jitGuestRead(RAX, rd);
+				jitAluImm(ALU_CMP, R14, 1);
+				jitAlu(ALU_SBB, RAX, source);
+				jitEmitFlagsSub();
+				break;
+			case 0x9: // NEG
+				jitMovImm(RAX, 0);
+				jitAlu(ALU_SUB, RAX, source);
+				jitEmitFlagsSub();
+				break;
+			case 0xA: // CMP
+				jitGuestRead(RAX, rd);
+				jitAlu(ALU_SUB, RAX, source);
+				jitEmitFlagsSub();
+				break;
+			case 0xB: // CMN
+				jitGuestRead(RAX, rd);
+				jitAlu(ALU_ADD, RAX, source);
+				jitEmitFlagsAdd();
+				break;
+			case 0xE: // BIC
+				jitMov(RCX, source);
+				jitNot(RCX);
+				jitGuestRead(RAX, rd);
+				jitAlu(ALU_AND, RAX, RCX);
+				break;
+			case 0xF: // MVN
+				jitMov(RAX, source);
+				jitNot(RAX);
+				break;
+			default: // AND, EOR, TST, ORR
+				jitGuestRead(RAX, rd);
+				jitAlu(op == 0x1 ? ALU_XOR : op == 0xC ? ALU_OR : ALU_AND, RAX, source);
+				break;
+			}
+			jitEmitFlagsNZ(RAX);
+			if (op != 0x8 && op != 0xA && op != 0xB)
+				jitGuestWrite(rd, RAX);
+			jitEmitDefaultTicks();
+			jitEmitInsnEnd(false);
+			return true;
+		}
+		else if ((opcode & 0x0300) != 0x0300)
+		{
+			// ADD, CMP and MOV with the high registers
+			int op = (opcode >> 8) & 3;
+			int h = (opcode >> 6) & 3;
+			int dest = rd | ((opcode >> 4) & 8);
+			int source = rs | ((opcode >> 3) & 8);
+			if ((op != 2 && h == 0) || (op != 1 && dest == 15))
+				return jitCompileInterpretedLast(opcode);
+
+			jitEmitInsnStart();
+			if (op == 2)
+			{
+				jitGuestRead(RAX, source);
+				jitGuestWrite(dest, RAX);
+				if (h < 2)
+					jitEmitTicksAdd(jitEmitCodeTicksSeq16(pc + 2), 1);
+				else
+					jitEmitDefaultTicks();
+			}
+			else
+			{
+				jitGuestRead(RAX, dest);
+				if (op == 0)
+				{
+					jitAluGuest(ALU_ADD, RAX, source);
+					jitGuestWrite(dest, RAX);
+				}
+				else
+				{
+					jitAluGuest(ALU_SUB, RAX, source);
+					jitEmitFlagsSub();
+					jitEmitFlagsNZ(RAX);
+				}
+				jitEmitDefaultTicks();
+			}
+			jitEmitInsnEnd(false);
+			return true;
+		}
+		// BX
+		return jitCompileInterpretedLast(opcode);
+
+	case 0x09: // LDR Rd, [PC, #Imm]
+	{
+		int dest = (opcode >> 8) & 7;
+		u32 address = ((pc + 4) & ~3) + ((opcode & 0xFF) << 2);
+		const u8 *data = jitPlain(address, 4);
+		if (data == NULL)
+			return jitCompileInterpreted(opcode, false);
+
+		jitEmitInsnStart();
+		if (jitBpcZero)
+		{
+			jitLoadU8(R11, jitVar(&busPrefetchEnable));
+			jitStore8(jitVar(&busPrefetch), R11);
+		}
+		else
+			jitEmitAccessStart();
+		jitMovImm64(RAX, data);
+		jitLoad(RAX, jitMem(RAX));
+		jitGuestWrite(dest, RAX);
+		jitStoreImm(jitVar(&busPrefetchCount), 0);
+
+		// dataTicksAccess32, the region is known
+		const WaitStates &region = waitStates[(address >> 24) & 15];
+		if (region.stopsPrefetch)
+		{
+			jitStore8Imm(jitVar(&busPrefetch), 0);
+			jitBpcZero = true;
+			jitBusPrefetchOff = true;
+		}
+		else
+		{
+			jitCmp8MemImm(jitVar(&busPrefetch), 0);
+			u8 *off = jitJcc(CC_E);
+			jitStoreImm(jitVar(&busPrefetchCount), (1 << (region.access32 ? region.access32 : 1)) - 1);
+			jitPatchHere(off);
+			jitBpcZero = false;
+			jitBusPrefetchOff = false;
+		}
+		jitEmitTicksAdd(jitEmitCodeTicks16(pc + 2, false), 3 + region.access32);
+		jitEmitInsnEnd(false);
+		return true;
+	}
+
+	case 0x0A: // STR, STRH, STRB, LDSB Rd, [Rs, Rn]
+	case 0x0B: // LDR, LDRH, LDRB, LDSH Rd, [Rs, Rn]
+	{
+		int rn = (opcode >> 6) & 7;
+		jitEmitInsnStart();
+		jitGuestRead(RAX, rs);
+		jitAluGuest(ALU_ADD, RAX, rn);
+		switch ((opcode >> 9) & 7)
+		{
+		case 0:
+			jitEmitStore(2, rd);
+			break;
+		case 1:
+			jitEmitStore(1, rd);
+			break;
+		case 2:
+			jitEmitStore(0, rd);
+			break;
+		case 3:
+			jitEmitLoad(JIT_LOAD_S8, false, rd);
+			break;
+		case 4:
+			jitEmitLoad(JIT_LOAD_32, true, rd);
+			break;
+		case 5:
+			jitEmitLoad(JIT_LOAD_U16, true, rd);
+			break;
+		case 6:
+			jitEmitLoad(JIT_LOAD_U8, false, rd);
+			break;
+		default:
+			jitEmitLoad(JIT_LOAD_S16, false, rd);
+			break;
+		}
+		return true;
+	}
+
+	case 0x0C: // STR Rd, [Rs, #Imm]
+	case 0x0D: // LDR Rd, [Rs, #Imm]
+	case 0x0E: // STRB Rd, [Rs, #Imm]
+	case 0x0F: // LDRB Rd, [Rs, #Imm]
+	case 0x10: // STRH Rd, [Rs, #Imm]
+	case 0x11: // LDRH Rd, [Rs, #Imm]
+	{
+		static const int sizeShifts[6] = { 2, 2, 0, 0, 1, 1 };
+		int sizeShift = sizeShifts[(opcode >> 11) - 0x0C];
+		jitEmitInsnStart();
+		jitGuestRead(RAX, rs);
+		jitAluImm(ALU_ADD, RAX, ((opcode >> 6) & 31) << sizeShift);
+		if (!(opcode & 0x0800))
+			jitEmitStore(sizeShift, rd);
+		else if (sizeShift == 2)
+			jitEmitLoad(JIT_LOAD_32, true, rd);
+		else if (sizeShift == 1)
+			jitEmitLoad(JIT_LOAD_U16, false, rd);
+		else
+			jitEmitLoad(JIT_LOAD_U8, false, rd);
+		return true;
+	}
+
+	case 0x12: // STR Rd, [SP, #Imm]
+	case 0x13: // LDR Rd, [SP, #Imm]
+	{
+		int dest = (opcode >> 8) & 7;
+		jitEmitInsnStart();
+		jitGuestRead(RAX, 13);
+		jitAluImm(ALU_ADD, RAX, (opcode & 0xFF) << 2);
+		if (opcode & 0x0800)
+			jitEmitLoad(JIT_LOAD_32, true, dest);
+		else
+			jitEmitStore(2, dest);
+		return true;
+	}
+
+	case 0x14: // ADD Rd, PC, #Imm
+	case 0x15: // ADD Rd, SP, #Imm
+	{
+		int dest = (opcode >> 8) & 7;
+		jitEmitInsnStart();
+		if (opcode & 0x0800)
+		{
+			jitGuestRead(RAX, 13);
+			jitAluImm(ALU_ADD, RAX, (opcode & 0xFF) << 2);
+		}
+		else
+			jitMovImm(RAX, ((pc + 4) & ~3) + ((opcode & 0xFF) << 2));
+		jitGuestWrite(dest, RAX);
+		jitEmitTicksAdd(jitEmitCodeTicks16(pc + 2, false), 1);
+		jitEmitInsnEnd(false);
+		return true;
+	}
+
+	case 0x16:
+	case 0x17:
+		switch (opcode >> 8)
+		{
+		case 0xB0: // ADD SP, #Imm
+		{
+			u32 imm = (opcode & 0x7F) << 2;
+			jitEmitInsnStart();
+			jitGuestRead(RAX, 13);
+			jitAluImm(ALU_ADD, RAX, (opcode & 0x80) ? -imm : imm);
+			jitGuestWrite(13, RAX);
+			jitEmitTicksAdd(jitEmitCodeTicks16(pc + 2, false), 1);
+			jitEmitInsnEnd(false);
+			return true;
+		}
+		case 0xB4: // PUSH {Rlist}
+		case 0xB5: // PUSH {Rlist, LR}
+			return jitCompileInterpreted(opcode, true);
+		case 0xBC: // POP {Rlist}
+			return jitCompileInterpreted(opcode, false);
+		default: // POP {Rlist, PC} and the undefined instructions
+			return jitCompileInterpretedLast(opcode);
+		}
+
+	case 0x18: // STM Rd!, {Rlist}
+		return jitCompileInterpreted(opcode, true);
+
+	case 0x19: // LDM Rd!, {Rlist}
+		return jitCompileInterpreted(opcode, false);
+
+	case 0x1A:
+	case 0x1B:
+	{
+		// Bcc
+		int cond = (opcode >> 8) & 15;
+		u32 target = pc + 4 + ((s8)(opcode & 0xFF) << 1);
+		if (cond >= 14 || !jitBranchable(target))
+			return jitCompileInterpretedLast(opcode);
+
+		jitEmitInsnStart();
+		jitEmitTicksAdd(jitEmitCodeTicksSeq16(pc + 2), 1);
+
+		u8 *taken[2] = { NULL, NULL };
+		u8 *skip = jitEmitCondition(cond, taken);
+		u8 *notTaken = jitJmp();
+
+		bool bpcZero = jitBpcZero;
+		bool busPrefetchOff = jitBusPrefetchOff;
+		for (int i = 0; i < 2; i++)
+			if (taken[i])
+				jitPatchHere(taken[i]);
+		jitEmitBranch(target, 1, 2);
+		jitBpcZero = bpcZero;
+		jitBusPrefetchOff = busPrefetchOff;
+
+		jitPatchHere(notTaken);
+		if (skip)
+			jitPatchHere(skip);
+		jitEmitInsnEnd(false);
+		return true;
+	}
+
+	case 0x1C: // B
+	{
+		u32 offset = (opcode & 0x3FF) << 1;
+		if (opcode & 0x0400)
+			offset |= 0xFFFFF800;
+		u32 target = pc + 4 + offset;
+		if (!jitBranchable(target))
+			return jitCompileInterpretedLast(opcode);
+
+		jitEmitInsnStart();
+		jitEmitBranch(target, 2, 3);
+		return false;
+	}
+
+	case 0x1E: // BL, first half
+	{
+		u32 offset = (opcode & 0x7FF) << 12;
+		if (opcode & 0x0400)
+			offset |= 0xFF800000;
+		jitEmitInsnStart();
+		jitLR = pc + 4 + offset;
+		jitMovImm(RAX, jitLR);
+		jitGuestWrite(14, RAX);
+		jitEmitTicksAdd(jitEmitCodeTicksSeq16(pc + 2), 1);
+		jitEmitInsnEnd(false);
+		jitLRKnown = true;
+		return true;
+	}
+
+	case 0x1F: // BL, second half
+	{
+		u32 target = (jitLR + ((opcode & 0x7FF) << 1)) & 0xFFFFFFFE;
+		if (!lrKnown || !jitBranchable(target))
+			return jitCompileInterpretedLast(opcode);
+
+		jitEmitInsnStart();
+		jitMovImm(RAX, (pc + 2) | 1);
+		jitGuestWrite(14, RAX);
+		jitEmitBranch(target, 2, 3);
+		return false;
+	}
+
+	default:
+		return jitCompileInterpretedLast(opcode);
+	}
+}
+
+// Compile the block starting at address, or return NULL when its first
+// instruction is not in plain memory or the code buffer is full
+static const u8 *jitCompile(u32 address, u16 &length)
+{
+	if (jitCodePtr + JIT_BLOCK_CODE_MAX > jitCode + JIT_CODE_SIZE)
+	{
+		jitFlushPending = true;
+		return NULL;
+	}
+
+	if (!jitCompilable(address))
+		return NULL;
+
+	const u8 *code = jitCodePtr;
+	jitBpcZero = false;
+	jitBusPrefetchOff = false;
+	jitLRKnown = false;
+	jitExitCount = 0;
+	jitCacheForget();
+
+	u32 pc = address;
+	for (int count = 1; ; count++)
+	{
+		jitPC = pc;
+		u16 opcode = MMU::read16(pc);
+		bool more = jitCompileInsn(opcode);
+		pc += 2;
+
+		if (!more)
+			break;
+
+		// Keep both halves of a BL together
+		if ((count >= JIT_BLOCK_INSNS && !jitLRKnown) || (pc >> 24) != (address >> 24)
+		    || !jitCompilable(pc))
+		{
+			jitEmitExitTo(pc, pc - 2);
+			break;
+		}
+	}
+
+	for (int i = 0; i < jitExitCount; i++)
+	{
+		jitPatchHere(jitExits[i].jump);
+		jitEmitExitTo(jitExits[i].next, jitExits[i].last);
+	}
+
+	length = pc - address;
+
+	if ((address >> 24) == 3)
+	{
+		for (u32 covered = address; covered < pc; covered += 2)
+		{
+			jitIwramCovered[(covered & 0x7FFF) >> 1] = 1;
+			iwramCode[(covered & 0x7FFF) >> IWRAM_CODE_SHIFT] = 1;
+		}
+	}
+
+	return code;
+}
+
+static JitEntry *jitEntry(u32 address)
+{
+	u32 region = address >> 24;
+
+	if (region == 3)
+		return address < 0x03008000 ? &jitIwram[(address & 0x7FFF) >> 1] : NULL;
+
+	if (region < 0x08 || region > 0x0D)
+		return NULL;
+
+	u32 page = (address - 0x08000000) >> JIT_PAGE_SHIFT;
+	if (UNLIKELY(jitRomPages[page] == NULL))
+		jitRomPages[page] = g_new0(JitEntry, JIT_PAGE_ENTRIES);
+
+	return &jitRomPages[page][(address >> 1) & (JIT_PAGE_ENTRIES - 1)];
+}
+
+bool jitRun(bool selfCheck, u32 &last)
+{
+	if (UNLIKELY(jitFlushPending || selfCheck != jitCompiledSelfCheck))
+	{
+		if (!jitAvailable)
+			return false;
+		if (!jitInit())
+		{
+			jitAvailable = false;
+			return false;
+		}
+		jitReset(selfCheck);
+	}
+
+	JitEntry *entry = jitEntry(armNextPC);
+	if (entry == NULL)
+		return false;
+
+	if (entry->code == NULL)
+	{
+		if (entry->rejected || ++entry->runs < JIT_HOT_RUNS)
+			return false;
+
+		entry->runs = 0;
+		entry->code = jitCompile(armNextPC, entry->length);
+		if (entry->code == NULL)
+		{
+			entry->rejected = !jitFlushPending;
+			return false;
+		}
+	}
+
+	flagsC = C_FLAG();
+	flagsV = V_FLAG();
+	flagsCLazy = false;
+	flagsVLazy = false;
+
+	jitStop = false;
+	jitCurrent = entry;
+	last = jitEnter(entry->code);
+	return true;
+}
+
+void jitFlush()
+{
+	jitFlushPending = true;
+	jitStop = true;
+}
+
+void jitInvalidateRange(u32 address, u32 length)
+{
+	if ((address >> 24) != 3 || length == 0)
+		return;
+
+	u32 first = (address & 0x7FFF) >> 1;
+	u32 end = (((address & 0x7FFF) + length - 1) >> 1) + 1;
+	if (end > G_N_ELEMENTS(jitIwramCovered))
+		end = G_N_ELEMENTS(jitIwramCovered);
+
+	for (u32 halfword = first; halfword < end; halfword++)
+	{
+		if (!jitIwramCovered[halfword])
+			continue;
+
+		// Blocks are at most JIT_BLOCK_INSNS + 1 instructions long
+		u32 start = halfword > JIT_BLOCK_INSNS ? halfword - JIT_BLOCK_INSNS : 0;
+		for (u32 block = start; block <= halfword; block++)
+		{
+			JitEntry &entry = jitIwram[block];
+			if (entry.code != NULL && block + (entry.length >> 1) > halfword)
+			{
+				entry.code = NULL;
+				entry.runs = 0;
+				jitStop = true;
+			}
+		}
+	}
+}
+
+#else
+
+bool jitRun(bool selfCheck, u32 &last)
+{
+	return false;
+}
+
+void jitFlush()
+{
+}
+
+void jitInvalidateRange(u32 address, u32 length)
+{
+}
+
+#endif
+
+} // namespace CPU
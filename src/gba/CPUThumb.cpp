@@ -11,262 +11,298 @@ namespace CPU
 
 static int clockTicks;
 
-static INSN_REGPARM void thumbUnknownInsn(u32 opcode)
-{
-#ifdef GBA_LOGGING
-	if (settings_log_channel_enabled(LOG_UNDEFINED))
-		g_message("Undefined THUMB instruction %04x at %08x\n", opcode, armNextPC-2);
-#endif
-	CPUUndefinedException();
-}
+// Operands of the Thumb instructions, as the format of each instruction
+// lays them out in the opcode
+struct ThumbOperands
+{
+	u8 rd;
+	u8 rs;
+	u8 rn;
+	u32 imm; // Immediate, shift amount, or offset scaled to bytes
+};
 
-// Common macros //////////////////////////////////////////////////////////
+enum ThumbOperandsKind
+{
+	THUMB_OPERANDS_SHIFT,       // Rd, Rs, #Imm5
+	THUMB_OPERANDS_RD_RS_RN,    // Rd, Rs, Rn or #Imm3
+	THUMB_OPERANDS_RD_RS,       // Rd, Rs
+	THUMB_OPERANDS_IMM8,        // Rd, #Imm8
+	THUMB_OPERANDS_WORD8,       // Rd, #Imm8 * 4
+	THUMB_OPERANDS_BYTE5,       // Rd, Rs, #Imm5
+	THUMB_OPERANDS_WORD5,       // Rd, Rs, #Imm5 * 4
+	THUMB_OPERANDS_HALF5,       // Rd, Rs, #Imm5 * 2
+	THUMB_OPERANDS_SP,          // #Imm7 * 4, signed by bit 7
+	THUMB_OPERANDS_BRANCH8,     // Signed #Imm8 * 2
+	THUMB_OPERANDS_BRANCH11,    // Signed #Imm11 * 2
+	THUMB_OPERANDS_IMM11        // #Imm11 of BL
+};
 
-static inline u32 NEG(const u32 i)
-{
-	return i >> 31;
-}
-static inline u32 POS(const u32 i)
+static INSN_INLINE ThumbOperands thumbOperandsDecode(u32 opcode, ThumbOperandsKind kind)
 {
-	return (~i) >> 31;
-}
-
+	ThumbOperands op;
+	op.rd = opcode & 7;
+	op.rs = (opcode >> 3) & 7;
+	op.rn = (opcode >> 6) & 7;
 
-// C core
+	switch (kind)
+	{
+	case THUMB_OPERANDS_SHIFT:
+	case THUMB_OPERANDS_BYTE5:
+		op.imm = (opcode >> 6) & 31;
+		break;
+	case THUMB_OPERANDS_RD_RS_RN:
+		op.imm = op.rn;
+		break;
+	case THUMB_OPERANDS_IMM8:
+		op.rd = (opcode >> 8) & 7;
+		op.imm = opcode & 255;
+		break;
+	case THUMB_OPERANDS_WORD8:
+		op.rd = (opcode >> 8) & 7;
+		op.imm = (opcode & 255) << 2;
+		break;
+	case THUMB_OPERANDS_WORD5:
+		op.imm = ((opcode >> 6) & 31) << 2;
+		break;
+	case THUMB_OPERANDS_HALF5:
+		op.imm = ((opcode >> 6) & 31) << 1;
+		break;
+	case THUMB_OPERANDS_SP:
+		op.imm = (opcode & 127) << 2;
+		if (opcode & 0x80)
+			op.imm = -op.imm;
+		break;
+	case THUMB_OPERANDS_BRANCH8:
+		op.imm = ((s8)(opcode & 0xFF)) << 1;
+		break;
+	case THUMB_OPERANDS_BRANCH11:
+		op.imm = (opcode & 0x3FF) << 1;
+		if (opcode & 0x0400)
+			op.imm |= 0xFFFFF800;
+		break;
+	case THUMB_OPERANDS_IMM11:
+		op.imm = opcode & 0x7FF;
+		break;
+	default:
+		op.imm = 0;
+		break;
+	}
 
-static inline bool ADDCARRY(const u32 a, const u32 b, const u32 c)
-{
-	return	(NEG(a) & NEG(b)) |
-	       (NEG(a) & POS(c)) |
-	       (NEG(b) & POS(c));
+	return op;
 }
 
-static inline bool ADDOVERFLOW(const u32 a, const u32 b, const u32 c)
-{
-	return	(NEG(a) & NEG(b) & POS(c)) |
-	       (POS(a) & POS(b) & NEG(c));
-}
+struct ThumbSlot;
+typedef INSN_REGPARM void (*insnfunc_t)(u32 opcode);
+typedef INSN_REGPARM void (*threadedfunc_t)(const ThumbSlot *slot);
 
-static inline bool SUBCARRY(const u32 a, const u32 b, const u32 c)
+// Slot of the threaded code, see below
+struct ThumbSlot
 {
-	return	(NEG(a) & POS(b)) |
-	       (NEG(a) & POS(c)) |
-	       (POS(b) & POS(c));
-}
+	threadedfunc_t threaded;
+	insnfunc_t func;
+	u16 opcode;
+	// The instruction may leave Thumb state or halt the CPU
+	bool checkState;
+	ThumbOperands op;
+};
+
+// Define the interpreter handler thumb<CODE>, which extracts the operands
+// from the opcode, and thumb<CODE>Threaded, which the threaded code runs with
+// the operands extracted when the page was translated. The body follows and
+// reads the operands from op.
+#define THUMB_INSN(CODE, OPERANDS) \
+  static INSN_INLINE void thumb##CODE##Body(const ThumbOperands &op);        \
+  static INSN_REGPARM void thumb##CODE(u32 opcode)                            \
+  {                                                                           \
+      thumb##CODE##Body(thumbOperandsDecode(opcode, THUMB_OPERANDS_##OPERANDS)); \
+  }                                                                           \
+  static INSN_REGPARM void thumb##CODE##Threaded(const ThumbSlot *slot)       \
+  {                                                                           \
+      thumb##CODE##Body(slot->op);                                            \
+  }                                                                           \
+  static INSN_INLINE void thumb##CODE##Body(const ThumbOperands &op)
+
+// Same for the interpreter handlers that are instantiated for each value of
+// one of their operands, given as N in place of op.FIELD
+#define THUMB_INSN_N(CODE, OPERANDS, FIELD) \
+  static INSN_INLINE void thumb##CODE##Body(const ThumbOperands &op);        \
+  template <int N>                                                            \
+  static INSN_REGPARM void thumb##CODE(u32 opcode)                            \
+  {                                                                           \
+      ThumbOperands op = thumbOperandsDecode(opcode, THUMB_OPERANDS_##OPERANDS); \
+      op.FIELD = N;                                                           \
+      thumb##CODE##Body(op);                                                  \
+  }                                                                           \
+  static INSN_REGPARM void thumb##CODE##Threaded(const ThumbSlot *slot)       \
+  {                                                                           \
+      thumb##CODE##Body(slot->op);                                            \
+  }                                                                           \
+  static INSN_INLINE void thumb##CODE##Body(const ThumbOperands &op)
 
-static inline bool SUBOVERFLOW(const u32 a, const u32 b, const u32 c)
+static INSN_REGPARM void thumbUnknownInsn(u32 opcode)
 {
-	return	(NEG(a) & POS(b) & POS(c)) |
-	       (POS(a) & NEG(b) & NEG(c));
+#ifdef GBA_LOGGING
+	if (settings_log_channel_enabled(LOG_UNDEFINED))
+		g_message("Undefined THUMB instruction %04x at %08x\n", opcode, armNextPC-2);
+#endif
+	CPUUndefinedException();
 }
 
 // 3-argument ADD/SUB /////////////////////////////////////////////////////
 
 // ADD Rd, Rs, Rn
-template <int N>
-static INSN_REGPARM void thumb18(u32 opcode)
+THUMB_INSN_N(18, RD_RS_RN, rn)
 {
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
+	int dest = op.rd;
+	int source = op.rs;
 	u32 lhs = reg[source].I;
-	u32 rhs = reg[N].I;
+	u32 rhs = reg[op.rn].I;
 	u32 res = lhs + rhs;
 	reg[dest].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = ADDCARRY(lhs, rhs, res);
-	V_FLAG = ADDOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_ADD(lhs, rhs, res);
 }
 
 // SUB Rd, Rs, Rn
-template <int N>
-static INSN_REGPARM void thumb1A(u32 opcode)
+THUMB_INSN_N(1A, RD_RS_RN, rn)
 {
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
+	int dest = op.rd;
+	int source = op.rs;
 	u32 lhs = reg[source].I;
-	u32 rhs = reg[N].I;
+	u32 rhs = reg[op.rn].I;
 	u32 res = lhs - rhs;
 	reg[dest].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = SUBCARRY(lhs, rhs, res);
-	V_FLAG = SUBOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_SUB(lhs, rhs, res);
 }
 
 // ADD Rd, Rs, #Offset3
-template <int N>
-static INSN_REGPARM void thumb1C(u32 opcode)
+THUMB_INSN_N(1C, RD_RS_RN, imm)
 {
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
+	int dest = op.rd;
+	int source = op.rs;
 	u32 lhs = reg[source].I;
-	u32 rhs = N;
+	u32 rhs = op.imm;
 	u32 res = lhs + rhs;
 	reg[dest].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = ADDCARRY(lhs, rhs, res);
-	V_FLAG = ADDOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_ADD(lhs, rhs, res);
 }
 
 // SUB Rd, Rs, #Offset3
-template <int N>
-static INSN_REGPARM void thumb1E(u32 opcode)
+THUMB_INSN_N(1E, RD_RS_RN, imm)
 {
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
+	int dest = op.rd;
+	int source = op.rs;
 	u32 lhs = reg[source].I;
-	u32 rhs = N;
+	u32 rhs = op.imm;
 	u32 res = lhs - rhs;
 	reg[dest].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = SUBCARRY(lhs, rhs, res);
-	V_FLAG = SUBOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_SUB(lhs, rhs, res);
 }
 
 // Shift instructions /////////////////////////////////////////////////////
 
 // LSL Rd, Rm, #Imm 5
-template <int N>
-static INSN_REGPARM void thumb00(u32 opcode)
+THUMB_INSN_N(00, SHIFT, imm)
 {
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
+	int dest = op.rd;
+	int source = op.rs;
 	u32 value;
-	int shift = N;
-	C_FLAG = (reg[source].I >> (32 - shift)) & 1 ? true : false;
-	value = reg[source].I << shift;
-	reg[dest].I = value;
-	N_FLAG = (value & 0x80000000 ? true : false);
-	Z_FLAG = (value ? false : true);
-}
-
-template <>
-INSN_REGPARM void thumb00<0>(u32 opcode)
-{
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
-	u32 value = reg[source].I;
+	int shift = op.imm;
+	if (shift)
+	{
+		SET_C_FLAG((reg[source].I >> (32 - shift)) & 1);
+		value = reg[source].I << shift;
+	}
+	else
+	{
+		value = reg[source].I;
+	}
 	reg[dest].I = value;
-	N_FLAG = (value & 0x80000000 ? true : false);
-	Z_FLAG = (value ? false : true);
+	SET_FLAGS_NZ(value);
 }
 
 // LSR Rd, Rm, #Imm 5
-template <int N>
-static INSN_REGPARM void thumb08(u32 opcode)
+THUMB_INSN_N(08, SHIFT, imm)
 {
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
+	int dest = op.rd;
+	int source = op.rs;
 	u32 value;
-	int shift = N;
-	C_FLAG = (reg[source].I >> (shift - 1)) & 1 ? true : false;
-	value = reg[source].I >> shift;
-	reg[dest].I = value;
-	N_FLAG = (value & 0x80000000 ? true : false);
-	Z_FLAG = (value ? false : true);
-}
-
-template <>
-INSN_REGPARM void thumb08<0>(u32 opcode)
-{
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
-	u32 value = 0;
-	C_FLAG = reg[source].I & 0x80000000 ? true : false;
+	int shift = op.imm;
+	if (shift)
+	{
+		SET_C_FLAG((reg[source].I >> (shift - 1)) & 1);
+		value = reg[source].I >> shift;
+	}
+	else
+	{
+		value = 0;
+		SET_C_FLAG(reg[source].I & 0x80000000);
+	}
 	reg[dest].I = value;
-	N_FLAG = (value & 0x80000000 ? true : false);
-	Z_FLAG = (value ? false : true);
+	SET_FLAGS_NZ(value);
 }
 
 // ASR Rd, Rm, #Imm 5
-template <int N>
-static INSN_REGPARM void thumb10(u32 opcode)
-{
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
-	u32 value;
-	int shift = N;
-	C_FLAG = ((s32)reg[source].I >> (int)(shift - 1)) & 1 ? true : false;
-	value = (s32)reg[source].I >> (int)shift;
-	reg[dest].I = value;
-	N_FLAG = (value & 0x80000000 ? true : false);
-	Z_FLAG = (value ? false : true);
-}
-
-template <>
-INSN_REGPARM void thumb10<0>(u32 opcode)
+THUMB_INSN_N(10, SHIFT, imm)
 {
-	int dest = opcode & 0x07;
-	int source = (opcode >> 3) & 0x07;
+	int dest = op.rd;
+	int source = op.rs;
 	u32 value;
-	if (reg[source].I & 0x80000000)
+	int shift = op.imm;
+	if (shift)
+	{
+		SET_C_FLAG(((s32)reg[source].I >> (int)(shift - 1)) & 1);
+		value = (s32)reg[source].I >> (int)shift;
+	}
+	else if (reg[source].I & 0x80000000)
 	{
 		value = 0xFFFFFFFF;
-		C_FLAG = true;
+		SET_C_FLAG(true);
 	}
 	else
 	{
 		value = 0;
-		C_FLAG = false;
+		SET_C_FLAG(false);
 	}
 	reg[dest].I = value;
-	N_FLAG = (value & 0x80000000 ? true : false);
-	Z_FLAG = (value ? false : true);
+	SET_FLAGS_NZ(value);
 }
 
 // MOV/CMP/ADD/SUB immediate //////////////////////////////////////////////
 
 // MOV RN, #Offset8
-template <int N>
-static INSN_REGPARM void thumb20(u32 opcode)
+THUMB_INSN_N(20, IMM8, rd)
 {
-	reg[N].I = opcode & 255;
-	N_FLAG = false;
-	Z_FLAG = (reg[N].I ? false : true);
+	reg[op.rd].I = op.imm;
+	SET_FLAGS_NZ(reg[op.rd].I);
 }
 
 // CMP RN, #Offset8
-template <int N>
-static INSN_REGPARM void thumb28(u32 opcode)
+THUMB_INSN_N(28, IMM8, rd)
 {
-	u32 lhs = reg[N].I;
-	u32 rhs = (opcode & 255);
+	u32 lhs = reg[op.rd].I;
+	u32 rhs = op.imm;
 	u32 res = lhs - rhs;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = SUBCARRY(lhs, rhs, res);
-	V_FLAG = SUBOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_SUB(lhs, rhs, res);
 }
 
 // ADD RN,#Offset8
-template <int N>
-static INSN_REGPARM void thumb30(u32 opcode)
+THUMB_INSN_N(30, IMM8, rd)
 {
-	u32 lhs = reg[N].I;
-	u32 rhs = (opcode & 255);
+	u32 lhs = reg[op.rd].I;
+	u32 rhs = op.imm;
 	u32 res = lhs + rhs;
-	reg[N].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = ADDCARRY(lhs, rhs, res);
-	V_FLAG = ADDOVERFLOW(lhs, rhs, res);
+	reg[op.rd].I = res;
+	SET_FLAGS_ADD(lhs, rhs, res);
 }
 
 // SUB RN,#Offset8
-template <int N>
-static INSN_REGPARM void thumb38(u32 opcode)
+THUMB_INSN_N(38, IMM8, rd)
 {
-	u32 lhs = reg[N].I;
-	u32 rhs = (opcode & 255);
+	u32 lhs = reg[op.rd].I;
+	u32 rhs = op.imm;
 	u32 res = lhs - rhs;
-	reg[N].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = SUBCARRY(lhs, rhs, res);
-	V_FLAG = SUBOVERFLOW(lhs, rhs, res);
+	reg[op.rd].I = res;
+	SET_FLAGS_SUB(lhs, rhs, res);
 }
 
 // ALU operations /////////////////////////////////////////////////////////
@@ -276,98 +312,91 @@ static inline void CMP_RD_RS(int dest, u32 value)
 	u32 lhs = reg[dest].I;
 	u32 rhs = value;
 	u32 res = lhs - rhs;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = SUBCARRY(lhs, rhs, res);
-	V_FLAG = SUBOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_SUB(lhs, rhs, res);
 }
 
 // AND Rd, Rs
-static INSN_REGPARM void thumb40_0(u32 opcode)
+THUMB_INSN(40_0, RD_RS)
 {
-	int dest = opcode & 7;
-	reg[dest].I &= reg[(opcode >> 3)&7].I;
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
-	Z_FLAG = reg[dest].I ? false : true;
+	int dest = op.rd;
+	reg[dest].I &= reg[op.rs].I;
+	SET_FLAGS_NZ(reg[dest].I);
 }
 
 // EOR Rd, Rs
-static INSN_REGPARM void thumb40_1(u32 opcode)
+THUMB_INSN(40_1, RD_RS)
 {
-	int dest = opcode & 7;
-	reg[dest].I ^= reg[(opcode >> 3)&7].I;
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
-	Z_FLAG = reg[dest].I ? false : true;
+	int dest = op.rd;
+	reg[dest].I ^= reg[op.rs].I;
+	SET_FLAGS_NZ(reg[dest].I);
 }
 
 // LSL Rd, Rs
-static INSN_REGPARM void thumb40_2(u32 opcode)
+THUMB_INSN(40_2, RD_RS)
 {
-	int dest = opcode & 7;
-	u32 value = reg[(opcode >> 3)&7].B.B0;
+	int dest = op.rd;
+	u32 value = reg[op.rs].B.B0;
 	if (value)
 	{
 		if (value == 32)
 		{
 			value = 0;
-			C_FLAG = (reg[dest].I & 1 ? true : false);
+			SET_C_FLAG(reg[dest].I & 1);
 		}
 		else if (value < 32)
 		{
-			C_FLAG = (reg[dest].I >> (32 - value)) & 1 ? true : false;
+			SET_C_FLAG((reg[dest].I >> (32 - value)) & 1);
 			value = reg[dest].I << value;
 		}
 		else
 		{
 			value = 0;
-			C_FLAG = false;
+			SET_C_FLAG(false);
 		}
 		reg[dest].I = value;
 	}
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
-	Z_FLAG = reg[dest].I ? false : true;
+	SET_FLAGS_NZ(reg[dest].I);
 	clockTicks = codeTicksAccess16(armNextPC)+2;
 }
 
 // LSR Rd, Rs
-static INSN_REGPARM void thumb40_3(u32 opcode)
+THUMB_INSN(40_3, RD_RS)
 {
-	int dest = opcode & 7;
-	u32 value = reg[(opcode >> 3)&7].B.B0;
+	int dest = op.rd;
+	u32 value = reg[op.rs].B.B0;
 	if (value)
 	{
 		if (value == 32)
 		{
 			value = 0;
-			C_FLAG = (reg[dest].I & 0x80000000 ? true : false);
+			SET_C_FLAG(reg[dest].I & 0x80000000);
 		}
 		else if (value < 32)
 		{
-			C_FLAG = (reg[dest].I >> (value - 1)) & 1 ? true : false;
+			SET_C_FLAG((reg[dest].I >> (value - 1)) & 1);
 			value = reg[dest].I >> value;
 		}
 		else
 		{
 			value = 0;
-			C_FLAG = false;
+			SET_C_FLAG(false);
 		}
 		reg[dest].I = value;
 	}
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
-	Z_FLAG = reg[dest].I ? false : true;
+	SET_FLAGS_NZ(reg[dest].I);
 	clockTicks = codeTicksAccess16(armNextPC)+2;
 }
 
 // ASR Rd, Rs
-static INSN_REGPARM void thumb41_0(u32 opcode)
+THUMB_INSN(41_0, RD_RS)
 {
-	int dest = opcode & 7;
-	u32 value = reg[(opcode >> 3)&7].B.B0;
+	int dest = op.rd;
+	u32 value = reg[op.rs].B.B0;
 	if (value)
 	{
 		if (value < 32)
 		{
-			C_FLAG = ((s32)reg[dest].I >> (int)(value - 1)) & 1 ? true : false;
+			SET_C_FLAG(((s32)reg[dest].I >> (int)(value - 1)) & 1);
 			value = (s32)reg[dest].I >> (int)value;
 			reg[dest].I = value;
 		}
@@ -376,137 +405,121 @@ static INSN_REGPARM void thumb41_0(u32 opcode)
 			if (reg[dest].I & 0x80000000)
 			{
 				reg[dest].I = 0xFFFFFFFF;
-				C_FLAG = true;
+				SET_C_FLAG(true);
 			}
 			else
 			{
 				reg[dest].I = 0x00000000;
-				C_FLAG = false;
+				SET_C_FLAG(false);
 			}
 		}
 	}
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
-	Z_FLAG = reg[dest].I ? false : true;
+	SET_FLAGS_NZ(reg[dest].I);
 	clockTicks = codeTicksAccess16(armNextPC)+2;
 }
 
 // ADC Rd, Rs
-static INSN_REGPARM void thumb41_1(u32 opcode)
+THUMB_INSN(41_1, RD_RS)
 {
-	int dest = opcode & 0x07;
-	u32 value = reg[(opcode >> 3)&7].I;
+	int dest = op.rd;
+	u32 value = reg[op.rs].I;
 	u32 lhs = reg[dest].I;
 	u32 rhs = value;
-	u32 res = lhs + rhs + (u32)C_FLAG;
+	u32 res = lhs + rhs + (u32)C_FLAG();
 	reg[dest].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = ADDCARRY(lhs, rhs, res);
-	V_FLAG = ADDOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_ADD(lhs, rhs, res);
 }
 
 // SBC Rd, Rs
-static INSN_REGPARM void thumb41_2(u32 opcode)
+THUMB_INSN(41_2, RD_RS)
 {
-	int dest = opcode & 0x07;
-	u32 value = reg[(opcode >> 3)&7].I;
+	int dest = op.rd;
+	u32 value = reg[op.rs].I;
 	u32 lhs = reg[dest].I;
 	u32 rhs = value;
-	u32 res = lhs - rhs - !((u32)C_FLAG);
+	u32 res = lhs - rhs - !((u32)C_FLAG());
 	reg[dest].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = SUBCARRY(lhs, rhs, res);
-	V_FLAG = SUBOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_SUB(lhs, rhs, res);
 }
 
 // ROR Rd, Rs
-static INSN_REGPARM void thumb41_3(u32 opcode)
+THUMB_INSN(41_3, RD_RS)
 {
-	int dest = opcode & 7;
-	u32 value = reg[(opcode >> 3)&7].B.B0;
+	int dest = op.rd;
+	u32 value = reg[op.rs].B.B0;
 
 	if (value)
 	{
 		value = value & 0x1f;
 		if (value == 0)
 		{
-			C_FLAG = (reg[dest].I & 0x80000000 ? true : false);
+			SET_C_FLAG(reg[dest].I & 0x80000000);
 		}
 		else
 		{
-			C_FLAG = (reg[dest].I >> (value - 1)) & 1 ? true : false;
+			SET_C_FLAG((reg[dest].I >> (value - 1)) & 1);
 			value = ((reg[dest].I << (32 - value)) |
 			         (reg[dest].I >> value));
 			reg[dest].I = value;
 		}
 	}
 	clockTicks = codeTicksAccess16(armNextPC)+2;
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
-	Z_FLAG = reg[dest].I ? false : true;
+	SET_FLAGS_NZ(reg[dest].I);
 }
 
 // TST Rd, Rs
-static INSN_REGPARM void thumb42_0(u32 opcode)
+THUMB_INSN(42_0, RD_RS)
 {
-	u32 value = reg[opcode & 7].I & reg[(opcode >> 3) & 7].I;
-	N_FLAG = value & 0x80000000 ? true : false;
-	Z_FLAG = value ? false : true;
+	u32 value = reg[op.rd].I & reg[op.rs].I;
+	SET_FLAGS_NZ(value);
 }
 
 // NEG Rd, Rs
-static INSN_REGPARM void thumb42_1(u32 opcode)
+THUMB_INSN(42_1, RD_RS)
 {
-	int dest = opcode & 7;
-	int source = (opcode >> 3) & 7;
+	int dest = op.rd;
+	int source = op.rs;
 	u32 lhs = reg[source].I;
 	u32 rhs = 0;
 	u32 res = rhs - lhs;
 	reg[dest].I = res;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = SUBCARRY(rhs, lhs, res);
-	V_FLAG = SUBOVERFLOW(rhs, lhs, res);
+	SET_FLAGS_SUB(rhs, lhs, res);
 }
 
 // CMP Rd, Rs
-static INSN_REGPARM void thumb42_2(u32 opcode)
+THUMB_INSN(42_2, RD_RS)
 {
-	int dest = opcode & 7;
-	u32 value = reg[(opcode >> 3)&7].I;
+	int dest = op.rd;
+	u32 value = reg[op.rs].I;
 	CMP_RD_RS(dest, value);
 }
 
 // CMN Rd, Rs
-static INSN_REGPARM void thumb42_3(u32 opcode)
+THUMB_INSN(42_3, RD_RS)
 {
-	int dest = opcode & 7;
-	u32 value = reg[(opcode >> 3)&7].I;
+	int dest = op.rd;
+	u32 value = reg[op.rs].I;
 	u32 lhs = reg[dest].I;
 	u32 rhs = value;
 	u32 res = lhs + rhs;
-	Z_FLAG = (res == 0) ? true : false;
-	N_FLAG = NEG(res) ? true : false;
-	C_FLAG = ADDCARRY(lhs, rhs, res);
-	V_FLAG = ADDOVERFLOW(lhs, rhs, res);
+	SET_FLAGS_ADD(lhs, rhs, res);
 }
 
 // ORR Rd, Rs
-static INSN_REGPARM void thumb43_0(u32 opcode)
+THUMB_INSN(43_0, RD_RS)
 {
-	int dest = opcode & 7;
-	reg[dest].I |= reg[(opcode >> 3) & 7].I;
-	Z_FLAG = reg[dest].I ? false : true;
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
+	int dest = op.rd;
+	reg[dest].I |= reg[op.rs].I;
+	SET_FLAGS_NZ(reg[dest].I);
 }
 
 // MUL Rd, Rs
-static INSN_REGPARM void thumb43_1(u32 opcode)
+THUMB_INSN(43_1, RD_RS)
 {
 	clockTicks = 1;
-	int dest = opcode & 7;
+	int dest = op.rd;
 	u32 rm = reg[dest].I;
-	reg[dest].I = reg[(opcode >> 3) & 7].I * rm;
+	reg[dest].I = reg[op.rs].I * rm;
 	if (((s32)rm) < 0)
 		rm = ~rm;
 	if ((rm & 0xFFFFFF00) == 0)
@@ -519,41 +532,38 @@ static INSN_REGPARM void thumb43_1(u32 opcode)
 		clockTicks += 3;
 	busPrefetchCount = (busPrefetchCount<<clockTicks) | (0xFF>>(8-clockTicks));
 	clockTicks += codeTicksAccess16(armNextPC) + 1;
-	Z_FLAG = reg[dest].I ? false : true;
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
+	SET_FLAGS_NZ(reg[dest].I);
 }
 
 // BIC Rd, Rs
-static INSN_REGPARM void thumb43_2(u32 opcode)
+THUMB_INSN(43_2, RD_RS)
 {
-	int dest = opcode & 7;
-	reg[dest].I &= (~reg[(opcode >> 3) & 7].I);
-	Z_FLAG = reg[dest].I ? false : true;
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
+	int dest = op.rd;
+	reg[dest].I &= (~reg[op.rs].I);
+	SET_FLAGS_NZ(reg[dest].I);
 }
 
 // MVN Rd, Rs
-static INSN_REGPARM void thumb43_3(u32 opcode)
+THUMB_INSN(43_3, RD_RS)
 {
-	int dest = opcode & 7;
-	reg[dest].I = ~reg[(opcode >> 3) & 7].I;
-	Z_FLAG = reg[dest].I ? false : true;
-	N_FLAG = reg[dest].I & 0x80000000 ? true : false;
+	int dest = op.rd;
+	reg[dest].I = ~reg[op.rs].I;
+	SET_FLAGS_NZ(reg[dest].I);
 }
 
 // High-register instructions and BX //////////////////////////////////////
 
 // ADD Rd, Hs
-static INSN_REGPARM void thumb44_1(u32 opcode)
+THUMB_INSN(44_1, RD_RS)
 {
-	reg[opcode&7].I += reg[((opcode>>3)&7)+8].I;
+	reg[op.rd].I += reg[op.rs+8].I;
 }
 
 // ADD Hd, Rs
-static INSN_REGPARM void thumb44_2(u32 opcode)
+THUMB_INSN(44_2, RD_RS)
 {
-	reg[(opcode&7)+8].I += reg[(opcode>>3)&7].I;
-	if ((opcode&7) == 7)
+	reg[op.rd+8].I += reg[op.rs].I;
+	if (op.rd == 7)
 	{
 		reg[15].I &= 0xFFFFFFFE;
 		armNextPC = reg[15].I;
@@ -565,10 +575,10 @@ static INSN_REGPARM void thumb44_2(u32 opcode)
 }
 
 // ADD Hd, Hs
-static INSN_REGPARM void thumb44_3(u32 opcode)
+THUMB_INSN(44_3, RD_RS)
 {
-	reg[(opcode&7)+8].I += reg[((opcode>>3)&7)+8].I;
-	if ((opcode&7) == 7)
+	reg[op.rd+8].I += reg[op.rs+8].I;
+	if (op.rd == 7)
 	{
 		reg[15].I &= 0xFFFFFFFE;
 		armNextPC = reg[15].I;
@@ -580,48 +590,48 @@ static INSN_REGPARM void thumb44_3(u32 opcode)
 }
 
 // CMP Rd, Hs
-static INSN_REGPARM void thumb45_1(u32 opcode)
+THUMB_INSN(45_1, RD_RS)
 {
-	int dest = opcode & 7;
-	u32 value = reg[((opcode>>3)&7)+8].I;
+	int dest = op.rd;
+	u32 value = reg[op.rs+8].I;
 	CMP_RD_RS(dest, value);
 }
 
 // CMP Hd, Rs
-static INSN_REGPARM void thumb45_2(u32 opcode)
+THUMB_INSN(45_2, RD_RS)
 {
-	int dest = (opcode & 7) + 8;
-	u32 value = reg[(opcode>>3)&7].I;
+	int dest = op.rd + 8;
+	u32 value = reg[op.rs].I;
 	CMP_RD_RS(dest, value);
 }
 
 // CMP Hd, Hs
-static INSN_REGPARM void thumb45_3(u32 opcode)
+THUMB_INSN(45_3, RD_RS)
 {
-	int dest = (opcode & 7) + 8;
-	u32 value = reg[((opcode>>3)&7)+8].I;
+	int dest = op.rd + 8;
+	u32 value = reg[op.rs+8].I;
 	CMP_RD_RS(dest, value);
 }
 
 // MOV Rd, Rs
-static INSN_REGPARM void thumb46_0(u32 opcode)
+THUMB_INSN(46_0, RD_RS)
 {
-	reg[opcode&7].I = reg[((opcode>>3)&7)].I;
+	reg[op.rd].I = reg[op.rs].I;
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
 }
 
 // MOV Rd, Hs
-static INSN_REGPARM void thumb46_1(u32 opcode)
+THUMB_INSN(46_1, RD_RS)
 {
-	reg[opcode&7].I = reg[((opcode>>3)&7)+8].I;
+	reg[op.rd].I = reg[op.rs+8].I;
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
 }
 
 // MOV Hd, Rs
-static INSN_REGPARM void thumb46_2(u32 opcode)
+THUMB_INSN(46_2, RD_RS)
 {
-	reg[(opcode&7)+8].I = reg[(opcode>>3)&7].I;
-	if ((opcode&7) == 7)
+	reg[op.rd+8].I = reg[op.rs].I;
+	if (op.rd == 7)
 	{
 		reg[15].I &= 0xFFFFFFFE;
 		armNextPC = reg[15].I;
@@ -633,10 +643,10 @@ static INSN_REGPARM void thumb46_2(u32 opcode)
 }
 
 // MOV Hd, Hs
-static INSN_REGPARM void thumb46_3(u32 opcode)
+THUMB_INSN(46_3, RD_RS)
 {
-	reg[(opcode&7)+8].I = reg[((opcode>>3)&7)+8].I;
-	if ((opcode&7) == 7)
+	reg[op.rd+8].I = reg[op.rs+8].I;
+	if (op.rd == 7)
 	{
 		reg[15].I &= 0xFFFFFFFE;
 		armNextPC = reg[15].I;
@@ -676,175 +686,175 @@ static INSN_REGPARM void thumb47(u32 opcode)
 // Load/store instructions ////////////////////////////////////////////////
 
 // LDR R0~R7,[PC, #Imm]
-static INSN_REGPARM void thumb48(u32 opcode)
+THUMB_INSN(48, WORD8)
 {
-	u8 regist = (opcode >> 8) & 7;
+	u8 regist = op.rd;
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = (reg[15].I & 0xFFFFFFFC) + ((opcode & 0xFF) << 2);
+	u32 address = (reg[15].I & 0xFFFFFFFC) + op.imm;
 	reg[regist].I = MMU::read32(address);
 	busPrefetchCount=0;
 	clockTicks = 3 + dataTicksAccess32(address) + codeTicksAccess16(armNextPC);
 }
 
 // STR Rd, [Rs, Rn]
-static INSN_REGPARM void thumb50(u32 opcode)
+THUMB_INSN(50, RD_RS_RN)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + reg[(opcode>>6)&7].I;
-	MMU::write32(address, reg[opcode & 7].I);
+	u32 address = reg[op.rs].I + reg[op.rn].I;
+	MMU::write32(address, reg[op.rd].I);
 	clockTicks = dataTicksAccess32(address) + codeTicksAccess16(armNextPC) + 2;
 }
 
 // STRH Rd, [Rs, Rn]
-static INSN_REGPARM void thumb52(u32 opcode)
+THUMB_INSN(52, RD_RS_RN)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + reg[(opcode>>6)&7].I;
-	MMU::write16(address, reg[opcode&7].W.W0);
+	u32 address = reg[op.rs].I + reg[op.rn].I;
+	MMU::write16(address, reg[op.rd].W.W0);
 	clockTicks = dataTicksAccess16(address) + codeTicksAccess16(armNextPC) + 2;
 }
 
 // STRB Rd, [Rs, Rn]
-static INSN_REGPARM void thumb54(u32 opcode)
+THUMB_INSN(54, RD_RS_RN)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + reg[(opcode >>6)&7].I;
-	MMU::write8(address, reg[opcode & 7].B.B0);
+	u32 address = reg[op.rs].I + reg[op.rn].I;
+	MMU::write8(address, reg[op.rd].B.B0);
 	clockTicks = dataTicksAccess16(address) + codeTicksAccess16(armNextPC) + 2;
 }
 
 // LDSB Rd, [Rs, Rn]
-static INSN_REGPARM void thumb56(u32 opcode)
+THUMB_INSN(56, RD_RS_RN)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + reg[(opcode>>6)&7].I;
-	reg[opcode&7].I = (s8)MMU::read8(address);
+	u32 address = reg[op.rs].I + reg[op.rn].I;
+	reg[op.rd].I = (s8)MMU::read8(address);
 	clockTicks = 3 + dataTicksAccess16(address) + codeTicksAccess16(armNextPC);
 }
 
 // LDR Rd, [Rs, Rn]
-static INSN_REGPARM void thumb58(u32 opcode)
+THUMB_INSN(58, RD_RS_RN)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + reg[(opcode>>6)&7].I;
-	reg[opcode&7].I = MMU::read32(address);
+	u32 address = reg[op.rs].I + reg[op.rn].I;
+	reg[op.rd].I = MMU::read32(address);
 	clockTicks = 3 + dataTicksAccess32(address) + codeTicksAccess16(armNextPC);
 }
 
 // LDRH Rd, [Rs, Rn]
-static INSN_REGPARM void thumb5A(u32 opcode)
+THUMB_INSN(5A, RD_RS_RN)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + reg[(opcode>>6)&7].I;
-	reg[opcode&7].I = MMU::read16(address);
+	u32 address = reg[op.rs].I + reg[op.rn].I;
+	reg[op.rd].I = MMU::read16(address);
 	clockTicks = 3 + dataTicksAccess32(address) + codeTicksAccess16(armNextPC);
 }
 
 // LDRB Rd, [Rs, Rn]
-static INSN_REGPARM void thumb5C(u32 opcode)
+THUMB_INSN(5C, RD_RS_RN)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + reg[(opcode>>6)&7].I;
-	reg[opcode&7].I = MMU::read8(address);
+	u32 address = reg[op.rs].I + reg[op.rn].I;
+	reg[op.rd].I = MMU::read8(address);
 	clockTicks = 3 + dataTicksAccess16(address) + codeTicksAccess16(armNextPC);
 }
 
 // LDSH Rd, [Rs, Rn]
-static INSN_REGPARM void thumb5E(u32 opcode)
+THUMB_INSN(5E, RD_RS_RN)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + reg[(opcode>>6)&7].I;
-	reg[opcode&7].I = (s16)MMU::read16s(address);
+	u32 address = reg[op.rs].I + reg[op.rn].I;
+	reg[op.rd].I = (s16)MMU::read16s(address);
 	clockTicks = 3 + dataTicksAccess16(address) + codeTicksAccess16(armNextPC);
 }
 
 // STR Rd, [Rs, #Imm]
-static INSN_REGPARM void thumb60(u32 opcode)
+THUMB_INSN(60, WORD5)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + (((opcode>>6)&31)<<2);
-	MMU::write32(address, reg[opcode&7].I);
+	u32 address = reg[op.rs].I + op.imm;
+	MMU::write32(address, reg[op.rd].I);
 	clockTicks = dataTicksAccess32(address) + codeTicksAccess16(armNextPC) + 2;
 }
 
 // LDR Rd, [Rs, #Imm]
-static INSN_REGPARM void thumb68(u32 opcode)
+THUMB_INSN(68, WORD5)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + (((opcode>>6)&31)<<2);
-	reg[opcode&7].I = MMU::read32(address);
+	u32 address = reg[op.rs].I + op.imm;
+	reg[op.rd].I = MMU::read32(address);
 	clockTicks = 3 + dataTicksAccess32(address) + codeTicksAccess16(armNextPC);
 }
 
 // STRB Rd, [Rs, #Imm]
-static INSN_REGPARM void thumb70(u32 opcode)
+THUMB_INSN(70, BYTE5)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + (((opcode>>6)&31));
-	MMU::write8(address, reg[opcode&7].B.B0);
+	u32 address = reg[op.rs].I + op.imm;
+	MMU::write8(address, reg[op.rd].B.B0);
 	clockTicks = dataTicksAccess16(address) + codeTicksAccess16(armNextPC) + 2;
 }
 
 // LDRB Rd, [Rs, #Imm]
-static INSN_REGPARM void thumb78(u32 opcode)
+THUMB_INSN(78, BYTE5)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + (((opcode>>6)&31));
-	reg[opcode&7].I = MMU::read8(address);
+	u32 address = reg[op.rs].I + op.imm;
+	reg[op.rd].I = MMU::read8(address);
 	clockTicks = 3 + dataTicksAccess16(address) + codeTicksAccess16(armNextPC);
 }
 
 // STRH Rd, [Rs, #Imm]
-static INSN_REGPARM void thumb80(u32 opcode)
+THUMB_INSN(80, HALF5)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + (((opcode>>6)&31)<<1);
-	MMU::write16(address, reg[opcode&7].W.W0);
+	u32 address = reg[op.rs].I + op.imm;
+	MMU::write16(address, reg[op.rd].W.W0);
 	clockTicks = dataTicksAccess16(address) + codeTicksAccess16(armNextPC) + 2;
 }
 
 // LDRH Rd, [Rs, #Imm]
-static INSN_REGPARM void thumb88(u32 opcode)
+THUMB_INSN(88, HALF5)
 {
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[(opcode>>3)&7].I + (((opcode>>6)&31)<<1);
-	reg[opcode&7].I = MMU::read16(address);
+	u32 address = reg[op.rs].I + op.imm;
+	reg[op.rd].I = MMU::read16(address);
 	clockTicks = 3 + dataTicksAccess16(address) + codeTicksAccess16(armNextPC);
 }
 
 // STR R0~R7, [SP, #Imm]
-static INSN_REGPARM void thumb90(u32 opcode)
+THUMB_INSN(90, WORD8)
 {
-	u8 regist = (opcode >> 8) & 7;
+	u8 regist = op.rd;
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[13].I + ((opcode&255)<<2);
+	u32 address = reg[13].I + op.imm;
 	MMU::write32(address, reg[regist].I);
 	clockTicks = dataTicksAccess32(address) + codeTicksAccess16(armNextPC) + 2;
 }
 
 // LDR R0~R7, [SP, #Imm]
-static INSN_REGPARM void thumb98(u32 opcode)
+THUMB_INSN(98, WORD8)
 {
-	u8 regist = (opcode >> 8) & 7;
+	u8 regist = op.rd;
 	if (busPrefetchCount == 0)
 		busPrefetch = busPrefetchEnable;
-	u32 address = reg[13].I + ((opcode&255)<<2);
+	u32 address = reg[13].I + op.imm;
 	reg[regist].I = MMU::read32(address);
 	clockTicks = 3 + dataTicksAccess32(address) + codeTicksAccess16(armNextPC);
 }
@@ -852,28 +862,25 @@ static INSN_REGPARM void thumb98(u32 opcode)
 // PC/stack-related ///////////////////////////////////////////////////////
 
 // ADD R0~R7, PC, Imm
-static INSN_REGPARM void thumbA0(u32 opcode)
+THUMB_INSN(A0, WORD8)
 {
-	u8 regist = (opcode >> 8) & 7;
-	reg[regist].I = (reg[15].I & 0xFFFFFFFC) + ((opcode&255)<<2);
+	u8 regist = op.rd;
+	reg[regist].I = (reg[15].I & 0xFFFFFFFC) + op.imm;
 	clockTicks = 1 + codeTicksAccess16(armNextPC);
 }
 
 // ADD R0~R7, SP, Imm
-static INSN_REGPARM void thumbA8(u32 opcode)
+THUMB_INSN(A8, WORD8)
 {
-	u8 regist = (opcode >> 8) & 7;
-	reg[regist].I = reg[13].I + ((opcode&255)<<2);
+	u8 regist = op.rd;
+	reg[regist].I = reg[13].I + op.imm;
 	clockTicks = 1 + codeTicksAccess16(armNextPC);
 }
 
 // ADD SP, Imm
-static INSN_REGPARM void thumbB0(u32 opcode)
+THUMB_INSN(B0, SP)
 {
-	int offset = (opcode & 127) << 2;
-	if (opcode & 0x80)
-		offset = -offset;
-	reg[13].I += offset;
+	reg[13].I += op.imm;
 	clockTicks = 1 + codeTicksAccess16(armNextPC);
 }
 
@@ -1096,12 +1103,12 @@ static INSN_REGPARM void thumbC8(u32 opcode)
 // Conditional branches ///////////////////////////////////////////////////
 
 // BEQ offset
-static INSN_REGPARM void thumbD0(u32 opcode)
+THUMB_INSN(D0, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (Z_FLAG)
+	if (Z_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1111,12 +1118,12 @@ static INSN_REGPARM void thumbD0(u32 opcode)
 }
 
 // BNE offset
-static INSN_REGPARM void thumbD1(u32 opcode)
+THUMB_INSN(D1, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (!Z_FLAG)
+	if (!Z_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1126,12 +1133,12 @@ static INSN_REGPARM void thumbD1(u32 opcode)
 }
 
 // BCS offset
-static INSN_REGPARM void thumbD2(u32 opcode)
+THUMB_INSN(D2, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (C_FLAG)
+	if (C_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1141,12 +1148,12 @@ static INSN_REGPARM void thumbD2(u32 opcode)
 }
 
 // BCC offset
-static INSN_REGPARM void thumbD3(u32 opcode)
+THUMB_INSN(D3, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (!C_FLAG)
+	if (!C_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1156,12 +1163,12 @@ static INSN_REGPARM void thumbD3(u32 opcode)
 }
 
 // BMI offset
-static INSN_REGPARM void thumbD4(u32 opcode)
+THUMB_INSN(D4, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (N_FLAG)
+	if (N_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1171,12 +1178,12 @@ static INSN_REGPARM void thumbD4(u32 opcode)
 }
 
 // BPL offset
-static INSN_REGPARM void thumbD5(u32 opcode)
+THUMB_INSN(D5, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (!N_FLAG)
+	if (!N_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1186,12 +1193,12 @@ static INSN_REGPARM void thumbD5(u32 opcode)
 }
 
 // BVS offset
-static INSN_REGPARM void thumbD6(u32 opcode)
+THUMB_INSN(D6, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (V_FLAG)
+	if (V_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1201,12 +1208,12 @@ static INSN_REGPARM void thumbD6(u32 opcode)
 }
 
 // BVC offset
-static INSN_REGPARM void thumbD7(u32 opcode)
+THUMB_INSN(D7, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (!V_FLAG)
+	if (!V_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1216,12 +1223,12 @@ static INSN_REGPARM void thumbD7(u32 opcode)
 }
 
 // BHI offset
-static INSN_REGPARM void thumbD8(u32 opcode)
+THUMB_INSN(D8, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (C_FLAG && !Z_FLAG)
+	if (C_FLAG() && !Z_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1231,12 +1238,12 @@ static INSN_REGPARM void thumbD8(u32 opcode)
 }
 
 // BLS offset
-static INSN_REGPARM void thumbD9(u32 opcode)
+THUMB_INSN(D9, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (!C_FLAG || Z_FLAG)
+	if (!C_FLAG() || Z_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1246,12 +1253,12 @@ static INSN_REGPARM void thumbD9(u32 opcode)
 }
 
 // BGE offset
-static INSN_REGPARM void thumbDA(u32 opcode)
+THUMB_INSN(DA, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (N_FLAG == V_FLAG)
+	if (N_FLAG() == V_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1261,12 +1268,12 @@ static INSN_REGPARM void thumbDA(u32 opcode)
 }
 
 // BLT offset
-static INSN_REGPARM void thumbDB(u32 opcode)
+THUMB_INSN(DB, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (N_FLAG != V_FLAG)
+	if (N_FLAG() != V_FLAG())
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1276,12 +1283,12 @@ static INSN_REGPARM void thumbDB(u32 opcode)
 }
 
 // BGT offset
-static INSN_REGPARM void thumbDC(u32 opcode)
+THUMB_INSN(DC, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (!Z_FLAG && (N_FLAG == V_FLAG))
+	if (!Z_FLAG() && (N_FLAG() == V_FLAG()))
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1291,12 +1298,12 @@ static INSN_REGPARM void thumbDC(u32 opcode)
 }
 
 // BLE offset
-static INSN_REGPARM void thumbDD(u32 opcode)
+THUMB_INSN(DD, BRANCH8)
 {
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
-	if (Z_FLAG || (N_FLAG != V_FLAG))
+	if (Z_FLAG() || (N_FLAG() != V_FLAG()))
 	{
-		reg[15].I += ((s8)(opcode & 0xFF)) << 1;
+		reg[15].I += op.imm;
 		armNextPC = reg[15].I;
 		reg[15].I += 2;
 		THUMB_PREFETCH();
@@ -1317,12 +1324,9 @@ static INSN_REGPARM void thumbDF(u32 opcode)
 }
 
 // B offset
-static INSN_REGPARM void thumbE0(u32 opcode)
+THUMB_INSN(E0, BRANCH11)
 {
-	int offset = (opcode & 0x3FF) << 1;
-	if (opcode & 0x0400)
-		offset |= 0xFFFFF800;
-	reg[15].I += offset;
+	reg[15].I += op.imm;
 	armNextPC = reg[15].I;
 	reg[15].I += 2;
 	THUMB_PREFETCH();
@@ -1331,25 +1335,25 @@ static INSN_REGPARM void thumbE0(u32 opcode)
 }
 
 // BLL #offset (forward)
-static INSN_REGPARM void thumbF0(u32 opcode)
+THUMB_INSN(F0, IMM11)
 {
-	int offset = (opcode & 0x7FF);
+	int offset = op.imm;
 	reg[14].I = reg[15].I + (offset << 12);
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
 }
 
 // BLL #offset (backward)
-static INSN_REGPARM void thumbF4(u32 opcode)
+THUMB_INSN(F4, IMM11)
 {
-	int offset = (opcode & 0x7FF);
+	int offset = op.imm;
 	reg[14].I = reg[15].I + ((offset << 12) | 0xFF800000);
 	clockTicks = codeTicksAccessSeq16(armNextPC) + 1;
 }
 
 // BLH #offset
-static INSN_REGPARM void thumbF8(u32 opcode)
+THUMB_INSN(F8, IMM11)
 {
-	int offset = (opcode & 0x7FF);
+	int offset = op.imm;
 	u32 temp = reg[15].I-2;
 	reg[15].I = (reg[14].I + (offset<<1))&0xFFFFFFFE;
 	armNextPC = reg[15].I;
@@ -1362,7 +1366,6 @@ static INSN_REGPARM void thumbF8(u32 opcode)
 
 // Instruction table //////////////////////////////////////////////////////
 
-typedef INSN_REGPARM void (*insnfunc_t)(u32 opcode);
 #define thumbUI thumbUnknownInsn
 #define thumbBP thumbUnknownInsn
 static insnfunc_t thumbInsnTable[1024] =
@@ -1497,37 +1500,352 @@ static insnfunc_t thumbInsnTable[1024] =
 	thumbF8,thumbF8,thumbF8,thumbF8,thumbF8,thumbF8,thumbF8,thumbF8,
 };
 
+// Threaded code /////////////////////////////////////////////////////////
+
+// Thumb code running from the cartridge ROM is translated page by page into
+// threaded code: one slot per halfword holding the handler to call and the
+// operands extracted from the opcode. Sequential execution moves from one
+// slot to the next without going through the prefetch and the instruction
+// table. The ROM never changes, so the translation only needs to be dropped
+// on reset.
+
+// Handlers of the threaded code taking the extracted operands, the other
+// instructions run through thumbThreadedOpcode
+struct ThumbThreadedHandler
+{
+	insnfunc_t func;
+	threadedfunc_t threaded;
+	ThumbOperandsKind kind;
+};
+
+#define THREADED(CODE, KIND) { thumb##CODE, thumb##CODE##Threaded, THUMB_OPERANDS_##KIND }
+#define THREADED_N(CODE, KIND, N) { thumb##CODE<N>, thumb##CODE##Threaded, THUMB_OPERANDS_##KIND }
+#define THREADED_8(CODE, KIND, N) \
+    THREADED_N(CODE, KIND, N + 0), THREADED_N(CODE, KIND, N + 1), \
+    THREADED_N(CODE, KIND, N + 2), THREADED_N(CODE, KIND, N + 3), \
+    THREADED_N(CODE, KIND, N + 4), THREADED_N(CODE, KIND, N + 5), \
+    THREADED_N(CODE, KIND, N + 6), THREADED_N(CODE, KIND, N + 7)
+#define THREADED_32(CODE, KIND) \
+    THREADED_8(CODE, KIND, 0), THREADED_8(CODE, KIND, 8), \
+    THREADED_8(CODE, KIND, 16), THREADED_8(CODE, KIND, 24)
+static const ThumbThreadedHandler thumbThreadedHandlers[] =
+{
+	THREADED_32(00, SHIFT), THREADED_32(08, SHIFT), THREADED_32(10, SHIFT),
+	THREADED_8(18, RD_RS_RN, 0), THREADED_8(1A, RD_RS_RN, 0),
+	THREADED_8(1C, RD_RS_RN, 0), THREADED_8(1E, RD_RS_RN, 0),
+	THREADED_8(20, IMM8, 0), THREADED_8(28, IMM8, 0),
+	THREADED_8(30, IMM8, 0), THREADED_8(38, IMM8, 0),
+	THREADED(40_0, RD_RS), THREADED(40_1, RD_RS), THREADED(40_2, RD_RS), THREADED(40_3, RD_RS),
+	THREADED(41_0, RD_RS), THREADED(41_1, RD_RS), THREADED(41_2, RD_RS), THREADED(41_3, RD_RS),
+	THREADED(42_0, RD_RS), THREADED(42_1, RD_RS), THREADED(42_2, RD_RS), THREADED(42_3, RD_RS),
+	THREADED(43_0, RD_RS), THREADED(43_1, RD_RS), THREADED(43_2, RD_RS), THREADED(43_3, RD_RS),
+	THREADED(44_1, RD_RS), THREADED(44_2, RD_RS), THREADED(44_3, RD_RS),
+	THREADED(45_1, RD_RS), THREADED(45_2, RD_RS), THREADED(45_3, RD_RS),
+	THREADED(46_0, RD_RS), THREADED(46_1, RD_RS), THREADED(46_2, RD_RS), THREADED(46_3, RD_RS),
+	THREADED(48, WORD8),
+	THREADED(50, RD_RS_RN), THREADED(52, RD_RS_RN), THREADED(54, RD_RS_RN), THREADED(56, RD_RS_RN),
+	THREADED(58, RD_RS_RN), THREADED(5A, RD_RS_RN), THREADED(5C, RD_RS_RN), THREADED(5E, RD_RS_RN),
+	THREADED(60, WORD5), THREADED(68, WORD5), THREADED(70, BYTE5), THREADED(78, BYTE5),
+	THREADED(80, HALF5), THREADED(88, HALF5), THREADED(90, WORD8), THREADED(98, WORD8),
+	THREADED(A0, WORD8), THREADED(A8, WORD8), THREADED(B0, SP),
+	THREADED(D0, BRANCH8), THREADED(D1, BRANCH8), THREADED(D2, BRANCH8), THREADED(D3, BRANCH8),
+	THREADED(D4, BRANCH8), THREADED(D5, BRANCH8), THREADED(D6, BRANCH8), THREADED(D7, BRANCH8),
+	THREADED(D8, BRANCH8), THREADED(D9, BRANCH8), THREADED(DA, BRANCH8), THREADED(DB, BRANCH8),
+	THREADED(DC, BRANCH8), THREADED(DD, BRANCH8),
+	THREADED(E0, BRANCH11), THREADED(F0, IMM11), THREADED(F4, IMM11), THREADED(F8, IMM11)
+};
+
+static INSN_REGPARM void thumbThreadedOpcode(const ThumbSlot *slot)
+{
+	(*slot->func)(slot->opcode);
+}
+
+// Threaded handler of each entry of thumbInsnTable, NULL when it runs through
+// thumbThreadedOpcode
+static const ThumbThreadedHandler *thumbThreadedTable[1024];
+static bool thumbThreadedTableReady;
+
+static void thumbThreadedTableInit()
+{
+	for (int i = 0; i < 1024; i++)
+	{
+		thumbThreadedTable[i] = NULL;
+		for (size_t j = 0; j < G_N_ELEMENTS(thumbThreadedHandlers); j++)
+		{
+			if (thumbThreadedHandlers[j].func == thumbInsnTable[i])
+			{
+				thumbThreadedTable[i] = &thumbThreadedHandlers[j];
+				break;
+			}
+		}
+	}
+
+	thumbThreadedTableReady = true;
+}
+
+#define THUMB_PAGE_SHIFT 12
+#define THUMB_PAGE_SLOTS (1 << (THUMB_PAGE_SHIFT - 1))
+
+static ThumbSlot *thumbPages[0x2000000 >> THUMB_PAGE_SHIFT];
+
+static bool thumbInsnCheckState(u16 opcode, insnfunc_t func)
+{
+	// BX and SWI
+	if ((opcode & 0xFF00) == 0x4700 || (opcode & 0xFF00) == 0xDF00)
+		return true;
+	// Stores, which can write to HALTCNT
+	if ((opcode >> 12) >= 5 && (opcode >> 12) <= 9 && !(opcode & 0x0800))
+		return true;
+	// PUSH and STMIA
+	if ((opcode & 0xFE00) == 0xB400 || (opcode & 0xF800) == 0xC000)
+		return true;
+	return func == thumbUnknownInsn;
+}
+
+static void thumbSlotFill(ThumbSlot *slot, u16 opcode)
+{
+	const ThumbThreadedHandler *handler = thumbThreadedTable[opcode>>6];
+
+	slot->func = thumbInsnTable[opcode>>6];
+	slot->opcode = opcode;
+	slot->checkState = thumbInsnCheckState(opcode, slot->func);
+
+	if (handler != NULL)
+	{
+		slot->threaded = handler->threaded;
+		slot->op = thumbOperandsDecode(opcode, handler->kind);
+	}
+	else
+	{
+		slot->threaded = thumbThreadedOpcode;
+		slot->op = thumbOperandsDecode(opcode, THUMB_OPERANDS_RD_RS);
+	}
+}
+
+static ThumbSlot *thumbTranslatePage(u32 page)
+{
+	ThumbSlot *slots = new ThumbSlot[THUMB_PAGE_SLOTS];
+	u32 address = 0x08000000 | (page << THUMB_PAGE_SHIFT);
+
+	if (UNLIKELY(!thumbThreadedTableReady))
+		thumbThreadedTableInit();
+
+	for (int i = 0; i < THUMB_PAGE_SLOTS; i++, address += 2)
+		thumbSlotFill(&slots[i], MMU::read16(address));
+
+	thumbPages[page] = slots;
+	return slots;
+}
+
+// SWI runs the BIOS, running it twice would not give the same result
+static inline bool thumbInsnRunsOnce(u16 opcode)
+{
+	return (opcode & 0xFF00) == 0xDF00;
+}
+
+// Compare a slot with the instruction the interpreter would have fetched,
+// and translate it again if they differ. This is all the self-check does
+// for the instructions that can only run once.
+static void thumbSlotCheck(ThumbSlot *slot, u32 address)
+{
+	u16 opcode = MMU::read16(address);
+	insnfunc_t func = thumbInsnTable[opcode>>6];
+
+	if (slot->opcode != opcode || slot->func != func)
+	{
+		g_message("Thumb threaded code mismatch at %08x: translated %04x, memory %04x\n",
+		    address, slot->opcode, opcode);
+
+		thumbSlotFill(slot, opcode);
+	}
+}
+
+static inline ThumbSlot *thumbThreadedSlot(u32 address)
+{
+	if ((address >> 24) < 0x08 || (address >> 24) > 0x0C)
+		return NULL;
+
+	u32 page = (address & 0x1FFFFFF) >> THUMB_PAGE_SHIFT;
+	ThumbSlot *slots = thumbPages[page];
+	if (UNLIKELY(slots == NULL))
+		slots = thumbTranslatePage(page);
+
+	return &slots[(address >> 1) & (THUMB_PAGE_SLOTS - 1)];
+}
+
+// Run the instruction the threaded code has just run at address again
+// through the interpreter and compare both runs. The threaded run is the one
+// kept, the slot is translated again if they differ.
+static void thumbSelfCheck(ThumbSlot *slot, u32 address)
+{
+	selfCheckReplay(clockTicks);
+
+	u16 opcode = MMU::read16(address);
+	if (slot->opcode != opcode)
+	{
+		g_message("Thumb threaded code mismatch at %08x: translated %04x, memory %04x\n",
+		    address, slot->opcode, opcode);
+	}
+
+	busPrefetch = false;
+	if (busPrefetchCount & 0xFFFFFF00)
+		busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+	clockTicks = 0;
+
+	armNextPC = reg[15].I;
+	reg[15].I += 2;
+	THUMB_PREFETCH_NEXT();
+
+	(*thumbInsnTable[opcode>>6])(opcode);
+
+	if (!selfCheckEnd("Thumb threaded code", address, opcode, clockTicks) || slot->opcode != opcode)
+		thumbSlotFill(slot, opcode);
+}
+
+void thumbCacheFlush()
+{
+	for (u32 i = 0; i < G_N_ELEMENTS(thumbPages); i++)
+	{
+		delete[] thumbPages[i];
+		thumbPages[i] = NULL;
+	}
+}
+
 // Wrapper routine (execution loop) ///////////////////////////////////////
 
+int thumbInsnRun(u32 opcode)
+{
+	u32 address = armNextPC;
+
+	busPrefetch = false;
+	if (busPrefetchCount & 0xFFFFFF00)
+		busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+	clockTicks = 0;
+
+	armNextPC = reg[15].I;
+	reg[15].I += 2;
+
+	(*thumbInsnTable[opcode>>6])(opcode);
+
+	if (clockTicks == 0)
+		clockTicks = codeTicksAccessSeq16(address) + 1;
+
+	return clockTicks;
+}
+
 int thumbExecute()
 {
+	bool threaded = settings_threaded_thumb();
+	bool selfCheck = settings_cpu_self_check();
+	bool recompiler = settings_thumb_recompiler();
+	// Set when cpuPrefetch has not been kept up to date by threaded code
+	bool prefetchStale = false;
+	ThumbSlot *slot = NULL;
+	bool checkState;
+
+	idleLoopRestart();
+
 	do
 	{
-		u32 opcode = cpuPrefetch[0];
-		cpuPrefetch[0] = cpuPrefetch[1];
-
-		busPrefetch = false;
-		if (busPrefetchCount & 0xFFFFFF00)
-			busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
-		clockTicks = 0;
 		u32 oldArmNextPC = armNextPC;
 
-		armNextPC = reg[15].I;
-		reg[15].I += 2;
-		THUMB_PREFETCH_NEXT();
+		if (recompiler && slot == NULL)
+		{
+			u32 last;
+			if (jitRun(selfCheck, last))
+			{
+				prefetchStale = true;
+				checkState = true;
 
-		(*thumbInsnTable[opcode>>6])(opcode);
+				if (UNLIKELY(armNextPC < last) && idleLoopEnabled)
+					idleLoopBranch(last, armNextPC);
+				continue;
+			}
+		}
+
+		if (threaded && slot == NULL)
+			slot = thumbThreadedSlot(armNextPC);
+
+		if (slot != NULL)
+		{
+			bool checking = false;
+			if (UNLIKELY(selfCheck))
+			{
+				if (thumbInsnRunsOnce(slot->opcode))
+					thumbSlotCheck(slot, armNextPC);
+				else
+				{
+					selfCheckBegin();
+					checking = true;
+				}
+			}
+
+			prefetchStale = true;
+
+			busPrefetch = false;
+			if (busPrefetchCount & 0xFFFFFF00)
+				busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+			clockTicks = 0;
+
+			armNextPC = reg[15].I;
+			reg[15].I += 2;
+
+			(*slot->threaded)(slot);
+			if (UNLIKELY(checking))
+				thumbSelfCheck(slot, oldArmNextPC);
+			checkState = slot->checkState;
+
+			// Chain to the next slot unless the instruction branched
+			if (armNextPC == oldArmNextPC + 2 && (armNextPC & ((1 << THUMB_PAGE_SHIFT) - 1)))
+				slot++;
+			else
+				slot = NULL;
+		}
+		else
+		{
+			if (prefetchStale)
+			{
+				THUMB_PREFETCH();
+				prefetchStale = false;
+			}
+
+			u32 opcode = cpuPrefetch[0];
+			cpuPrefetch[0] = cpuPrefetch[1];
+
+			busPrefetch = false;
+			if (busPrefetchCount & 0xFFFFFF00)
+				busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+			clockTicks = 0;
+
+			armNextPC = reg[15].I;
+			reg[15].I += 2;
+			THUMB_PREFETCH_NEXT();
+
+			(*thumbInsnTable[opcode>>6])(opcode);
+			checkState = true;
+		}
 
 		if (clockTicks < 0)
+		{
+			if (prefetchStale && !armState)
+				THUMB_PREFETCH();
 			return 0;
+		}
 
 		if (clockTicks == 0)
 			clockTicks = codeTicksAccessSeq16(oldArmNextPC) + 1;
 
 		cpuTotalTicks += clockTicks;
 
+		if (UNLIKELY(armNextPC < oldArmNextPC) && idleLoopEnabled)
+			idleLoopBranch(oldArmNextPC, armNextPC);
+
 	}
-	while (cpuTotalTicks < cpuNextEvent && !armState && !holdState);
+	while (cpuTotalTicks < cpuNextEvent && !(checkState && (armState || holdState)));
+
+	// Leave the pipeline as the interpreter expects to find it
+	if (prefetchStale && !armState)
+		THUMB_PREFETCH();
 
 	return 1;
 }
@@ -85,6 +85,30 @@ const gchar *cartridge_get_game_publisher() {
 	return game->publisher;
 }
 
+gboolean cartridge_get_idle_loop_detection() {
+	if (!cartridge_is_present()) {
+		return TRUE;
+	}
+
+	return game->idleLoopDetection;
+}
+
+u32 cartridge_get_idle_loop() {
+	if (!cartridge_is_present()) {
+		return 0;
+	}
+
+	return game->idleLoop;
+}
+
+gboolean cartridge_get_bios_hle() {
+	if (!cartridge_is_present()) {
+		return TRUE;
+	}
+
+	return game->biosHle;
+}
+
 gboolean cartridge_is_present() {
 	return game != NULL;
 }
@@ -223,6 +247,25 @@ gboolean cartridge_read_battery(GError **err) {
 	return TRUE;
 }
 
+u8 *cartridge_get_rom_pointer(u32 address, u32 *available)
+{
+	address &= 0x1FFFFFF;
+
+	// Stop before the RTC registers
+	if (cartridge_rtc_is_enabled() && address <= 0xc8)
+	{
+		if (address >= 0xc4)
+			return NULL;
+		*available = 0xc4 - address;
+	}
+	else
+	{
+		*available = 0x2000000 - address;
+	}
+
+	return &rom[address];
+}
+
 u32 cartridge_read32(const u32 address)
 {
 	switch (address >> 24)
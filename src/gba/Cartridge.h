@@ -36,11 +36,15 @@ void cartridge_get_game_name(u8 *romname);
 const gchar *cartridge_get_game_title();
 const gchar *cartridge_get_game_region();
 const gchar *cartridge_get_game_publisher();
+gboolean cartridge_get_idle_loop_detection();
+u32 cartridge_get_idle_loop();
+gboolean cartridge_get_bios_hle();
 gboolean cartridge_is_present();
 
 gboolean cartridge_read_battery(GError **err);
 gboolean cartridge_write_battery(GError **err);
 
+u8 *cartridge_get_rom_pointer(u32 address, u32 *available);
 u32 cartridge_read32(const u32 address);
 u16 cartridge_read16(const u32 address);
 u8 cartridge_read8(const u32 address);
@@ -16,6 +16,7 @@
 // Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
 
 #include "Display.h"
+#include "GBA.h"
 
 #include "../common/Util.h"
 
@@ -24,23 +25,104 @@
 static const int width = 240;
 static const int height = 160;
 
-static guint16 *pix;
 static const DisplayDriver *displayDriver = NULL;
 
+// Frame being drawn, from the driver or our own
+static guint8 *frame = NULL;
+static int framePitch = 0;
+static guint8 *ownFrame = NULL;
+
+static int display_pixel_size()
+{
+	return displayDriver->format == DISPLAY_FORMAT_XRGB8888 ? 4 : 2;
+}
+
+static void display_frame_next()
+{
+	if (displayDriver->getFrame != NULL)
+	{
+		frame = (guint8 *)displayDriver->getFrame(displayDriver, &framePitch);
+	}
+	else
+	{
+		frame = ownFrame;
+		framePitch = width * display_pixel_size();
+	}
+}
+
+static guint32 display_pixel_read(int x, int y)
+{
+	const guint8 *line = frame + y * framePitch;
+	guint32 color;
+
+	switch (displayDriver->format)
+	{
+	case DISPLAY_FORMAT_RGB565:
+		color = ((const guint16 *)line)[x];
+		return ((color >> 11) & 0x1F) | ((color >> 1) & 0x3E0) | ((color & 0x1F) << 10);
+	case DISPLAY_FORMAT_XRGB8888:
+		color = ((const guint32 *)line)[x];
+		return ((color >> 19) & 0x1F) | ((color >> 6) & 0x3E0) | ((color & 0xF8) << 7);
+	case DISPLAY_FORMAT_BGR555:
+	default:
+		return ((const guint16 *)line)[x];
+	}
+}
+
+static void display_pixel_write(int x, int y, guint32 color)
+{
+	guint8 *line = frame + y * framePitch;
+
+	if (displayDriver->format == DISPLAY_FORMAT_XRGB8888)
+		((guint32 *)line)[x] = display_color_convert(displayDriver->format, color);
+	else
+		((guint16 *)line)[x] = display_color_convert(displayDriver->format, color);
+}
+
+// The states hold the frame as 32 bits BGR555 pixels, whatever the format
+// of the driver. Before version 12, they held the 16 bits pixels of the
+// frame followed by as many bytes of garbage.
+
 void display_save_state(gzFile gzFile)
 {
-	utilGzWrite(gzFile, pix, 4 * width * height);
+	guint32 *pixels = g_new(guint32, width * height);
+
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			pixels[y * width + x] = display_pixel_read(x, y);
+
+	utilGzWrite(gzFile, pixels, 4 * width * height);
+	g_free(pixels);
 }
 
-void display_read_state(gzFile gzFile)
+void display_read_state(gzFile gzFile, int version)
 {
-	utilGzRead(gzFile, pix, 4 * width * height);
+	guint32 *pixels = g_new(guint32, width * height);
+
+	utilGzRead(gzFile, pixels, 4 * width * height);
+
+	if (version < SAVE_GAME_VERSION_12)
+	{
+		const guint16 *pixels16 = (const guint16 *)pixels;
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				display_pixel_write(x, y, pixels16[y * width + x]);
+	}
+	else
+	{
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+				display_pixel_write(x, y, pixels[y * width + x]);
+	}
+
+	g_free(pixels);
 }
 
 void display_free()
 {
-	g_free(pix);
-	pix = NULL;
+	g_free(ownFrame);
+	ownFrame = NULL;
+	frame = NULL;
 	displayDriver = NULL;
 }
 
@@ -50,42 +132,36 @@ void display_init(const DisplayDriver *driver)
 
 	displayDriver = driver;
 
-	pix = (guint16 *)g_malloc(width * height * sizeof(guint16));
+	if (driver->getFrame == NULL)
+		ownFrame = (guint8 *)g_malloc0(width * height * display_pixel_size());
+
+	display_frame_next();
 }
 
 void display_clear()
 {
-	memset(pix, width * height * sizeof(guint32), 0);
+	for (int y = 0; y < height; y++)
+		memset(frame + y * framePitch, 0, width * display_pixel_size());
 }
 
-void display_draw_line(int line, u32* src)
+gpointer display_line_get(int line)
 {
-	u16 *dest = pix + width * line;
-	for (int x = 0; x < width; )
-	{
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-		*dest++ = src[x++] & 0xFFFF;
-	}
+	return frame + line * framePitch;
+}
+
+DisplayFormat display_format()
+{
+	return displayDriver->format;
+}
+
+void display_line_fill(int line, guint32 color)
+{
+	for (int x = 0; x < width; x++)
+		display_pixel_write(x, line, color);
 }
 
 void display_draw_screen()
 {
-	displayDriver->drawScreen(displayDriver, pix);
+	displayDriver->drawScreen(displayDriver, frame, framePitch);
+	display_frame_next();
 }
@@ -30,13 +30,38 @@ extern "C" {
 void display_init(const DisplayDriver *driver);
 void display_free();
 
-void display_read_state(gzFile gzFile);
+// Read a frame saved with the given save game version
+void display_read_state(gzFile gzFile, int version);
 void display_save_state(gzFile gzFile);
 
-void display_draw_line(int line, guint32* src);
+// Pixels of a line of the frame being drawn, in the format of the driver.
+// The renderer writes them directly.
+gpointer display_line_get(int line);
+DisplayFormat display_format();
+// Fill a line with a BGR555 colour
+void display_line_fill(int line, guint32 color);
+
 void display_draw_screen();
 void display_clear();
 
+// Convert a BGR555 colour, as in the palette, to the format of the display
+static inline guint32 display_color_convert(DisplayFormat format, guint32 color)
+{
+	switch (format)
+	{
+	case DISPLAY_FORMAT_RGB565:
+		return ((color & 0x1F) << 11) | ((color & 0x3E0) << 1) | ((color >> 4) & 0x20)
+		       | ((color >> 10) & 0x1F);
+	case DISPLAY_FORMAT_XRGB8888:
+		return ((color & 0x1F) << 19) | ((color & 0x1C) << 14)
+		       | ((color & 0x3E0) << 6) | ((color & 0x380) << 1)
+		       | ((color & 0x7C00) >> 7) | ((color & 0x7000) >> 12);
+	case DISPLAY_FORMAT_BGR555:
+	default:
+		return color & 0xFFFF;
+	}
+}
+
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
 }
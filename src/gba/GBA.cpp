@@ -3,6 +3,7 @@
 #include <memory.h>
 #include <stdarg.h>
 #include <string.h>
+#include "BIOS.h"
 #include "Cartridge.h"
 #include "Display.h"
 #include "GBA.h"
@@ -12,6 +13,7 @@
 #include "Gfx.h"
 #include "CartridgeRTC.h"
 #include "Savestate.h"
+#include "Scheduler.h"
 #include "Sound.h"
 #include "../common/Util.h"
 #include "../common/Port.h"
@@ -26,7 +28,11 @@
 #define _stricmp strcasecmp
 #endif
 
+// Ticks until the end of the interrupt delay and until the next LCD event,
+// only kept up to date in the save states. The events are run by the
+// scheduler.
 static int IRQTicks = 0;
+static int lcdTicks = 0;
 
 static int layerEnableDelay = 0;
 static int cpuDmaTicksToUpdate = 0;
@@ -40,7 +46,8 @@ gboolean holdState = false;
 
 int cpuTotalTicks = 0;
 
-static int lcdTicks = 1008;
+// The timerXTicks hold the ticks left until the overflow while the timer
+// does not run on its own clock, and in the save states
 static u8 timerOnOffDelay = 0;
 u16 timer0Value = 0;
 bool timer0On = false;
@@ -84,21 +91,6 @@ static const int TIMER_TICKS[4] =
 	10
 };
 
-static const u8 gamepakRamWaitState[4] = { 4, 3, 2, 8 };
-static const u8 gamepakWaitState[4] =  { 4, 3, 2, 8 };
-static const u8 gamepakWaitState0[2] = { 2, 1 };
-static const u8 gamepakWaitState1[2] = { 4, 1 };
-static const u8 gamepakWaitState2[2] = { 8, 1 };
-
-u8 memoryWait[16] =
-    { 0, 0, 2, 0, 0, 0, 0, 0, 4, 4, 4, 4, 4, 4, 4, 0 };
-u8 memoryWait32[16] =
-    { 0, 0, 5, 0, 0, 1, 1, 0, 7, 7, 9, 9, 13, 13, 4, 0 };
-u8 memoryWaitSeq[16] =
-    { 0, 0, 2, 0, 0, 0, 0, 0, 2, 2, 4, 4, 8, 8, 4, 0 };
-u8 memoryWaitSeq32[16] =
-    { 0, 0, 5, 0, 0, 1, 1, 0, 5, 5, 9, 9, 17, 17, 4, 0 };
-
 // The videoMemoryWait constants are used to add some waitstates
 // if the opcode access video memory data outside of vblank/hblank
 // It seems to happen on only one ticks for each pixel.
@@ -109,6 +101,12 @@ u8 memoryWaitSeq32[16] =
 
 u8 biosProtected[4];
 
+// The CPU evaluates its flags lazily, they are saved as plain bools
+static bool stateN;
+static bool stateC;
+static bool stateZ;
+static bool stateV;
+
 static variable_desc saveGameStruct[] =
 {
 	{ &DISPCNT  , sizeof(u16) },
@@ -214,10 +212,10 @@ static variable_desc saveGameStruct[] =
 	{ &dma2Dest , sizeof(u32) },
 	{ &dma3Source , sizeof(u32) },
 	{ &dma3Dest , sizeof(u32) },
-	{ &CPU::N_FLAG , sizeof(bool) },
-	{ &CPU::C_FLAG , sizeof(bool) },
-	{ &CPU::Z_FLAG , sizeof(bool) },
-	{ &CPU::V_FLAG , sizeof(bool) },
+	{ &stateN , sizeof(bool) },
+	{ &stateC , sizeof(bool) },
+	{ &stateZ , sizeof(bool) },
+	{ &stateV , sizeof(bool) },
 	{ &CPU::armState , sizeof(bool) },
 	{ &CPU::armIrqEnable , sizeof(bool) },
 	{ &CPU::armNextPC , sizeof(u32) },
@@ -232,37 +230,45 @@ static inline void UPDATE_REG(u32 address, u16 value)
 	WRITE16LE(((u16 *)&ioMem[address]), value);
 }
 
-static inline int CPUUpdateTicks()
-{
-	int cpuLoopTicks = lcdTicks;
+static void lcdUpdate(int late);
+static void timer0Overflow(int late);
+static void timer1Overflow(int late);
+static void timer2Overflow(int late);
+static void timer3Overflow(int late);
+static void irqDelayEnd(int late);
 
-	if (soundTicks < cpuLoopTicks)
-		cpuLoopTicks = soundTicks;
+// Keep the ticks left until the overflow of a timer in timerTicks
+static void timerSaveTicks(Scheduler::Event event, int &timerTicks)
+{
+	if (Scheduler::isScheduled(event))
+		timerTicks = Scheduler::ticksUntil(event);
+}
 
-	if (timer0On && (timer0Ticks < cpuLoopTicks))
-	{
-		cpuLoopTicks = timer0Ticks;
-	}
-	if (timer1On && !(TM1CNT & 4) && (timer1Ticks < cpuLoopTicks))
-	{
-		cpuLoopTicks = timer1Ticks;
-	}
-	if (timer2On && !(TM2CNT & 4) && (timer2Ticks < cpuLoopTicks))
+// The counter of a timer running on its own clock is only worked out when it
+// is read. Store it in its register before the timer stops or is saved.
+static void timerLatchCounter(Scheduler::Event event, int clockReload, u16 &counter, u32 address)
+{
+	if (Scheduler::isScheduled(event))
 	{
-		cpuLoopTicks = timer2Ticks;
+		counter = 0xFFFF - ((Scheduler::ticksUntil(event) - cpuTotalTicks) >> clockReload);
+		UPDATE_REG(address, counter);
 	}
-	if (timer3On && !(TM3CNT & 4) && (timer3Ticks < cpuLoopTicks))
+}
+
+// The overflow event of a timer is scheduled while the timer runs on its own
+// clock. Otherwise the ticks left until the overflow wait in timerTicks.
+static void timerUpdateEvent(Scheduler::Event event, bool scheduled, int &timerTicks, Scheduler::Callback callback)
+{
+	if (scheduled)
 	{
-		cpuLoopTicks = timer3Ticks;
+		if (!Scheduler::isScheduled(event))
+			Scheduler::schedule(event, timerTicks, callback);
 	}
-
-	if (IRQTicks)
+	else if (Scheduler::isScheduled(event))
 	{
-		if (IRQTicks < cpuLoopTicks)
-			cpuLoopTicks = IRQTicks;
+		timerTicks = Scheduler::ticksUntil(event);
+		Scheduler::cancel(event);
 	}
-
-	return cpuLoopTicks;
 }
 
 void CPUWriteState(gzFile gzFile)
@@ -275,6 +281,24 @@ void CPUWriteState(gzFile gzFile)
 
 	utilGzWrite(gzFile, &CPU::reg[0], sizeof(CPU::reg));
 
+	stateN = CPU::N_FLAG();
+	stateC = CPU::C_FLAG();
+	stateZ = CPU::Z_FLAG();
+	stateV = CPU::V_FLAG();
+
+	lcdTicks = Scheduler::ticksUntil(Scheduler::EVENT_LCD);
+	IRQTicks = 0;
+	if (Scheduler::isScheduled(Scheduler::EVENT_IRQ))
+		IRQTicks = Scheduler::ticksUntil(Scheduler::EVENT_IRQ);
+	timerLatchCounter(Scheduler::EVENT_TIMER0, timer0ClockReload, TM0D, 0x100);
+	timerLatchCounter(Scheduler::EVENT_TIMER1, timer1ClockReload, TM1D, 0x104);
+	timerLatchCounter(Scheduler::EVENT_TIMER2, timer2ClockReload, TM2D, 0x108);
+	timerLatchCounter(Scheduler::EVENT_TIMER3, timer3ClockReload, TM3D, 0x10C);
+	timerSaveTicks(Scheduler::EVENT_TIMER0, timer0Ticks);
+	timerSaveTicks(Scheduler::EVENT_TIMER1, timer1Ticks);
+	timerSaveTicks(Scheduler::EVENT_TIMER2, timer2Ticks);
+	timerSaveTicks(Scheduler::EVENT_TIMER3, timer3Ticks);
+
 	utilWriteData(gzFile, saveGameStruct);
 
 	utilGzWrite(gzFile, internalRAM, 0x8000);
@@ -282,6 +306,7 @@ void CPUWriteState(gzFile gzFile)
 	utilGzWrite(gzFile, workRAM, 0x40000);
 	utilGzWrite(gzFile, vram, 0x20000);
 	utilGzWrite(gzFile, oam, 0x400);
+	gfx_sync();
 	display_save_state(gzFile);
 	utilGzWrite(gzFile, ioMem, 0x400);
 
@@ -323,31 +348,55 @@ gboolean CPUReadState(gzFile gzFile, GError **err) {
 
 	utilReadData(gzFile, saveGameStruct);
 
+	CPU::SET_N_FLAG(stateN);
+	CPU::SET_C_FLAG(stateC);
+	CPU::SET_Z_FLAG(stateZ);
+	CPU::SET_V_FLAG(stateV);
+
 	if (IRQTicks > 0)
+	{
 		intState = true;
+		Scheduler::schedule(Scheduler::EVENT_IRQ, IRQTicks, irqDelayEnd);
+	}
 	else
 	{
 		intState = false;
 		IRQTicks = 0;
+		Scheduler::cancel(Scheduler::EVENT_IRQ);
 	}
 
+	Scheduler::schedule(Scheduler::EVENT_LCD, lcdTicks, lcdUpdate);
+	Scheduler::cancel(Scheduler::EVENT_TIMER0);
+	Scheduler::cancel(Scheduler::EVENT_TIMER1);
+	Scheduler::cancel(Scheduler::EVENT_TIMER2);
+	Scheduler::cancel(Scheduler::EVENT_TIMER3);
+	timerUpdateEvent(Scheduler::EVENT_TIMER0, timer0On, timer0Ticks, timer0Overflow);
+	timerUpdateEvent(Scheduler::EVENT_TIMER1, timer1On && !(TM1CNT & 4), timer1Ticks, timer1Overflow);
+	timerUpdateEvent(Scheduler::EVENT_TIMER2, timer2On && !(TM2CNT & 4), timer2Ticks, timer2Overflow);
+	timerUpdateEvent(Scheduler::EVENT_TIMER3, timer3On && !(TM3CNT & 4), timer3Ticks, timer3Overflow);
+
 	utilGzRead(gzFile, internalRAM, 0x8000);
 	utilGzRead(gzFile, paletteRAM, 0x400);
 	utilGzRead(gzFile, workRAM, 0x40000);
 	utilGzRead(gzFile, vram, 0x20000);
 	utilGzRead(gzFile, oam, 0x400);
-	display_read_state(gzFile);
+	gfx_sync();
+	display_read_state(gzFile, version);
 	utilGzRead(gzFile, ioMem, 0x400);
 
 	soundReadGame(gzFile, version);
 
 	cartridge_rtc_load_state(gzFile);
 
+	CPU::armCacheFlush();
+	CPU::jitFlush();
+
 	// set pointers!
 	layerEnable = DISPCNT;
 
 	gfx_renderer_choose();
 	gfx_buffers_clear(true);
+	gfx_dirty_mark_all();
 	gfx_window0_update();
 	gfx_window1_update();
 
@@ -367,6 +416,7 @@ gboolean CPUReadState(gzFile gzFile, GError **err) {
 
 void CPUCleanUp()
 {
+	gfx_free();
 	cartridge_free();
 
 	MMU::uninit();
@@ -389,6 +439,13 @@ gboolean CPUInitMemory(GError **err) {
 		return FALSE;
 	}
 
+	if (!gfx_init()) {
+		g_set_error(err, LOADER_ERROR, G_LOADER_ERROR_FAILED,
+				"Failed to start the %s", "render thread");
+		CPUCleanUp();
+		return FALSE;
+	}
+
 	gfx_buffers_clear(TRUE);
 
 	return TRUE;
@@ -421,6 +478,51 @@ static void CPUCompareVCOUNT()
 
 }
 
+// Transfer count units between plain memory regions with memmove, or fill
+// them with a single unit when the source is fixed. Returns false when the
+// transfer has to go through the memory handlers one unit at a time.
+template<typename T>
+static bool doDMABlock(u32 &s, u32 &d, u32 si, u32 di, u32 c)
+{
+	const u32 length = c * sizeof(T);
+
+	if (di != sizeof(T) || (si != sizeof(T) && si != 0) || (d & (sizeof(T) - 1)))
+		return false;
+
+	u32 region = d >> 24;
+	if (region != 2 && region != 3 && region != 5 && region != 6 && region != 7)
+		return false;
+
+	u32 available;
+	u8 *dst = MMU::pointer(d, available);
+	if (dst == NULL || available < length)
+		return false;
+
+	u8 *src = MMU::pointer(s, available);
+	if (src == NULL || available < (si ? length : sizeof(T)))
+		return false;
+
+	if (si == 0)
+	{
+		T value = MMU::readLE<T>(src);
+		for (u32 i = 0; i < length; i += sizeof(T))
+			MMU::writeLE<T>(&dst[i], value);
+	}
+	else
+	{
+		// The units are copied in increasing address order
+		if (dst > src && dst < src + length)
+			return false;
+		memmove(dst, src, length);
+	}
+
+	MMU::invalidate(d, length);
+
+	s += si * c;
+	d += length;
+	return true;
+}
+
 static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 {
 	int sm = s >> 24;
@@ -451,7 +553,7 @@ static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 				c--;
 			}
 		}
-		else
+		else if (!doDMABlock<u32>(s, d, si, di, c))
 		{
 			while (c != 0)
 			{
@@ -477,7 +579,7 @@ static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 				c--;
 			}
 		}
-		else
+		else if (!doDMABlock<u16>(s, d, si, di, c))
 		{
 			while (c != 0)
 			{
@@ -495,17 +597,17 @@ static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 
 	if (transfer32)
 	{
-		sw =1+memoryWaitSeq32[sm & 15];
-		dw =1+memoryWaitSeq32[dm & 15];
-		totalTicks = (sw+dw)*(sc-1) + 6 + memoryWait32[sm & 15] +
-		             memoryWaitSeq32[dm & 15];
+		sw =1+CPU::waitStates[sm & 15].accessSeq32;
+		dw =1+CPU::waitStates[dm & 15].accessSeq32;
+		totalTicks = (sw+dw)*(sc-1) + 6 + CPU::waitStates[sm & 15].access32 +
+		             CPU::waitStates[dm & 15].accessSeq32;
 	}
 	else
 	{
-		sw = 1+memoryWaitSeq[sm & 15];
-		dw = 1+memoryWaitSeq[dm & 15];
-		totalTicks = (sw+dw)*(sc-1) + 6 + memoryWait[sm & 15] +
-		             memoryWaitSeq[dm & 15];
+		sw = 1+CPU::waitStates[sm & 15].accessSeq16;
+		dw = 1+CPU::waitStates[dm & 15].accessSeq16;
+		totalTicks = (sw+dw)*(sc-1) + 6 + CPU::waitStates[sm & 15].access16 +
+		             CPU::waitStates[dm & 15].accessSeq16;
 	}
 
 	cpuDmaTicksToUpdate += totalTicks;
@@ -836,7 +938,7 @@ void CPUUpdateRegister(u32 address, u16 value)
 		{
 			if (!(DISPSTAT & 1))
 			{
-				lcdTicks = 1008;
+				Scheduler::schedule(Scheduler::EVENT_LCD, 1008, lcdUpdate);
 				//      VCOUNT = 0;
 				//      UPDATE_REG(0x06, VCOUNT);
 				DISPSTAT &= 0xFFFC;
@@ -1303,23 +1405,7 @@ void CPUUpdateRegister(u32 address, u16 value)
 		break;
 	case 0x204:
 	{
-		memoryWait[0x0e] = memoryWaitSeq[0x0e] = gamepakRamWaitState[value & 3];
-		memoryWait[0x08] = memoryWait[0x09] = gamepakWaitState[(value >> 2) & 3];
-		memoryWaitSeq[0x08] = memoryWaitSeq[0x09] = gamepakWaitState0[(value >> 4) & 1];
-
-		memoryWait[0x0a] = memoryWait[0x0b] = gamepakWaitState[(value >> 5) & 3];
-		memoryWaitSeq[0x0a] = memoryWaitSeq[0x0b] = gamepakWaitState1[(value >> 7) & 1];
-
-		memoryWait[0x0c] = memoryWait[0x0d] = gamepakWaitState[(value >> 8) & 3];
-		memoryWaitSeq[0x0c] = memoryWaitSeq[0x0d] = gamepakWaitState2[(value >> 10) & 1];
-
-		for (int i = 8; i < 15; i++)
-		{
-			memoryWait32[i] = memoryWait[i] + memoryWaitSeq[i] + 1;
-			memoryWaitSeq32[i] = memoryWaitSeq[i]*2 + 1;
-		}
-
-		CPU::enableBusPrefetch((value & 0x4000) == 0x4000);
+		CPU::updateWaitStates(value);
 
 		UPDATE_REG(0x204, value & 0x7FFF);
 
@@ -1346,6 +1432,7 @@ static void applyTimer ()
 {
 	if (timerOnOffDelay & 1)
 	{
+		timerLatchCounter(Scheduler::EVENT_TIMER0, timer0ClockReload, TM0D, 0x100);
 		timer0ClockReload = TIMER_TICKS[timer0Value & 3];
 		if (!timer0On && (timer0Value & 0x80))
 		{
@@ -1358,10 +1445,12 @@ static void applyTimer ()
 		TM0CNT = timer0Value & 0xC7;
 		interp_rate();
 		UPDATE_REG(0x102, TM0CNT);
+		timerUpdateEvent(Scheduler::EVENT_TIMER0, timer0On, timer0Ticks, timer0Overflow);
 		//    CPUUpdateTicks();
 	}
 	if (timerOnOffDelay & 2)
 	{
+		timerLatchCounter(Scheduler::EVENT_TIMER1, timer1ClockReload, TM1D, 0x104);
 		timer1ClockReload = TIMER_TICKS[timer1Value & 3];
 		if (!timer1On && (timer1Value & 0x80))
 		{
@@ -1374,9 +1463,11 @@ static void applyTimer ()
 		TM1CNT = timer1Value & 0xC7;
 		interp_rate();
 		UPDATE_REG(0x106, TM1CNT);
+		timerUpdateEvent(Scheduler::EVENT_TIMER1, timer1On && !(TM1CNT & 4), timer1Ticks, timer1Overflow);
 	}
 	if (timerOnOffDelay & 4)
 	{
+		timerLatchCounter(Scheduler::EVENT_TIMER2, timer2ClockReload, TM2D, 0x108);
 		timer2ClockReload = TIMER_TICKS[timer2Value & 3];
 		if (!timer2On && (timer2Value & 0x80))
 		{
@@ -1388,9 +1479,11 @@ static void applyTimer ()
 		timer2On = timer2Value & 0x80 ? true : false;
 		TM2CNT = timer2Value & 0xC7;
 		UPDATE_REG(0x10A, TM2CNT);
+		timerUpdateEvent(Scheduler::EVENT_TIMER2, timer2On && !(TM2CNT & 4), timer2Ticks, timer2Overflow);
 	}
 	if (timerOnOffDelay & 8)
 	{
+		timerLatchCounter(Scheduler::EVENT_TIMER3, timer3ClockReload, TM3D, 0x10C);
 		timer3ClockReload = TIMER_TICKS[timer3Value & 3];
 		if (!timer3On && (timer3Value & 0x80))
 		{
@@ -1402,8 +1495,9 @@ static void applyTimer ()
 		timer3On = timer3Value & 0x80 ? true : false;
 		TM3CNT = timer3Value & 0xC7;
 		UPDATE_REG(0x10E, TM3CNT);
+		timerUpdateEvent(Scheduler::EVENT_TIMER3, timer3On && !(TM3CNT & 4), timer3Ticks, timer3Overflow);
 	}
-	cpuNextEvent = CPUUpdateTicks();
+	cpuNextEvent = Scheduler::nextEventTicks();
 	timerOnOffDelay = 0;
 }
 
@@ -1436,6 +1530,7 @@ void CPUReset()
 	// clean palette
 	memset(paletteRAM, 0, 0x400);
 	// clean picture
+	gfx_sync();
 	display_clear();
 	// clean vram
 	memset(vram, 0, 0x20000);
@@ -1537,7 +1632,8 @@ void CPUReset()
 	biosProtected[2] = 0x29;
 	biosProtected[3] = 0xe1;
 
-	lcdTicks = 1008;
+	Scheduler::reset();
+	Scheduler::schedule(Scheduler::EVENT_LCD, 1008, lcdUpdate);
 	timer0On = false;
 	timer0Ticks = 0;
 	timer0Reload = 0;
@@ -1566,8 +1662,10 @@ void CPUReset()
 	layerEnable = DISPCNT;
 
 	gfx_buffers_clear(true);
+	gfx_dirty_mark_all();
 
 	cartridge_reset();
+	MMU::reset();
 
 	gfx_window0_update();
 	gfx_window1_update();
@@ -1575,15 +1673,253 @@ void CPUReset()
 	soundReset();
 
 	CPU::reset();
+	BIOS::reset();
 
 	lastTime = g_get_monotonic_time();
 
 }
 
+static void lcdUpdate(int late)
+{
+	if (DISPSTAT & 1)  // V-BLANK
+	{
+		// if in V-Blank mode, keep computing...
+		if (DISPSTAT & 2)
+		{
+			Scheduler::schedule(Scheduler::EVENT_LCD, 1008 - late, lcdUpdate);
+			VCOUNT++;
+			UPDATE_REG(0x06, VCOUNT);
+			DISPSTAT &= 0xFFFD;
+			UPDATE_REG(0x04, DISPSTAT);
+			CPUCompareVCOUNT();
+		}
+		else
+		{
+			Scheduler::schedule(Scheduler::EVENT_LCD, 224 - late, lcdUpdate);
+			DISPSTAT |= 2;
+			UPDATE_REG(0x04, DISPSTAT);
+			if (DISPSTAT & 16)
+			{
+				IF |= 2;
+				UPDATE_REG(0x202, IF);
+			}
+		}
+
+		if (VCOUNT >= 228)  //Reaching last line
+		{
+			DISPSTAT &= 0xFFFC;
+			UPDATE_REG(0x04, DISPSTAT);
+			VCOUNT = 0;
+			UPDATE_REG(0x06, VCOUNT);
+			CPUCompareVCOUNT();
+			gfx_frame_new();
+		}
+	}
+	else
+	{
+		if (DISPSTAT & 2)
+		{
+			// if in H-Blank, leave it and move to drawing mode
+			VCOUNT++;
+			UPDATE_REG(0x06, VCOUNT);
+
+			Scheduler::schedule(Scheduler::EVENT_LCD, 1008 - late, lcdUpdate);
+			DISPSTAT &= 0xFFFD;
+			if (VCOUNT == 160)
+			{
+				count++;
+
+				if (count == 60)
+				{
+					gint64 time = g_get_monotonic_time();
+					if (time != lastTime) {
+						speed = 100000000/(time - lastTime);
+					} else {
+						speed = 0;
+					}
+					lastTime = time;
+					count = 0;
+				}
+				u32 joy = inputDriver->read_joypad(inputDriver);
+				P1 = 0x03FF ^ (joy & 0x3FF);
+				
+				//FIXME: Reenable
+				/*if (features.hasMotionSensor)*/
+				inputDriver->update_motion_sensor(inputDriver);
+
+				UPDATE_REG(0x130, P1);
+				u16 P1CNT = READ16LE(((u16 *)&ioMem[0x132]));
+				// this seems wrong, but there are cases where the game
+				// can enter the stop state without requesting an IRQ from
+				// the joypad.
+				if ((P1CNT & 0x4000) || stopState)
+				{
+					u16 p1 = (0x3FF ^ P1) & 0x3FF;
+					if (P1CNT & 0x8000)
+					{
+						if (p1 == (P1CNT & 0x3FF))
+						{
+							IF |= 0x1000;
+							UPDATE_REG(0x202, IF);
+						}
+					}
+					else
+					{
+						if (p1 & P1CNT)
+						{
+							IF |= 0x1000;
+							UPDATE_REG(0x202, IF);
+						}
+					}
+				}
+
+				DISPSTAT |= 1;
+				DISPSTAT &= 0xFFFD;
+				UPDATE_REG(0x04, DISPSTAT);
+				if (DISPSTAT & 0x0008)
+				{
+					IF |= 1;
+					UPDATE_REG(0x202, IF);
+				}
+				CPUCheckDMA(1, 0x0f);
+				gfx_sync();
+				display_draw_screen();
+				soundVBlank();
+			}
+
+			UPDATE_REG(0x04, DISPSTAT);
+			CPUCompareVCOUNT();
+
+		}
+		else
+		{
+			gfx_line_render();
+
+			// entering H-Blank
+			DISPSTAT |= 2;
+			UPDATE_REG(0x04, DISPSTAT);
+			Scheduler::schedule(Scheduler::EVENT_LCD, 224 - late, lcdUpdate);
+			CPUCheckDMA(2, 0x0f);
+			if (DISPSTAT & 16)
+			{
+				IF |= 2;
+				UPDATE_REG(0x202, IF);
+			}
+		}
+	}
+}
+
+// The overflows of the previous timer make a timer count up when its
+// cascade bit is set
+static void timer3CountUp()
+{
+	if (!timer3On || !(TM3CNT & 4))
+		return;
+
+	TM3D++;
+	if (TM3D == 0)
+	{
+		TM3D += timer3Reload;
+		if (TM3CNT & 0x40)
+		{
+			IF |= 0x40;
+			UPDATE_REG(0x202, IF);
+		}
+	}
+	UPDATE_REG(0x10C, TM3D);
+}
+
+static void timer2CountUp()
+{
+	if (!timer2On || !(TM2CNT & 4))
+		return;
+
+	TM2D++;
+	if (TM2D == 0)
+	{
+		TM2D += timer2Reload;
+		if (TM2CNT & 0x40)
+		{
+			IF |= 0x20;
+			UPDATE_REG(0x202, IF);
+		}
+		timer3CountUp();
+	}
+	UPDATE_REG(0x108, TM2D);
+}
+
+static void timer1CountUp()
+{
+	if (!timer1On || !(TM1CNT & 4))
+		return;
+
+	TM1D++;
+	if (TM1D == 0)
+	{
+		TM1D += timer1Reload;
+		soundTimerOverflow(1);
+		if (TM1CNT & 0x40)
+		{
+			IF |= 0x10;
+			UPDATE_REG(0x202, IF);
+		}
+		timer2CountUp();
+	}
+	UPDATE_REG(0x104, TM1D);
+}
+
+static void timer0Overflow(int late)
+{
+	Scheduler::schedule(Scheduler::EVENT_TIMER0, ((0x10000 - timer0Reload) << timer0ClockReload) - late, timer0Overflow);
+	soundTimerOverflow(0);
+	if (TM0CNT & 0x40)
+	{
+		IF |= 0x08;
+		UPDATE_REG(0x202, IF);
+	}
+	timer1CountUp();
+}
+
+static void timer1Overflow(int late)
+{
+	Scheduler::schedule(Scheduler::EVENT_TIMER1, ((0x10000 - timer1Reload) << timer1ClockReload) - late, timer1Overflow);
+	soundTimerOverflow(1);
+	if (TM1CNT & 0x40)
+	{
+		IF |= 0x10;
+		UPDATE_REG(0x202, IF);
+	}
+	timer2CountUp();
+}
+
+static void timer2Overflow(int late)
+{
+	Scheduler::schedule(Scheduler::EVENT_TIMER2, ((0x10000 - timer2Reload) << timer2ClockReload) - late, timer2Overflow);
+	if (TM2CNT & 0x40)
+	{
+		IF |= 0x20;
+		UPDATE_REG(0x202, IF);
+	}
+	timer3CountUp();
+}
+
+static void timer3Overflow(int late)
+{
+	Scheduler::schedule(Scheduler::EVENT_TIMER3, ((0x10000 - timer3Reload) << timer3ClockReload) - late, timer3Overflow);
+	if (TM3CNT & 0x40)
+	{
+		IF |= 0x40;
+		UPDATE_REG(0x202, IF);
+	}
+}
+
+static void irqDelayEnd(int /*late*/)
+{
+}
+
 void CPULoop(int ticks)
 {
 	int clockTicks;
-	int timerOverflow = 0;
 	// variable used by the CPU core
 	cpuTotalTicks = 0;
 #ifdef LINK_EMULATION
@@ -1591,7 +1927,7 @@ void CPULoop(int ticks)
 		cpuNextEvent = 1;
 #endif
 	cpuBreakLoop = false;
-	cpuNextEvent = CPUUpdateTicks();
+	cpuNextEvent = Scheduler::nextEventTicks();
 	if (cpuNextEvent > ticks)
 		cpuNextEvent = ticks;
 
@@ -1613,7 +1949,7 @@ void CPULoop(int ticks)
 			clockTicks = 0;
 		}
 		else
-			clockTicks = CPUUpdateTicks();
+			clockTicks = Scheduler::nextEventTicks();
 
 		cpuTotalTicks += clockTicks;
 
@@ -1627,298 +1963,23 @@ void CPULoop(int ticks)
 
 updateLoop:
 
-			if (IRQTicks)
+			// the timers do not count in stop state
+			if (stopState)
 			{
-				IRQTicks -= clockTicks;
-				if (IRQTicks<0)
-					IRQTicks = 0;
+				Scheduler::postpone(Scheduler::EVENT_TIMER0, clockTicks);
+				Scheduler::postpone(Scheduler::EVENT_TIMER1, clockTicks);
+				Scheduler::postpone(Scheduler::EVENT_TIMER2, clockTicks);
+				Scheduler::postpone(Scheduler::EVENT_TIMER3, clockTicks);
 			}
 
-			lcdTicks -= clockTicks;
-
-
-			if (lcdTicks <= 0)
-			{
-				if (DISPSTAT & 1)  // V-BLANK
-				{
-					// if in V-Blank mode, keep computing...
-					if (DISPSTAT & 2)
-					{
-						lcdTicks += 1008;
-						VCOUNT++;
-						UPDATE_REG(0x06, VCOUNT);
-						DISPSTAT &= 0xFFFD;
-						UPDATE_REG(0x04, DISPSTAT);
-						CPUCompareVCOUNT();
-					}
-					else
-					{
-						lcdTicks += 224;
-						DISPSTAT |= 2;
-						UPDATE_REG(0x04, DISPSTAT);
-						if (DISPSTAT & 16)
-						{
-							IF |= 2;
-							UPDATE_REG(0x202, IF);
-						}
-					}
-
-					if (VCOUNT >= 228)  //Reaching last line
-					{
-						DISPSTAT &= 0xFFFC;
-						UPDATE_REG(0x04, DISPSTAT);
-						VCOUNT = 0;
-						UPDATE_REG(0x06, VCOUNT);
-						CPUCompareVCOUNT();
-						gfx_frame_new();
-					}
-				}
-				else
-				{
-					if (DISPSTAT & 2)
-					{
-						// if in H-Blank, leave it and move to drawing mode
-						VCOUNT++;
-						UPDATE_REG(0x06, VCOUNT);
-
-						lcdTicks += 1008;
-						DISPSTAT &= 0xFFFD;
-						if (VCOUNT == 160)
-						{
-							count++;
-
-							if (count == 60)
-							{
-								gint64 time = g_get_monotonic_time();
-								if (time != lastTime) {
-									speed = 100000000/(time - lastTime);
-								} else {
-									speed = 0;
-								}
-								lastTime = time;
-								count = 0;
-							}
-							u32 joy = inputDriver->read_joypad(inputDriver);
-							P1 = 0x03FF ^ (joy & 0x3FF);
-							
-							//FIXME: Reenable
-							/*if (features.hasMotionSensor)*/
-							inputDriver->update_motion_sensor(inputDriver);
-
-							UPDATE_REG(0x130, P1);
-							u16 P1CNT = READ16LE(((u16 *)&ioMem[0x132]));
-							// this seems wrong, but there are cases where the game
-							// can enter the stop state without requesting an IRQ from
-							// the joypad.
-							if ((P1CNT & 0x4000) || stopState)
-							{
-								u16 p1 = (0x3FF ^ P1) & 0x3FF;
-								if (P1CNT & 0x8000)
-								{
-									if (p1 == (P1CNT & 0x3FF))
-									{
-										IF |= 0x1000;
-										UPDATE_REG(0x202, IF);
-									}
-								}
-								else
-								{
-									if (p1 & P1CNT)
-									{
-										IF |= 0x1000;
-										UPDATE_REG(0x202, IF);
-									}
-								}
-							}
-
-							DISPSTAT |= 1;
-							DISPSTAT &= 0xFFFD;
-							UPDATE_REG(0x04, DISPSTAT);
-							if (DISPSTAT & 0x0008)
-							{
-								IF |= 1;
-								UPDATE_REG(0x202, IF);
-							}
-							CPUCheckDMA(1, 0x0f);
-							display_draw_screen();
-						}
-
-						UPDATE_REG(0x04, DISPSTAT);
-						CPUCompareVCOUNT();
-
-					}
-					else
-					{
-						gfx_line_render();
-						display_draw_line(VCOUNT, gfxLineMix);
-
-						// entering H-Blank
-						DISPSTAT |= 2;
-						UPDATE_REG(0x04, DISPSTAT);
-						lcdTicks += 224;
-						CPUCheckDMA(2, 0x0f);
-						if (DISPSTAT & 16)
-						{
-							IF |= 2;
-							UPDATE_REG(0x202, IF);
-						}
-					}
-				}
-			}
-
-			// we shouldn't be doing sound in stop state, but we loose synchronization
-			// if sound is disabled, so in stop state, soundTick will just produce
-			// mute sound
-			soundTicks -= clockTicks;
-			if (soundTicks <= 0)
-			{
-				psoundTickfn();
-				soundTicks += SOUND_CLOCK_TICKS;
-			}
-
-			if (!stopState)
-			{
-				if (timer0On)
-				{
-					timer0Ticks -= clockTicks;
-					if (timer0Ticks <= 0)
-					{
-						timer0Ticks += (0x10000 - timer0Reload) << timer0ClockReload;
-						timerOverflow |= 1;
-						soundTimerOverflow(0);
-						if (TM0CNT & 0x40)
-						{
-							IF |= 0x08;
-							UPDATE_REG(0x202, IF);
-						}
-					}
-					TM0D = 0xFFFF - (timer0Ticks >> timer0ClockReload);
-					UPDATE_REG(0x100, TM0D);
-				}
-
-				if (timer1On)
-				{
-					if (TM1CNT & 4)
-					{
-						if (timerOverflow & 1)
-						{
-							TM1D++;
-							if (TM1D == 0)
-							{
-								TM1D += timer1Reload;
-								timerOverflow |= 2;
-								soundTimerOverflow(1);
-								if (TM1CNT & 0x40)
-								{
-									IF |= 0x10;
-									UPDATE_REG(0x202, IF);
-								}
-							}
-							UPDATE_REG(0x104, TM1D);
-						}
-					}
-					else
-					{
-						timer1Ticks -= clockTicks;
-						if (timer1Ticks <= 0)
-						{
-							timer1Ticks += (0x10000 - timer1Reload) << timer1ClockReload;
-							timerOverflow |= 2;
-							soundTimerOverflow(1);
-							if (TM1CNT & 0x40)
-							{
-								IF |= 0x10;
-								UPDATE_REG(0x202, IF);
-							}
-						}
-						TM1D = 0xFFFF - (timer1Ticks >> timer1ClockReload);
-						UPDATE_REG(0x104, TM1D);
-					}
-				}
-
-				if (timer2On)
-				{
-					if (TM2CNT & 4)
-					{
-						if (timerOverflow & 2)
-						{
-							TM2D++;
-							if (TM2D == 0)
-							{
-								TM2D += timer2Reload;
-								timerOverflow |= 4;
-								if (TM2CNT & 0x40)
-								{
-									IF |= 0x20;
-									UPDATE_REG(0x202, IF);
-								}
-							}
-							UPDATE_REG(0x108, TM2D);
-						}
-					}
-					else
-					{
-						timer2Ticks -= clockTicks;
-						if (timer2Ticks <= 0)
-						{
-							timer2Ticks += (0x10000 - timer2Reload) << timer2ClockReload;
-							timerOverflow |= 4;
-							if (TM2CNT & 0x40)
-							{
-								IF |= 0x20;
-								UPDATE_REG(0x202, IF);
-							}
-						}
-						TM2D = 0xFFFF - (timer2Ticks >> timer2ClockReload);
-						UPDATE_REG(0x108, TM2D);
-					}
-				}
-
-				if (timer3On)
-				{
-					if (TM3CNT & 4)
-					{
-						if (timerOverflow & 4)
-						{
-							TM3D++;
-							if (TM3D == 0)
-							{
-								TM3D += timer3Reload;
-								if (TM3CNT & 0x40)
-								{
-									IF |= 0x40;
-									UPDATE_REG(0x202, IF);
-								}
-							}
-							UPDATE_REG(0x10C, TM3D);
-						}
-					}
-					else
-					{
-						timer3Ticks -= clockTicks;
-						if (timer3Ticks <= 0)
-						{
-							timer3Ticks += (0x10000 - timer3Reload) << timer3ClockReload;
-							if (TM3CNT & 0x40)
-							{
-								IF |= 0x40;
-								UPDATE_REG(0x202, IF);
-							}
-						}
-						TM3D = 0xFFFF - (timer3Ticks >> timer3ClockReload);
-						UPDATE_REG(0x10C, TM3D);
-					}
-				}
-			}
-
-			timerOverflow = 0;
+			Scheduler::advance(clockTicks);
 
 			ticks -= clockTicks;
 #ifdef LINK_EMULATION
 			if (linkenable)
 				LinkUpdate(clockTicks);
 #endif
-			cpuNextEvent = CPUUpdateTicks();
+			cpuNextEvent = Scheduler::nextEventTicks();
 
 			if (cpuDmaTicksToUpdate > 0)
 			{
@@ -1944,7 +2005,7 @@ updateLoop:
 				{
 					if (intState)
 					{
-						if (!IRQTicks)
+						if (!Scheduler::isScheduled(Scheduler::EVENT_IRQ))
 						{
 							CPU::interrupt();
 							intState = false;
@@ -1957,9 +2018,9 @@ updateLoop:
 						if (!holdState)
 						{
 							intState = true;
-							IRQTicks=7;
-							if (cpuNextEvent> IRQTicks)
-								cpuNextEvent = IRQTicks;
+							Scheduler::schedule(Scheduler::EVENT_IRQ, 7, irqDelayEnd);
+							if (cpuNextEvent > 7)
+								cpuNextEvent = 7;
 						}
 						else
 						{
@@ -2000,6 +2061,10 @@ guint gba_get_speed() {
 	return speed;
 }
 
+guint64 gba_get_idle_loop_skipped_ticks() {
+	return CPU::idleLoopSkippedTicks;
+}
+
 void gba_init_input(InputDriver *driver) {
 	inputDriver = driver;
 }
@@ -7,16 +7,13 @@
 #include <zlib.h>
 
 #define SAVE_GAME_VERSION_11 11
-#define SAVE_GAME_VERSION  SAVE_GAME_VERSION_11
+#define SAVE_GAME_VERSION_12 12 // Frame in 32 bits pixels
+#define SAVE_GAME_VERSION  SAVE_GAME_VERSION_12
 
 extern u8 biosProtected[4];
 extern int cpuNextEvent;
 extern int cpuTotalTicks;
 extern gboolean holdState;
-extern u8 memoryWait[16];
-extern u8 memoryWait32[16];
-extern u8 memoryWaitSeq[16];
-extern u8 memoryWaitSeq32[16];
 
 extern void CPUUpdateRender();
 extern void CPUUpdateRegister(u32, u16);
@@ -35,6 +32,11 @@ void CPUWriteState(gzFile gzFile);
  */
 guint gba_get_speed();
 
+/**
+ * Return the number of CPU cycles skipped in idle loops since the last reset
+ */
+guint64 gba_get_idle_loop_skipped_ticks();
+
 /**
  * Set the input driver
  * @param driver Input driver to be used
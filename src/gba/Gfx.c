@@ -1,27 +1,11 @@
 #include "Gfx.h"
 #include "GfxHelpers.h"
+#include "GfxThread.h"
+#include "Display.h"
 #include "Globals.h"
+#include "../common/Settings.h"
 
-typedef void (*InternalLineRenderer)();
-
-typedef struct ModeLineRenderers ModeLineRenderers;
-struct ModeLineRenderers {
-	InternalLineRenderer simple;
-	InternalLineRenderer noWindow;
-	InternalLineRenderer all;
-};
-
-static const ModeLineRenderers lineRenderers[] =
-{
-	{ gfx_mode0_line_render, gfx_mode0_line_render_no_window, gfx_mode0_line_render_all },
-	{ gfx_mode1_line_render, gfx_mode1_line_render_no_window, gfx_mode1_line_render_all },
-	{ gfx_mode2_line_render, gfx_mode2_line_render_no_window, gfx_mode2_line_render_all },
-	{ gfx_mode3_line_render, gfx_mode3_line_render_no_window, gfx_mode3_line_render_all },
-	{ gfx_mode4_line_render, gfx_mode4_line_render_no_window, gfx_mode4_line_render_all },
-	{ gfx_mode5_line_render, gfx_mode5_line_render_no_window, gfx_mode5_line_render_all }
-};
-
-static InternalLineRenderer internalRenderLine = NULL;
+#include <string.h>
 
 int gfxCoeff[32] =
 {
@@ -29,152 +13,384 @@ int gfxCoeff[32] =
 	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16
 };
 
-u32 gfxLine0[240];
-u32 gfxLine1[240];
-u32 gfxLine2[240];
-u32 gfxLine3[240];
-u32 gfxLineOBJ[240];
-u32 gfxLineOBJWin[240];
-u32 gfxLineMix[240];
-gboolean gfxInWin0[240];
-gboolean gfxInWin1[240];
-
-int gfxBG2X = 0;
-int gfxBG2Y = 0;
-int gfxBG3X = 0;
-int gfxBG3Y = 0;
+GFX_THREAD_LOCAL u32 gfxLine0[240];
+GFX_THREAD_LOCAL u32 gfxLine1[240];
+GFX_THREAD_LOCAL u32 gfxLine2[240];
+GFX_THREAD_LOCAL u32 gfxLine3[240];
+GFX_THREAD_LOCAL u32 gfxLineOBJ[240];
+GFX_THREAD_LOCAL u32 gfxLineOBJWin[8];
+GFX_THREAD_LOCAL GfxWindowSpans gfxWindow0;
+GFX_THREAD_LOCAL GfxWindowSpans gfxWindow1;
 
-void gfx_line_render()
+u32 gfxDirtyVram[GFX_VRAM_BLOCKS / 32];
+u32 gfxDirtyOam[GFX_OAM_ENTRIES / 32];
+u32 gfxDirtyPalette[GFX_PALETTE_ENTRIES / 32];
+
+u32 gfxFrameGeneration = 0;
+u32 gfxVramGeneration = 0;
+u32 gfxOamGeneration = 0;
+u32 gfxPaletteGeneration = 0;
+
+GFX_THREAD_LOCAL int gfxBG2X = 0;
+GFX_THREAD_LOCAL int gfxBG2Y = 0;
+GFX_THREAD_LOCAL int gfxBG3X = 0;
+GFX_THREAD_LOCAL int gfxBG3Y = 0;
+
+GFX_THREAD_LOCAL GfxRegisters gfxRegs;
+
+// Values of WIN0H and WIN1H gfxWindow0 and gfxWindow1 were computed for
+static GFX_THREAD_LOCAL u16 windowH[2];
+
+u8 *gfxVram = NULL;
+u8 *gfxPalette = NULL;
+u8 *gfxOam = NULL;
+
+// Notifications received since the last line was captured
+static u32 pendingUpdates = 0;
+static u32 pendingClearedLayers = 0;
+
+static gboolean threaded = FALSE;
+
+gboolean gfx_init()
 {
-	if (DISPCNT & 0x80)
+	gfxVram = vram;
+	gfxPalette = paletteRAM;
+	gfxOam = oam;
+
+	// Choose the compositors before the render threads look them up
+	gfx_line_compositor_get(0, display_format());
+
+	threaded = settings_render_thread();
+	if (threaded && !gfx_thread_start(settings_render_threads()))
 	{
-		for (int x = 0; x < 240; x++)
-		{
-			gfxLineMix[x] = 0x7fff;
-		}
-		return;
+		threaded = FALSE;
+		return FALSE;
 	}
 
-	internalRenderLine();
+	return TRUE;
+}
+
+void gfx_free()
+{
+	if (threaded)
+		gfx_thread_stop();
+	threaded = FALSE;
+
+	gfxVram = NULL;
+	gfxPalette = NULL;
+	gfxOam = NULL;
 }
 
 void gfx_BG2X_update()
 {
-	gfxBG2X = (BG2X_L) | ((BG2X_H & 0x07FF)<<16);
-	if (BG2X_H & 0x0800)
-		gfxBG2X |= 0xF8000000;
+	pendingUpdates |= GFX_UPDATE_BG2X;
 }
 
 void gfx_BG2Y_update()
 {
-	gfxBG2Y = (BG2Y_L) | ((BG2Y_H & 0x07FF)<<16);
-	if (BG2Y_H & 0x0800)
-		gfxBG2Y |= 0xF8000000;
+	pendingUpdates |= GFX_UPDATE_BG2Y;
 }
 
 void gfx_BG3X_update()
 {
-	gfxBG3X = (BG3X_L) | ((BG3X_H & 0x07FF)<<16);
-	if (BG3X_H & 0x0800)
-		gfxBG3X |= 0xF8000000;
+	pendingUpdates |= GFX_UPDATE_BG3X;
 }
 
 void gfx_BG3Y_update()
 {
-	gfxBG3Y = (BG3Y_L) | ((BG3Y_H & 0x07FF)<<16);
-	if (BG3Y_H & 0x0800)
-		gfxBG3Y |= 0xF8000000;
+	pendingUpdates |= GFX_UPDATE_BG3Y;
 }
 
-void gfx_frame_new()
+void gfx_window0_update()
 {
-	gfx_BG2X_update();
-	gfx_BG2Y_update();
-	gfx_BG3X_update();
-	gfx_BG3Y_update();
+	pendingUpdates |= GFX_UPDATE_WIN0;
+}
+
+void gfx_window1_update()
+{
+	pendingUpdates |= GFX_UPDATE_WIN1;
 }
 
 void gfx_renderer_choose()
 {
-	gboolean fxOn = ((BLDMOD>>6)&3) != 0;
-	gboolean windowOn = (layerEnable & 0x6000) ? TRUE : FALSE;
-	int mode = DISPCNT & 7;
+	pendingUpdates |= GFX_UPDATE_RENDERER;
+}
 
-	if (mode > 5)
-		return;
+void gfx_buffers_clear(gboolean force)
+{
+	pendingClearedLayers |= force ? 0x0F00 : (~layerEnable & 0x0F00);
+}
+
+void gfx_frame_new()
+{
+	gfxFrameGeneration++;
+
+	pendingUpdates |= GFX_UPDATE_BG2X | GFX_UPDATE_BG2Y | GFX_UPDATE_BG3X | GFX_UPDATE_BG3Y;
+}
 
-	if (!fxOn && !windowOn && !(layerEnable & 0x8000))
+static void gfx_line_capture(GfxLineState *state)
+{
+	GfxRegisters *registers = &state->registers;
+
+	registers->layerEnable = layerEnable;
+	registers->DISPCNT = DISPCNT;
+	registers->VCOUNT = VCOUNT;
+	registers->BG0CNT = BG0CNT;
+	registers->BG1CNT = BG1CNT;
+	registers->BG2CNT = BG2CNT;
+	registers->BG3CNT = BG3CNT;
+	registers->BG0HOFS = BG0HOFS;
+	registers->BG0VOFS = BG0VOFS;
+	registers->BG1HOFS = BG1HOFS;
+	registers->BG1VOFS = BG1VOFS;
+	registers->BG2HOFS = BG2HOFS;
+	registers->BG2VOFS = BG2VOFS;
+	registers->BG3HOFS = BG3HOFS;
+	registers->BG3VOFS = BG3VOFS;
+	registers->BG2PA = BG2PA;
+	registers->BG2PB = BG2PB;
+	registers->BG2PC = BG2PC;
+	registers->BG2PD = BG2PD;
+	registers->BG2X_L = BG2X_L;
+	registers->BG2X_H = BG2X_H;
+	registers->BG2Y_L = BG2Y_L;
+	registers->BG2Y_H = BG2Y_H;
+	registers->BG3PA = BG3PA;
+	registers->BG3PB = BG3PB;
+	registers->BG3PC = BG3PC;
+	registers->BG3PD = BG3PD;
+	registers->BG3X_L = BG3X_L;
+	registers->BG3X_H = BG3X_H;
+	registers->BG3Y_L = BG3Y_L;
+	registers->BG3Y_H = BG3Y_H;
+	registers->WIN0H = WIN0H;
+	registers->WIN1H = WIN1H;
+	registers->WIN0V = WIN0V;
+	registers->WIN1V = WIN1V;
+	registers->WININ = WININ;
+	registers->WINOUT = WINOUT;
+	registers->MOSAIC = MOSAIC;
+	registers->BLDMOD = BLDMOD;
+	registers->COLEV = COLEV;
+	registers->COLY = COLY;
+
+	state->updates = pendingUpdates;
+	state->clearedLayers = pendingClearedLayers;
+	pendingUpdates = 0;
+	pendingClearedLayers = 0;
+}
+
+void gfx_line_render()
+{
+	GfxLineState state;
+	gfx_line_capture(&state);
+
+	if (threaded)
 	{
-		internalRenderLine = lineRenderers[mode].simple;
+		gfx_thread_queue(&state);
+		return;
 	}
-	else if (fxOn && !windowOn && !(layerEnable & 0x8000))
+
+	gfx_tile_cache_invalidate(gfxDirtyVram);
+	gfx_sprites_invalidate(gfxDirtyOam);
+	gfx_dirty_vram_clear();
+	gfx_dirty_oam_clear();
+	gfx_dirty_palette_clear();
+
+	gfx_line_draw(&state);
+}
+
+void gfx_sync()
+{
+	if (threaded)
+		gfx_thread_sync();
+}
+
+static void gfx_window_span_add(GfxWindowSpans *window, int start, int end)
+{
+	if (end > 240)
+		end = 240;
+	if (start >= end)
+		return;
+
+	window->start[window->count] = start;
+	window->end[window->count] = end;
+	window->count++;
+}
+
+static void gfx_window_compute(u16 winh, GfxWindowSpans *window)
+{
+	int x00 = winh>>8;
+	int x01 = winh & 255;
+
+	window->count = 0;
+
+	if (x00 <= x01)
 	{
-		internalRenderLine = lineRenderers[mode].noWindow;
+		gfx_window_span_add(window, x00, x01);
 	}
 	else
 	{
-		internalRenderLine = lineRenderers[mode].all;
+		gfx_window_span_add(window, 0, x01);
+		gfx_window_span_add(window, x00, 240);
 	}
 }
 
-void gfx_buffers_clear(gboolean force)
+static void gfx_line_prepare(const GfxLineState *state)
 {
-	if (!(layerEnable & 0x0100) || force)
+	gfxRegs = state->registers;
+
+	u32 updates = state->updates;
+
+	if (updates & GFX_UPDATE_BG2X)
 	{
-		gfx_clear_array(gfxLine0);
+		gfxBG2X = (gfxRegs.BG2X_L) | ((gfxRegs.BG2X_H & 0x07FF)<<16);
+		if (gfxRegs.BG2X_H & 0x0800)
+			gfxBG2X |= 0xF8000000;
 	}
-	if (!(layerEnable & 0x0200) || force)
+	if (updates & GFX_UPDATE_BG2Y)
 	{
-		gfx_clear_array(gfxLine1);
+		gfxBG2Y = (gfxRegs.BG2Y_L) | ((gfxRegs.BG2Y_H & 0x07FF)<<16);
+		if (gfxRegs.BG2Y_H & 0x0800)
+			gfxBG2Y |= 0xF8000000;
 	}
-	if (!(layerEnable & 0x0400) || force)
+	if (updates & GFX_UPDATE_BG3X)
 	{
-		gfx_clear_array(gfxLine2);
+		gfxBG3X = (gfxRegs.BG3X_L) | ((gfxRegs.BG3X_H & 0x07FF)<<16);
+		if (gfxRegs.BG3X_H & 0x0800)
+			gfxBG3X |= 0xF8000000;
 	}
-	if (!(layerEnable & 0x0800) || force)
+	if (updates & GFX_UPDATE_BG3Y)
 	{
-		gfx_clear_array(gfxLine3);
+		gfxBG3Y = (gfxRegs.BG3Y_L) | ((gfxRegs.BG3Y_H & 0x07FF)<<16);
+		if (gfxRegs.BG3Y_H & 0x0800)
+			gfxBG3Y |= 0xF8000000;
 	}
-}
-
-void gfx_window0_update()
-{
-	int x00 = WIN0H>>8;
-	int x01 = WIN0H & 255;
-
-	if (x00 <= x01)
+	if (updates & GFX_UPDATE_WIN0)
 	{
-		for (int i = 0; i < 240; i++)
-		{
-			gfxInWin0[i] = (i >= x00 && i < x01);
-		}
+		windowH[0] = gfxRegs.WIN0H;
+		gfx_window_compute(windowH[0], &gfxWindow0);
 	}
-	else
+	if (updates & GFX_UPDATE_WIN1)
 	{
-		for (int i = 0; i < 240; i++)
-		{
-			gfxInWin0[i] = (i >= x00 || i < x01);
-		}
+		windowH[1] = gfxRegs.WIN1H;
+		gfx_window_compute(windowH[1], &gfxWindow1);
 	}
+	if (updates & GFX_UPDATE_RENDERER)
+		gfx_mode_renderer_choose();
 }
 
-void gfx_window1_update()
+void gfx_line_draw(const GfxLineState *state)
 {
-	int x00 = WIN1H>>8;
-	int x01 = WIN1H & 255;
+	gfx_line_prepare(state);
 
-	if (x00 <= x01)
-	{
-		for (int i = 0; i < 240; i++)
-		{
-			gfxInWin1[i] = (i >= x00 && i < x01);
-		}
-	}
-	else
+	if (state->clearedLayers & 0x0100)
+		gfx_clear_array(gfxLine0);
+	if (state->clearedLayers & 0x0200)
+		gfx_clear_array(gfxLine1);
+	if (state->clearedLayers & 0x0400)
+		gfx_clear_array(gfxLine2);
+	if (state->clearedLayers & 0x0800)
+		gfx_clear_array(gfxLine3);
+
+	gfx_mode_line_draw();
+}
+
+void gfx_line_skip(const GfxLineState *state)
+{
+	gfx_line_prepare(state);
+	gfx_mode_line_skip();
+}
+
+void gfx_line_carry_save(GfxLineCarry *carry)
+{
+	carry->BG2X = gfxBG2X;
+	carry->BG2Y = gfxBG2Y;
+	carry->BG3X = gfxBG3X;
+	carry->BG3Y = gfxBG3Y;
+	carry->WIN0H = windowH[0];
+	carry->WIN1H = windowH[1];
+	carry->renderer = gfx_mode_renderer_get();
+}
+
+void gfx_line_carry_restore(const GfxLineCarry *carry)
+{
+	gfxBG2X = carry->BG2X;
+	gfxBG2Y = carry->BG2Y;
+	gfxBG3X = carry->BG3X;
+	gfxBG3Y = carry->BG3Y;
+	windowH[0] = carry->WIN0H;
+	windowH[1] = carry->WIN1H;
+	gfx_window_compute(windowH[0], &gfxWindow0);
+	gfx_window_compute(windowH[1], &gfxWindow1);
+	gfx_mode_renderer_set(carry->renderer);
+
+	// The buffers of the disabled backgrounds are always clear, the others
+	// are drawn again
+	gfx_clear_array(gfxLine0);
+	gfx_clear_array(gfxLine1);
+	gfx_clear_array(gfxLine2);
+	gfx_clear_array(gfxLine3);
+}
+
+static void gfx_dirty_set(u32 *bits, u32 first, u32 last)
+{
+	for (u32 i = first; i <= last; i++)
+		bits[i >> 5] |= 1u << (i & 31);
+}
+
+void gfx_dirty_mark(u32 address, u32 length)
+{
+	if (length == 0)
+		return;
+
+	switch (address >> 24)
 	{
-		for (int i = 0; i < 240; i++)
-		{
-			gfxInWin1[i] = (i >= x00 || i < x01);
-		}
+	case 5:
+		address &= 0x3FF;
+		length = MIN(length, 0x400 - address);
+		gfx_dirty_set(gfxDirtyPalette, address >> 1, (address + length - 1) >> 1);
+		gfxPaletteGeneration = gfxFrameGeneration;
+		break;
+	case 6:
+		address &= 0x1FFFF;
+		if (address >= 0x18000)
+			address &= 0x17FFF;
+		length = MIN(length, 0x18000 - address);
+		gfx_dirty_set(gfxDirtyVram, address >> GFX_VRAM_BLOCK_SHIFT,
+		              (address + length - 1) >> GFX_VRAM_BLOCK_SHIFT);
+		gfxVramGeneration = gfxFrameGeneration;
+		break;
+	case 7:
+		address &= 0x3FF;
+		length = MIN(length, 0x400 - address);
+		gfx_dirty_set(gfxDirtyOam, address >> 3, (address + length - 1) >> 3);
+		gfxOamGeneration = gfxFrameGeneration;
+		break;
 	}
 }
+
+void gfx_dirty_mark_all()
+{
+	memset(gfxDirtyVram, 0xFF, sizeof(gfxDirtyVram));
+	memset(gfxDirtyOam, 0xFF, sizeof(gfxDirtyOam));
+	memset(gfxDirtyPalette, 0xFF, sizeof(gfxDirtyPalette));
+	gfxVramGeneration = gfxFrameGeneration;
+	gfxOamGeneration = gfxFrameGeneration;
+	gfxPaletteGeneration = gfxFrameGeneration;
+}
+
+void gfx_dirty_vram_clear()
+{
+	memset(gfxDirtyVram, 0, sizeof(gfxDirtyVram));
+}
+
+void gfx_dirty_oam_clear()
+{
+	memset(gfxDirtyOam, 0, sizeof(gfxDirtyOam));
+}
+
+void gfx_dirty_palette_clear()
+{
+	memset(gfxDirtyPalette, 0, sizeof(gfxDirtyPalette));
+}
@@ -26,9 +26,19 @@
 extern "C" {
 #endif
 
+// The state of the renderer is per thread, for several threads to draw the
+// strips of a frame
+#define GFX_THREAD_LOCAL __thread
+
+// Start the render thread when enabled in the settings, the memory
+// must be allocated
+gboolean gfx_init();
+void gfx_free();
+
+// The emulation notifies the renderer of the register writes it cares
+// about. The renderer applies them when it draws the next line.
 void gfx_frame_new();
 void gfx_renderer_choose();
-void gfx_line_render();
 void gfx_buffers_clear(gboolean force);
 void gfx_BG2X_update();
 void gfx_BG2Y_update();
@@ -37,45 +47,167 @@ void gfx_BG3Y_update();
 void gfx_window0_update();
 void gfx_window1_update();
 
-void gfx_mode0_line_render();
-void gfx_mode0_line_render_no_window();
-void gfx_mode0_line_render_all();
+// Draw the line VCOUNT to the display, or hand it to the render thread
+void gfx_line_render();
+// Wait for the render thread to draw the lines handed to it
+void gfx_sync();
+
+// Registers the renderer reads, captured at the end of each line
+typedef struct GfxRegisters GfxRegisters;
+struct GfxRegisters
+{
+	int layerEnable;
+	u16 DISPCNT;
+	u16 VCOUNT;
+	u16 BG0CNT;
+	u16 BG1CNT;
+	u16 BG2CNT;
+	u16 BG3CNT;
+	u16 BG0HOFS;
+	u16 BG0VOFS;
+	u16 BG1HOFS;
+	u16 BG1VOFS;
+	u16 BG2HOFS;
+	u16 BG2VOFS;
+	u16 BG3HOFS;
+	u16 BG3VOFS;
+	u16 BG2PA;
+	u16 BG2PB;
+	u16 BG2PC;
+	u16 BG2PD;
+	u16 BG2X_L;
+	u16 BG2X_H;
+	u16 BG2Y_L;
+	u16 BG2Y_H;
+	u16 BG3PA;
+	u16 BG3PB;
+	u16 BG3PC;
+	u16 BG3PD;
+	u16 BG3X_L;
+	u16 BG3X_H;
+	u16 BG3Y_L;
+	u16 BG3Y_H;
+	u16 WIN0H;
+	u16 WIN1H;
+	u16 WIN0V;
+	u16 WIN1V;
+	u16 WININ;
+	u16 WINOUT;
+	u16 MOSAIC;
+	u16 BLDMOD;
+	u16 COLEV;
+	u16 COLY;
+};
+
+// GFX_UPDATE_* flags
+#define GFX_UPDATE_BG2X     0x01
+#define GFX_UPDATE_BG2Y     0x02
+#define GFX_UPDATE_BG3X     0x04
+#define GFX_UPDATE_BG3Y     0x08
+#define GFX_UPDATE_WIN0     0x10
+#define GFX_UPDATE_WIN1     0x20
+#define GFX_UPDATE_RENDERER 0x40
 
-void gfx_mode1_line_render();
-void gfx_mode1_line_render_no_window();
-void gfx_mode1_line_render_all();
+// Everything a line is drawn from, apart from the video memory
+typedef struct GfxLineState GfxLineState;
+struct GfxLineState
+{
+	GfxRegisters registers;
+	u32 updates; // GFX_UPDATE_* flags of the notifications since the previous line
+	u32 clearedLayers; // Backgrounds whose line buffer was cleared, as in DISPCNT
+};
 
-void gfx_mode2_line_render();
-void gfx_mode2_line_render_no_window();
-void gfx_mode2_line_render_all();
+// Draw a line on the thread the renderer runs on
+void gfx_line_draw(const GfxLineState *state);
+// Update the renderer state as drawing the line would, without drawing it
+void gfx_line_skip(const GfxLineState *state);
 
-void gfx_mode3_line_render();
-void gfx_mode3_line_render_no_window();
-void gfx_mode3_line_render_all();
+// Renderer state a line depends on, apart from the line state
+typedef struct GfxLineCarry GfxLineCarry;
+struct GfxLineCarry
+{
+	int BG2X;
+	int BG2Y;
+	int BG3X;
+	int BG3Y;
+	u16 WIN0H;
+	u16 WIN1H;
+	int renderer;
+};
 
-void gfx_mode4_line_render();
-void gfx_mode4_line_render_no_window();
-void gfx_mode4_line_render_all();
+// Hand the renderer state of a thread over to another, to draw the
+// following lines there
+void gfx_line_carry_save(GfxLineCarry *carry);
+void gfx_line_carry_restore(const GfxLineCarry *carry);
 
-void gfx_mode5_line_render();
-void gfx_mode5_line_render_no_window();
-void gfx_mode5_line_render_all();
+// Registers of the line being drawn
+extern GFX_THREAD_LOCAL GfxRegisters gfxRegs;
+
+// Memory the renderer reads, the emulated memory when drawing the lines
+// inline or the copy the render thread keeps up to date
+extern u8 *gfxVram;
+extern u8 *gfxPalette;
+extern u8 *gfxOam;
 
 extern int gfxCoeff[32];
-extern u32 gfxLine0[240];
-extern u32 gfxLine1[240];
-extern u32 gfxLine2[240];
-extern u32 gfxLine3[240];
-extern u32 gfxLineOBJ[240];
-extern u32 gfxLineOBJWin[240];
-extern u32 gfxLineMix[240];
-extern gboolean gfxInWin0[240];
-extern gboolean gfxInWin1[240];
-
-extern int gfxBG2X;
-extern int gfxBG2Y;
-extern int gfxBG3X;
-extern int gfxBG3Y;
+extern GFX_THREAD_LOCAL u32 gfxLine0[240];
+extern GFX_THREAD_LOCAL u32 gfxLine1[240];
+extern GFX_THREAD_LOCAL u32 gfxLine2[240];
+extern GFX_THREAD_LOCAL u32 gfxLine3[240];
+extern GFX_THREAD_LOCAL u32 gfxLineOBJ[240];
+// One bit for each pixel inside the OBJ window
+extern GFX_THREAD_LOCAL u32 gfxLineOBJWin[8];
+
+// Pixels of the lines inside WIN0 or WIN1, from start to end in each span.
+// A window wrapping around the right edge of the screen has two spans.
+typedef struct GfxWindowSpans GfxWindowSpans;
+struct GfxWindowSpans
+{
+	int count;
+	int start[2];
+	int end[2];
+};
+
+extern GFX_THREAD_LOCAL GfxWindowSpans gfxWindow0;
+extern GFX_THREAD_LOCAL GfxWindowSpans gfxWindow1;
+
+// Dirty tracking of the video memory. Writes set a bit for each 32 bytes
+// block of VRAM (one 4bpp tile), OAM entry and palette entry they touch.
+// The bits stay set until the consumer of a region clears them. The
+// generation of a region is the value gfxFrameGeneration had when it was
+// last written, gfxFrameGeneration counts the frames.
+#define GFX_VRAM_BLOCK_SHIFT 5
+#define GFX_VRAM_BLOCKS (0x18000 >> GFX_VRAM_BLOCK_SHIFT)
+#define GFX_OAM_ENTRIES 128
+#define GFX_PALETTE_ENTRIES 512
+
+extern u32 gfxDirtyVram[GFX_VRAM_BLOCKS / 32];
+extern u32 gfxDirtyOam[GFX_OAM_ENTRIES / 32];
+extern u32 gfxDirtyPalette[GFX_PALETTE_ENTRIES / 32];
+
+extern u32 gfxFrameGeneration;
+extern u32 gfxVramGeneration;
+extern u32 gfxOamGeneration;
+extern u32 gfxPaletteGeneration;
+
+// Mark length bytes written from a bus address, addresses outside of the
+// palette, VRAM and OAM are ignored
+void gfx_dirty_mark(u32 address, u32 length);
+// Mark everything written, after a reset or loading a state
+void gfx_dirty_mark_all();
+void gfx_dirty_vram_clear();
+void gfx_dirty_oam_clear();
+void gfx_dirty_palette_clear();
+
+static inline gboolean gfx_dirty_test(const u32 *bits, u32 index)
+{
+	return (bits[index >> 5] >> (index & 31)) & 1;
+}
+
+extern GFX_THREAD_LOCAL int gfxBG2X;
+extern GFX_THREAD_LOCAL int gfxBG2Y;
+extern GFX_THREAD_LOCAL int gfxBG3X;
+extern GFX_THREAD_LOCAL int gfxBG3Y;
 
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
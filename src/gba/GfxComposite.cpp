@@ -0,0 +1,524 @@
+#include "Gfx.h"
+#include "GfxHelpers.h"
+#include "Display.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GFX_COMPOSITE_X86
+#include <immintrin.h>
+#endif
+
+// The layers are selected by comparing the top byte of their pixels, which
+// holds the priority. Only the pixels of semi-transparent OBJs have bit 16
+// set. The top pixel is never transparent as the backdrop is behind all of
+// the layers. The colours are converted to the format of the display as
+// they are written to the line of the frame.
+
+static inline u8 gfx_pixel_prio(u32 color)
+{
+	return color >> 24;
+}
+
+// Find the layer below the top one, among the layers enabled by mask
+static inline u8 gfx_pixel_second(int x, u8 mask, u8 top, u32 backdrop, u32 *back)
+{
+	const u32 *lines[5] = { gfxLine0, gfxLine1, gfxLine2, gfxLine3, gfxLineOBJ };
+	u8 top2 = 0x20;
+
+	*back = backdrop;
+	for (int i = 0; i < 5; i++)
+	{
+		u8 layer = 1 << i;
+		if ((mask & layer) && top != layer && gfx_pixel_prio(lines[i][x]) < gfx_pixel_prio(*back))
+		{
+			*back = lines[i][x];
+			top2 = layer;
+		}
+	}
+
+	return top2;
+}
+
+template<int effect>
+static inline u32 gfx_pixel_composite(int x, u32 backdrop, u8 mask, int ca, int cb, int cy)
+{
+	const u32 *lines[5] = { gfxLine0, gfxLine1, gfxLine2, gfxLine3, gfxLineOBJ };
+	u32 color = backdrop;
+	u8 top = 0x20;
+
+	for (int i = 0; i < 5; i++)
+	{
+		u8 layer = 1 << i;
+		if ((mask & layer) && gfx_pixel_prio(lines[i][x]) < gfx_pixel_prio(color))
+		{
+			color = lines[i][x];
+			top = layer;
+		}
+	}
+
+	if (color & 0x00010000)
+	{
+		// semi-transparent OBJ
+		u32 back;
+		u8 top2 = gfx_pixel_second(x, mask, top, backdrop, &back);
+
+		if (top2 & (gfxRegs.BLDMOD>>8))
+			color = gfx_alpha_blend(color, back, ca, cb);
+		else if (effect == 2 && (gfxRegs.BLDMOD & top))
+			color = gfx_brightness_increase(color, cy);
+		else if (effect == 3 && (gfxRegs.BLDMOD & top))
+			color = gfx_brightness_decrease(color, cy);
+	}
+	else if (mask & 32)
+	{
+		// special FX on in the window
+		switch (effect)
+		{
+		case 1:
+			if (gfxRegs.BLDMOD & top)
+			{
+				u32 back;
+				u8 top2 = gfx_pixel_second(x, mask, top, backdrop, &back);
+
+				if (top2 & (gfxRegs.BLDMOD>>8))
+					color = gfx_alpha_blend(color, back, ca, cb);
+			}
+			break;
+		case 2:
+			if (gfxRegs.BLDMOD & top)
+				color = gfx_brightness_increase(color, cy);
+			break;
+		case 3:
+			if (gfxRegs.BLDMOD & top)
+				color = gfx_brightness_decrease(color, cy);
+			break;
+		}
+	}
+
+	return color;
+}
+
+template<int format>
+static inline void gfx_pixel_store(void *dest, int x, u32 color)
+{
+	if (format == DISPLAY_FORMAT_XRGB8888)
+		((u32 *)dest)[x] = display_color_convert((DisplayFormat)format, color);
+	else
+		((u16 *)dest)[x] = display_color_convert((DisplayFormat)format, color);
+}
+
+template<int effect, int format>
+static void gfx_pixels_composite(u32 backdrop, u8 mask, int start, int end, void *dest)
+{
+	int ca = gfxCoeff[gfxRegs.COLEV & 0x1F];
+	int cb = gfxCoeff[(gfxRegs.COLEV >> 8) & 0x1F];
+	int cy = gfxCoeff[gfxRegs.COLY & 0x1F];
+
+	for (int x = start; x < end; x++)
+		gfx_pixel_store<format>(dest, x, gfx_pixel_composite<effect>(x, backdrop, mask, ca, cb, cy));
+}
+
+template<int effect, int format>
+static void gfx_line_composite_scalar(u32 backdrop, u8 mask, int start, int end, void *dest)
+{
+	gfx_pixels_composite<effect, format>(backdrop, mask, start, end, dest);
+}
+
+#ifdef GFX_COMPOSITE_X86
+
+// The SSE2 and AVX2 versions process 4 and 8 pixels at a time, and the
+// pixels left at the end of the span one at a time. The layers are selected
+// with compare masks instead of branches, and the blending is only computed
+// for the groups of pixels that need it.
+
+__attribute__((target("sse2")))
+static inline __m128i gfx_sse2_select(__m128i sel, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(sel, a), _mm_andnot_si128(sel, b));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i gfx_sse2_test(__m128i v, __m128i bits)
+{
+	return _mm_cmpeq_epi32(_mm_cmpeq_epi32(_mm_and_si128(v, bits), _mm_setzero_si128()),
+	                       _mm_setzero_si128());
+}
+
+// SSE2 has no 32 bits multiplication keeping the low half
+__attribute__((target("sse2")))
+static inline __m128i gfx_sse2_mul(__m128i v, __m128i coeff)
+{
+	__m128i even = _mm_mul_epu32(v, coeff);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(v, 32), coeff);
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+	                          _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Spread the RGB555 components so that they can be scaled together
+__attribute__((target("sse2")))
+static inline __m128i gfx_sse2_spread(__m128i color)
+{
+	color = _mm_and_si128(color, _mm_set1_epi32(0xFFFF));
+	return _mm_and_si128(_mm_or_si128(_mm_slli_epi32(color, 16), color), _mm_set1_epi32(0x03E07C1F));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i gfx_sse2_gather(__m128i color)
+{
+	return _mm_or_si128(_mm_srli_epi32(color, 16), color);
+}
+
+// The conversions of display_color_convert, on the low 16 bits of each
+// colour
+template<int format>
+__attribute__((target("sse2")))
+static inline __m128i gfx_sse2_convert(__m128i color)
+{
+	switch (format)
+	{
+	case DISPLAY_FORMAT_RGB565:
+		return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(color, _mm_set1_epi32(0x1F)), 11),
+		                                 _mm_slli_epi32(_mm_and_si128(color, _mm_set1_epi32(0x3E0)), 1)),
+		                    _mm_or_si128(_mm_and_si128(_mm_srli_epi32(color, 4), _mm_set1_epi32(0x20)),
+		                                 _mm_and_si128(_mm_srli_epi32(color, 10), _mm_set1_epi32(0x1F))));
+	case DISPLAY_FORMAT_XRGB8888:
+	{
+		__m128i r = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(color, _mm_set1_epi32(0x1F)), 19),
+		                         _mm_slli_epi32(_mm_and_si128(color, _mm_set1_epi32(0x1C)), 14));
+		__m128i g = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(color, _mm_set1_epi32(0x3E0)), 6),
+		                         _mm_slli_epi32(_mm_and_si128(color, _mm_set1_epi32(0x380)), 1));
+		__m128i b = _mm_or_si128(_mm_srli_epi32(_mm_and_si128(color, _mm_set1_epi32(0x7C00)), 7),
+		                         _mm_srli_epi32(_mm_and_si128(color, _mm_set1_epi32(0x7000)), 12));
+		return _mm_or_si128(_mm_or_si128(r, g), b);
+	}
+	default:
+		return color;
+	}
+}
+
+// The 16 bits formats keep the low half of each colour, which the signed
+// saturation leaves as it is once sign extended
+template<int format>
+__attribute__((target("sse2")))
+static inline void gfx_sse2_store(void *dest, int x, __m128i color)
+{
+	color = gfx_sse2_convert<format>(color);
+
+	if (format == DISPLAY_FORMAT_XRGB8888)
+	{
+		_mm_storeu_si128((__m128i *)&((u32 *)dest)[x], color);
+	}
+	else
+	{
+		color = _mm_srai_epi32(_mm_slli_epi32(color, 16), 16);
+		_mm_storel_epi64((__m128i *)&((u16 *)dest)[x], _mm_packs_epi32(color, color));
+	}
+}
+
+template<int effect, int format>
+__attribute__((target("sse2")))
+static void gfx_line_composite_sse2(u32 backdrop, u8 mask, int start, int end, void *dest)
+{
+	const u32 *lines[5] = { gfxLine0, gfxLine1, gfxLine2, gfxLine3, gfxLineOBJ };
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgb = _mm_set1_epi32(0x03E07C1F);
+	const __m128i firstTargets = _mm_set1_epi32(gfxRegs.BLDMOD & 0x3F);
+	const __m128i secondTargets = _mm_set1_epi32((gfxRegs.BLDMOD >> 8) & 0x3F);
+	const __m128i ca = _mm_set1_epi32(gfxCoeff[gfxRegs.COLEV & 0x1F]);
+	const __m128i cb = _mm_set1_epi32(gfxCoeff[(gfxRegs.COLEV >> 8) & 0x1F]);
+	const __m128i cy = _mm_set1_epi32(gfxCoeff[gfxRegs.COLY & 0x1F]);
+	const gboolean saturate = gfxCoeff[gfxRegs.COLEV & 0x1F] + gfxCoeff[(gfxRegs.COLEV >> 8) & 0x1F] > 16;
+	const __m128i effectAlpha = effect == 1 ? _mm_set1_epi32(-1) : zero;
+	const __m128i effectBrightness = effect >= 2 ? _mm_set1_epi32(-1) : zero;
+	// Special effects enabled for the span
+	const __m128i fx = (mask & 32) ? _mm_or_si128(effectAlpha, effectBrightness) : zero;
+
+	int x = start;
+	for (; x + 4 <= end; x += 4)
+	{
+		__m128i pixels[5];
+		__m128i color = _mm_set1_epi32(backdrop);
+		__m128i prio = _mm_set1_epi32(backdrop >> 24);
+		__m128i top = _mm_set1_epi32(0x20);
+
+		for (int i = 0; i < 5; i++)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+
+			__m128i layer = _mm_set1_epi32(1 << i);
+			pixels[i] = _mm_loadu_si128((const __m128i *)&lines[i][x]);
+			__m128i p = _mm_srli_epi32(pixels[i], 24);
+			__m128i sel = _mm_cmplt_epi32(p, prio);
+			color = gfx_sse2_select(sel, pixels[i], color);
+			prio = gfx_sse2_select(sel, p, prio);
+			top = gfx_sse2_select(sel, layer, top);
+		}
+
+		__m128i semi = gfx_sse2_test(color, _mm_set1_epi32(0x00010000));
+
+		if (!_mm_movemask_epi8(_mm_or_si128(semi, fx)))
+		{
+			gfx_sse2_store<format>(dest, x, color);
+			continue;
+		}
+
+		// Layer below the top one
+		__m128i back = _mm_set1_epi32(backdrop);
+		__m128i backPrio = _mm_set1_epi32(backdrop >> 24);
+		__m128i top2 = _mm_set1_epi32(0x20);
+
+		for (int i = 0; i < 5; i++)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+
+			__m128i layer = _mm_set1_epi32(1 << i);
+			__m128i p = _mm_srli_epi32(pixels[i], 24);
+			__m128i sel = _mm_cmplt_epi32(p, backPrio);
+			sel = _mm_andnot_si128(_mm_cmpeq_epi32(top, layer), sel);
+			back = gfx_sse2_select(sel, pixels[i], back);
+			backPrio = gfx_sse2_select(sel, p, backPrio);
+			top2 = gfx_sse2_select(sel, layer, top2);
+		}
+
+		__m128i firstTarget = gfx_sse2_test(top, firstTargets);
+		__m128i secondTarget = gfx_sse2_test(top2, secondTargets);
+
+		__m128i alpha = _mm_or_si128(_mm_and_si128(semi, secondTarget),
+		                             _mm_andnot_si128(semi, _mm_and_si128(_mm_and_si128(fx, effectAlpha),
+		                                                  _mm_and_si128(firstTarget, secondTarget))));
+		__m128i brightness = _mm_and_si128(_mm_and_si128(effectBrightness, firstTarget),
+		                                   gfx_sse2_select(semi, _mm_andnot_si128(secondTarget, semi), fx));
+
+		__m128i result = color;
+
+		if (_mm_movemask_epi8(brightness))
+		{
+			__m128i c = gfx_sse2_spread(color);
+			if (effect == 2)
+				c = _mm_and_si128(_mm_add_epi32(c, _mm_srli_epi32(gfx_sse2_mul(_mm_sub_epi32(rgb, c), cy), 4)), rgb);
+			else
+				c = _mm_sub_epi32(c, _mm_and_si128(_mm_srli_epi32(gfx_sse2_mul(c, cy), 4), rgb));
+			result = gfx_sse2_select(brightness, gfx_sse2_gather(c), result);
+		}
+
+		if (_mm_movemask_epi8(alpha))
+		{
+			__m128i c = _mm_add_epi32(gfx_sse2_mul(gfx_sse2_spread(color), ca),
+			                          gfx_sse2_mul(gfx_sse2_spread(back), cb));
+			c = _mm_srli_epi32(c, 4);
+			if (saturate)
+			{
+				c = _mm_or_si128(c, _mm_and_si128(gfx_sse2_test(c, _mm_set1_epi32(0x20)), _mm_set1_epi32(0x1F)));
+				c = _mm_or_si128(c, _mm_and_si128(gfx_sse2_test(c, _mm_set1_epi32(0x8000)), _mm_set1_epi32(0x7C00)));
+				c = _mm_or_si128(c, _mm_and_si128(gfx_sse2_test(c, _mm_set1_epi32(0x4000000)), _mm_set1_epi32(0x03E00000)));
+			}
+			c = _mm_and_si128(c, rgb);
+			result = gfx_sse2_select(alpha, gfx_sse2_gather(c), result);
+		}
+
+		gfx_sse2_store<format>(dest, x, result);
+	}
+
+	gfx_pixels_composite<effect, format>(backdrop, mask, x, end, dest);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i gfx_avx2_select(__m256i sel, __m256i a, __m256i b)
+{
+	return _mm256_blendv_epi8(b, a, sel);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i gfx_avx2_test(__m256i v, __m256i bits)
+{
+	return _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(v, bits), _mm256_setzero_si256()),
+	                        _mm256_set1_epi32(-1));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i gfx_avx2_spread(__m256i color)
+{
+	color = _mm256_and_si256(color, _mm256_set1_epi32(0xFFFF));
+	return _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi32(color, 16), color), _mm256_set1_epi32(0x03E07C1F));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i gfx_avx2_gather(__m256i color)
+{
+	return _mm256_or_si256(_mm256_srli_epi32(color, 16), color);
+}
+
+template<int format>
+__attribute__((target("avx2")))
+static inline void gfx_avx2_store(void *dest, int x, __m256i color)
+{
+	gfx_sse2_store<format>(dest, x, _mm256_castsi256_si128(color));
+	gfx_sse2_store<format>(dest, x + 4, _mm256_extracti128_si256(color, 1));
+}
+
+template<int effect, int format>
+__attribute__((target("avx2")))
+static void gfx_line_composite_avx2(u32 backdrop, u8 mask, int start, int end, void *dest)
+{
+	const u32 *lines[5] = { gfxLine0, gfxLine1, gfxLine2, gfxLine3, gfxLineOBJ };
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i rgb = _mm256_set1_epi32(0x03E07C1F);
+	const __m256i firstTargets = _mm256_set1_epi32(gfxRegs.BLDMOD & 0x3F);
+	const __m256i secondTargets = _mm256_set1_epi32((gfxRegs.BLDMOD >> 8) & 0x3F);
+	const __m256i ca = _mm256_set1_epi32(gfxCoeff[gfxRegs.COLEV & 0x1F]);
+	const __m256i cb = _mm256_set1_epi32(gfxCoeff[(gfxRegs.COLEV >> 8) & 0x1F]);
+	const __m256i cy = _mm256_set1_epi32(gfxCoeff[gfxRegs.COLY & 0x1F]);
+	const gboolean saturate = gfxCoeff[gfxRegs.COLEV & 0x1F] + gfxCoeff[(gfxRegs.COLEV >> 8) & 0x1F] > 16;
+	const __m256i effectAlpha = effect == 1 ? _mm256_set1_epi32(-1) : zero;
+	const __m256i effectBrightness = effect >= 2 ? _mm256_set1_epi32(-1) : zero;
+	// Special effects enabled for the span
+	const __m256i fx = (mask & 32) ? _mm256_or_si256(effectAlpha, effectBrightness) : zero;
+
+	int x = start;
+	for (; x + 8 <= end; x += 8)
+	{
+		__m256i pixels[5];
+		__m256i color = _mm256_set1_epi32(backdrop);
+		__m256i prio = _mm256_set1_epi32(backdrop >> 24);
+		__m256i top = _mm256_set1_epi32(0x20);
+
+		for (int i = 0; i < 5; i++)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+
+			__m256i layer = _mm256_set1_epi32(1 << i);
+			pixels[i] = _mm256_loadu_si256((const __m256i *)&lines[i][x]);
+			__m256i p = _mm256_srli_epi32(pixels[i], 24);
+			__m256i sel = _mm256_cmpgt_epi32(prio, p);
+			color = gfx_avx2_select(sel, pixels[i], color);
+			prio = gfx_avx2_select(sel, p, prio);
+			top = gfx_avx2_select(sel, layer, top);
+		}
+
+		__m256i semi = gfx_avx2_test(color, _mm256_set1_epi32(0x00010000));
+
+		if (_mm256_testz_si256(_mm256_or_si256(semi, fx), _mm256_set1_epi32(-1)))
+		{
+			gfx_avx2_store<format>(dest, x, color);
+			continue;
+		}
+
+		// Layer below the top one
+		__m256i back = _mm256_set1_epi32(backdrop);
+		__m256i backPrio = _mm256_set1_epi32(backdrop >> 24);
+		__m256i top2 = _mm256_set1_epi32(0x20);
+
+		for (int i = 0; i < 5; i++)
+		{
+			if (!(mask & (1 << i)))
+				continue;
+
+			__m256i layer = _mm256_set1_epi32(1 << i);
+			__m256i p = _mm256_srli_epi32(pixels[i], 24);
+			__m256i sel = _mm256_cmpgt_epi32(backPrio, p);
+			sel = _mm256_andnot_si256(_mm256_cmpeq_epi32(top, layer), sel);
+			back = gfx_avx2_select(sel, pixels[i], back);
+			backPrio = gfx_avx2_select(sel, p, backPrio);
+			top2 = gfx_avx2_select(sel, layer, top2);
+		}
+
+		__m256i firstTarget = gfx_avx2_test(top, firstTargets);
+		__m256i secondTarget = gfx_avx2_test(top2, secondTargets);
+
+		__m256i alpha = _mm256_or_si256(_mm256_and_si256(semi, secondTarget),
+		                                _mm256_andnot_si256(semi, _mm256_and_si256(_mm256_and_si256(fx, effectAlpha),
+		                                                    _mm256_and_si256(firstTarget, secondTarget))));
+		__m256i brightness = _mm256_and_si256(_mm256_and_si256(effectBrightness, firstTarget),
+		                                      gfx_avx2_select(semi, _mm256_andnot_si256(secondTarget, semi), fx));
+
+		__m256i result = color;
+
+		if (!_mm256_testz_si256(brightness, brightness))
+		{
+			__m256i c = gfx_avx2_spread(color);
+			if (effect == 2)
+				c = _mm256_and_si256(_mm256_add_epi32(c, _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(rgb, c), cy), 4)), rgb);
+			else
+				c = _mm256_sub_epi32(c, _mm256_and_si256(_mm256_srli_epi32(_mm256_mullo_epi32(c, cy), 4), rgb));
+			result = gfx_avx2_select(brightness, gfx_avx2_gather(c), result);
+		}
+
+		if (!_mm256_testz_si256(alpha, alpha))
+		{
+			__m256i c = _mm256_add_epi32(_mm256_mullo_epi32(gfx_avx2_spread(color), ca),
+			                             _mm256_mullo_epi32(gfx_avx2_spread(back), cb));
+			c = _mm256_srli_epi32(c, 4);
+			if (saturate)
+			{
+				c = _mm256_or_si256(c, _mm256_and_si256(gfx_avx2_test(c, _mm256_set1_epi32(0x20)), _mm256_set1_epi32(0x1F)));
+				c = _mm256_or_si256(c, _mm256_and_si256(gfx_avx2_test(c, _mm256_set1_epi32(0x8000)), _mm256_set1_epi32(0x7C00)));
+				c = _mm256_or_si256(c, _mm256_and_si256(gfx_avx2_test(c, _mm256_set1_epi32(0x4000000)), _mm256_set1_epi32(0x03E00000)));
+			}
+			c = _mm256_and_si256(c, rgb);
+			result = gfx_avx2_select(alpha, gfx_avx2_gather(c), result);
+		}
+
+		gfx_avx2_store<format>(dest, x, result);
+	}
+
+	gfx_pixels_composite<effect, format>(backdrop, mask, x, end, dest);
+}
+
+#endif // GFX_COMPOSITE_X86
+
+#define GFX_FORMAT_COMPOSITORS(compositor, effect) \
+	{ compositor<effect, DISPLAY_FORMAT_BGR555>, compositor<effect, DISPLAY_FORMAT_RGB565>, \
+	  compositor<effect, DISPLAY_FORMAT_XRGB8888> }
+
+#define GFX_COMPOSITORS(compositor) \
+	{ \
+		GFX_FORMAT_COMPOSITORS(compositor, 0), \
+		GFX_FORMAT_COMPOSITORS(compositor, 1), \
+		GFX_FORMAT_COMPOSITORS(compositor, 2), \
+		GFX_FORMAT_COMPOSITORS(compositor, 3) \
+	}
+
+static const GfxLineCompositors scalarCompositors = GFX_COMPOSITORS(gfx_line_composite_scalar);
+#ifdef GFX_COMPOSITE_X86
+static const GfxLineCompositors sse2Compositors = GFX_COMPOSITORS(gfx_line_composite_sse2);
+static const GfxLineCompositors avx2Compositors = GFX_COMPOSITORS(gfx_line_composite_avx2);
+#endif
+
+// Compositors of the fastest implementation the host supports
+static const GfxLineCompositor (*compositors)[3] = NULL;
+
+GfxLineCompositor gfx_line_compositor_get(int effect, DisplayFormat format)
+{
+	if (!compositors)
+	{
+		compositors = scalarCompositors;
+
+#ifdef GFX_COMPOSITE_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			compositors = avx2Compositors;
+		else if (__builtin_cpu_supports("sse2"))
+			compositors = sse2Compositors;
+#endif
+	}
+
+	return compositors[effect][format];
+}
+
+const GfxLineCompositors *gfx_line_compositors_get(const char *name)
+{
+	if (!strcmp(name, "scalar"))
+		return &scalarCompositors;
+#ifdef GFX_COMPOSITE_X86
+	if (!strcmp(name, "sse2"))
+		return &sse2Compositors;
+	if (!strcmp(name, "avx2"))
+		return &avx2Compositors;
+#endif
+
+	return NULL;
+}
@@ -17,11 +17,11 @@
 // Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 
 #include "GfxHelpers.h"
-#include "Globals.h"
+#include "Gfx.h"
 #include "../common/Port.h"
 #include <string.h>
 
-static int lineOBJpixleft[128];
+static GFX_THREAD_LOCAL int lineOBJpixleft[128];
 
 //#define SPRITE_DEBUG
 
@@ -72,6 +72,140 @@ static inline void gfx_pixel_draw(u32 *dest, const u8 color, const u16 *palette,
 	*dest = color ? (READ16LE(&palette[color]) | prio): 0x80000000;
 }
 
+// The tiles of the text backgrounds are kept decoded to palette indices,
+// in both horizontal orientations. A 4bpp tile is one dirty tracking block
+// of VRAM and an 8bpp tile two, a cached tile is decoded again once one of
+// its blocks has been written.
+typedef struct DecodedTile DecodedTile;
+struct DecodedTile
+{
+	u8 rows[8][8];
+	u8 flippedRows[8][8];
+};
+
+// Each thread drawing lines has its own cache
+struct GfxTileCache
+{
+	DecodedTile tiles16[GFX_VRAM_BLOCKS];
+	DecodedTile tiles256[GFX_VRAM_BLOCKS / 2];
+	// Indexed by block, for the 8bpp tiles only the bit of the first block is used
+	u32 valid16[GFX_VRAM_BLOCKS / 32];
+	u32 valid256[GFX_VRAM_BLOCKS / 32];
+	GfxTileCache *next;
+};
+
+static GfxTileCache mainTileCache;
+// All the caches, for the invalidations
+static GfxTileCache *tileCaches = &mainTileCache;
+static GFX_THREAD_LOCAL GfxTileCache *tileCache = &mainTileCache;
+
+GfxTileCache *gfx_tile_cache_new()
+{
+	GfxTileCache *cache = (GfxTileCache *)g_malloc0(sizeof(GfxTileCache));
+	cache->next = tileCaches;
+	tileCaches = cache;
+	return cache;
+}
+
+void gfx_tile_cache_free(GfxTileCache *cache)
+{
+	GfxTileCache **link = &tileCaches;
+	while (*link != cache)
+		link = &(*link)->next;
+	*link = cache->next;
+	g_free(cache);
+}
+
+void gfx_tile_cache_use(GfxTileCache *cache)
+{
+	tileCache = cache;
+}
+
+void gfx_tile_cache_invalidate(const u32 *blocks)
+{
+	for (GfxTileCache *cache = tileCaches; cache; cache = cache->next)
+	{
+		for (int i = 0; i < GFX_VRAM_BLOCKS / 32; i++)
+		{
+			u32 dirty = blocks[i];
+			if (dirty)
+			{
+				cache->valid16[i] &= ~dirty;
+				cache->valid256[i] &= ~(dirty | (dirty >> 1));
+			}
+		}
+	}
+}
+
+static void gfx_tile_decode_16(const u8 *tileBase, DecodedTile *decoded)
+{
+	for (int y = 0; y < 8; y++)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			u8 v = tileBase[y * 4 + x / 2];
+			u8 color = (x & 1) ? u8_upper_half(v) : u8_lower_half(v);
+			decoded->rows[y][x] = color;
+			decoded->flippedRows[y][7 - x] = color;
+		}
+	}
+}
+
+static void gfx_tile_decode_256(const u8 *tileBase, DecodedTile *decoded)
+{
+	for (int y = 0; y < 8; y++)
+	{
+		for (int x = 0; x < 8; x++)
+		{
+			decoded->rows[y][x] = tileBase[y * 8 + x];
+			decoded->flippedRows[y][7 - x] = tileBase[y * 8 + x];
+		}
+	}
+}
+
+static inline const DecodedTile *gfx_tile_cache_get_16(u32 address)
+{
+	u32 block = address >> GFX_VRAM_BLOCK_SHIFT;
+	GfxTileCache *cache = tileCache;
+	DecodedTile *decoded = &cache->tiles16[block];
+
+	if (!gfx_dirty_test(cache->valid16, block))
+	{
+		gfx_tile_decode_16(&gfxVram[address], decoded);
+		cache->valid16[block >> 5] |= 1u << (block & 31);
+	}
+
+	return decoded;
+}
+
+static inline const DecodedTile *gfx_tile_cache_get_256(u32 address, DecodedTile *uncached)
+{
+	// The tile numbers of an 8bpp background can go past the end of VRAM
+	if (address >= 0x18000)
+	{
+		gfx_tile_decode_256(&gfxVram[address], uncached);
+		return uncached;
+	}
+
+	u32 block = address >> GFX_VRAM_BLOCK_SHIFT;
+	GfxTileCache *cache = tileCache;
+	DecodedTile *decoded = &cache->tiles256[block >> 1];
+
+	if (!gfx_dirty_test(cache->valid256, block))
+	{
+		gfx_tile_decode_256(&gfxVram[address], decoded);
+		cache->valid256[block >> 5] |= 1u << (block & 31);
+	}
+
+	return decoded;
+}
+
+static inline void gfx_tile_row_draw(TileLine *tileLine, const u8 *row, const u16 *palette, const u32 prio)
+{
+	for (int i = 0; i < 8; i++)
+		gfx_pixel_draw(&tileLine->pixels[i], row[i], palette, prio);
+}
+
 static inline const TileLine gfx_tile_read(const u16 *screenSource, const int yyy, const u8 *charBase, u16 *palette, const u32 prio)
 {
 	TileEntry tile;
@@ -81,30 +215,13 @@ static inline const TileLine gfx_tile_read(const u16 *screenSource, const int yy
 	if (tileentry_v_flip(tile)) tileY = 7 - tileY;
 	TileLine tileLine;
 
-	const u8 *tileBase = &charBase[tileentry_tile_num(tile) * 64 + tileY * 8];
+	DecodedTile uncached;
+	const DecodedTile *decoded = gfx_tile_cache_get_256((charBase - gfxVram) + tileentry_tile_num(tile) * 64, &uncached);
 
 	if (!tileentry_h_flip(tile))
-	{
-		gfx_pixel_draw(&tileLine.pixels[0], tileBase[0], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[1], tileBase[1], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[2], tileBase[2], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[3], tileBase[3], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[4], tileBase[4], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[5], tileBase[5], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[6], tileBase[6], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[7], tileBase[7], palette, prio);
-	}
+		gfx_tile_row_draw(&tileLine, decoded->rows[tileY], palette, prio);
 	else
-	{
-		gfx_pixel_draw(&tileLine.pixels[0], tileBase[7], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[1], tileBase[6], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[2], tileBase[5], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[3], tileBase[4], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[4], tileBase[3], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[5], tileBase[2], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[6], tileBase[1], palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[7], tileBase[0], palette, prio);
-	}
+		gfx_tile_row_draw(&tileLine, decoded->flippedRows[tileY], palette, prio);
 
 	return tileLine;
 }
@@ -119,30 +236,12 @@ static inline const TileLine gfx_tile_read_palette(const u16 *screenSource, cons
 	palette += tileentry_palette(tile) * 16;
 	TileLine tileLine;
 
-	const u8 *tileBase = &charBase[tileentry_tile_num(tile) * 32 + tileY * 4];
+	const DecodedTile *decoded = gfx_tile_cache_get_16((charBase - gfxVram) + tileentry_tile_num(tile) * 32);
 
 	if (!tileentry_h_flip(tile))
-	{
-		gfx_pixel_draw(&tileLine.pixels[0], u8_lower_half(tileBase[0]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[1], u8_upper_half(tileBase[0]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[2], u8_lower_half(tileBase[1]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[3], u8_upper_half(tileBase[1]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[4], u8_lower_half(tileBase[2]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[5], u8_upper_half(tileBase[2]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[6], u8_lower_half(tileBase[3]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[7], u8_upper_half(tileBase[3]), palette, prio);
-	}
+		gfx_tile_row_draw(&tileLine, decoded->rows[tileY], palette, prio);
 	else
-	{
-		gfx_pixel_draw(&tileLine.pixels[0], u8_upper_half(tileBase[3]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[1], u8_lower_half(tileBase[3]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[2], u8_upper_half(tileBase[2]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[3], u8_lower_half(tileBase[2]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[4], u8_upper_half(tileBase[1]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[5], u8_lower_half(tileBase[1]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[6], u8_upper_half(tileBase[0]), palette, prio);
-		gfx_pixel_draw(&tileLine.pixels[7], u8_lower_half(tileBase[0]), palette, prio);
-	}
+		gfx_tile_row_draw(&tileLine, decoded->flippedRows[tileY], palette, prio);
 
 	return tileLine;
 }
@@ -160,9 +259,9 @@ static inline void gfx_tile_draw_clipped(const TileLine tileLine, u32 *line, con
 static void gfx_text_screen_draw_intern(TileReader readTile, u16 control, u16 hofs, u16 vofs,
                        u32 *line)
 {
-	u16 *palette = (u16 *)paletteRAM;
-	u8 *charBase = &vram[((control >> 2) & 0x03) * 0x4000];
-	u16 *screenBase = (u16 *)&vram[((control >> 8) & 0x1f) * 0x800];
+	u16 *palette = (u16 *)gfxPalette;
+	u8 *charBase = &gfxVram[((control >> 2) & 0x03) * 0x4000];
+	u16 *screenBase = (u16 *)&gfxVram[((control >> 8) & 0x1f) * 0x800];
 	u32 prio = ((control & 3)<<25) + 0x1000000;
 	int sizeX = 256;
 	int sizeY = 256;
@@ -188,15 +287,15 @@ static void gfx_text_screen_draw_intern(TileReader readTile, u16 control, u16 ho
 	gboolean mosaicOn = (control & 0x40) ? TRUE : FALSE;
 
 	int xxx = hofs & maskX;
-	int yyy = (vofs + VCOUNT) & maskY;
-	int mosaicX = (MOSAIC & 0x000F)+1;
-	int mosaicY = ((MOSAIC & 0x00F0)>>4)+1;
+	int yyy = (vofs + gfxRegs.VCOUNT) & maskY;
+	int mosaicX = (gfxRegs.MOSAIC & 0x000F)+1;
+	int mosaicY = ((gfxRegs.MOSAIC & 0x00F0)>>4)+1;
 
 	if (mosaicOn)
 	{
-		if ((VCOUNT % mosaicY) != 0)
+		if ((gfxRegs.VCOUNT % mosaicY) != 0)
 		{
-			mosaicY = VCOUNT - (VCOUNT % mosaicY);
+			mosaicY = gfxRegs.VCOUNT - (gfxRegs.VCOUNT % mosaicY);
 			yyy = (vofs + mosaicY) & maskY;
 		}
 	}
@@ -286,15 +385,139 @@ void gfx_text_screen_draw(u16 control, u16 hofs, u16 vofs, u32 *line)
 		gfx_text_screen_draw_intern(&gfx_tile_read_palette, control, hofs, vofs, line);
 }
 
+// The pixels of a rotation background line read texels along a straight
+// line, so the ones inside the background are a single span found up front.
+// The span is then drawn without bounds checks, reading a single row when
+// the line is only scaled.
+
+// Clip start and end to the pixels where real + x * delta, in 8.8 fixed
+// point, is between 0 and size
+static void gfx_affine_span_clip(int real, int delta, int size, int *start, int *end)
+{
+	s64 limit = (s64)size << 8;
+	s64 first = 0;
+	s64 last = 240;
+
+	if (delta > 0)
+	{
+		if (real < 0)
+			first = (-(s64)real + delta - 1) / delta;
+		last = (limit - real <= 0) ? 0 : (limit - real + delta - 1) / delta;
+	}
+	else if (delta < 0)
+	{
+		s64 step = -(s64)delta;
+		if (real >= limit)
+			first = (real - limit) / step + 1;
+		last = (real < 0) ? 0 : real / step + 1;
+	}
+	else if (real < 0 || real >= limit)
+	{
+		last = 0;
+	}
+
+	if (first > *start)
+		*start = (int)MIN(first, 240);
+	if (last < *end)
+		*end = (int)MAX(last, 0);
+	if (*end < *start)
+		*end = *start;
+}
+
+static inline void gfx_affine_bitmap_draw(const u8 *screenBase, int sizeX, int sizeY, gboolean paletted,
+                                          int prio, int realX, int realY, int dx, int dy, u32 *line)
+{
+	const u16 *palette = (const u16 *)gfxPalette;
+	const u16 *screenBase16 = (const u16 *)screenBase;
+
+	int start = 0;
+	int end = 240;
+	gfx_affine_span_clip(realX, dx, sizeX, &start, &end);
+	gfx_affine_span_clip(realY, dy, sizeY, &start, &end);
+
+	for (int x = 0; x < start; x++)
+		line[x] = 0x80000000;
+
+	realX += start * dx;
+	realY += start * dy;
+
+	if (dy == 0 && dx == 256)
+	{
+		int offset = (realY >> 8) * sizeX + (realX >> 8) - start;
+
+		if (paletted)
+		{
+			const u8 *row = &screenBase[offset];
+			for (int x = start; x < end; x++)
+			{
+				u8 color = row[x];
+				line[x] = color ? (READ16LE(&palette[color])|prio): 0x80000000;
+			}
+		}
+		else
+		{
+			const u16 *row = &screenBase16[offset];
+			for (int x = start; x < end; x++)
+				line[x] = (READ16LE(&row[x]) | prio);
+		}
+	}
+	else if (dy == 0)
+	{
+		int offset = (realY >> 8) * sizeX;
+
+		if (paletted)
+		{
+			const u8 *row = &screenBase[offset];
+			for (int x = start; x < end; x++)
+			{
+				u8 color = row[realX >> 8];
+				line[x] = color ? (READ16LE(&palette[color])|prio): 0x80000000;
+				realX += dx;
+			}
+		}
+		else
+		{
+			const u16 *row = &screenBase16[offset];
+			for (int x = start; x < end; x++)
+			{
+				line[x] = (READ16LE(&row[realX >> 8]) | prio);
+				realX += dx;
+			}
+		}
+	}
+	else
+	{
+		for (int x = start; x < end; x++)
+		{
+			int offset = (realY >> 8) * sizeX + (realX >> 8);
+
+			if (paletted)
+			{
+				u8 color = screenBase[offset];
+				line[x] = color ? (READ16LE(&palette[color])|prio): 0x80000000;
+			}
+			else
+			{
+				line[x] = (READ16LE(&screenBase16[offset]) | prio);
+			}
+			realX += dx;
+			realY += dy;
+		}
+	}
+
+	for (int x = end; x < 240; x++)
+		line[x] = 0x80000000;
+}
+
 void gfx_rot_screen_draw(u16 control,
                       u16 pa,  u16 pb,
                       u16 pc,  u16 pd,
                       int *currentX, int *currentY,
                       u32 *line)
 {
-	u16 *palette = (u16 *)paletteRAM;
-	u8 *charBase = &vram[((control >> 2) & 0x03) * 0x4000];
-	u8 *screenBase = (u8 *)&vram[((control >> 8) & 0x1f) * 0x800];
+	u16 *palette = (u16 *)gfxPalette;
+	u8 *charBase = &gfxVram[((control >> 2) & 0x03) * 0x4000];
+	u8 *screenBase = (u8 *)&gfxVram[((control >> 8) & 0x1f) * 0x800];
 	int prio = ((control & 3) << 25) + 0x1000000;
 
 	int sizeX = 128;
@@ -337,65 +560,72 @@ void gfx_rot_screen_draw(u16 control,
 
 	if (control & 0x40)
 	{
-		int mosaicY = ((MOSAIC & 0xF0)>>4) + 1;
-		int y = (VCOUNT % mosaicY);
+		int mosaicY = ((gfxRegs.MOSAIC & 0xF0)>>4) + 1;
+		int y = (gfxRegs.VCOUNT % mosaicY);
 		realX -= y*dmx;
 		realY -= y*dmy;
 	}
 
-	if (control & 0x2000)
+	// The whole line is inside when the background wraps around
+	int start = 0;
+	int end = 240;
+	if (!(control & 0x2000))
 	{
-		for (int x = 0; x < 240; x++)
-		{
-			int xxx = (realX >> 8) & maskX;
-			int yyy = (realY >> 8) & maskY;
+		gfx_affine_span_clip(realX, dx, sizeX, &start, &end);
+		gfx_affine_span_clip(realY, dy, sizeY, &start, &end);
+	}
 
-			int tile = screenBase[(xxx>>3) + ((yyy>>3)<<yshift)];
+	for (int x = 0; x < start; x++)
+		line[x] = 0x80000000;
 
-			int tileX = (xxx & 7);
-			int tileY = yyy & 7;
+	realX += start * dx;
+	realY += start * dy;
 
-			u8 color = charBase[(tile<<6) + (tileY<<3) + tileX];
+	if (dy == 0)
+	{
+		int yyy = (realY >> 8) & maskY;
+		const u8 *screenRow = &screenBase[(yyy>>3)<<yshift];
+		const u8 *charRow = &charBase[(yyy & 7)<<3];
+
+		for (int x = start; x < end; x++)
+		{
+			int xxx = (realX >> 8) & maskX;
+
+			int tile = screenRow[xxx>>3];
+			u8 color = charRow[(tile<<6) + (xxx & 7)];
 
 			line[x] = color ? (READ16LE(&palette[color])|prio): 0x80000000;
 
 			realX += dx;
-			realY += dy;
 		}
 	}
 	else
 	{
-		for (int x = 0; x < 240; x++)
+		for (int x = start; x < end; x++)
 		{
-			int xxx = (realX >> 8);
-			int yyy = (realY >> 8);
+			int xxx = (realX >> 8) & maskX;
+			int yyy = (realY >> 8) & maskY;
 
-			if (xxx < 0 ||
-			        yyy < 0 ||
-			        xxx >= sizeX ||
-			        yyy >= sizeY)
-			{
-				line[x] = 0x80000000;
-			}
-			else
-			{
-				int tile = screenBase[(xxx>>3) + ((yyy>>3)<<yshift)];
+			int tile = screenBase[(xxx>>3) + ((yyy>>3)<<yshift)];
 
-				int tileX = (xxx & 7);
-				int tileY = yyy & 7;
+			int tileX = (xxx & 7);
+			int tileY = yyy & 7;
 
-				u8 color = charBase[(tile<<6) + (tileY<<3) + tileX];
+			u8 color = charBase[(tile<<6) + (tileY<<3) + tileX];
+
+			line[x] = color ? (READ16LE(&palette[color])|prio): 0x80000000;
 
-				line[x] = color ? (READ16LE(&palette[color])|prio): 0x80000000;
-			}
 			realX += dx;
 			realY += dy;
 		}
 	}
 
+	for (int x = end; x < 240; x++)
+		line[x] = 0x80000000;
+
 	if (control & 0x40)
 	{
-		int mosaicX = (MOSAIC & 0xF) + 1;
+		int mosaicX = (gfxRegs.MOSAIC & 0xF) + 1;
 		if (mosaicX > 1)
 		{
 			int m = 1;
@@ -424,7 +654,7 @@ void gfx_rot_screen_draw_16bit(u16 control,
                            int *currentX, int *currentY,
                            u32 *line)
 {
-	u16 *screenBase = (u16 *)&vram[0];
+	u16 *screenBase = (u16 *)&gfxVram[0];
 	int prio = ((control & 3) << 25) + 0x1000000;
 	int sizeX = 240;
 	int sizeY = 160;
@@ -454,38 +684,17 @@ void gfx_rot_screen_draw_16bit(u16 control,
 
 	if (control & 0x40)
 	{
-		int mosaicY = ((MOSAIC & 0xF0)>>4) + 1;
-		int y = (VCOUNT % mosaicY);
+		int mosaicY = ((gfxRegs.MOSAIC & 0xF0)>>4) + 1;
+		int y = (gfxRegs.VCOUNT % mosaicY);
 		realX -= y*dmx;
 		realY -= y*dmy;
 	}
 
-	int xxx = (realX >> 8);
-	int yyy = (realY >> 8);
-
-	for (int x = 0; x < 240; x++)
-	{
-		if (xxx < 0 ||
-		        yyy < 0 ||
-		        xxx >= sizeX ||
-		        yyy >= sizeY)
-		{
-			line[x] = 0x80000000;
-		}
-		else
-		{
-			line[x] = (READ16LE(&screenBase[yyy * sizeX + xxx]) | prio);
-		}
-		realX += dx;
-		realY += dy;
-
-		xxx = (realX >> 8);
-		yyy = (realY >> 8);
-	}
+	gfx_affine_bitmap_draw((const u8 *)screenBase, sizeX, sizeY, FALSE, prio, realX, realY, dx, dy, line);
 
 	if (control & 0x40)
 	{
-		int mosaicX = (MOSAIC & 0xF) + 1;
+		int mosaicX = (gfxRegs.MOSAIC & 0xF) + 1;
 		if (mosaicX > 1)
 		{
 			int m = 1;
@@ -514,8 +723,7 @@ void gfx_rot_screen_draw_256(u16 control,
                          int *currentX, int *currentY,
                          u32 *line)
 {
-	u16 *palette = (u16 *)paletteRAM;
-	u8 *screenBase = (DISPCNT & 0x0010) ? &vram[0xA000] : &vram[0x0000];
+	u8 *screenBase = (gfxRegs.DISPCNT & 0x0010) ? &gfxVram[0xA000] : &gfxVram[0x0000];
 	int prio = ((control & 3) << 25) + 0x1000000;
 	int sizeX = 240;
 	int sizeY = 160;
@@ -545,41 +753,18 @@ void gfx_rot_screen_draw_256(u16 control,
 
 	if (control & 0x40)
 	{
-		int mosaicY = ((MOSAIC & 0xF0)>>4) + 1;
-		int y = VCOUNT - (VCOUNT % mosaicY);
+		int mosaicY = ((gfxRegs.MOSAIC & 0xF0)>>4) + 1;
+		int y = gfxRegs.VCOUNT - (gfxRegs.VCOUNT % mosaicY);
 
 		realX = startX + y*dmx;
 		realY = startY + y*dmy;
 	}
 
-	int xxx = (realX >> 8);
-	int yyy = (realY >> 8);
-
-	for (int x = 0; x < 240; x++)
-	{
-		if (xxx < 0 ||
-		        yyy < 0 ||
-		        xxx >= sizeX ||
-		        yyy >= sizeY)
-		{
-			line[x] = 0x80000000;
-		}
-		else
-		{
-			u8 color = screenBase[yyy * 240 + xxx];
-
-			line[x] = color ? (READ16LE(&palette[color])|prio): 0x80000000;
-		}
-		realX += dx;
-		realY += dy;
-
-		xxx = (realX >> 8);
-		yyy = (realY >> 8);
-	}
+	gfx_affine_bitmap_draw(screenBase, sizeX, sizeY, TRUE, prio, realX, realY, dx, dy, line);
 
 	if (control & 0x40)
 	{
-		int mosaicX = (MOSAIC & 0xF) + 1;
+		int mosaicX = (gfxRegs.MOSAIC & 0xF) + 1;
 		if (mosaicX > 1)
 		{
 			int m = 1;
@@ -608,8 +793,8 @@ void gfx_rot_screen_draw_16bit160(u16 control,
                               int *currentX, int *currentY,
                               u32 *line)
 {
-	u16 *screenBase = (DISPCNT & 0x0010) ? (u16 *)&vram[0xa000] :
-	                  (u16 *)&vram[0];
+	u16 *screenBase = (gfxRegs.DISPCNT & 0x0010) ? (u16 *)&gfxVram[0xa000] :
+	                  (u16 *)&gfxVram[0];
 	int prio = ((control & 3) << 25) + 0x1000000;
 	int sizeX = 160;
 	int sizeY = 128;
@@ -639,38 +824,17 @@ void gfx_rot_screen_draw_16bit160(u16 control,
 
 	if (control & 0x40)
 	{
-		int mosaicY = ((MOSAIC & 0xF0)>>4) + 1;
-		int y = VCOUNT - (VCOUNT % mosaicY);
+		int mosaicY = ((gfxRegs.MOSAIC & 0xF0)>>4) + 1;
+		int y = gfxRegs.VCOUNT - (gfxRegs.VCOUNT % mosaicY);
 		realX = startX + y * dmx;
 		realY = startY + y * dmy;
 	}
 
-	int xxx = (realX >> 8);
-	int yyy = (realY >> 8);
-
-	for (int x = 0; x < 240; x++)
-	{
-		if (xxx < 0 ||
-		        yyy < 0 ||
-		        xxx >= sizeX ||
-		        yyy >= sizeY)
-		{
-			line[x] = 0x80000000;
-		}
-		else
-		{
-			line[x] = (READ16LE(&screenBase[yyy * sizeX + xxx]) | prio);
-		}
-		realX += dx;
-		realY += dy;
-
-		xxx = (realX >> 8);
-		yyy = (realY >> 8);
-	}
+	gfx_affine_bitmap_draw((const u8 *)screenBase, sizeX, sizeY, FALSE, prio, realX, realY, dx, dy, line);
 
 	if (control & 0x40)
 	{
-		int mosaicX = (MOSAIC & 0xF) + 1;
+		int mosaicX = (gfxRegs.MOSAIC & 0xF) + 1;
 		if (mosaicX > 1)
 		{
 			int m = 1;
@@ -691,26 +855,163 @@ void gfx_rot_screen_draw_16bit160(u16 control,
 	*currentY += dmy;
 }
 
+// The OBJ attributes are kept decoded, with each entry binned to the lines
+// it may cover at either its normal or its double size. The entries are
+// decoded again when they are invalidated, the drawers then only walk the
+// entries binned to the current line.
+typedef struct DecodedSprite DecodedSprite;
+struct DecodedSprite
+{
+	u16 a0;
+	u16 a1;
+	u16 a2;
+	u8 sizeX;
+	u8 sizeY;
+};
+
+#define GFX_SPRITE_LINES 228
+
+static DecodedSprite decodedSprites[GFX_OAM_ENTRIES];
+static int spriteAffine[32][4]; // dx, dmx, dy, dmy
+static u32 spriteLines[GFX_SPRITE_LINES][GFX_OAM_ENTRIES / 32];
+
+static void gfx_sprite_lines_set(int index, int sy, int height)
+{
+	int first = sy;
+	int last = sy + height;
+
+	if (last > 256)
+	{
+		first = 0;
+		last -= 256;
+	}
+
+	if (last > GFX_SPRITE_LINES)
+		last = GFX_SPRITE_LINES;
+
+	for (int line = first; line < last; line++)
+		spriteLines[line][index >> 5] |= 1u << (index & 31);
+}
+
+static void gfx_sprite_decode(int index)
+{
+	const u16 *sprite = &((const u16 *)gfxOam)[index << 2];
+	u16 a0 = READ16LE(&sprite[0]);
+	u16 a1 = READ16LE(&sprite[1]);
+	u16 a2 = READ16LE(&sprite[2]);
+
+	if ((a0 & 0x0c00) == 0x0c00)
+		a0 &=0xF3FF;
+
+	if ((a0>>14) == 3)
+	{
+		a0 &= 0x3FFF;
+		a1 &= 0x3FFF;
+	}
+
+	int sizeX = 8<<(a1>>14);
+	int sizeY = sizeX;
+
+	if ((a0>>14) & 1)
+	{
+		if (sizeX<32)
+			sizeX<<=1;
+		if (sizeY>8)
+			sizeY>>=1;
+	}
+	else if ((a0>>14) & 2)
+	{
+		if (sizeX>8)
+			sizeX>>=1;
+		if (sizeY<32)
+			sizeY<<=1;
+	}
+
+	DecodedSprite *decoded = &decodedSprites[index];
+	decoded->a0 = a0;
+	decoded->a1 = a1;
+	decoded->a2 = a2;
+	decoded->sizeX = sizeX;
+	decoded->sizeY = sizeY;
+
+	// The fourth halfword of each entry is part of a rotation parameter set
+	s16 parameter = READ16LE(&sprite[3]);
+	spriteAffine[index >> 2][index & 3] = parameter;
+
+	u32 bit = 1u << (index & 31);
+	for (int line = 0; line < GFX_SPRITE_LINES; line++)
+		spriteLines[line][index >> 5] &= ~bit;
+
+	// Disabled entries never reach the drawers, unless in the OBJ window
+	// where they still use up cycles
+	if (((a0 & 0x0c00) != 0x0800) && ((a0 & 0x0300) == 0x0200))
+		return;
+
+	gfx_sprite_lines_set(index, a0 & 255, sizeY);
+	gfx_sprite_lines_set(index, a0 & 255, sizeY << 1);
+}
+
+void gfx_sprites_invalidate(const u32 *entries)
+{
+	for (int i = 0; i < GFX_OAM_ENTRIES / 32; i++)
+	{
+		u32 dirty = entries[i];
+		if (!dirty)
+			continue;
+
+		for (int j = 0; j < 32; j++)
+		{
+			if (dirty & (1u << j))
+				gfx_sprite_decode((i << 5) | j);
+		}
+	}
+}
+
+// Index of the first entry binned to the line from index on, or 128
+static inline int gfx_sprite_next(const u32 *line, int index)
+{
+	while (index < GFX_OAM_ENTRIES)
+	{
+		u32 bits = line[index >> 5] >> (index & 31);
+		if (bits)
+		{
+			while (!(bits & 1))
+			{
+				bits >>= 1;
+				index++;
+			}
+			return index;
+		}
+		index = (index | 31) + 1;
+	}
+	return GFX_OAM_ENTRIES;
+}
+
 void gfx_sprites_draw(u32 *lineOBJ)
 {
 	// lineOBJpix is used to keep track of the drawn OBJs
 	// and to stop drawing them if the 'maximum number of OBJ per line'
 	// has been reached.
-	int lineOBJpix = (DISPCNT & 0x20) ? 954 : 1226;
+	int lineOBJpix = (gfxRegs.DISPCNT & 0x20) ? 954 : 1226;
 	int m=0;
 	gfx_clear_array(lineOBJ);
-	if (layerEnable & 0x1000)
+	if (gfxRegs.layerEnable & 0x1000)
 	{
-		u16 *sprites = (u16 *)oam;
-		u16 *spritePalette = &((u16 *)paletteRAM)[256];
-		int mosaicY = ((MOSAIC & 0xF000)>>12) + 1;
-		int mosaicX = ((MOSAIC & 0xF00)>>8) + 1;
-		for (int x = 0; x < 128 ; x++)
+		u16 *spritePalette = &((u16 *)gfxPalette)[256];
+		int mosaicY = ((gfxRegs.MOSAIC & 0xF000)>>12) + 1;
+		int mosaicX = ((gfxRegs.MOSAIC & 0xF00)>>8) + 1;
+		const u32 *line = spriteLines[gfxRegs.VCOUNT];
+		int next = 0;
+		for (int x = gfx_sprite_next(line, 0); x < 128 ; x = gfx_sprite_next(line, x + 1))
 		{
-			u16 a0 = READ16LE(sprites++);
-			u16 a1 = READ16LE(sprites++);
-			u16 a2 = READ16LE(sprites++);
-			sprites++;
+			// The entries skipped take 2 cycles each
+			lineOBJpix -= 2 * (x - next);
+			next = x + 1;
+
+			const DecodedSprite *sprite = &decodedSprites[x];
+			u16 a0 = sprite->a0;
+			u16 a1 = sprite->a1;
+			u16 a2 = sprite->a2;
 
 			lineOBJpixleft[x]=lineOBJpix;
 
@@ -718,32 +1019,8 @@ void gfx_sprites_draw(u32 *lineOBJ)
 			if (lineOBJpix<=0)
 				continue;
 
-			if ((a0 & 0x0c00) == 0x0c00)
-				a0 &=0xF3FF;
-
-			if ((a0>>14) == 3)
-			{
-				a0 &= 0x3FFF;
-				a1 &= 0x3FFF;
-			}
-
-			int sizeX = 8<<(a1>>14);
-			int sizeY = sizeX;
-
-			if ((a0>>14) & 1)
-			{
-				if (sizeX<32)
-					sizeX<<=1;
-				if (sizeY>8)
-					sizeY>>=1;
-			}
-			else if ((a0>>14) & 2)
-			{
-				if (sizeX>8)
-					sizeX>>=1;
-				if (sizeY<32)
-					sizeY<<=1;
-			}
+			int sizeX = sprite->sizeX;
+			int sizeY = sprite->sizeY;
 
 #ifdef SPRITE_DEBUG
 			int maskX = sizeX-1;
@@ -754,7 +1031,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 			int sx = (a1 & 0x1FF);
 
 			// computes ticks used by OBJ-WIN if OBJWIN is enabled
-			if (((a0 & 0x0c00) == 0x0800) && (layerEnable & 0x8000))
+			if (((a0 & 0x0c00) == 0x0800) && (gfxRegs.layerEnable & 0x8000))
 			{
 				if ((a0 & 0x0300) == 0x0300)
 				{
@@ -772,7 +1049,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 				}
 				else if ((sx+sizeX)>240)
 					sizeX=240-sx;
-				if ((VCOUNT>=sy) && (VCOUNT<sy+sizeY) && (sx<240))
+				if ((gfxRegs.VCOUNT>=sy) && (gfxRegs.VCOUNT<sy+sizeY) && (sx<240))
 				{
 					if (a0 & 0x0100)
 						lineOBJpix-=8+2*sizeX;
@@ -802,7 +1079,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 				}
 				if ((sy+fieldY) > 256)
 					sy -= 256;
-				int t = VCOUNT - sy;
+				int t = gfxRegs.VCOUNT - sy;
 				if ((t >= 0) && (t < fieldY))
 				{
 					int startpix = 0;
@@ -815,20 +1092,11 @@ void gfx_sprites_draw(u32 *lineOBJ)
 						{
 							lineOBJpix-=8;
 							// int t2 = t - (fieldY >> 1);
-							int rot = (a1 >> 9) & 0x1F;
-							u16 *OAM = (u16 *)oam;
-							int dx = READ16LE(&OAM[3 + (rot << 4)]);
-							if (dx & 0x8000)
-								dx |= 0xFFFF8000;
-							int dmx = READ16LE(&OAM[7 + (rot << 4)]);
-							if (dmx & 0x8000)
-								dmx |= 0xFFFF8000;
-							int dy = READ16LE(&OAM[11 + (rot << 4)]);
-							if (dy & 0x8000)
-								dy |= 0xFFFF8000;
-							int dmy = READ16LE(&OAM[15 + (rot << 4)]);
-							if (dmy & 0x8000)
-								dmy |= 0xFFFF8000;
+							const int *affine = spriteAffine[(a1 >> 9) & 0x1F];
+							int dx = affine[0];
+							int dmx = affine[1];
+							int dy = affine[2];
+							int dmy = affine[3];
 
 							if (a0 & 0x1000)
 							{
@@ -845,10 +1113,10 @@ void gfx_sprites_draw(u32 *lineOBJ)
 							if (a0 & 0x2000)
 							{
 								int c = (a2 & 0x3FF);
-								if ((DISPCNT & 7) > 2 && (c < 512))
+								if ((gfxRegs.DISPCNT & 7) > 2 && (c < 512))
 									continue;
 								int inc = 32;
-								if (DISPCNT & 0x40)
+								if (gfxRegs.DISPCNT & 0x40)
 									inc = sizeX >> 2;
 								else
 									c &= 0x3FE;
@@ -866,7 +1134,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 									        sx >= 240);
 									else
 									{
-										u32 color = vram[0x10000 + ((((c + (yyy>>3) * inc)<<5)
+										u32 color = gfxVram[0x10000 + ((((c + (yyy>>3) * inc)<<5)
 										                             + ((yyy & 7)<<3) + ((xxx >> 3)<<6) +
 										                             (xxx & 7))&0x7FFF)];
 										if ((color==0) && (((prio >> 25)&3) <
@@ -902,11 +1170,11 @@ void gfx_sprites_draw(u32 *lineOBJ)
 							else
 							{
 								int c = (a2 & 0x3FF);
-								if ((DISPCNT & 7) > 2 && (c < 512))
+								if ((gfxRegs.DISPCNT & 7) > 2 && (c < 512))
 									continue;
 
 								int inc = 32;
-								if (DISPCNT & 0x40)
+								if (gfxRegs.DISPCNT & 0x40)
 									inc = sizeX >> 3;
 								int palette = (a2 >> 8) & 0xF0;
 								for (int x = 0; x < fieldX; x++)
@@ -922,7 +1190,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 									        sx >= 240);
 									else
 									{
-										u32 color = vram[0x10000 + ((((c + (yyy>>3) * inc)<<5)
+										u32 color = gfxVram[0x10000 + ((((c + (yyy>>3) * inc)<<5)
 										                             + ((yyy & 7)<<2) + ((xxx >> 3)<<5) +
 										                             ((xxx & 7)>>1))&0x7FFF)];
 										if (xxx & 1)
@@ -968,7 +1236,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 			{
 				if (sy+sizeY > 256)
 					sy -= 256;
-				int t = VCOUNT - sy;
+				int t = gfxRegs.VCOUNT - sy;
 				if ((t >= 0) && (t < sizeY))
 				{
 					int startpix = 0;
@@ -984,11 +1252,11 @@ void gfx_sprites_draw(u32 *lineOBJ)
 							if (a1 & 0x2000)
 								t = sizeY - t - 1;
 							int c = (a2 & 0x3FF);
-							if ((DISPCNT & 7) > 2 && (c < 512))
+							if ((gfxRegs.DISPCNT & 7) > 2 && (c < 512))
 								continue;
 
 							int inc = 32;
-							if (DISPCNT & 0x40)
+							if (gfxRegs.DISPCNT & 0x40)
 							{
 								inc = sizeX >> 2;
 							}
@@ -1020,7 +1288,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 									continue;
 								if (sx < 240)
 								{
-									u8 color = vram[address];
+									u8 color = gfxVram[address];
 									if ((color==0) && (((prio >> 25)&3) <
 									                   ((lineOBJ[sx]>>25)&3)))
 									{
@@ -1080,11 +1348,11 @@ void gfx_sprites_draw(u32 *lineOBJ)
 							if (a1 & 0x2000)
 								t = sizeY - t - 1;
 							int c = (a2 & 0x3FF);
-							if ((DISPCNT & 7) > 2 && (c < 512))
+							if ((gfxRegs.DISPCNT & 7) > 2 && (c < 512))
 								continue;
 
 							int inc = 32;
-							if (DISPCNT & 0x40)
+							if (gfxRegs.DISPCNT & 0x40)
 							{
 								inc = sizeX >> 3;
 							}
@@ -1112,7 +1380,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 										continue;
 									if (sx < 240)
 									{
-										u8 color = vram[address];
+										u8 color = gfxVram[address];
 										if (xx & 1)
 										{
 											color = (color >> 4);
@@ -1167,7 +1435,7 @@ void gfx_sprites_draw(u32 *lineOBJ)
 										continue;
 									if (sx < 240)
 									{
-										u8 color = vram[address];
+										u8 color = gfxVram[address];
 										if (xx & 1)
 										{
 											color = (color >> 4);
@@ -1223,18 +1491,18 @@ void gfx_sprites_draw(u32 *lineOBJ)
 
 void gfx_obj_win_draw(u32 *lineOBJWin)
 {
-	gfx_clear_array(lineOBJWin);
-	if ((layerEnable & 0x9000) == 0x9000)
+	memset(lineOBJWin, 0, 240 / 8);
+	if ((gfxRegs.layerEnable & 0x9000) == 0x9000)
 	{
-		u16 *sprites = (u16 *)oam;
-		// u16 *spritePalette = &((u16 *)paletteRAM)[256];
-		for (int x = 0; x < 128 ; x++)
+		// u16 *spritePalette = &((u16 *)gfxPalette)[256];
+		const u32 *line = spriteLines[gfxRegs.VCOUNT];
+		for (int x = gfx_sprite_next(line, 0); x < 128 ; x = gfx_sprite_next(line, x + 1))
 		{
 			int lineOBJpix = lineOBJpixleft[x];
-			u16 a0 = READ16LE(sprites++);
-			u16 a1 = READ16LE(sprites++);
-			u16 a2 = READ16LE(sprites++);
-			sprites++;
+			const DecodedSprite *sprite = &decodedSprites[x];
+			u16 a0 = sprite->a0;
+			u16 a1 = sprite->a1;
+			u16 a2 = sprite->a2;
 
 			if (lineOBJpix<=0)
 				continue;
@@ -1243,32 +1511,8 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 			if (((a0 & 0x0c00) != 0x0800) || ((a0 & 0x0300) == 0x0200))
 				continue;
 
-			if ((a0 & 0x0c00) == 0x0c00)
-				a0 &=0xF3FF;
-
-			if ((a0>>14) == 3)
-			{
-				a0 &= 0x3FFF;
-				a1 &= 0x3FFF;
-			}
-
-			int sizeX = 8<<(a1>>14);
-			int sizeY = sizeX;
-
-			if ((a0>>14) & 1)
-			{
-				if (sizeX<32)
-					sizeX<<=1;
-				if (sizeY>8)
-					sizeY>>=1;
-			}
-			else if ((a0>>14) & 2)
-			{
-				if (sizeX>8)
-					sizeX>>=1;
-				if (sizeY<32)
-					sizeY<<=1;
-			}
+			int sizeX = sprite->sizeX;
+			int sizeY = sprite->sizeY;
 
 			int sy = (a0 & 255);
 
@@ -1283,7 +1527,7 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 				}
 				if ((sy+fieldY) > 256)
 					sy -= 256;
-				int t = VCOUNT - sy;
+				int t = gfxRegs.VCOUNT - sy;
 				if ((t >= 0) && (t < fieldY))
 				{
 					int sx = (a1 & 0x1FF);
@@ -1296,20 +1540,11 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 					{
 						lineOBJpix-=8;
 						// int t2 = t - (fieldY >> 1);
-						int rot = (a1 >> 9) & 0x1F;
-						u16 *OAM = (u16 *)oam;
-						int dx = READ16LE(&OAM[3 + (rot << 4)]);
-						if (dx & 0x8000)
-							dx |= 0xFFFF8000;
-						int dmx = READ16LE(&OAM[7 + (rot << 4)]);
-						if (dmx & 0x8000)
-							dmx |= 0xFFFF8000;
-						int dy = READ16LE(&OAM[11 + (rot << 4)]);
-						if (dy & 0x8000)
-							dy |= 0xFFFF8000;
-						int dmy = READ16LE(&OAM[15 + (rot << 4)]);
-						if (dmy & 0x8000)
-							dmy |= 0xFFFF8000;
+						const int *affine = spriteAffine[(a1 >> 9) & 0x1F];
+						int dx = affine[0];
+						int dmx = affine[1];
+						int dy = affine[2];
+						int dmy = affine[3];
 
 						int realX = ((sizeX) << 7) - (fieldX >> 1)*dx - (fieldY>>1)*dmx
 						            + t * dmx;
@@ -1321,10 +1556,10 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 						if (a0 & 0x2000)
 						{
 							int c = (a2 & 0x3FF);
-							if ((DISPCNT & 7) > 2 && (c < 512))
+							if ((gfxRegs.DISPCNT & 7) > 2 && (c < 512))
 								continue;
 							int inc = 32;
-							if (DISPCNT & 0x40)
+							if (gfxRegs.DISPCNT & 0x40)
 								inc = sizeX >> 2;
 							else
 								c &= 0x3FE;
@@ -1344,12 +1579,12 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 								}
 								else
 								{
-									u32 color = vram[0x10000 + ((((c + (yyy>>3) * inc)<<5)
+									u32 color = gfxVram[0x10000 + ((((c + (yyy>>3) * inc)<<5)
 									                             + ((yyy & 7)<<3) + ((xxx >> 3)<<6) +
 									                             (xxx & 7))&0x7fff)];
 									if (color)
 									{
-										lineOBJWin[sx] = 1;
+										lineOBJWin[sx >> 5] |= 1u << (sx & 31);
 									}
 								}
 								sx = (sx+1)&511;
@@ -1360,11 +1595,11 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 						else
 						{
 							int c = (a2 & 0x3FF);
-							if ((DISPCNT & 7) > 2 && (c < 512))
+							if ((gfxRegs.DISPCNT & 7) > 2 && (c < 512))
 								continue;
 
 							int inc = 32;
-							if (DISPCNT & 0x40)
+							if (gfxRegs.DISPCNT & 0x40)
 								inc = sizeX >> 3;
 							// int palette = (a2 >> 8) & 0xF0;
 							for (int x = 0; x < fieldX; x++)
@@ -1387,7 +1622,7 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 								}
 								else
 								{
-									u32 color = vram[0x10000 + ((((c + (yyy>>3) * inc)<<5)
+									u32 color = gfxVram[0x10000 + ((((c + (yyy>>3) * inc)<<5)
 									                             + ((yyy & 7)<<2) + ((xxx >> 3)<<5) +
 									                             ((xxx & 7)>>1))&0x7fff)];
 									if (xxx & 1)
@@ -1397,7 +1632,7 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 
 									if (color)
 									{
-										lineOBJWin[sx] = 1;
+										lineOBJWin[sx >> 5] |= 1u << (sx & 31);
 									}
 								}
 								//            }
@@ -1413,7 +1648,7 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 			{
 				if ((sy+sizeY) > 256)
 					sy -= 256;
-				int t = VCOUNT - sy;
+				int t = gfxRegs.VCOUNT - sy;
 				if ((t >= 0) && (t < sizeY))
 				{
 					int sx = (a1 & 0x1FF);
@@ -1430,11 +1665,11 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 							if (a1 & 0x2000)
 								t = sizeY - t - 1;
 							int c = (a2 & 0x3FF);
-							if ((DISPCNT & 7) > 2 && (c < 512))
+							if ((gfxRegs.DISPCNT & 7) > 2 && (c < 512))
 								continue;
 
 							int inc = 32;
-							if (DISPCNT & 0x40)
+							if (gfxRegs.DISPCNT & 0x40)
 							{
 								inc = sizeX >> 2;
 							}
@@ -1458,10 +1693,10 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 									continue;
 								if (sx < 240)
 								{
-									u8 color = vram[address];
+									u8 color = gfxVram[address];
 									if (color)
 									{
-										lineOBJWin[sx] = 1;
+										lineOBJWin[sx >> 5] |= 1u << (sx & 31);
 									}
 								}
 
@@ -1497,11 +1732,11 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 							if (a1 & 0x2000)
 								t = sizeY - t - 1;
 							int c = (a2 & 0x3FF);
-							if ((DISPCNT & 7) > 2 && (c < 512))
+							if ((gfxRegs.DISPCNT & 7) > 2 && (c < 512))
 								continue;
 
 							int inc = 32;
-							if (DISPCNT & 0x40)
+							if (gfxRegs.DISPCNT & 0x40)
 							{
 								inc = sizeX >> 3;
 							}
@@ -1523,7 +1758,7 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 										continue;
 									if (sx < 240)
 									{
-										u8 color = vram[address];
+										u8 color = gfxVram[address];
 										if (xx & 1)
 										{
 											color = (color >> 4);
@@ -1533,7 +1768,7 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 
 										if (color)
 										{
-											lineOBJWin[sx] = 1;
+											lineOBJWin[sx >> 5] |= 1u << (sx & 31);
 										}
 									}
 									sx = (sx+1) & 511;
@@ -1559,7 +1794,7 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 										continue;
 									if (sx < 240)
 									{
-										u8 color = vram[address];
+										u8 color = gfxVram[address];
 										if (xx & 1)
 										{
 											color = (color >> 4);
@@ -1569,7 +1804,7 @@ void gfx_obj_win_draw(u32 *lineOBJWin)
 
 										if (color)
 										{
-											lineOBJWin[sx] = 1;
+											lineOBJWin[sx >> 5] |= 1u << (sx & 31);
 										}
 									}
 									sx = (sx+1) & 511;
@@ -18,13 +18,39 @@
 #ifndef __VBA_GFX_HELPERS_H
 #define __VBA_GFX_HELPERS_H
 
+#include <glib.h>
 #include "../common/Types.h"
+#include "../common/DisplayDriver.h"
 
 /* Set up for C function definitions, even when using C++ */
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Pick the line renderer for the mode and windows in gfxRegs
+void gfx_mode_renderer_choose();
+// Draw the line in gfxRegs to the display
+void gfx_mode_line_draw();
+// Advance the reference points of the rotation backgrounds as drawing the
+// line in gfxRegs would
+void gfx_mode_line_skip();
+// The line renderer chosen, -1 when none has been
+int gfx_mode_renderer_get();
+void gfx_mode_renderer_set(int renderer);
+
+// Cache of the decoded tiles of a thread, the threads that do not pick one
+// use the default cache
+typedef struct GfxTileCache GfxTileCache;
+GfxTileCache *gfx_tile_cache_new();
+void gfx_tile_cache_free(GfxTileCache *cache);
+// Use the cache for the lines drawn by the calling thread
+void gfx_tile_cache_use(GfxTileCache *cache);
+
+// Drop the decoded tiles and decode again the sprites of the VRAM blocks
+// and OAM entries set in the bitmaps, as in gfxDirtyVram and gfxDirtyOam
+void gfx_tile_cache_invalidate(const u32 *blocks);
+void gfx_sprites_invalidate(const u32 *entries);
+
 // Drawing helpers
 void gfx_clear_array(u32 *array);
 void gfx_text_screen_draw(u16 control, u16 hofs, u16 vofs, u32 *line);
@@ -55,7 +81,20 @@ void gfx_rot_screen_draw_16bit160(u16 control,
                               int *currentX, int *currentY,
                               u32 *line);
 void gfx_sprites_draw(u32 *lineOBJ);
+// Set the bits of the pixels inside the OBJ window in a 240 bits mask
 void gfx_obj_win_draw(u32 *lineOBJWin);
+// Picks the top layer of each pixel from start to end and applies the
+// special effects, into the line dest in the format of the display. Bits 0-4
+// of mask enable BG0-3 and OBJ, bit 5 the special effects.
+typedef void (*GfxLineCompositor)(u32 backdrop, u8 mask, int start, int end, void *dest);
+// Compositor specialised for a special effect, as in BLDCNT, and a display
+// format, in the fastest implementation the host supports
+GfxLineCompositor gfx_line_compositor_get(int effect, DisplayFormat format);
+// Compositors of an implementation, indexed by special effect and display format
+typedef GfxLineCompositor GfxLineCompositors[4][3];
+// Compositors of the implementation named "scalar", "sse2" or "avx2", or NULL
+// when it is not built for the host. Does not check the CPU supports it.
+const GfxLineCompositors *gfx_line_compositors_get(const char *name);
 u32 gfx_brightness_increase(u32 color, int coeff);
 u32 gfx_brightness_decrease(u32 color, int coeff);
 u32 gfx_alpha_blend(u32 color, u32 color2, int ca, int cb);
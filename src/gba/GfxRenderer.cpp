@@ -0,0 +1,346 @@
+#include "Gfx.h"
+#include "GfxHelpers.h"
+#include "Display.h"
+#include "../common/Port.h"
+
+#include <stddef.h>
+
+// The line renderers are instantiated from a single template for each mode
+// and combination of enabled windows. The compositor is specialised for the
+// special effect, and called for each span of pixels the windows enable the
+// same layers in, and writes the pixels to the line of the display frame.
+// Both are chosen when DISPCNT or BLDCNT has been written.
+
+typedef void (*LineRenderer)(void *dest);
+
+static GFX_THREAD_LOCAL LineRenderer lineRenderer = NULL;
+static GFX_THREAD_LOCAL GfxLineCompositor lineCompositor = NULL;
+// Mode, windows and special effect the renderer was chosen for
+static GFX_THREAD_LOCAL int lineChoice = -1;
+
+// Backgrounds of each mode, as in the window masks
+static const u8 modeLayers[6] = { 0x0F, 0x07, 0x0C, 0x04, 0x04, 0x04 };
+
+template<int mode>
+static inline void gfx_bg_layers_draw()
+{
+	switch (mode)
+	{
+	case 0:
+		if (gfxRegs.layerEnable & 0x0100)
+			gfx_text_screen_draw(gfxRegs.BG0CNT, gfxRegs.BG0HOFS, gfxRegs.BG0VOFS, gfxLine0);
+		if (gfxRegs.layerEnable & 0x0200)
+			gfx_text_screen_draw(gfxRegs.BG1CNT, gfxRegs.BG1HOFS, gfxRegs.BG1VOFS, gfxLine1);
+		if (gfxRegs.layerEnable & 0x0400)
+			gfx_text_screen_draw(gfxRegs.BG2CNT, gfxRegs.BG2HOFS, gfxRegs.BG2VOFS, gfxLine2);
+		if (gfxRegs.layerEnable & 0x0800)
+			gfx_text_screen_draw(gfxRegs.BG3CNT, gfxRegs.BG3HOFS, gfxRegs.BG3VOFS, gfxLine3);
+		break;
+	case 1:
+		if (gfxRegs.layerEnable & 0x0100)
+			gfx_text_screen_draw(gfxRegs.BG0CNT, gfxRegs.BG0HOFS, gfxRegs.BG0VOFS, gfxLine0);
+		if (gfxRegs.layerEnable & 0x0200)
+			gfx_text_screen_draw(gfxRegs.BG1CNT, gfxRegs.BG1HOFS, gfxRegs.BG1VOFS, gfxLine1);
+		if (gfxRegs.layerEnable & 0x0400)
+			gfx_rot_screen_draw(gfxRegs.BG2CNT, gfxRegs.BG2PA, gfxRegs.BG2PB, gfxRegs.BG2PC, gfxRegs.BG2PD,
+			                    &gfxBG2X, &gfxBG2Y, gfxLine2);
+		break;
+	case 2:
+		if (gfxRegs.layerEnable & 0x0400)
+			gfx_rot_screen_draw(gfxRegs.BG2CNT, gfxRegs.BG2PA, gfxRegs.BG2PB, gfxRegs.BG2PC, gfxRegs.BG2PD,
+			                    &gfxBG2X, &gfxBG2Y, gfxLine2);
+		if (gfxRegs.layerEnable & 0x0800)
+			gfx_rot_screen_draw(gfxRegs.BG3CNT, gfxRegs.BG3PA, gfxRegs.BG3PB, gfxRegs.BG3PC, gfxRegs.BG3PD,
+			                    &gfxBG3X, &gfxBG3Y, gfxLine3);
+		break;
+	case 3:
+		if (gfxRegs.layerEnable & 0x0400)
+			gfx_rot_screen_draw_16bit(gfxRegs.BG2CNT, gfxRegs.BG2X_L, gfxRegs.BG2X_H, gfxRegs.BG2Y_L, gfxRegs.BG2Y_H,
+			                          gfxRegs.BG2PA, gfxRegs.BG2PB, gfxRegs.BG2PC, gfxRegs.BG2PD,
+			                          &gfxBG2X, &gfxBG2Y, gfxLine2);
+		break;
+	case 4:
+		if (gfxRegs.layerEnable & 0x0400)
+			gfx_rot_screen_draw_256(gfxRegs.BG2CNT, gfxRegs.BG2X_L, gfxRegs.BG2X_H, gfxRegs.BG2Y_L, gfxRegs.BG2Y_H,
+			                        gfxRegs.BG2PA, gfxRegs.BG2PB, gfxRegs.BG2PC, gfxRegs.BG2PD,
+			                        &gfxBG2X, &gfxBG2Y, gfxLine2);
+		break;
+	case 5:
+		if (gfxRegs.layerEnable & 0x0400)
+			gfx_rot_screen_draw_16bit160(gfxRegs.BG2CNT, gfxRegs.BG2X_L, gfxRegs.BG2X_H, gfxRegs.BG2Y_L, gfxRegs.BG2Y_H,
+			                             gfxRegs.BG2PA, gfxRegs.BG2PB, gfxRegs.BG2PC, gfxRegs.BG2PD,
+			                             &gfxBG2X, &gfxBG2Y, gfxLine2);
+		break;
+	}
+}
+
+static inline gboolean gfx_window_line_inside(u16 winv)
+{
+	u8 v0 = winv >> 8;
+	u8 v1 = winv & 255;
+	gboolean inside = ((v0 == v1) && (v0 >= 0xe8));
+	if (v1 >= v0)
+		inside |= (gfxRegs.VCOUNT >= v0 && gfxRegs.VCOUNT < v1);
+	else
+		inside |= (gfxRegs.VCOUNT >= v0 || gfxRegs.VCOUNT < v1);
+	return inside;
+}
+
+static inline gboolean gfx_window_span_inside(const GfxWindowSpans *window, int x)
+{
+	for (int i = 0; i < window->count; i++)
+	{
+		if (x >= window->start[i] && x < window->end[i])
+			return TRUE;
+	}
+	return FALSE;
+}
+
+// End of the pixels from x, up to end, all inside or all outside the OBJ
+// window
+static inline int gfx_obj_window_run(int x, int end, gboolean inside)
+{
+	while (x < end)
+	{
+		int bit = x & 31;
+		u32 word = gfxLineOBJWin[x >> 5];
+		if (!inside)
+			word = ~word;
+
+		// The bits shifted in stop the run at the end of the word
+		u32 rest = ~(word >> bit);
+		int run = rest ? __builtin_ctz(rest) : 32;
+		x += run;
+		if (run < 32 - bit)
+			break;
+	}
+	return x < end ? x : end;
+}
+
+// Pixels of the line with the same layers and special effects enabled by
+// the windows, as in WININ
+struct WindowSpan
+{
+	int start;
+	int end;
+	u8 mask;
+};
+
+static inline void gfx_window_span_add(WindowSpan *spans, int &count, int start, int end, u8 mask)
+{
+	if (count > 0 && spans[count - 1].mask == mask)
+	{
+		spans[count - 1].end = end;
+		return;
+	}
+
+	spans[count].start = start;
+	spans[count].end = end;
+	spans[count].mask = mask;
+	count++;
+}
+
+template<bool win0, bool win1, bool objWin>
+static inline int gfx_window_spans_draw(WindowSpan *spans)
+{
+	gboolean inWindow0 = win0 && (gfxRegs.layerEnable & 0x2000) && gfx_window_line_inside(gfxRegs.WIN0V);
+	gboolean inWindow1 = win1 && (gfxRegs.layerEnable & 0x4000) && gfx_window_line_inside(gfxRegs.WIN1V);
+
+	u8 inWin0Mask = gfxRegs.WININ & 0xFF;
+	u8 inWin1Mask = gfxRegs.WININ >> 8;
+	u8 outMask = gfxRegs.WINOUT & 0xFF;
+	u8 objWinMask = gfxRegs.WINOUT >> 8;
+
+	// The masks only change at the edges of the window spans, and inside
+	// the OBJ window
+	int edges[10];
+	int edgeCount = 0;
+
+	edges[edgeCount++] = 0;
+	if (inWindow0)
+	{
+		for (int i = 0; i < gfxWindow0.count; i++)
+		{
+			edges[edgeCount++] = gfxWindow0.start[i];
+			edges[edgeCount++] = gfxWindow0.end[i];
+		}
+	}
+	if (inWindow1)
+	{
+		for (int i = 0; i < gfxWindow1.count; i++)
+		{
+			edges[edgeCount++] = gfxWindow1.start[i];
+			edges[edgeCount++] = gfxWindow1.end[i];
+		}
+	}
+	edges[edgeCount++] = 240;
+
+	for (int i = 1; i < edgeCount; i++)
+	{
+		int edge = edges[i];
+		int j = i;
+		for (; j > 0 && edges[j - 1] > edge; j--)
+			edges[j] = edges[j - 1];
+		edges[j] = edge;
+	}
+
+	int count = 0;
+
+	for (int i = 0; i + 1 < edgeCount; i++)
+	{
+		int start = edges[i];
+		int end = edges[i + 1];
+
+		if (start == end)
+			continue;
+
+		if (inWindow0 && gfx_window_span_inside(&gfxWindow0, start))
+		{
+			gfx_window_span_add(spans, count, start, end, inWin0Mask);
+		}
+		else if (inWindow1 && gfx_window_span_inside(&gfxWindow1, start))
+		{
+			gfx_window_span_add(spans, count, start, end, inWin1Mask);
+		}
+		else if (objWin)
+		{
+			for (int x = start; x < end; )
+			{
+				gboolean inside = (gfxLineOBJWin[x >> 5] >> (x & 31)) & 1;
+				int runEnd = gfx_obj_window_run(x, end, inside);
+				gfx_window_span_add(spans, count, x, runEnd, inside ? objWinMask : outMask);
+				x = runEnd;
+			}
+		}
+		else
+		{
+			gfx_window_span_add(spans, count, start, end, outMask);
+		}
+	}
+
+	return count;
+}
+
+template<int mode, bool win0, bool win1, bool objWin>
+static void gfx_mode_line_render(void *dest)
+{
+	u16 *palette = (u16 *)gfxPalette;
+
+	gfx_bg_layers_draw<mode>();
+	gfx_sprites_draw(gfxLineOBJ);
+
+	u32 backdrop = (READ16LE(&palette[0]) | 0x30000000);
+	u8 mask = modeLayers[mode] | 0x30;
+
+	if (win0 || win1 || objWin)
+	{
+		WindowSpan spans[240];
+
+		if (objWin)
+			gfx_obj_win_draw(gfxLineOBJWin);
+
+		int count = gfx_window_spans_draw<win0, win1, objWin>(spans);
+		for (int i = 0; i < count; i++)
+			lineCompositor(backdrop, mask & spans[i].mask, spans[i].start, spans[i].end, dest);
+	}
+	else
+	{
+		lineCompositor(backdrop, mask, 0, 240, dest);
+	}
+}
+
+#define GFX_MODE_RENDERERS(mode) \
+	{ \
+		{ \
+			{ gfx_mode_line_render<mode, false, false, false>, gfx_mode_line_render<mode, false, false, true> }, \
+			{ gfx_mode_line_render<mode, false, true, false>, gfx_mode_line_render<mode, false, true, true> } \
+		}, \
+		{ \
+			{ gfx_mode_line_render<mode, true, false, false>, gfx_mode_line_render<mode, true, false, true> }, \
+			{ gfx_mode_line_render<mode, true, true, false>, gfx_mode_line_render<mode, true, true, true> } \
+		} \
+	}
+
+// Indexed by mode, WIN0, WIN1 and OBJ window enabled
+static const LineRenderer lineRenderers[6][2][2][2] =
+{
+	GFX_MODE_RENDERERS(0),
+	GFX_MODE_RENDERERS(1),
+	GFX_MODE_RENDERERS(2),
+	GFX_MODE_RENDERERS(3),
+	GFX_MODE_RENDERERS(4),
+	GFX_MODE_RENDERERS(5)
+};
+
+int gfx_mode_renderer_get()
+{
+	return lineChoice;
+}
+
+void gfx_mode_renderer_set(int renderer)
+{
+	lineChoice = renderer;
+
+	if (renderer < 0)
+	{
+		lineRenderer = NULL;
+		lineCompositor = NULL;
+		return;
+	}
+
+	int mode = renderer >> 5;
+	int win0 = (renderer >> 4) & 1;
+	int win1 = (renderer >> 3) & 1;
+	int objWin = (renderer >> 2) & 1;
+
+	lineRenderer = lineRenderers[mode][win0][win1][objWin];
+	lineCompositor = gfx_line_compositor_get(renderer & 3, display_format());
+}
+
+void gfx_mode_renderer_choose()
+{
+	int mode = gfxRegs.DISPCNT & 7;
+
+	if (mode > 5)
+		return;
+
+	int win0 = (gfxRegs.layerEnable & 0x2000) ? 1 : 0;
+	int win1 = (gfxRegs.layerEnable & 0x4000) ? 1 : 0;
+	int objWin = (gfxRegs.layerEnable & 0x8000) ? 1 : 0;
+	int effect = (gfxRegs.BLDMOD >> 6) & 3;
+
+	gfx_mode_renderer_set((mode << 5) | (win0 << 4) | (win1 << 3) | (objWin << 2) | effect);
+}
+
+void gfx_mode_line_draw()
+{
+	if (gfxRegs.DISPCNT & 0x80)
+	{
+		display_line_fill(gfxRegs.VCOUNT, 0x7fff);
+		return;
+	}
+
+	lineRenderer(display_line_get(gfxRegs.VCOUNT));
+}
+
+void gfx_mode_line_skip()
+{
+	if ((gfxRegs.DISPCNT & 0x80) || lineChoice < 0)
+		return;
+
+	// The rotation backgrounds gfx_bg_layers_draw draws
+	int mode = lineChoice >> 5;
+	gboolean bg2 = (mode != 0) && (gfxRegs.layerEnable & 0x0400);
+	gboolean bg3 = (mode == 2) && (gfxRegs.layerEnable & 0x0800);
+
+	if (bg2)
+	{
+		gfxBG2X += (s16)gfxRegs.BG2PB;
+		gfxBG2Y += (s16)gfxRegs.BG2PD;
+	}
+	if (bg3)
+	{
+		gfxBG3X += (s16)gfxRegs.BG3PB;
+		gfxBG3Y += (s16)gfxRegs.BG3PD;
+	}
+}
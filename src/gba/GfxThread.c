@@ -0,0 +1,484 @@
+#include "GfxThread.h"
+#include "GfxHelpers.h"
+#include "Globals.h"
+
+#include <string.h>
+
+// Room for a few lines each writing all of the video memory
+#define GFX_QUEUE_SIZE (1 << 20)
+#define GFX_THREADS_MAX 8
+
+typedef struct GfxCommand GfxCommand;
+struct GfxCommand
+{
+	guint size; // Including the data following the command, 0 to go back to the start of the queue
+	GfxLineState state;
+	// Followed by these VRAM blocks and OAM entries, then by the whole
+	// palette if it has been written
+	u32 vram[GFX_VRAM_BLOCKS / 32];
+	u32 oam[GFX_OAM_ENTRIES / 32];
+	gboolean palette;
+};
+
+static GThread *thread = NULL;
+static GMutex mutex;
+static GCond cond;
+static gboolean stopping = FALSE;
+
+static u8 *queue = NULL;
+static guint queueRead = 0; // Only used by the render thread
+static guint queueWrite = 0; // Only used by the emulation
+// Including the space left at the end of the queue when going back to the start
+static guint queueUsed = 0;
+
+static u8 *renderVram = NULL;
+static u8 *renderPalette = NULL;
+static u8 *renderOam = NULL;
+
+// With several threads, the lines are drawn in batches of consecutive lines
+// without video memory written in between. The render thread first runs
+// through the batch without drawing to find the state each strip starts
+// from, then draws the first strip while the pool draws the others.
+static const GfxCommand *batch[228];
+static int batchCount = 0;
+static int batchLastLine = -1;
+// Size of the commands in the batch, left in the queue until drawn
+static guint queueHeld = 0;
+// Set while the emulation waits for the queue to be emptied
+static gboolean syncing = FALSE;
+
+typedef struct GfxStrip GfxStrip;
+struct GfxStrip
+{
+	GfxLineCarry carry; // Renderer state before the first line
+	int first;
+	int count;
+};
+
+typedef struct GfxWorker GfxWorker;
+struct GfxWorker
+{
+	GThread *thread;
+	GfxTileCache *cache;
+	const GfxStrip *strip;
+};
+
+static GfxWorker workers[GFX_THREADS_MAX - 1];
+static int workerCount = 0;
+static GfxStrip strips[GFX_THREADS_MAX];
+
+static GMutex poolMutex;
+static GCond poolCond;
+static guint stripGeneration = 0;
+static int stripsPending = 0;
+static gboolean poolStopping = FALSE;
+
+static guint gfx_bits_count(const u32 *bits, int words)
+{
+	guint count = 0;
+	for (int i = 0; i < words; i++)
+	{
+		for (u32 word = bits[i]; word; word &= word - 1)
+			count++;
+	}
+	return count;
+}
+
+static void gfx_strip_draw(const GfxStrip *strip)
+{
+	gfx_line_carry_restore(&strip->carry);
+
+	for (int i = strip->first; i < strip->first + strip->count; i++)
+		gfx_line_draw(&batch[i]->state);
+}
+
+static gpointer gfx_worker_run(gpointer data)
+{
+	GfxWorker *worker = (GfxWorker *)data;
+	guint generation = 0;
+
+	gfx_tile_cache_use(worker->cache);
+
+	g_mutex_lock(&poolMutex);
+
+	for (;;)
+	{
+		while (stripGeneration == generation && !poolStopping)
+			g_cond_wait(&poolCond, &poolMutex);
+
+		if (poolStopping)
+			break;
+
+		generation = stripGeneration;
+		g_mutex_unlock(&poolMutex);
+
+		gfx_strip_draw(worker->strip);
+
+		g_mutex_lock(&poolMutex);
+		if (--stripsPending == 0)
+			g_cond_broadcast(&poolCond);
+	}
+
+	g_mutex_unlock(&poolMutex);
+
+	return NULL;
+}
+
+static void gfx_batch_draw()
+{
+	int stripCount = workerCount + 1;
+
+	if (batchCount < stripCount)
+	{
+		for (int i = 0; i < batchCount; i++)
+			gfx_line_draw(&batch[i]->state);
+	}
+	else
+	{
+		int first = 0;
+		for (int i = 0; i < stripCount; i++)
+		{
+			GfxStrip *strip = &strips[i];
+			gfx_line_carry_save(&strip->carry);
+			strip->first = first;
+			strip->count = (batchCount - first) / (stripCount - i);
+
+			for (int j = first; j < first + strip->count; j++)
+				gfx_line_skip(&batch[j]->state);
+			first += strip->count;
+		}
+
+		GfxLineCarry end;
+		gfx_line_carry_save(&end);
+
+		g_mutex_lock(&poolMutex);
+		stripGeneration++;
+		stripsPending = workerCount;
+		g_cond_broadcast(&poolCond);
+		g_mutex_unlock(&poolMutex);
+
+		gfx_strip_draw(&strips[0]);
+
+		g_mutex_lock(&poolMutex);
+		while (stripsPending != 0)
+			g_cond_wait(&poolCond, &poolMutex);
+		g_mutex_unlock(&poolMutex);
+
+		gfx_line_carry_restore(&end);
+	}
+
+	batchCount = 0;
+	batchLastLine = -1;
+}
+
+// Called with the queue locked, unlocks it while drawing
+static void gfx_batch_flush()
+{
+	if (batchCount != 0)
+	{
+		g_mutex_unlock(&mutex);
+		gfx_batch_draw();
+		g_mutex_lock(&mutex);
+	}
+
+	queueUsed -= queueHeld;
+	queueHeld = 0;
+	g_cond_broadcast(&cond);
+}
+
+static gboolean gfx_command_has_memory(const GfxCommand *command)
+{
+	return command->palette
+	    || gfx_bits_count(command->vram, GFX_VRAM_BLOCKS / 32) != 0
+	    || gfx_bits_count(command->oam, GFX_OAM_ENTRIES / 32) != 0;
+}
+
+static void gfx_command_memory_apply(const GfxCommand *command)
+{
+	const u8 *data = (const u8 *)(command + 1);
+
+	for (int i = 0; i < GFX_VRAM_BLOCKS; i++)
+	{
+		if (gfx_dirty_test(command->vram, i))
+		{
+			memcpy(&renderVram[i << GFX_VRAM_BLOCK_SHIFT], data, 1 << GFX_VRAM_BLOCK_SHIFT);
+			data += 1 << GFX_VRAM_BLOCK_SHIFT;
+		}
+	}
+
+	for (int i = 0; i < GFX_OAM_ENTRIES; i++)
+	{
+		if (gfx_dirty_test(command->oam, i))
+		{
+			memcpy(&renderOam[i << 3], data, 8);
+			data += 8;
+		}
+	}
+
+	if (command->palette)
+		memcpy(renderPalette, data, 0x400);
+
+	gfx_tile_cache_invalidate(command->vram);
+	gfx_sprites_invalidate(command->oam);
+}
+
+static gpointer gfx_thread_run(gpointer data)
+{
+	g_mutex_lock(&mutex);
+
+	for (;;)
+	{
+		while (queueUsed == queueHeld && !stopping && !syncing)
+			g_cond_wait(&cond, &mutex);
+
+		if (queueUsed == queueHeld)
+		{
+			// Nothing left to read, draw what the emulation waits for
+			gfx_batch_flush();
+			if (stopping)
+				break;
+			while (syncing && !stopping && queueUsed == 0)
+				g_cond_wait(&cond, &mutex);
+			continue;
+		}
+
+		g_mutex_unlock(&mutex);
+
+		const GfxCommand *command = (const GfxCommand *)&queue[queueRead];
+		guint released;
+		gboolean flush = FALSE;
+
+		if (GFX_QUEUE_SIZE - queueRead < sizeof(GfxCommand) || command->size == 0)
+		{
+			released = GFX_QUEUE_SIZE - queueRead;
+			queueRead = 0;
+		}
+		else
+		{
+			int line = command->state.registers.VCOUNT;
+
+			// The lines of a batch all see the same video memory
+			if (batchCount != 0 && (gfx_command_has_memory(command) || line <= batchLastLine
+			                        || batchCount == G_N_ELEMENTS(batch)))
+			{
+				g_mutex_lock(&mutex);
+				gfx_batch_flush();
+				g_mutex_unlock(&mutex);
+			}
+
+			gfx_command_memory_apply(command);
+
+			batch[batchCount++] = command;
+			batchLastLine = line;
+			released = command->size;
+			queueRead += released;
+
+			flush = workerCount == 0 || line >= 159;
+		}
+
+		g_mutex_lock(&mutex);
+		queueHeld += released;
+		if (flush)
+			gfx_batch_flush();
+	}
+
+	g_mutex_unlock(&mutex);
+
+	return NULL;
+}
+
+void gfx_thread_queue(const GfxLineState *state)
+{
+	guint blocks = gfx_bits_count(gfxDirtyVram, GFX_VRAM_BLOCKS / 32);
+	guint entries = gfx_bits_count(gfxDirtyOam, GFX_OAM_ENTRIES / 32);
+	gboolean palette = gfx_bits_count(gfxDirtyPalette, GFX_PALETTE_ENTRIES / 32) != 0;
+
+	guint size = sizeof(GfxCommand) + (blocks << GFX_VRAM_BLOCK_SHIFT) + entries * 8;
+	if (palette)
+		size += 0x400;
+	size = (size + 7) & ~7;
+
+	// Commands are not split, the space left at the end is skipped
+	guint skipped = 0;
+	if (GFX_QUEUE_SIZE - queueWrite < size)
+		skipped = GFX_QUEUE_SIZE - queueWrite;
+
+	g_mutex_lock(&mutex);
+	while (GFX_QUEUE_SIZE - queueUsed < skipped + size)
+		g_cond_wait(&cond, &mutex);
+	g_mutex_unlock(&mutex);
+
+	if (GFX_QUEUE_SIZE - queueWrite < size)
+	{
+		if (skipped >= sizeof(GfxCommand))
+			((GfxCommand *)&queue[queueWrite])->size = 0;
+		queueWrite = 0;
+	}
+
+	GfxCommand *command = (GfxCommand *)&queue[queueWrite];
+	command->size = size;
+	command->state = *state;
+	memcpy(command->vram, gfxDirtyVram, sizeof(command->vram));
+	memcpy(command->oam, gfxDirtyOam, sizeof(command->oam));
+	command->palette = palette;
+
+	u8 *data = (u8 *)(command + 1);
+
+	for (int i = 0; i < GFX_VRAM_BLOCKS; i++)
+	{
+		if (gfx_dirty_test(gfxDirtyVram, i))
+		{
+			memcpy(data, &vram[i << GFX_VRAM_BLOCK_SHIFT], 1 << GFX_VRAM_BLOCK_SHIFT);
+			data += 1 << GFX_VRAM_BLOCK_SHIFT;
+		}
+	}
+
+	for (int i = 0; i < GFX_OAM_ENTRIES; i++)
+	{
+		if (gfx_dirty_test(gfxDirtyOam, i))
+		{
+			memcpy(data, &oam[i << 3], 8);
+			data += 8;
+		}
+	}
+
+	if (palette)
+		memcpy(data, paletteRAM, 0x400);
+
+	gfx_dirty_vram_clear();
+	gfx_dirty_oam_clear();
+	gfx_dirty_palette_clear();
+
+	queueWrite += size;
+
+	g_mutex_lock(&mutex);
+	queueUsed += skipped + size;
+	g_cond_broadcast(&cond);
+	g_mutex_unlock(&mutex);
+}
+
+void gfx_thread_sync()
+{
+	g_mutex_lock(&mutex);
+	syncing = TRUE;
+	g_cond_broadcast(&cond);
+	while (queueUsed != 0)
+		g_cond_wait(&cond, &mutex);
+	syncing = FALSE;
+	g_mutex_unlock(&mutex);
+}
+
+static void gfx_thread_memory_free()
+{
+	g_free(queue);
+	g_free(renderVram);
+	g_free(renderPalette);
+	g_free(renderOam);
+	queue = NULL;
+	renderVram = NULL;
+	renderPalette = NULL;
+	renderOam = NULL;
+}
+
+static void gfx_pool_stop()
+{
+	g_mutex_lock(&poolMutex);
+	poolStopping = TRUE;
+	g_cond_broadcast(&poolCond);
+	g_mutex_unlock(&poolMutex);
+
+	for (int i = 0; i < workerCount; i++)
+	{
+		g_thread_join(workers[i].thread);
+		gfx_tile_cache_free(workers[i].cache);
+		workers[i].thread = NULL;
+		workers[i].cache = NULL;
+	}
+
+	workerCount = 0;
+}
+
+static gboolean gfx_pool_start(int threads)
+{
+	stripGeneration = 0;
+	stripsPending = 0;
+	poolStopping = FALSE;
+
+	for (workerCount = 0; workerCount < MIN(threads, GFX_THREADS_MAX) - 1; workerCount++)
+	{
+		GfxWorker *worker = &workers[workerCount];
+		worker->cache = gfx_tile_cache_new();
+		worker->strip = &strips[workerCount + 1];
+		worker->thread = g_thread_try_new("render strip", gfx_worker_run, worker, NULL);
+		if (worker->thread == NULL)
+		{
+			gfx_tile_cache_free(worker->cache);
+			gfx_pool_stop();
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+gboolean gfx_thread_start(int threads)
+{
+	queue = (u8 *)g_malloc(GFX_QUEUE_SIZE);
+	renderVram = (u8 *)g_malloc(0x20000);
+	renderPalette = (u8 *)g_malloc(0x400);
+	renderOam = (u8 *)g_malloc(0x400);
+
+	memcpy(renderVram, vram, 0x20000);
+	memcpy(renderPalette, paletteRAM, 0x400);
+	memcpy(renderOam, oam, 0x400);
+
+	queueRead = 0;
+	queueWrite = 0;
+	queueUsed = 0;
+	queueHeld = 0;
+	batchCount = 0;
+	batchLastLine = -1;
+	stopping = FALSE;
+	syncing = FALSE;
+
+	gfxVram = renderVram;
+	gfxPalette = renderPalette;
+	gfxOam = renderOam;
+
+	if (!gfx_pool_start(threads))
+	{
+		gfxVram = vram;
+		gfxPalette = paletteRAM;
+		gfxOam = oam;
+		gfx_thread_memory_free();
+		return FALSE;
+	}
+
+	thread = g_thread_try_new("render", gfx_thread_run, NULL, NULL);
+	if (thread == NULL)
+	{
+		gfx_pool_stop();
+		gfxVram = vram;
+		gfxPalette = paletteRAM;
+		gfxOam = oam;
+		gfx_thread_memory_free();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void gfx_thread_stop()
+{
+	g_mutex_lock(&mutex);
+	stopping = TRUE;
+	g_cond_broadcast(&cond);
+	g_mutex_unlock(&mutex);
+
+	g_thread_join(thread);
+	thread = NULL;
+
+	gfx_pool_stop();
+
+	gfx_thread_memory_free();
+}
@@ -0,0 +1,32 @@
+#ifndef __VBA_GFX_THREAD_H
+#define __VBA_GFX_THREAD_H
+
+#include <glib.h>
+#include "Gfx.h"
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The render thread draws the lines from a queue of captured line states,
+// each followed by the video memory written since the previous line. It
+// keeps its own copy of the video memory the renderer reads. With more
+// than one thread, the lines of a frame are drawn in strips by a pool.
+
+gboolean gfx_thread_start(int threads);
+// Draws the queued lines before stopping
+void gfx_thread_stop();
+
+// Queue a line, along with the memory set in the dirty bitmaps which are
+// cleared
+void gfx_thread_queue(const GfxLineState *state);
+// Wait for the queued lines to be drawn
+void gfx_thread_sync();
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __VBA_GFX_THREAD_H
@@ -117,10 +117,12 @@ extern u16 IME;
 
 #ifdef __GNUC__
 # define INSN_REGPARM __attribute__((regparm(1)))
+# define INSN_INLINE inline __attribute__((always_inline))
 # define LIKELY(x) __builtin_expect(!!(x),1)
 # define UNLIKELY(x) __builtin_expect(!!(x),0)
 #else
 # define INSN_REGPARM /*nothing*/
+# define INSN_INLINE inline
 # define LIKELY(x) (x)
 # define UNLIKELY(x) (x)
 #endif
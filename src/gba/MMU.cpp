@@ -3,23 +3,22 @@
 #include "Cartridge.h"
 #include "CPU.h"
 #include "GBA.h"
+#include "Gfx.h"
 #include "Globals.h"
+#include "Scheduler.h"
 #include "Sound.h"
 #include <cstdio>
+#include <cstring>
 
 
 extern bool stopState;
 extern bool timer0On;
-extern int timer0Ticks;
 extern int timer0ClockReload;
 extern bool timer1On;
-extern int timer1Ticks;
 extern int timer1ClockReload;
 extern bool timer2On;
-extern int timer2Ticks;
 extern int timer2ClockReload;
 extern bool timer3On;
-extern int timer3Ticks;
 extern int timer3ClockReload;
 
 namespace MMU
@@ -27,17 +26,8 @@ namespace MMU
 
 static bool ioReadable[0x400];
 
-template <typename T>
-static inline T readLE(u8* x)
-{
-	return *((T *)x);
-}
-
-template <typename T>
-static inline void writeLE(u8* x, T value)
-{
-	*((T *)x) = value;
-}
+Page readPages[PAGE_COUNT];
+Page writePages[PAGE_COUNT];
 
 // Memory read functions forward declarations
 template<typename T>
@@ -182,10 +172,147 @@ void uninit()
 	bios = 0;
 	oam = 0;
 	ioMem = 0;
+
+	memset(readPages, 0, sizeof(readPages));
+	memset(writePages, 0, sizeof(writePages));
+}
+
+void reset()
+{
+	for (u32 page = 0; page < PAGE_COUNT; page++)
+	{
+		u32 address = page << PAGE_SHIFT;
+		u32 region = address >> 24;
+		u32 available = 0;
+		Page plain = { pointer(address, available), (1 << PAGE_SHIFT) - 1 };
+		Page handled = { NULL, 0 };
+
+		// Palette and OAM are mirrored within a page
+		if (region == 5 || region == 7)
+			plain.mask = memMap[region].mask;
+		else if (available < (1 << PAGE_SHIFT))
+			plain = handled;
+
+		readPages[page] = plain;
+		// Writing to the cartridge talks to the backup media or the RTC
+		writePages[page] = region < 8 ? plain : handled;
+	}
+
+	// The recompiled code reads its literal pools from the pages
+	CPU::jitFlush();
 }
 
-u32 read32(u32 address)
+// Write through the page table, returns false when the region handler has
+// to be used instead
+template<typename T>
+static inline bool writePage(u32 address, T value)
 {
+	u32 page = address >> PAGE_SHIFT;
+	if (page >= PAGE_COUNT || writePages[page].mem == NULL || (address & (sizeof(T) - 1)))
+		return false;
+
+	writeLE<T>(&writePages[page].mem[address & writePages[page].mask], value);
+
+	// RAM may hold ARM code, the renderer tracks the video memory
+	if ((address >> 25) == 1)
+	{
+		CPU::armCacheInvalidate(address);
+		CPU::jitInvalidate(address);
+	}
+	else
+		gfx_dirty_mark(address, sizeof(T));
+
+	return true;
+}
+
+// Journal of the CPU self-check /////////////////////////////////////////
+
+static JournalMode journalMode = JOURNAL_OFF;
+static Journal *journalAccesses = NULL;
+static const Journal *journalRecord = NULL;
+
+void journalStart(JournalMode mode, Journal *accesses, const Journal *record)
+{
+	journalMode = mode;
+	journalAccesses = accesses;
+	journalAccesses->count = 0;
+	journalRecord = record;
+}
+
+void journalStop()
+{
+	journalMode = JOURNAL_OFF;
+	journalAccesses = NULL;
+	journalRecord = NULL;
+}
+
+static void journalAppend(u32 address, u32 value, u8 size, bool write)
+{
+	if (journalAccesses->count < JOURNAL_SIZE)
+	{
+		JournalAccess &access = journalAccesses->accesses[journalAccesses->count];
+		access.address = address;
+		access.value = value;
+		access.size = size;
+		access.write = write;
+	}
+
+	journalAccesses->count++;
+}
+
+static u32 journalRead(u32 address, u8 size)
+{
+	JournalMode mode = journalMode;
+	int index = journalAccesses->count;
+	u32 value;
+
+	if (mode == JOURNAL_REPLAY && index < journalRecord->count && index < JOURNAL_SIZE
+	    && !journalRecord->accesses[index].write
+	    && journalRecord->accesses[index].address == address
+	    && journalRecord->accesses[index].size == size)
+	{
+		value = journalRecord->accesses[index].value;
+	}
+	else
+	{
+		// Not in the record, reading again is the best that can be done
+		journalMode = JOURNAL_OFF;
+		if (size == 4)
+			value = slowRead32(address);
+		else if (size == 2)
+			value = slowRead16(address);
+		else
+			value = slowRead8(address);
+		journalMode = mode;
+	}
+
+	journalAppend(address, value, size, false);
+	return value;
+}
+
+static void journalWrite(u32 address, u32 value, u8 size)
+{
+	JournalMode mode = journalMode;
+
+	journalAppend(address, value, size, true);
+	if (mode == JOURNAL_REPLAY)
+		return;
+
+	journalMode = JOURNAL_OFF;
+	if (size == 4)
+		write32(address, value);
+	else if (size == 2)
+		write16(address, value);
+	else
+		write8(address, value);
+	journalMode = mode;
+}
+
+u32 slowRead32(u32 address)
+{
+	if (UNLIKELY(journalMode != JOURNAL_OFF))
+		return journalRead(address, 4);
+
  #ifdef GBA_LOGGING
 	if (address & 3)
 	{
@@ -209,8 +336,11 @@ u32 read32(u32 address)
  	return value;
  }
  
-u32 read16(u32 address)
+u32 slowRead16(u32 address)
  {
+	if (UNLIKELY(journalMode != JOURNAL_OFF))
+		return journalRead(address, 2);
+
  #ifdef GBA_LOGGING
  	if (address & 1)
 	{
@@ -241,13 +371,25 @@ u16 read16s(u32 address)
 	return value;
 }
 
-u8 read8(u32 address)
+u8 slowRead8(u32 address)
 {
+	if (UNLIKELY(journalMode != JOURNAL_OFF))
+		return journalRead(address, 1);
+
 	return memMap[address >> 24].read8(address);
 }
 
 void write32(u32 address, u32 value)
 {
+	if (UNLIKELY(journalMode != JOURNAL_OFF))
+	{
+		journalWrite(address, value, 4);
+		return;
+	}
+
+	if (writePage<u32>(address, value))
+		return;
+
 #ifdef GBA_LOGGING
 	if (address & 3)
 	{
@@ -266,6 +408,15 @@ void write32(u32 address, u32 value)
 
 void write16(u32 address, u16 value)
 {
+	if (UNLIKELY(journalMode != JOURNAL_OFF))
+	{
+		journalWrite(address, value, 2);
+		return;
+	}
+
+	if (writePage<u16>(address, value))
+		return;
+
 #ifdef GBA_LOGGING
 	if (address & 1)
 	{
@@ -284,9 +435,60 @@ void write16(u32 address, u16 value)
 
 void write8(u32 address, u8 b)
 {
+	if (UNLIKELY(journalMode != JOURNAL_OFF))
+	{
+		journalWrite(address, b, 1);
+		return;
+	}
+
+	// Byte writes to video memory are not plain
+	if ((address >> 25) == 1 && writePage<u8>(address, b))
+		return;
+
 	memMap[address >> 24].write8(address, b);
 }
 
+void invalidate(u32 address, u32 length)
+{
+	if ((address >> 25) == 1)
+	{
+		CPU::armCacheInvalidateRange(address, length);
+		CPU::jitInvalidateRange(address, length);
+	}
+	else
+		gfx_dirty_mark(address, length);
+}
+
+u8 *pointer(u32 address, u32 &available)
+{
+	u32 region = address >> 24;
+
+	switch (region)
+	{
+	case 2:
+	case 3:
+	case 5:
+	case 7:
+		available = memMap[region].mask + 1 - (address & memMap[region].mask);
+		return &memMap[region].mem[address & memMap[region].mask];
+	case 6:
+		// Stop before the mirrored OBJ tiles
+		address &= 0x1FFFF;
+		if (address >= 0x18000)
+			return NULL;
+		available = 0x18000 - address;
+		return &vram[address];
+	case 8:
+	case 9:
+	case 10:
+	case 11:
+	case 12:
+		return cartridge_get_rom_pointer(address, &available);
+	default:
+		return NULL;
+	}
+}
+
 // Memory read functions implementations
 template<typename T>
 static T unreadable(u32 address)
@@ -334,10 +536,47 @@ static T readBios(u32 address)
 	return value;
 }
 
+// The counters of the timers running on their own clock are not kept up to
+// date in ioMem, they are worked out from the time left until the overflow
+static inline bool isTimerCounter(u32 address)
+{
+	return (address & 0x3f2) == 0x100;
+}
+
+static u16 readTimerCounter(u32 address, u16 value)
+{
+	// Timer counters change without an event
+	CPU::idleLoopVolatileRead = true;
+
+	switch (address & 0x3fe)
+	{
+	case 0x100:
+		if (timer0On)
+			value = 0xFFFF - ((Scheduler::ticksUntil(Scheduler::EVENT_TIMER0)-cpuTotalTicks) >> timer0ClockReload);
+		break;
+	case 0x104:
+		if (timer1On && !(TM1CNT & 4))
+			value = 0xFFFF - ((Scheduler::ticksUntil(Scheduler::EVENT_TIMER1)-cpuTotalTicks) >> timer1ClockReload);
+		break;
+	case 0x108:
+		if (timer2On && !(TM2CNT & 4))
+			value = 0xFFFF - ((Scheduler::ticksUntil(Scheduler::EVENT_TIMER2)-cpuTotalTicks) >> timer2ClockReload);
+		break;
+	case 0x10C:
+		if (timer3On && !(TM3CNT & 4))
+			value = 0xFFFF - ((Scheduler::ticksUntil(Scheduler::EVENT_TIMER3)-cpuTotalTicks) >> timer3ClockReload);
+		break;
+	}
+
+	return value;
+}
+
 static u8 readIo8(u32 address)
 {
 	if ((address < 0x4000400) && ioReadable[address & 0x3FF])
 	{
+		if (isTimerCounter(address))
+			return readTimerCounter(address, readGeneric<4, u16>(address & ~1)) >> ((address & 1) << 3);
 		return readGeneric<4, u8>(address);
 	}
 	else
@@ -353,20 +592,8 @@ static u16 readIo16(u32 address)
 	if ((address < 0x4000400) && ioReadable[address & 0x3FF])
 	{
 		value = readGeneric<4, u16>(address);
-		if (((address & 0x3fe)>0xFF) && ((address & 0x3fe)<0x10E))
-		{
-			if (((address & 0x3fe) == 0x100) && timer0On)
-				value = 0xFFFF - ((timer0Ticks-cpuTotalTicks) >> timer0ClockReload);
-			else
-				if (((address & 0x3fe) == 0x104) && timer1On && !(TM1CNT & 4))
-					value = 0xFFFF - ((timer1Ticks-cpuTotalTicks) >> timer1ClockReload);
-				else
-					if (((address & 0x3fe) == 0x108) && timer2On && !(TM2CNT & 4))
-						value = 0xFFFF - ((timer2Ticks-cpuTotalTicks) >> timer2ClockReload);
-					else
-						if (((address & 0x3fe) == 0x10C) && timer3On && !(TM3CNT & 4))
-							value = 0xFFFF - ((timer3Ticks-cpuTotalTicks) >> timer3ClockReload);
-		}
+		if (isTimerCounter(address))
+			value = readTimerCounter(address, value);
 	}
 	else
 	{
@@ -386,6 +613,8 @@ static u32 readIo32(u32 address)
 			value = readGeneric<4, u32>(address);
 		else
 			value = readGeneric<4, u16>(address);
+		if (isTimerCounter(address))
+			value = (value & 0xFFFF0000) | readTimerCounter(address, value);
 	}
 	else
 	{
@@ -433,6 +662,12 @@ static void writeGeneric(u32 address, T value)
 	u32 mask = memMap[s].mask;
 
 	writeLE<T>(&memMap[s].mem[address & mask], value);
+
+	// RAM may hold ARM code, the renderer tracks the video memory
+	if (s == 2 || s == 3)
+		CPU::armCacheInvalidate(address);
+	else if (s >= 5)
+		gfx_dirty_mark((s << 24) | (address & mask), sizeof(T));
 }
 
 template<int s>
@@ -6,18 +6,118 @@
 namespace MMU
 {
 
+// Plain memory is mapped in 16 KiB pages covering the 28 bits address bus.
+// Aligned reads from a page backed by host memory do not go through the
+// region handlers. Regions smaller than a page are mirrored with the mask.
+#define PAGE_SHIFT 14
+#define PAGE_COUNT (0x10000000 >> PAGE_SHIFT)
+
+struct Page
+{
+	u8 *mem; // NULL when the accesses go through the region handlers
+	u32 mask;
+};
+
+template <typename T>
+inline T readLE(u8* x)
+{
+	return *((T *)x);
+}
+
+template <typename T>
+inline void writeLE(u8* x, T value)
+{
+	*((T *)x) = value;
+}
+
+extern Page readPages[PAGE_COUNT];
+extern Page writePages[PAGE_COUNT];
+
 bool init();
 void uninit();
- 
-u32 read32(u32 address);
-u32 read16(u32 address);
+
+// Map the pages again, after the RTC of the cartridge has been enabled or
+// disabled
+void reset();
+
+// Reads through the region handlers
+u32 slowRead32(u32 address);
+u32 slowRead16(u32 address);
+u8 slowRead8(u32 address);
+
+inline u32 read32(u32 address)
+{
+	u32 page = address >> PAGE_SHIFT;
+	if (page < PAGE_COUNT && readPages[page].mem && !(address & 3))
+		return readLE<u32>(&readPages[page].mem[address & readPages[page].mask]);
+	return slowRead32(address);
+}
+
+inline u32 read16(u32 address)
+{
+	u32 page = address >> PAGE_SHIFT;
+	if (page < PAGE_COUNT && readPages[page].mem && !(address & 1))
+		return readLE<u16>(&readPages[page].mem[address & readPages[page].mask]);
+	return slowRead16(address);
+}
+
+inline u8 read8(u32 address)
+{
+	u32 page = address >> PAGE_SHIFT;
+	if (page < PAGE_COUNT && readPages[page].mem)
+		return readPages[page].mem[address & readPages[page].mask];
+	return slowRead8(address);
+}
+
 u16 read16s(u32 address);
-u8 read8(u32 address);
- 
+
 void write32(u32 address, u32 value);
 void write16(u32 address, u16 value);
 void write8(u32 address, u8 b);
 
+// Host memory backing address, or NULL when it is not plain RAM or ROM.
+// available receives how many bytes follow it before the end of the
+// region or of its mirror. Writing through it bypasses the ARM block cache
+// and the dirty tracking of the video memory, see invalidate().
+u8 *pointer(u32 address, u32 &available);
+
+// Tell the ARM block cache or the renderer that length bytes starting at
+// address have been written through pointer(). The range must not wrap
+// around the end of its region.
+void invalidate(u32 address, u32 length);
+
+// Journal of the memory accesses of one instruction, for the self-check of
+// the CPU engines. It holds the writes and the reads going through the
+// region handlers, reads from plain memory have no side effects.
+#define JOURNAL_SIZE 64
+
+struct JournalAccess
+{
+	u32 address;
+	u32 value;
+	u8 size; // in bytes
+	bool write;
+};
+
+struct Journal
+{
+	int count; // may be larger than JOURNAL_SIZE, the extra accesses are lost
+	JournalAccess accesses[JOURNAL_SIZE];
+};
+
+enum JournalMode
+{
+	JOURNAL_OFF,
+	JOURNAL_RECORD, // the accesses are done and journaled
+	JOURNAL_REPLAY  // the reads return the values of the record, the writes are dropped
+};
+
+// Journal the accesses of the CPU to accesses. When replaying, record is the
+// journal of the first run of the same instruction. The accesses done by the
+// region handlers themselves, like those of a DMA, are not journaled.
+void journalStart(JournalMode mode, Journal *accesses, const Journal *record);
+void journalStop();
+
 u32 CPUReadMemory(u32 address);
 u32 CPUReadHalfWord(u32 address);
 u16 CPUReadHalfWordSigned(u32 address);
@@ -0,0 +1,199 @@
+#include "Scheduler.h"
+
+#include <limits.h>
+#include <stddef.h>
+
+namespace Scheduler
+{
+
+struct Entry
+{
+	u64 when;
+	Callback callback;
+	int position; // Index in the heap
+	bool scheduled;
+	bool due; // Taken out of the heap by advance(), not run yet
+};
+
+// Time of the last call to advance()
+static u64 currentTime = 0;
+
+static Entry events[EVENT_COUNT];
+
+// Binary min-heap of the scheduled events, ordered by time then by event
+static Event heap[EVENT_COUNT];
+static int heapSize = 0;
+
+static inline bool before(Event a, Event b)
+{
+	if (events[a].when != events[b].when)
+		return (s64)(events[a].when - events[b].when) < 0;
+	return a < b;
+}
+
+static inline void place(Event event, int position)
+{
+	heap[position] = event;
+	events[event].position = position;
+}
+
+static void siftUp(int position)
+{
+	Event event = heap[position];
+
+	while (position > 0)
+	{
+		int parent = (position - 1) / 2;
+		if (!before(event, heap[parent]))
+			break;
+		place(heap[parent], position);
+		position = parent;
+	}
+
+	place(event, position);
+}
+
+static void siftDown(int position)
+{
+	Event event = heap[position];
+
+	for (;;)
+	{
+		int child = 2 * position + 1;
+		if (child >= heapSize)
+			break;
+		if (child + 1 < heapSize && before(heap[child + 1], heap[child]))
+			child++;
+		if (!before(heap[child], event))
+			break;
+		place(heap[child], position);
+		position = child;
+	}
+
+	place(event, position);
+}
+
+static void remove(Event event)
+{
+	int position = events[event].position;
+	events[event].scheduled = false;
+
+	heapSize--;
+	if (position == heapSize)
+		return;
+
+	Event last = heap[heapSize];
+	place(last, position);
+	siftUp(position);
+	siftDown(events[last].position);
+}
+
+void reset()
+{
+	currentTime = 0;
+	heapSize = 0;
+
+	for (int i = 0; i < EVENT_COUNT; i++)
+	{
+		events[i].when = 0;
+		events[i].callback = NULL;
+		events[i].position = 0;
+		events[i].scheduled = false;
+		events[i].due = false;
+	}
+}
+
+void schedule(Event event, int ticks, Callback callback)
+{
+	Entry &entry = events[event];
+
+	entry.when = currentTime + ticks;
+	entry.callback = callback;
+	entry.due = false;
+
+	if (!entry.scheduled)
+	{
+		entry.scheduled = true;
+		place(event, heapSize++);
+		siftUp(entry.position);
+	}
+	else
+	{
+		siftUp(entry.position);
+		siftDown(entry.position);
+	}
+}
+
+void cancel(Event event)
+{
+	events[event].due = false;
+
+	if (events[event].scheduled)
+		remove(event);
+}
+
+void postpone(Event event, int ticks)
+{
+	Entry &entry = events[event];
+
+	if (!entry.scheduled)
+		return;
+
+	entry.when += ticks;
+	siftDown(entry.position);
+}
+
+bool isScheduled(Event event)
+{
+	return events[event].scheduled;
+}
+
+int ticksUntil(Event event)
+{
+	return (int)(s64)(events[event].when - currentTime);
+}
+
+int nextEventTicks()
+{
+	if (heapSize == 0)
+		return INT_MAX;
+
+	return ticksUntil(heap[0]);
+}
+
+void advance(int ticks)
+{
+	currentTime += ticks;
+
+	// Take all the due events out of the heap before running them, so that
+	// an event scheduled again for a time that has passed runs only once
+	Event due[EVENT_COUNT];
+	int count = 0;
+
+	while (heapSize > 0 && ticksUntil(heap[0]) <= 0)
+	{
+		Event event = heap[0];
+		remove(event);
+		events[event].due = true;
+		due[count++] = event;
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		Entry &entry = events[due[i]];
+
+		// Cancelled or scheduled again by a previous callback
+		if (!entry.due)
+			continue;
+
+		entry.due = false;
+		entry.callback(-ticksUntil(due[i]));
+	}
+}
+
+u64 now()
+{
+	return currentTime;
+}
+
+} // namespace Scheduler
@@ -0,0 +1,82 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "../common/Types.h"
+
+namespace Scheduler
+{
+
+/**
+ * The events of the hardware. When several events are due at the same
+ * time, they run in this order.
+ */
+enum Event
+{
+	EVENT_IRQ, // End of the delay before an interrupt is taken
+	EVENT_LCD, // Next H-Blank or V-Blank state change
+	EVENT_SOUND, // Sound samples are due
+	EVENT_TIMER0, // Timer overflows
+	EVENT_TIMER1,
+	EVENT_TIMER2,
+	EVENT_TIMER3,
+	EVENT_COUNT
+};
+
+/**
+ * Called when an event is due
+ *
+ * @param late Number of ticks elapsed since the time the event was due
+ */
+typedef void (*Callback)(int late);
+
+/**
+ * Cancel all the events and restart the time from zero
+ */
+void reset();
+
+/**
+ * Schedule an event, replacing its previous occurrence if any
+ *
+ * @param event Event to schedule
+ * @param ticks Number of ticks from now until the event is due
+ * @param callback Function to call when the event is due
+ */
+void schedule(Event event, int ticks, Callback callback);
+
+/**
+ * Cancel an event if it is scheduled
+ */
+void cancel(Event event);
+
+/**
+ * Delay an event by a number of ticks, if it is scheduled
+ */
+void postpone(Event event, int ticks);
+
+bool isScheduled(Event event);
+
+/**
+ * Number of ticks from now until the time an event is or was due
+ */
+int ticksUntil(Event event);
+
+/**
+ * Number of ticks from now until the first scheduled event
+ */
+int nextEventTicks();
+
+/**
+ * Move the time forward and run the events that are due, in time order.
+ * An event scheduled again by a callback for a time that has already
+ * passed runs at the next call.
+ */
+void advance(int ticks);
+
+/**
+ * Absolute time in ticks since the last reset
+ */
+u64 now();
+
+} // namespace Scheduler
+
+#endif // SCHEDULER_H
@@ -1,9 +1,11 @@
 #include <string.h>
+#include <math.h>
 
 #include "Sound.h"
 
 #include "GBA.h"
 #include "Globals.h"
+#include "Scheduler.h"
 #include "../common/Port.h"
 
 #include "../apu/Gb_Apu.h"
@@ -25,17 +27,22 @@ extern bool stopState;      // TODO: silence sound when true
 
 static int const SOUND_CLOCK_TICKS_ = 167772; // 1/100 second
 
-static u16   soundFinalWave [1600];
+static u16 * soundFinalWave     = 0; // as much as the buffer holds, at the sample rate
+static long  soundFinalWaveLen  = 0; // in samples
 static long  soundSampleRate    = 44100;
 static bool  soundInterpolation = true;
 static bool  soundPaused        = true;
 static float soundFiltering     = 0.5f;
 int   SOUND_CLOCK_TICKS  = SOUND_CLOCK_TICKS_;
-int   soundTicks         = SOUND_CLOCK_TICKS_;
 
 static float soundVolume     = 1.0f;
 static float soundFiltering_ = -1;
 static float soundVolume_    = -1;
+static double soundRateRemainder = 0;
+
+static int   soundFlushFrames = 0; // hand the samples over every 1/100 second when 0
+static int   soundFlushVBlanks = 0;
+static u64   soundFrameStart  = 0; // time the current Blip frame started at
 
 void interp_rate()
 { /* empty for now */ }
@@ -85,7 +92,7 @@ static Blip_Synth<blip_best_quality,1> pcm_synth [3]; // 32 kHz, 16 kHz, 8 kHz
 
 static inline blip_time_t blip_time()
 {
-	return SOUND_CLOCK_TICKS - soundTicks;
+	return (blip_time_t) (Scheduler::now() - soundFrameStart);
 }
 
 void Gba_Pcm::init()
@@ -341,15 +348,42 @@ static void end_frame( blip_time_t time )
 
 static void flush_samples(Multi_Buffer * buffer)
 {
-	// The number of bytes of available sound date
-	int soundBufferLen = buffer->samples_avail() * sizeof(blip_sample_t);
+	// soundFinalWave holds all the buffer can, this only splits the write
+	// if it somehow holds more
+	long count;
+	while ( (count = buffer->samples_avail()) > 0 )
+	{
+		if ( count > soundFinalWaveLen )
+			count = soundFinalWaveLen & ~1;
+
+		count = buffer->read_samples((blip_sample_t*) soundFinalWave, count);
+
+		soundDriver->write(soundDriver, soundFinalWave, count * sizeof(blip_sample_t));
+	}
+}
+
+// Resample to the rate the driver asks for, by telling the buffer the clock
+// runs slightly slower or faster than it does. The buffer resamples by steps
+// of about 0.6% at the usual sample rates, so alternate between the two
+// closest steps to get the ratio on average.
+static void apply_rate_control()
+{
+	if ( !soundDriver->getRateRatio )
+		return;
+
+	double ratio = soundDriver->getRateRatio( soundDriver );
+	double sample_rate = stereo_buffer->sample_rate();
 
-	// Ensure we won't overflow soundFinalWave
-	assert(soundBufferLen < sizeof(soundFinalWave));
+	double factor = sample_rate / gb_apu->clock_rate * ratio * (1L << BLIP_BUFFER_ACCURACY)
+			+ soundRateRemainder;
+	double step = floor( factor + 0.5 );
+	soundRateRemainder = factor - step;
 
-	buffer->read_samples((blip_sample_t*) soundFinalWave, buffer->samples_avail());
+	// Clock rate for which the buffer uses that step
+	long rate = (long) floor( sample_rate * (1L << BLIP_BUFFER_ACCURACY) / step + 0.5 );
 
-	soundDriver->write(soundDriver, soundFinalWave, soundBufferLen);
+	if ( rate != stereo_buffer->center()->clock_rate() )
+		stereo_buffer->clock_rate( rate );
 }
 
 static void apply_filtering()
@@ -368,14 +402,19 @@ static void apply_filtering()
 	}
 }
 
-void psoundTickfn()
+// Ends the Blip frame after the given number of clocks, and hands its samples
+// to the driver
+static void flush_frame( blip_time_t time )
 {
+	soundFrameStart += time;
+
 	if ( gb_apu && stereo_buffer )
 	{
 		// Run sound hardware to present
-		end_frame( SOUND_CLOCK_TICKS );
+		end_frame( time );
 
 		flush_samples(stereo_buffer);
+		apply_rate_control();
 
 		if ( soundFiltering_ != soundFiltering )
 			apply_filtering();
@@ -385,6 +424,38 @@ void psoundTickfn()
 	}
 }
 
+void psoundTickfn()
+{
+	flush_frame( SOUND_CLOCK_TICKS );
+}
+
+static void sound_tick( int late )
+{
+	psoundTickfn();
+	Scheduler::schedule( Scheduler::EVENT_SOUND, SOUND_CLOCK_TICKS - late, sound_tick );
+}
+
+void soundVBlank()
+{
+	if ( !soundFlushFrames || ++soundFlushVBlanks < soundFlushFrames )
+		return;
+
+	soundFlushVBlanks = 0;
+	flush_frame( blip_time() );
+}
+
+// Starts a new Blip frame now, and the count until it is flushed
+static void schedule_flush()
+{
+	soundFrameStart   = Scheduler::now();
+	soundFlushVBlanks = 0;
+
+	if ( soundFlushFrames )
+		Scheduler::cancel( Scheduler::EVENT_SOUND );
+	else
+		Scheduler::schedule( Scheduler::EVENT_SOUND, SOUND_CLOCK_TICKS, sound_tick );
+}
+
 static void apply_muting()
 {
 	if ( !stereo_buffer || !ioMem )
@@ -411,7 +482,7 @@ static void reset_apu()
 	if ( stereo_buffer )
 		stereo_buffer->clear();
 
-	soundTicks = SOUND_CLOCK_TICKS;
+	schedule_flush();
 }
 
 static void remake_stereo_buffer()
@@ -438,6 +509,11 @@ static void remake_stereo_buffer()
 	stereo_buffer->set_sample_rate( soundSampleRate ); // TODO: handle out of memory
 	stereo_buffer->clock_rate( gb_apu->clock_rate );
 
+	// Room for all the stereo samples the buffer holds
+	delete [] soundFinalWave;
+	soundFinalWaveLen = 2 * ((soundSampleRate * (blip_default_length + 1) + 999) / 1000);
+	soundFinalWave = new u16 [soundFinalWaveLen]; // TODO: handle out of memory
+
 	// PCM
 	pcm [0].which = 0;
 	pcm [1].which = 1;
@@ -470,6 +546,11 @@ float soundGetVolume()
 	return soundVolume;
 }
 
+void soundSetFlushFrames( int frames )
+{
+	soundFlushFrames = frames;
+}
+
 void soundReset()
 {
 	soundDriver->reset(soundDriver);
@@ -479,7 +560,7 @@ void soundReset()
 
 	soundPaused = true;
 	SOUND_CLOCK_TICKS = SOUND_CLOCK_TICKS_;
-	soundTicks        = SOUND_CLOCK_TICKS_;
+	schedule_flush();
 
 	soundEvent( NR52, (u8) 0x80 );
 }
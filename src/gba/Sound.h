@@ -16,6 +16,11 @@ bool soundInit(SoundDriver *driver);
 void soundSetVolume( float );
 float soundGetVolume();
 
+// Sets how often the samples are handed to the sound driver: every 1/100
+// second when 0, or every given number of video frames, at V-Blank. Takes
+// effect at the next reset.
+void soundSetFlushFrames( int frames );
+
 // Pauses/resumes system sound output
 void soundPause(gboolean pause);
 
@@ -40,8 +45,10 @@ void interp_rate();
 
 // Notifies emulator that SOUND_CLOCK_TICKS clocks have passed
 void psoundTickfn();
+
+// Notifies emulator that a video frame has ended, at the start of V-Blank
+void soundVBlank();
 extern int SOUND_CLOCK_TICKS;   // Number of 16.8 MHz clocks between calls to soundTick()
-extern int soundTicks;          // Number of 16.8 MHz clocks until soundTick() will be called
 
 // Saves/loads emulator state
 void soundSaveGame( gzFile );
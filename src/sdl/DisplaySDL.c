@@ -114,7 +114,10 @@ static gboolean display_sdl_create_window(Display *display, GError **err) {
 		return FALSE;
 	}
 
-	display->renderer = SDL_CreateRenderer(display->window, -1, SDL_RENDERER_ACCELERATED);
+	int rendererFlags = SDL_RENDERER_ACCELERATED;
+	rendererFlags |= settings_vsync() ? SDL_RENDERER_PRESENTVSYNC : 0;
+
+	display->renderer = SDL_CreateRenderer(display->window, -1, rendererFlags);
 	if (display->renderer == NULL) {
 		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
 				"Failed to create renderer: %s", SDL_GetError());
@@ -0,0 +1,205 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2008 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+#include "Emulation.h"
+#include "../gba/GBA.h"
+#include "../gba/Savestate.h"
+#include "../gba/Sound.h"
+#include "../common/Settings.h"
+
+#include <math.h>
+
+typedef enum {
+	COMMAND_PAUSE,
+	COMMAND_RESUME,
+	COMMAND_RESET,
+	COMMAND_STATE_SAVE,
+	COMMAND_STATE_LOAD,
+	COMMAND_VOLUME_CHANGE,
+	COMMAND_QUIT
+} CommandType;
+
+typedef struct {
+	CommandType type;
+	gint slot;
+	gfloat delta;
+} Command;
+
+static GThread *thread = NULL;
+// Commands from the interface to the emulation thread
+static GAsyncQueue *commands = NULL;
+// Status messages from the emulation thread to the interface
+static GAsyncQueue *messages = NULL;
+
+static void emulation_message_post(gchar *message) {
+	g_async_queue_push(messages, message);
+}
+
+static void emulation_post(CommandType type, gint slot, gfloat delta) {
+	if (commands == NULL)
+		return;
+
+	Command *command = g_new(Command, 1);
+	command->type = type;
+	command->slot = slot;
+	command->delta = delta;
+
+	g_async_queue_push(commands, command);
+}
+
+static void emulation_state_save_run(gint num) {
+	GError *err = NULL;
+
+	if (!savestate_save_slot(num, &err)) {
+		emulation_message_post(g_strdup(err->message));
+		g_clear_error(&err);
+	} else {
+		emulation_message_post(g_strdup_printf("Wrote state %d", num + 1));
+	}
+}
+
+static void emulation_state_load_run(gint num) {
+	GError *err = NULL;
+
+	if (!savestate_load_slot(num, &err)) {
+		emulation_message_post(g_strdup(err->message));
+		g_clear_error(&err);
+	} else {
+		emulation_message_post(g_strdup_printf("Loaded state %d", num + 1));
+	}
+}
+
+static void emulation_volume_change_run(gfloat delta) {
+	float oldVolume = soundGetVolume();
+	float newVolume = oldVolume + delta;
+
+	if (newVolume < 0.0) newVolume = 0.0;
+	if (newVolume > SETTINGS_SOUND_MAX_VOLUME) newVolume = SETTINGS_SOUND_MAX_VOLUME;
+
+	if (fabs(newVolume - oldVolume) > 0.001) {
+		soundSetVolume(newVolume);
+		emulation_message_post(g_strdup_printf("Volume: %i%%", (int)(newVolume*100.0+0.5)));
+	}
+}
+
+static gpointer emulation_run(gpointer data) {
+	gboolean paused = FALSE;
+
+	for (;;) {
+		// Sleep until told to resume when paused
+		Command *command = paused ?
+				(Command *)g_async_queue_pop(commands) :
+				(Command *)g_async_queue_try_pop(commands);
+
+		if (command == NULL) {
+			CPULoop(250000);
+			continue;
+		}
+
+		CommandType type = command->type;
+
+		switch (type) {
+		case COMMAND_PAUSE:
+		case COMMAND_RESUME:
+			paused = type == COMMAND_PAUSE;
+			soundPause(paused);
+			break;
+		case COMMAND_RESET:
+			CPUReset();
+			emulation_message_post(g_strdup("Reset"));
+			break;
+		case COMMAND_STATE_SAVE:
+			emulation_state_save_run(command->slot);
+			break;
+		case COMMAND_STATE_LOAD:
+			emulation_state_load_run(command->slot);
+			break;
+		case COMMAND_VOLUME_CHANGE:
+			emulation_volume_change_run(command->delta);
+			break;
+		case COMMAND_QUIT:
+			break;
+		}
+
+		g_free(command);
+
+		if (type == COMMAND_QUIT)
+			break;
+	}
+
+	return NULL;
+}
+
+gboolean emulation_start(GError **err) {
+	g_return_val_if_fail(err == NULL || *err == NULL, FALSE);
+	g_assert(thread == NULL);
+
+	commands = g_async_queue_new_full(g_free);
+	messages = g_async_queue_new_full(g_free);
+
+	thread = g_thread_try_new("emulation", emulation_run, NULL, err);
+	if (thread == NULL) {
+		g_async_queue_unref(commands);
+		g_async_queue_unref(messages);
+		commands = NULL;
+		messages = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void emulation_stop() {
+	if (thread == NULL)
+		return;
+
+	emulation_post(COMMAND_QUIT, 0, 0.0);
+	g_thread_join(thread);
+	thread = NULL;
+
+	g_async_queue_unref(commands);
+	g_async_queue_unref(messages);
+	commands = NULL;
+	messages = NULL;
+}
+
+void emulation_pause(gboolean pause) {
+	emulation_post(pause ? COMMAND_PAUSE : COMMAND_RESUME, 0, 0.0);
+}
+
+void emulation_reset() {
+	emulation_post(COMMAND_RESET, 0, 0.0);
+}
+
+void emulation_state_save(gint num) {
+	emulation_post(COMMAND_STATE_SAVE, num, 0.0);
+}
+
+void emulation_state_load(gint num) {
+	emulation_post(COMMAND_STATE_LOAD, num, 0.0);
+}
+
+void emulation_volume_change(gfloat delta) {
+	emulation_post(COMMAND_VOLUME_CHANGE, 0, delta);
+}
+
+gchar *emulation_message_pop() {
+	if (messages == NULL)
+		return NULL;
+
+	return (gchar *)g_async_queue_try_pop(messages);
+}
@@ -0,0 +1,96 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 2008 VBA-M development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+#ifndef __VBA_EMULATION_SDL_H__
+#define __VBA_EMULATION_SDL_H__
+
+#include <glib.h>
+
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The core runs on a thread of its own so that waiting for the audio does
+ * not hold up the user interface. The interface talks to it through
+ * commands, which the emulation thread runs between two slices of
+ * emulation, in the order they were posted. The frames and the input go
+ * through the display and input drivers, which are safe to use from both
+ * threads.
+ */
+
+/**
+ * Start running the loaded game on the emulation thread
+ *
+ * @param err return location for a GError, or NULL
+ * @return success
+ */
+gboolean emulation_start(GError **err);
+
+/**
+ * Stop the emulation thread and wait for it to exit. The core can then be
+ * used from the calling thread again.
+ */
+void emulation_stop();
+
+/**
+ * Pause or resume the emulation, along with the sound
+ *
+ * @param pause TRUE to pause
+ */
+void emulation_pause(gboolean pause);
+
+/**
+ * Reset the emulated console
+ */
+void emulation_reset();
+
+/**
+ * Save the state of the game to a slot
+ *
+ * @param num slot number
+ */
+void emulation_state_save(gint num);
+
+/**
+ * Load the state of the game from a slot
+ *
+ * @param num slot number
+ */
+void emulation_state_load(gint num);
+
+/**
+ * Change the sound volume
+ *
+ * @param delta amount to add to the current volume
+ */
+void emulation_volume_change(gfloat delta);
+
+/**
+ * Get the next status message the commands have produced
+ *
+ * @return message to be freed with g_free, or NULL if there are none left
+ */
+gchar *emulation_message_pop();
+
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __VBA_EMULATION_SDL_H__
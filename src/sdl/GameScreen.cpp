@@ -18,27 +18,52 @@
 #include "GameScreen.h"
 #include "GUI.h"
 #include "DisplaySDL.h"
+#include "Emulation.h"
 #include "InputSDL.h"
 #include "OSD.h"
 #include "Timer.h"
 #include "VBA.h"
 #include "../gba/Cartridge.h"
 #include "../gba/GBA.h"
-#include "../gba/Savestate.h"
-#include "../gba/Sound.h"
 #include "../common/Settings.h"
 
 #include <glib/gprintf.h>
-#include <math.h>
+#include <string.h>
 
 static const int screenWidth = 240;
 static const int screenHeight = 160;
 
+// Set in the mailbox along with the index of a frame not shown yet
+static const gint FRAME_FRESH = 4;
+
+// Longest wait for the interface to take a frame when following the display
+// refresh, so that the emulation keeps going when it is not shown
+static const Uint32 frameTakenTimeout = 50;
+
 struct GameScreen {
 	Screen *screen;
 
 	Renderable *renderable;
-	SDL_Texture *screenTexture;
+
+	// Streaming textures the core draws the frames straight into, locked
+	// while the core owns them. The emulation thread draws to the back
+	// texture and the interface shows the front one. A frame drawn is
+	// swapped with the one in the mailbox, so that the interface always gets
+	// the latest frame, and the core never waits for it. The interface locks
+	// the front texture again before handing it back through the mailbox.
+	SDL_Texture *textures[3];
+	gpointer pixels[3];
+	int pitches[3];
+	gint back;
+	gint front;
+	gint mailbox;
+	SDL_sem *frameReady;
+
+	// With vsync, the emulation waits for the interface to take a frame
+	// before it hands the next one, so that it runs at the display refresh
+	gboolean vsync;
+	gint sync;
+	SDL_sem *frameTaken;
 
 	DisplayDriver *displayDriver;
 	Display *display;
@@ -63,13 +88,49 @@ static void gamescreen_update_speed(TextOSD *speed) {
 	text_osd_set_message(speed, buffer);
 }
 
-static void gamescreen_update_texture(GameScreen *game, guint16 *pix) {
+static gint gamescreen_mailbox_exchange(GameScreen *game, gint frame) {
+	gint old;
+
+	do {
+		old = g_atomic_int_get(&game->mailbox);
+	} while (!g_atomic_int_compare_and_exchange(&game->mailbox, old, frame));
+
+	return old;
+}
+
+// Called on the interface thread, the pixels stay valid until the texture
+// is unlocked
+static gboolean gamescreen_lock_texture(GameScreen *game, gint texture) {
+	void *pixels;
+	int pitch;
+
+	if (SDL_LockTexture(game->textures[texture], NULL, &pixels, &pitch) != 0)
+		return FALSE;
+
+	game->pixels[texture] = pixels;
+	game->pitches[texture] = pitch;
+	return TRUE;
+}
+
+static gboolean gamescreen_update_texture(GameScreen *game) {
 	g_assert(game != NULL);
 
-	SDL_UpdateTexture(game->screenTexture, NULL, pix, screenWidth * sizeof(*pix));
-	// TODO: Error checking
+	if (!(g_atomic_int_get(&game->mailbox) & FRAME_FRESH))
+		return FALSE;
+
+	// Keep showing the current frame until its texture can be drawn to again
+	if (!gamescreen_lock_texture(game, game->front))
+		return FALSE;
+
+	game->front = gamescreen_mailbox_exchange(game, game->front) & ~FRAME_FRESH;
+	if (game->vsync)
+		SDL_SemPost(game->frameTaken);
+
+	SDL_UnlockTexture(game->textures[game->front]);
 
 	gamescreen_update_speed(game->speed);
+
+	return TRUE;
 }
 
 static void gamescreen_render(gpointer entity) {
@@ -82,7 +143,7 @@ static void gamescreen_render(gpointer entity) {
 	screenRect.h = display_sdl_scale(game->display, screenHeight);
 	display_sdl_renderable_get_absolute_position(game->renderable, &screenRect.x, &screenRect.y);
 
-	SDL_RenderCopy(game->renderable->renderer, game->screenTexture, NULL, &screenRect);
+	SDL_RenderCopy(game->renderable->renderer, game->textures[game->front], NULL, &screenRect);
 }
 
 static void gamescreen_mouse_hide(gpointer entity) {
@@ -108,7 +169,11 @@ static void gamescreen_free(GameScreen *game) {
 	text_osd_free(game->speed);
 
 	display_sdl_renderable_free(game->renderable);
-	SDL_DestroyTexture(game->screenTexture);
+	for (int i = 0; i < 3; i++)
+		if (game->textures[i] != NULL)
+			SDL_DestroyTexture(game->textures[i]);
+	SDL_DestroySemaphore(game->frameReady);
+	SDL_DestroySemaphore(game->frameTaken);
 	g_free(game->displayDriver);
 	screen_free(game->screen);
 
@@ -119,70 +184,55 @@ static void gamescreen_free_from_entity(gpointer entity) {
 	gamescreen_free((GameScreen *) entity);
 }
 
-static void gamescreen_draw_screen(const DisplayDriver *driver, guint16 *pix) {
+// Called on the emulation thread
+static gpointer gamescreen_get_frame(const DisplayDriver *driver, int *pitch) {
 	g_assert(driver != NULL);
+	GameScreen *game = (GameScreen *)driver->driverData;
 
-	gamescreen_update_texture((GameScreen*)driver->driverData, pix);
+	*pitch = game->pitches[game->back];
+	return game->pixels[game->back];
 }
 
-const DisplayDriver *gamescreen_get_display_driver(GameScreen *game) {
-	g_assert(game != NULL);
-
-	if (game->displayDriver != NULL)
-		return game->displayDriver;
+// Called on the emulation thread
+static void gamescreen_draw_screen(const DisplayDriver *driver, gpointer pix, int pitch) {
+	g_assert(driver != NULL);
+	GameScreen *game = (GameScreen *)driver->driverData;
 
-	DisplayDriver *driver = g_new(DisplayDriver, 1);
+	if (game->vsync && g_atomic_int_get(&game->sync)) {
+		// Drop the posts for the frames taken while running fast
+		while (SDL_SemTryWait(game->frameTaken) == 0);
 
-	driver->drawScreen = gamescreen_draw_screen;
-	driver->driverData = game;
+		if (g_atomic_int_get(&game->mailbox) & FRAME_FRESH)
+			SDL_SemWaitTimeout(game->frameTaken, frameTakenTimeout);
+	}
 
-	return driver;
+	game->back = gamescreen_mailbox_exchange(game, game->back | FRAME_FRESH) & ~FRAME_FRESH;
+	SDL_SemPost(game->frameReady);
 }
 
-static void gamescreen_change_volume(GameScreen *game, float d)
-{
-	float oldVolume = soundGetVolume();
-	float newVolume = oldVolume + d;
-
-	if (newVolume < 0.0) newVolume = 0.0;
-	if (newVolume > SETTINGS_SOUND_MAX_VOLUME) newVolume = SETTINGS_SOUND_MAX_VOLUME;
+void gamescreen_enable_sync(GameScreen *game, gboolean enable) {
+	g_assert(game != NULL);
 
-	if (fabs(newVolume - oldVolume) > 0.001) {
-		char tmp[32];
-		g_sprintf(tmp, "Volume: %i%%", (int)(newVolume*100.0+0.5));
-		gamescreen_show_status_message(game, tmp);
-		soundSetVolume(newVolume);
-	}
+	g_atomic_int_set(&game->sync, enable);
+	if (game->vsync)
+		SDL_SemPost(game->frameTaken);
 }
 
-static void gamescreen_write_state(GameScreen *game, int num) {
-	gchar *message = NULL;
-	GError *err = NULL;
-
-	if (!savestate_save_slot(num, &err)) {
-		message = g_strdup(err->message);
-		g_clear_error(&err);
-	} else {
-		message = g_strdup_printf("Wrote state %d", num + 1);
-	}
+const DisplayDriver *gamescreen_get_display_driver(GameScreen *game) {
+	g_assert(game != NULL);
 
-	gamescreen_show_status_message(game, message);
-	g_free(message);
-}
+	if (game->displayDriver != NULL)
+		return game->displayDriver;
 
-static void gamescreen_read_state(GameScreen *game, int num) {
-	gchar *message = NULL;
-	GError *err = NULL;
+	DisplayDriver *driver = g_new(DisplayDriver, 1);
 
-	if (!savestate_load_slot(num, &err)) {
-		message = g_strdup(err->message);
-		g_clear_error(&err);
-	} else {
-		message = g_strdup_printf("Loaded state %d", num + 1);
-	}
+	driver->format = DISPLAY_FORMAT_XRGB8888;
+	driver->getFrame = gamescreen_get_frame;
+	driver->drawScreen = gamescreen_draw_screen;
+	driver->driverData = game;
 
-	gamescreen_show_status_message(game, message);
-	g_free(message);
+	game->displayDriver = driver;
+	return driver;
 }
 
 void gamescreen_write_battery(GameScreen *game) {
@@ -216,13 +266,13 @@ static gboolean gamescreen_process_event(gpointer entity, const SDL_Event *event
 	case SDL_WINDOWEVENT_FOCUS_LOST:
 		if (!vba_is_paused() && settings_pause_when_inactive()) {
 			game->inactive = TRUE;
-			soundPause(game->inactive);
+			emulation_pause(game->inactive);
 		}
 		return FALSE;
 	case SDL_WINDOWEVENT_FOCUS_GAINED:
 		if (!vba_is_paused() && settings_pause_when_inactive()) {
 			game->inactive = FALSE;
-			soundPause(game->inactive);
+			emulation_pause(game->inactive);
 		}
 		return FALSE;
 	case SDL_MOUSEMOTION:
@@ -238,18 +288,16 @@ static gboolean gamescreen_process_event(gpointer entity, const SDL_Event *event
 		case SDLK_r:
 			if (!(event->key.keysym.mod & MOD_NOCTRL)
 					&& (event->key.keysym.mod & KMOD_CTRL)) {
-				CPUReset();
-				gamescreen_show_status_message(game, "Reset");
-
+				emulation_reset();
 				return TRUE;
 			}
 			break;
 
 		case SDLK_KP_DIVIDE:
-			gamescreen_change_volume(game, -0.1);
+			emulation_volume_change(-0.1);
 			return TRUE;
 		case SDLK_KP_MULTIPLY:
-			gamescreen_change_volume(game, 0.1);
+			emulation_volume_change(0.1);
 			return TRUE;
 		case SDLK_F1:
 		case SDLK_F2:
@@ -261,10 +309,10 @@ static gboolean gamescreen_process_event(gpointer entity, const SDL_Event *event
 		case SDLK_F8:
 			if (!(event->key.keysym.mod & MOD_NOSHIFT)
 					&& (event->key.keysym.mod & KMOD_SHIFT)) {
-				gamescreen_write_state(game, event->key.keysym.sym - SDLK_F1);
+				emulation_state_save(event->key.keysym.sym - SDLK_F1);
 				return TRUE;
 			} else if (!(event->key.keysym.mod & MOD_KEYS)) {
-				gamescreen_read_state(game, event->key.keysym.sym - SDLK_F1);
+				emulation_state_load(event->key.keysym.sym - SDLK_F1);
 				return TRUE;
 			}
 			break;
@@ -280,10 +328,17 @@ static void gamescreen_update(gpointer entity) {
 	GameScreen *game = (GameScreen *) entity;
 	g_assert(game != NULL);
 
-	if (!game->inactive) {
-		CPULoop(250000);
-	} else {
-		SDL_Delay(500);
+	gchar *message;
+	while ((message = emulation_message_pop()) != NULL) {
+		gamescreen_show_status_message(game, message);
+		g_free(message);
+	}
+
+	// Wait for the emulation thread to draw a frame, without holding up the
+	// events for long
+	if (!gamescreen_update_texture(game)) {
+		SDL_SemWaitTimeout(game->frameReady, 20);
+		gamescreen_update_texture(game);
 	}
 }
 
@@ -294,6 +349,15 @@ GameScreen *gamescreen_create(Display *display, GError **err) {
 	GameScreen *game = g_new(GameScreen, 1);
 
 	game->displayDriver = NULL;
+	for (int i = 0; i < 3; i++)
+		game->textures[i] = NULL;
+	game->back = 0;
+	game->front = 1;
+	game->mailbox = 2;
+	game->frameReady = SDL_CreateSemaphore(0);
+	game->vsync = settings_vsync();
+	game->sync = TRUE;
+	game->frameTaken = SDL_CreateSemaphore(0);
 	game->status = NULL;
 	game->speed = NULL;
 	game->display = display;
@@ -309,14 +373,24 @@ GameScreen *gamescreen_create(Display *display, GError **err) {
 	display_sdl_renderable_set_size(game->renderable, screenWidth, screenHeight);
 	display_sdl_renderable_set_alignment(game->renderable, ALIGN_CENTER, ALIGN_MIDDLE);
 
-	game->screenTexture = SDL_CreateTexture(game->renderable->renderer, SDL_PIXELFORMAT_BGR555,
-			SDL_TEXTUREACCESS_STREAMING, screenWidth, screenHeight);
+	// Clear the textures, and leave all but the front one locked for the core
+	for (int i = 0; i < 3; i++) {
+		game->textures[i] = SDL_CreateTexture(game->renderable->renderer, SDL_PIXELFORMAT_RGB888,
+				SDL_TEXTUREACCESS_STREAMING, screenWidth, screenHeight);
+
+		if (game->textures[i] == NULL || !gamescreen_lock_texture(game, i)) {
+			g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
+					"Failed to create screen: %s", SDL_GetError());
+			gamescreen_free(game);
+			return NULL;
+		}
+
+		for (int y = 0; y < screenHeight; y++)
+			memset((guint8 *)game->pixels[i] + y * game->pitches[i], 0,
+					screenWidth * sizeof(guint32));
 
-	if (game->screenTexture == NULL) {
-		g_set_error(err, DISPLAY_ERROR, G_DISPLAY_ERROR_FAILED,
-				"Failed to create screen: %s", SDL_GetError());
-		gamescreen_free(game);
-		return NULL;
+		if (i == game->front)
+			SDL_UnlockTexture(game->textures[i]);
 	}
 
 	if (settings_show_speed()) {
@@ -53,6 +53,16 @@ GameScreen *gamescreen_create(Display *display, GError **err);
  */
 void gamescreen_show_status_message(GameScreen *game, const gchar *msg);
 
+/**
+ * Enable or disable following the display refresh, when vsync is on
+ *
+ * Disabling it makes the emulation speed unlimited
+ *
+ * @param game Game screen
+ * @param enable value to set
+ */
+void gamescreen_enable_sync(GameScreen *game, gboolean enable);
+
 /**
  * Create a display driver to update the screen
  *
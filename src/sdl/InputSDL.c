@@ -54,6 +54,25 @@ static uint32_t defaultMotion[4] = {
 static int sensorX = 2047;
 static int sensorY = 2047;
 
+// The events are processed on the interface thread and the emulation thread
+// reads the joypad once per frame. The interface pushes a snapshot of the
+// buttons to a queue each time they change, and the emulation takes one
+// snapshot a frame so that a button pressed and released between two
+// frames is still seen. The snapshots queued while the emulation lagged
+// behind, or was paused, are dropped. Bits 0-9 hold the joypad, as in
+// KEYINPUT, bits 16-19 the motion sensor buttons.
+#define INPUT_QUEUE_SIZE 64
+#define INPUT_QUEUE_LAG 4
+#define INPUT_MOTION_SHIFT 16
+
+static guint32 inputQueue[INPUT_QUEUE_SIZE];
+static gint inputQueueRead = 0; // Only written by the emulation thread
+static gint inputQueueWrite = 0; // Only written by the interface thread
+// Latest snapshot, for when the queue was full
+static gint inputLatest = 0;
+// Snapshot the emulation reads from
+static guint32 inputCurrent = 0;
+
 static GSList *gamecontrollers;
 
 static void controller_open(gint32 index) {
@@ -148,7 +167,7 @@ static void key_update(SDL_Scancode key, gboolean down)
 	}
 }
 
-static uint32_t input_read_joypad(InputDriver *driver)
+static uint32_t input_snapshot_compute()
 {
 	uint32_t res = 0;
 
@@ -179,18 +198,63 @@ static uint32_t input_read_joypad(InputDriver *driver)
 	if ((res & 192) == 192)
 		res &= ~128;
 
+	for (int i = 0; i < 4; i++) {
+		if (sdlMotionButtons[i])
+			res |= 1 << (INPUT_MOTION_SHIFT + i);
+	}
+
 	return res;
 }
 
+static void input_snapshot_push()
+{
+	guint32 snapshot = input_snapshot_compute();
+
+	if ((guint32)g_atomic_int_get(&inputLatest) == snapshot)
+		return;
+
+	g_atomic_int_set(&inputLatest, snapshot);
+
+	gint write = inputQueueWrite;
+	if (write - g_atomic_int_get(&inputQueueRead) < INPUT_QUEUE_SIZE) {
+		inputQueue[write % INPUT_QUEUE_SIZE] = snapshot;
+		g_atomic_int_set(&inputQueueWrite, write + 1);
+	}
+}
+
+static uint32_t input_read_joypad(InputDriver *driver)
+{
+	gint read = inputQueueRead;
+	gint queued = g_atomic_int_get(&inputQueueWrite) - read;
+
+	if (queued > INPUT_QUEUE_LAG) {
+		// Catch up with the interface
+		inputCurrent = g_atomic_int_get(&inputLatest);
+		g_atomic_int_set(&inputQueueRead, read + queued);
+	} else if (queued > 0) {
+		inputCurrent = inputQueue[read % INPUT_QUEUE_SIZE];
+		g_atomic_int_set(&inputQueueRead, read + 1);
+	} else {
+		inputCurrent = g_atomic_int_get(&inputLatest);
+	}
+
+	return inputCurrent & 0x3FF;
+}
+
+static gboolean input_motion_button(EKey key)
+{
+	return (inputCurrent >> (INPUT_MOTION_SHIFT + key)) & 1;
+}
+
 static void input_update_motion_sensor(InputDriver *driver)
 {
-	if (sdlMotionButtons[KEY_LEFT]) {
+	if (input_motion_button(KEY_LEFT)) {
 		sensorX += 3;
 		if (sensorX > 2197)
 			sensorX = 2197;
 		if (sensorX < 2047)
 			sensorX = 2057;
-	} else if (sdlMotionButtons[KEY_RIGHT]) {
+	} else if (input_motion_button(KEY_RIGHT)) {
 		sensorX -= 3;
 		if (sensorX < 1897)
 			sensorX = 1897;
@@ -206,13 +270,13 @@ static void input_update_motion_sensor(InputDriver *driver)
 			sensorX = 2047;
 	}
 
-	if (sdlMotionButtons[KEY_UP]) {
+	if (input_motion_button(KEY_UP)) {
 		sensorY += 3;
 		if (sensorY > 2197)
 			sensorY = 2197;
 		if (sensorY < 2047)
 			sensorY = 2057;
-	} else if (sdlMotionButtons[KEY_DOWN]) {
+	} else if (input_motion_button(KEY_DOWN)) {
 		sensorY -= 3;
 		if (sensorY < 1897)
 			sensorY = 1897;
@@ -312,5 +376,7 @@ void input_sdl_process_SDL_event(const SDL_Event *event)
 		controller_update_button(event->cbutton.button, FALSE);
 		break;
 	}
+
+	input_snapshot_push();
 }
 
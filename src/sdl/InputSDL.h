@@ -70,7 +70,9 @@ uint32_t input_sdl_get_keymap(EKey key);
 void input_sdl_set_motion_keymap(EKey key, uint32_t code);
 
 /**
- * Update the emulated pads state with a SDL event
+ * Update the emulated pads state with a SDL event. The driver hands the
+ * state to the core through a queue, so the events can be processed on
+ * another thread than the emulation.
  * @param event An event that has just occured
  */
 void input_sdl_process_SDL_event(const SDL_Event *event);
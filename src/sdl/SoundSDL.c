@@ -20,19 +20,65 @@
 #include "../common/RingBuffer.h"
 
 #include <SDL.h>
+#include <string.h>
 
 typedef struct {
 	struct ring_buffer *_rbuf;
 
-	SDL_cond  * _cond;
-	SDL_mutex * _mutex;
+	// Posted by the audio callback when the emulation waits for room in
+	// the buffer. The callback never takes a lock, it only posts when
+	// waiting is set.
+	SDL_sem *_space;
+	gint waiting;
+
+	gint underruns;
+	gint overruns;
 
 	gboolean _initialized;
-	gboolean sync;
+	gint sync;
+
+	// Bytes of sound per second, the buffer fill level aimed for, and the
+	// most the emulation may write before it waits
+	guint bytesPerSecond;
+	guint target;
+	guint limit;
+
+	// Rate control state, only used by the emulation thread
+	gboolean rateControl;
+	gdouble fill;
+	gdouble drift;
+	gdouble ratio;
+
+	// Fill levels over the second of sound being measured, in bytes
+	guint statsMin;
+	guint statsMax;
+	guint64 statsSum;
+	guint statsCount;
+	guint statsWritten;
+
+	// The measures of the last second, for the other threads
+	SDL_mutex *_statsMutex;
+	SoundSDLStats stats;
 } DriverData;
 
-// Hold up to 100 ms of data in the ring buffer
-static const float delay = 0.1f;
+// Largest change the rate control makes to the output sample rate, small
+// enough for the change of pitch not to be heard
+static const gdouble maxRateDeviation = 0.005;
+
+// Time constant of the smoothed fill level, in seconds of sound, so that the
+// device taking data by chunks does not make the rate wobble
+static const gdouble fillTimeConstant = 0.16;
+
+// How fast the rate control learns the difference between the emulation and
+// the device clocks, per second of sound
+static const gdouble driftGain = 0.001;
+
+// Largest chunk of data the device is asked to take at once, in samples
+static const Uint16 maxDeviceSamples = 1024;
+
+// Longest wait for room in the buffer, in case the device stops asking for
+// data
+static const Uint32 spaceTimeout = 100;
 
 static void sound_sdl_read(SoundDriver *driver, guint8 *stream, int len) {
 	g_assert(driver != NULL);
@@ -41,12 +87,75 @@ static void sound_sdl_read(SoundDriver *driver, guint8 *stream, int len) {
 	if (!data->_initialized || len <= 0)
 		return;
 
-	SDL_LockMutex(data->_mutex);
+	int read = ring_buffer_read(data->_rbuf, stream, len);
 
-	ring_buffer_read(data->_rbuf, stream, len);
+	if (read < len) {
+		// Play silence rather than whatever the stream holds
+		memset(stream + read, 0, len - read);
+		g_atomic_int_inc(&data->underruns);
+	}
 
-	SDL_CondSignal(data->_cond);
-	SDL_UnlockMutex(data->_mutex);
+	if (g_atomic_int_compare_and_exchange(&data->waiting, TRUE, FALSE))
+		SDL_SemPost(data->_space);
+}
+
+// Room left for the emulation to write before it goes over the latency limit
+static guint sound_sdl_room(DriverData *data) {
+	guint used = ring_buffer_used(data->_rbuf);
+	return used < data->limit ? data->limit - used : 0;
+}
+
+static guint sound_sdl_bytes_to_ms(DriverData *data, guint64 bytes) {
+	return bytes * 1000 / data->bytesPerSecond;
+}
+
+// Fold the fill level after a write into the measures of the current second
+// of sound, and steer the output rate toward the fill level aimed for
+static void sound_sdl_measure(DriverData *data, int length) {
+	guint used = ring_buffer_used(data->_rbuf);
+
+	// The core writes 1/100 second at a time, or whole video frames
+	gdouble seconds = (gdouble)length / data->bytesPerSecond;
+
+	data->fill += (used - data->fill) * seconds / (fillTimeConstant + seconds);
+	if (data->rateControl) {
+		// Full speed up when empty and full slow down at the limit, plus the
+		// drift between the clocks, which would keep the buffer off target
+		gdouble error = CLAMP((data->target - data->fill) / data->target, -1.0, 1.0);
+
+		data->drift = CLAMP(data->drift + driftGain * error * seconds,
+				-maxRateDeviation, maxRateDeviation);
+		data->ratio = 1.0 + CLAMP(maxRateDeviation * error + data->drift,
+				-maxRateDeviation, maxRateDeviation);
+	}
+
+	data->statsMin = MIN(data->statsMin, used);
+	data->statsMax = MAX(data->statsMax, used);
+	data->statsSum += used;
+	data->statsCount++;
+	data->statsWritten += length;
+
+	if (data->statsWritten < data->bytesPerSecond)
+		return;
+
+	SDL_LockMutex(data->_statsMutex);
+	data->stats.fillMin = sound_sdl_bytes_to_ms(data, data->statsMin);
+	data->stats.fillAverage = sound_sdl_bytes_to_ms(data, data->statsSum / data->statsCount);
+	data->stats.fillMax = sound_sdl_bytes_to_ms(data, data->statsMax);
+	data->stats.rateRatio = data->ratio;
+	SDL_UnlockMutex(data->_statsMutex);
+
+	if (settings_log_channel_enabled(LOG_SOUNDOUTPUT)) {
+		g_message("Sound buffer fill: min %u ms, average %u ms, max %u ms, rate %+.2f%%",
+				data->stats.fillMin, data->stats.fillAverage, data->stats.fillMax,
+				(data->ratio - 1.0) * 100.0);
+	}
+
+	data->statsMin = G_MAXUINT;
+	data->statsMax = 0;
+	data->statsSum = 0;
+	data->statsCount = 0;
+	data->statsWritten = 0;
 }
 
 static void sound_sdl_write(SoundDriver *driver, guint16 * finalWave, int length) {
@@ -59,12 +168,10 @@ static void sound_sdl_write(SoundDriver *driver, guint16 * finalWave, int length
 	if (SDL_GetAudioStatus() != SDL_AUDIO_PLAYING)
 		SDL_PauseAudio(0);
 
-	SDL_LockMutex(data->_mutex);
-
 	unsigned int samples = length / 4;
 
-	int avail;
-	while ((avail = ring_buffer_avail(data->_rbuf) / 4) < samples)
+	unsigned int avail;
+	while ((avail = sound_sdl_room(data) / 4) < samples)
 	{
 		ring_buffer_write(data->_rbuf, finalWave, avail * 4);
 
@@ -73,21 +180,32 @@ static void sound_sdl_write(SoundDriver *driver, guint16 * finalWave, int length
 
 		// If emulating and not in speed up mode, synchronize to audio
 		// by waiting till there is enough room in the buffer
-		if (data->sync)
-		{
-			SDL_CondWait(data->_cond, data->_mutex);
-		}
-		else
+		if (!g_atomic_int_get(&data->sync))
 		{
 			// Drop the remaining of the audio data
-			SDL_UnlockMutex(data->_mutex);
-			return;
+			g_atomic_int_inc(&data->overruns);
+			samples = 0;
+			break;
 		}
+
+		// Check the room again once the callback knows to post, so that
+		// a read in between is not missed
+		g_atomic_int_set(&data->waiting, TRUE);
+		if (sound_sdl_room(data) / 4 == 0)
+			SDL_SemWaitTimeout(data->_space, spaceTimeout);
+		g_atomic_int_set(&data->waiting, FALSE);
 	}
 
 	ring_buffer_write(data->_rbuf, finalWave, samples * 4);
 
-	SDL_UnlockMutex(data->_mutex);
+	sound_sdl_measure(data, length);
+}
+
+static gdouble sound_sdl_get_rate_ratio(SoundDriver *driver) {
+	g_assert(driver != NULL);
+	DriverData *data = (DriverData *)driver->driverData;
+
+	return data->ratio;
 }
 
 static void sound_sdl_pause(SoundDriver *driver, gboolean pause) {
@@ -104,22 +222,40 @@ static void sound_sdl_reset(SoundDriver *driver) {
 	g_assert(driver != NULL);
 	DriverData *data = (DriverData *)driver->driverData;
 
+	// Both ends of the buffer move, keep the callback out
+	SDL_LockAudio();
 	ring_buffer_reset(data->_rbuf);
+	SDL_UnlockAudio();
+
+	data->fill = data->target;
+	data->ratio = 1.0;
 }
 
 static void sound_sdl_callback(void *data, guint8 *stream, int len) {
 	sound_sdl_read((SoundDriver *)data, stream, len);
 }
 
+// Have the device take chunks of at most half the latency aimed for
+static Uint16 sound_sdl_device_samples(guint sampleRate, guint latency) {
+	Uint16 samples = maxDeviceSamples;
+	while (samples > 64 && samples * 2000 > latency * sampleRate)
+		samples /= 2;
+
+	return samples;
+}
+
 SoundDriver *sound_sdl_init(GError **err) {
 	g_return_val_if_fail(err == NULL || *err == NULL, NULL);
 
+	guint sampleRate = settings_sound_sample_rate();
+	guint latency = settings_sound_latency();
+	gboolean rateControl = settings_sound_rate_control();
+
 	SoundDriver *driver = g_new(SoundDriver, 1);
 	driver->write = sound_sdl_write;
 	driver->pause = sound_sdl_pause;
 	driver->reset = sound_sdl_reset;
-
-	guint sampleRate = settings_sound_sample_rate();
+	driver->getRateRatio = rateControl ? sound_sdl_get_rate_ratio : NULL;
 
 	SDL_InitSubSystem(SDL_INIT_AUDIO);
 
@@ -127,7 +263,7 @@ SoundDriver *sound_sdl_init(GError **err) {
 	audio.freq = sampleRate;
 	audio.format = AUDIO_S16SYS;
 	audio.channels = 2;
-	audio.samples = 1024;
+	audio.samples = sound_sdl_device_samples(sampleRate, latency);
 	audio.callback = sound_sdl_callback;
 	audio.userdata = driver;
 
@@ -139,12 +275,39 @@ SoundDriver *sound_sdl_init(GError **err) {
 	}
 
 	DriverData *data = g_new(DriverData, 1);
-	data->_rbuf = ring_buffer_new(delay * sampleRate * 2 * sizeof(guint16));
-	data->_cond = SDL_CreateCond();
-	data->_mutex = SDL_CreateMutex();
+	data->bytesPerSecond = sampleRate * 2 * sizeof(guint16);
+	data->target = latency * data->bytesPerSecond / 1000;
+
+	// With rate control, the buffer is kept around the target, half way to
+	// the limit. Otherwise the emulation fills it up to the target.
+	data->limit = rateControl ? data->target * 2 : data->target;
+
+	data->_rbuf = ring_buffer_new(data->limit);
+	data->_space = SDL_CreateSemaphore(0);
+	data->waiting = FALSE;
+	data->underruns = 0;
+	data->overruns = 0;
 	data->_initialized = TRUE;
 	data->sync = TRUE;
 
+	data->rateControl = rateControl;
+	data->fill = data->target;
+	data->drift = 0.0;
+	data->ratio = 1.0;
+
+	data->statsMin = G_MAXUINT;
+	data->statsMax = 0;
+	data->statsSum = 0;
+	data->statsCount = 0;
+	data->statsWritten = 0;
+	data->_statsMutex = SDL_CreateMutex();
+	data->stats.underruns = 0;
+	data->stats.overruns = 0;
+	data->stats.fillMin = 0;
+	data->stats.fillAverage = 0;
+	data->stats.fillMax = 0;
+	data->stats.rateRatio = 1.0;
+
 	driver->driverData = data;
 
 	return driver;
@@ -159,17 +322,17 @@ void sound_sdl_free(SoundDriver *driver) {
 	if (!data->_initialized)
 		return;
 
-	SDL_mutexP(data->_mutex);
+	if (settings_log_channel_enabled(LOG_SOUNDOUTPUT)) {
+		g_message("Sound underruns: %d, overruns: %d",
+				g_atomic_int_get(&data->underruns), g_atomic_int_get(&data->overruns));
+	}
 
-	SDL_CondSignal(data->_cond);
-	SDL_UnlockMutex(data->_mutex);
+	SDL_CloseAudio();
 
-	SDL_DestroyCond(data->_cond);
-	SDL_DestroyMutex(data->_mutex);
+	SDL_DestroySemaphore(data->_space);
+	SDL_DestroyMutex(data->_statsMutex);
 	ring_buffer_free(data->_rbuf);
 
-	SDL_CloseAudio();
-
 	SDL_QuitSubSystem(SDL_INIT_AUDIO);
 
 	g_free(data);
@@ -180,5 +343,22 @@ void sound_sdl_enable_sync(SoundDriver *driver, gboolean enable) {
 	g_assert(driver != NULL);
 	DriverData *data = (DriverData *)driver->driverData;
 
-	data->sync = enable;
+	// Called from the interface thread, wake up the emulation if it waits
+	// for room in the buffer
+	g_atomic_int_set(&data->sync, enable);
+	if (g_atomic_int_compare_and_exchange(&data->waiting, TRUE, FALSE))
+		SDL_SemPost(data->_space);
+}
+
+void sound_sdl_get_stats(SoundDriver *driver, SoundSDLStats *stats) {
+	g_assert(driver != NULL);
+	g_assert(stats != NULL);
+	DriverData *data = (DriverData *)driver->driverData;
+
+	SDL_LockMutex(data->_statsMutex);
+	*stats = data->stats;
+	SDL_UnlockMutex(data->_statsMutex);
+
+	stats->underruns = g_atomic_int_get(&data->underruns);
+	stats->overruns = g_atomic_int_get(&data->overruns);
 }
@@ -50,6 +50,27 @@ void sound_sdl_free(SoundDriver *driver);
  */
 void sound_sdl_enable_sync(SoundDriver *driver, gboolean enable);
 
+/**
+ * Counters of the glitches in the sound output since the driver was created,
+ * and measures of the sound buffer over the last second of sound
+ */
+typedef struct {
+	guint underruns; /**< Times the device asked for more than was buffered */
+	guint overruns; /**< Times samples were dropped for lack of room */
+	guint fillMin; /**< Lowest buffer fill level, in ms */
+	guint fillAverage; /**< Average buffer fill level, in ms */
+	guint fillMax; /**< Highest buffer fill level, in ms */
+	gdouble rateRatio; /**< Factor applied to the output sample rate */
+} SoundSDLStats;
+
+/**
+ * Get the sound output counters, from any thread
+ *
+ * @param driver SDL sound driver
+ * @param stats return location for the counters
+ */
+void sound_sdl_get_stats(SoundDriver *driver, SoundSDLStats *stats);
+
 /* Ends C function definitions when using C++ */
 #ifdef __cplusplus
 }
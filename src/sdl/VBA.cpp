@@ -24,6 +24,7 @@
 #include "../gba/Sound.h"
 
 #include "DisplaySDL.h"
+#include "Emulation.h"
 #include "InputSDL.h"
 #include "SoundSDL.h"
 #include "Timer.h"
@@ -39,6 +40,7 @@
 #include <stdlib.h>
 
 static Display *display = NULL;
+static GameScreen *game = NULL;
 static SoundDriver *soundDriver = NULL;
 static InputDriver *inputDriver = NULL;
 gchar *filename = NULL;
@@ -65,6 +67,8 @@ static gboolean main_process_event(const SDL_Event *event) {
 			break;
 		case SDLK_SPACE:
 			sound_sdl_enable_sync(soundDriver, TRUE);
+			if (game != NULL)
+				gamescreen_enable_sync(game, TRUE);
 			return TRUE;
 		}
 		break;
@@ -72,6 +76,8 @@ static gboolean main_process_event(const SDL_Event *event) {
 		switch (event->key.keysym.sym) {
 		case SDLK_SPACE:
 			sound_sdl_enable_sync(soundDriver, FALSE);
+			if (game != NULL)
+				gamescreen_enable_sync(game, FALSE);
 			return TRUE;
 		}
 		break;
@@ -126,12 +132,14 @@ static gboolean loadROM(const char *file, GError **err) {
 }
 
 static void vba_free() {
+	emulation_stop();
 	soundShutdown();
 	cartridge_unload();
-	display_free();
 	CPUCleanUp();
+	display_free();
 
 	screens_free_all();
+	game = NULL;
 	sound_sdl_free(soundDriver);
 	input_sdl_free(inputDriver);
 	display_sdl_free(display);
@@ -147,6 +155,7 @@ __attribute__((noreturn)) static void vba_fatal_error(GError *err) {
 		g_clear_error(&err);
 	} else {
 		screens_free_all();
+		game = NULL;
 
 		errorscreen_create(display, err->message, NULL);
 		g_clear_error(&err);
@@ -203,7 +212,7 @@ int main(int argc, char **argv)
 	g_mkdir_with_parents(savesDir, 0777);
 
 	// Init the game screen
-	GameScreen *game = gamescreen_create(display, &err);
+	game = gamescreen_create(display, &err);
 	if (game == NULL) {
 		vba_fatal_error(err);
 	}
@@ -216,6 +225,7 @@ int main(int argc, char **argv)
 		vba_fatal_error(err);
 	}
 	soundSetVolume(settings_sound_volume());
+	soundSetFlushFrames(settings_sound_flush_frames());
 	soundInit(soundDriver);
 
 	// Init the input driver
@@ -235,6 +245,11 @@ int main(int argc, char **argv)
 
 	display_sdl_set_window_title(display, cartridge_get_game_title());
 
+	// Run the core on its own thread, the interface stays on this one
+	if (!emulation_start(&err)) {
+		vba_fatal_error(err);
+	}
+
 	while (emulating) {
 		screens_update_current();
 		display_sdl_render(display);
@@ -243,6 +258,7 @@ int main(int argc, char **argv)
 	}
 
 	fprintf(stdout, "Shutting down\n");
+	emulation_stop();
 	gamescreen_write_battery(game);
 
 	vba_free();
@@ -252,7 +268,7 @@ int main(int argc, char **argv)
 
 gboolean vba_toggle_pause() {
 	gboolean paused = !vba_is_paused();
-	soundPause(paused);
+	emulation_pause(paused);
 
 	if (paused) {
 		pausescreen_create(display, NULL);
@@ -0,0 +1,145 @@
+#include "../src/gba/Gfx.h"
+#include "../src/gba/GfxHelpers.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Checks the SIMD line compositors write the same pixels as the scalar one,
+// for every special effect, display format and window mask, from random
+// layers and with spans that start and end off the 4 and 8 pixels blocks.
+
+// Spans as the windows cut the line, the last one empty
+static const int spans[][2] =
+{
+	{ 0, 240 }, { 1, 239 }, { 3, 5 }, { 5, 6 }, { 7, 17 }, { 9, 233 },
+	{ 2, 10 }, { 13, 14 }, { 15, 31 }, { 0, 7 }, { 233, 240 }, { 120, 120 }
+};
+
+static GRand *rng;
+
+// Random pixel of a background, as drawn by gfx_*_screen_draw
+static u32 random_bg_pixel()
+{
+	if (g_rand_int_range(rng, 0, 4) == 0)
+		return 0x80000000;
+
+	return (g_rand_int(rng) & 0xFFFF) | (g_rand_int_range(rng, 0, 4) << 25) | 0x1000000;
+}
+
+// Random pixel of the OBJ line, as drawn by gfx_sprites_draw
+static u32 random_obj_pixel()
+{
+	if (g_rand_int_range(rng, 0, 4) == 0)
+		return 0x80000000;
+
+	u32 semiTransparent = g_rand_boolean(rng) ? 0x10000 : 0;
+	return (g_rand_int(rng) & 0xFFFF) | (g_rand_int_range(rng, 0, 4) << 25) | semiTransparent;
+}
+
+static void random_lines_fill()
+{
+	for (int x = 0; x < 240; x++)
+	{
+		gfxLine0[x] = random_bg_pixel();
+		gfxLine1[x] = random_bg_pixel();
+		gfxLine2[x] = random_bg_pixel();
+		gfxLine3[x] = random_bg_pixel();
+		gfxLineOBJ[x] = random_obj_pixel();
+	}
+
+	gfxRegs.BLDMOD = g_rand_int(rng) & 0x3FFF;
+	gfxRegs.COLEV = g_rand_int(rng) & 0x1F1F;
+	gfxRegs.COLY = g_rand_int(rng) & 0x1F;
+}
+
+// Composite a span with both implementations and compare the whole lines,
+// so that a pixel written outside of the span is caught as well
+static gboolean compositors_compare(const char *name, GfxLineCompositor reference,
+                                    GfxLineCompositor compositor, int effect, int format,
+                                    u32 backdrop, u8 mask, int start, int end)
+{
+	u32 expected[240];
+	u32 actual[240];
+
+	memset(expected, 0xA5, sizeof(expected));
+	memset(actual, 0xA5, sizeof(actual));
+
+	reference(backdrop, mask, start, end, expected);
+	compositor(backdrop, mask, start, end, actual);
+
+	if (memcmp(expected, actual, sizeof(expected)) == 0)
+		return TRUE;
+
+	int size = format == DISPLAY_FORMAT_XRGB8888 ? 4 : 2;
+	int x = 0;
+	while (memcmp((u8 *)expected + x * size, (u8 *)actual + x * size, size) == 0)
+		x++;
+
+	fprintf(stderr, "%s: effect %d, format %d, mask %02x, span %d-%d differs at pixel %d\n",
+	        name, effect, format, mask, start, end, x);
+	return FALSE;
+}
+
+static gboolean cpu_supports(const char *name)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if (!strcmp(name, "avx2"))
+		return __builtin_cpu_supports("avx2");
+	if (!strcmp(name, "sse2"))
+		return __builtin_cpu_supports("sse2");
+#endif
+
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	const GfxLineCompositors *scalar = gfx_line_compositors_get("scalar");
+	const char *names[] = { "sse2", "avx2" };
+	int failures = 0;
+
+	rng = g_rand_new_with_seed(0x1F2E3D4C);
+
+	for (int i = 0; i < 2; i++)
+	{
+		const GfxLineCompositors *compositors = gfx_line_compositors_get(names[i]);
+
+		if (!compositors)
+		{
+			printf("%s: not built for this host, skipped\n", names[i]);
+			continue;
+		}
+
+		if (!cpu_supports(names[i]))
+		{
+			printf("%s: not supported by the CPU, skipped\n", names[i]);
+			continue;
+		}
+
+		int checks = 0;
+		for (int round = 0; round < 8; round++)
+		{
+			random_lines_fill();
+			u32 backdrop = (g_rand_int(rng) & 0xFFFF) | 0x30000000;
+
+			for (int effect = 0; effect < 4; effect++)
+				for (int format = 0; format < 3; format++)
+					for (int mask = 0; mask < 64; mask++)
+						for (size_t span = 0; span < G_N_ELEMENTS(spans); span++)
+						{
+							if (!compositors_compare(names[i], (*scalar)[effect][format],
+							                         (*compositors)[effect][format], effect, format,
+							                         backdrop, mask, spans[span][0], spans[span][1]))
+								failures++;
+							checks++;
+						}
+		}
+
+		printf("%s: %d spans checked\n", names[i], checks);
+	}
+
+	g_rand_free(rng);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+#include "../src/gba/Gfx.h"
+#include "../src/gba/Display.h"
+#include "../src/gba/Globals.h"
+#include "../src/common/Settings.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Checks the render thread draws the same frames as the inline renderer,
+// with the registers, the palette, VRAM and OAM changed between the lines
+// of a frame as raster effects do.
+
+#define FRAMES 3
+
+static guint32 frames[FRAMES][160][240];
+static int framesDrawn;
+
+static void driver_draw_screen(const DisplayDriver *driver, gpointer pix, int pitch)
+{
+	if (framesDrawn >= FRAMES)
+		return;
+
+	for (int y = 0; y < 160; y++)
+		memcpy(frames[framesDrawn][y], (guint8 *)pix + y * pitch, 240 * 4);
+	framesDrawn++;
+}
+
+static const DisplayDriver driver =
+{
+	DISPLAY_FORMAT_XRGB8888,
+	NULL,
+	driver_draw_screen,
+	NULL
+};
+
+static void memory_fill(GRand *rng, u8 *memory, int length)
+{
+	for (int i = 0; i < length; i++)
+		memory[i] = g_rand_int(rng);
+}
+
+// Same video memory and registers for every run
+static void video_reset()
+{
+	GRand *rng = g_rand_new_with_seed(0x5EED1234);
+	memory_fill(rng, vram, 0x20000);
+	memory_fill(rng, paletteRAM, 0x400);
+	memory_fill(rng, oam, 0x400);
+	g_rand_free(rng);
+
+	// Mode 0 with BG0, BG1 and the sprites, 1D sprite mapping
+	DISPCNT = 0x1340;
+	layerEnable = DISPCNT;
+	BG0CNT = 0x0800;
+	BG1CNT = 0x0985;
+	BG2CNT = 0x0A02;
+	BG0HOFS = BG0VOFS = BG1HOFS = BG1VOFS = 0;
+	BG2PA = BG2PD = 0x100;
+	BG2PB = BG2PC = 0;
+	BG2X_L = BG2X_H = BG2Y_L = BG2Y_H = 0;
+	WIN0H = WIN1H = WIN0V = WIN1V = WININ = WINOUT = 0;
+	MOSAIC = 0;
+	BLDMOD = COLEV = COLY = 0;
+
+	gfx_dirty_mark_all();
+	gfx_renderer_choose();
+	gfx_buffers_clear(TRUE);
+}
+
+// Registers and memory written before the given line is drawn
+static void raster_effects(int frame, int line)
+{
+	switch (line)
+	{
+	case 20:
+		BG0HOFS = 3 * line + frame;
+		BG1VOFS = line;
+		break;
+	case 40:
+		// Palette fade of the backgrounds
+		for (int i = 0; i < 0x100; i += 2)
+			paletteRAM[i] ^= 0x1F;
+		gfx_dirty_mark(0x05000000, 0x100);
+		BLDMOD = 0x3F41;
+		COLEV = 0x0A06;
+		break;
+	case 80:
+		// Switch to mode 1 with a rotated BG2 and a window
+		DISPCNT = 0x7541;
+		layerEnable = DISPCNT;
+		gfx_renderer_choose();
+		gfx_buffers_clear(FALSE);
+		BG2PA = 0xE0;
+		BG2PB = 0x40;
+		BG2PC = 0xFFC0;
+		BG2PD = 0xE0;
+		BG2X_L = 0x800 * (frame + 1);
+		gfx_BG2X_update();
+		WIN0H = 0x20A0;
+		WIN0V = 0x50A0;
+		gfx_window0_update();
+		WININ = 0x003F;
+		WINOUT = 0x0015;
+		break;
+	case 100:
+		// Tiles and sprites rewritten while the frame is drawn
+		memset(vram + 0x4000, 0x11 * (frame + 1), 0x800);
+		gfx_dirty_mark(0x06004000, 0x800);
+		for (int i = 0; i < 0x400; i += 8)
+			oam[i] += 5;
+		gfx_dirty_mark(0x07000000, 0x400);
+		break;
+	case 120:
+		MOSAIC = 0x0303;
+		BLDMOD = 0x00C4;
+		COLY = 0x08;
+		break;
+	}
+}
+
+static void frames_render()
+{
+	framesDrawn = 0;
+	for (int frame = 0; frame < FRAMES; frame++)
+	{
+		video_reset();
+		gfx_frame_new();
+
+		for (int line = 0; line < 160; line++)
+		{
+			VCOUNT = line;
+			raster_effects(frame, line);
+			gfx_line_render();
+		}
+
+		gfx_sync();
+		display_draw_screen();
+	}
+}
+
+// Settings as given on the command line, with the inline renderer when
+// threads is 0
+static gboolean settings_set(int threads)
+{
+	gchar *threadsOption = g_strdup_printf("--render-threads=%d", MAX(threads, 1));
+	gchar *args[] = { (gchar *)"gfx-thread-test", threadsOption,
+	                  (gchar *)(threads ? "--render-thread" : "--render-threads=1"),
+	                  (gchar *)"test.gba" };
+	gchar **argv = args;
+	gint argc = G_N_ELEMENTS(args);
+	GError *err = NULL;
+
+	settings_free();
+	settings_init();
+	g_free(settings_parse_command_line(&argc, &argv, &err));
+	g_free(threadsOption);
+
+	if (err != NULL)
+	{
+		fprintf(stderr, "%s\n", err->message);
+		g_clear_error(&err);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+int main(int argc, char **argv)
+{
+	static guint32 expected[FRAMES][160][240];
+	const int threads[] = { 1, 4 };
+	int failures = 0;
+
+	vram = (u8 *)g_malloc0(0x20000);
+	paletteRAM = (u8 *)g_malloc0(0x400);
+	oam = (u8 *)g_malloc0(0x400);
+
+	settings_init();
+	display_init(&driver);
+
+	settings_set(0);
+	gfx_init();
+	frames_render();
+	gfx_free();
+	memcpy(expected, frames, sizeof(expected));
+
+	if (!memcmp(expected[0][79], expected[0][80], sizeof(expected[0][80])))
+	{
+		fprintf(stderr, "inline: the mode change of line 80 is not drawn\n");
+		failures++;
+	}
+
+	for (size_t i = 0; i < G_N_ELEMENTS(threads); i++)
+	{
+		if (!settings_set(threads[i]) || !gfx_init())
+		{
+			fprintf(stderr, "%d render threads: not started\n", threads[i]);
+			failures++;
+			continue;
+		}
+
+		frames_render();
+		gfx_free();
+
+		for (int frame = 0; frame < FRAMES; frame++)
+			for (int y = 0; y < 160; y++)
+				if (memcmp(expected[frame][y], frames[frame][y], sizeof(frames[frame][y])))
+				{
+					fprintf(stderr, "%d render threads: frame %d differs from the inline one at line %d\n",
+					        threads[i], frame, y);
+					failures++;
+					break;
+				}
+
+		printf("%d render threads: %d frames checked\n", threads[i], FRAMES);
+	}
+
+	display_free();
+	settings_free();
+	g_free(vram);
+	g_free(paletteRAM);
+	g_free(oam);
+
+	return failures ? 1 : 0;
+}